@@ -65,6 +65,9 @@
 #include <sstream>
 
 #include <string>
+#include <boost/bind.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
 #include <utf8/unicode.h>
 #include <pcrecpp.h>
 
@@ -139,15 +142,77 @@ namespace {
         return res;
     }
 
-}
+    // Files smaller than this are read into memory rather than mapped. A
+    // mapping keeps the file open (and so locked, on Windows) for as long as
+    // the document lives, and reading a mapped file that has since been
+    // truncated faults (SIGBUS) rather than failing, which is only worth
+    // risking where a copy would be costly; mapping is never used on Windows
+    const size_t mapThreshold = 32 * 1024 * 1024;
 
-/****************************************************************************/
+    // Keeps a file mapping alive for as long as any buffer refers to it
+    struct MappedRegionDeleter
+    {
+        MappedRegionDeleter(boost::shared_ptr<boost::interprocess::mapped_region> region_)
+            : region(region_)
+        {}
 
-boost::mutex Crackle::PDFDocument::_globalMutexDocument;
+        void operator () (char *) { region.reset(); }
 
+        boost::shared_ptr<boost::interprocess::mapped_region> region;
+    };
+
+    size_t defaultMaxRenderContexts()
+    {
+        return std::max(boost::thread::hardware_concurrency(), 1u);
+    }
+
+    struct ExtractAllState
+    {
+        ExtractAllState(size_t total_,
+                        Crackle::PDFDocument::ExtractProgressCallback callback_,
+                        void * userdef_)
+            : next(0), completed(0), total(total_), callback(callback_), userdef(userdef_)
+        {}
+
+        size_t next;
+        size_t completed;
+        size_t total;
+        Crackle::PDFDocument::ExtractProgressCallback callback;
+        void * userdef;
+        boost::mutex mutexNext;
+        boost::mutex mutexProgress;
+    };
+
+    void extractAllWorker(Crackle::PDFDocument * doc_, ExtractAllState * state_)
+    {
+        for (;;) {
+            size_t page;
+            {
+                boost::lock_guard<boost::mutex> g(state_->mutexNext);
+                if (state_->next >= state_->total) {
+                    break;
+                }
+                page = state_->next++;
+            }
+
+            // regions() fills the page's shared text and image data
+            (*doc_)[page].regions();
+
+            boost::lock_guard<boost::mutex> g(state_->mutexProgress);
+            ++state_->completed;
+            if (state_->callback) {
+                state_->callback(state_->userdef, state_->completed, state_->total);
+            }
+        }
+    }
+
+}
+
+/****************************************************************************/
 
 Crackle::PDFDocument::PDFDocument()
-    : Spine::Document(), _crackle_errorcode(errNone), _fonts_counted(false), _datalen(0), _generated_anchors(0)
+    : Spine::Document(), _crackle_errorcode(errNone), _fonts_counted(false), _datalen(0), _generated_anchors(0),
+      _maxRenderContexts(defaultMaxRenderContexts()), _pendingRenderContexts(0)
 
 {
     //std::cerr << "+++ DOC " << this << std::endl;
@@ -157,7 +222,8 @@ Crackle::PDFDocument::PDFDocument()
 /****************************************************************************/
 
 Crackle::PDFDocument::PDFDocument(const char *filename_)
-    : Spine::Document(), _crackle_errorcode(errNone), _fonts_counted(false), _datalen(0), _generated_anchors(0)
+    : Spine::Document(), _crackle_errorcode(errNone), _fonts_counted(false), _datalen(0), _generated_anchors(0),
+      _maxRenderContexts(defaultMaxRenderContexts()), _pendingRenderContexts(0)
 {
     //std::cerr << "+++ DOC " << this << std::endl;
     _initialise();
@@ -167,7 +233,8 @@ Crackle::PDFDocument::PDFDocument(const char *filename_)
 /****************************************************************************/
 
 Crackle::PDFDocument::PDFDocument(boost::shared_array<char> buffer_, std::size_t length_)
-    : Spine::Document(), _crackle_errorcode(errNone), _fonts_counted(false), _datalen(0), _generated_anchors(0)
+    : Spine::Document(), _crackle_errorcode(errNone), _fonts_counted(false), _datalen(0), _generated_anchors(0),
+      _maxRenderContexts(defaultMaxRenderContexts()), _pendingRenderContexts(0)
 {
     //std::cerr << "+++ DOC " << this << std::endl;
     _initialise();
@@ -178,7 +245,7 @@ Crackle::PDFDocument::PDFDocument(boost::shared_array<char> buffer_, std::size_t
 
 Crackle::PDFDocument::~PDFDocument()
 {
-    //std::cerr << "--- DOC " << this << " " << _textDevice.use_count() << std::endl;
+    //std::cerr << "--- DOC " << this << std::endl;
     this->close();
 }
 
@@ -186,6 +253,9 @@ Crackle::PDFDocument::~PDFDocument()
 
 void Crackle::PDFDocument::close() {
 
+    // _updateAnnotations() takes the page map lock with the document lock
+    // held, so take them in that order here too
+    boost::lock_guard<boost::recursive_mutex> d(_mutexDoc);
     boost::lock_guard<boost::mutex> g(_mutexPageMap);
     _crackle_errorcode=errNone;
 
@@ -193,15 +263,25 @@ void Crackle::PDFDocument::close() {
         i!=_pageMap.end(); ++i) {
         delete i->second;
     }
+    _pageMap.clear();
 
-    _textDevice.reset();
-    _renderDevice.reset();
-    _printDevice.reset();
+    {
+        // wait for any pages still rendering before tearing down the contexts
+        boost::unique_lock<boost::mutex> lock(_mutexRenderContexts);
+        while (_pendingRenderContexts > 0 || _idleRenderContexts.size() < _renderContexts.size()) {
+            _renderContextReleased.wait(lock);
+        }
+        _idleRenderContexts.clear();
+        _renderContexts.clear();
+    }
 
     _doc.reset();
     _dict.reset();
     _data.reset();
     _datalen=0;
+
+    boost::lock_guard<boost::mutex> h(_mutexFilehash);
+    _filehash.clear();
 }
 
 /****************************************************************************/
@@ -209,6 +289,7 @@ void Crackle::PDFDocument::close() {
 bool
 Crackle::PDFDocument::isOK()
 {
+    boost::lock_guard<boost::recursive_mutex> g(_mutexDoc);
     bool res(false);
     if(_doc) {
         res=(_doc->isOk()==gTrue);
@@ -222,6 +303,7 @@ const char *
 Crackle::PDFDocument::errorString()
 {
 
+    boost::lock_guard<boost::recursive_mutex> g(_mutexDoc);
     const char *res("");
     int err(_crackle_errorcode);
 
@@ -277,22 +359,45 @@ Crackle::PDFDocument::errorString()
 void Crackle::PDFDocument::readFile(const char * filename_) // MUST be utf-8
 {
     FILE *file=fopen(filename_, "rb");
-    if(file) {
-        fseek(file, 0, SEEK_END);
-        size_t len=ftell(file);
-        shared_array<char> data(new char[len]);
-        fseek(file, 0, SEEK_SET);
-        size_t rd=fread(static_cast<void *> (data.get()), 1, len, file);
-        if(rd < len)
-        {
-            _crackle_errorcode= errFileIO;
-        } else {
-            this->readBuffer(data, len);
+    if(!file) {
+        _crackle_errorcode= errFileIO;
+        return;
+    }
+
+    fseek(file, 0, SEEK_END);
+    size_t len=ftell(file);
+
+#ifndef _WIN32
+    // Large files are mapped read-only, so that pages are only paged in
+    // when xpdf actually touches them; anything else, or anything that
+    // cannot be mapped, is read into memory
+    if (len >= mapThreshold) {
+        try {
+            boost::interprocess::file_mapping mapping(filename_, boost::interprocess::read_only);
+            boost::shared_ptr<boost::interprocess::mapped_region> region(
+                new boost::interprocess::mapped_region(mapping, boost::interprocess::read_only));
+
+            if (region->get_size() > 0) {
+                fclose(file);
+                shared_array<char> data(static_cast<char *>(region->get_address()), MappedRegionDeleter(region));
+                this->readBuffer(data, region->get_size());
+                return;
+            }
+        } catch (boost::interprocess::interprocess_exception &) {
         }
-        fclose(file);
-    } else {
+    }
+#endif
+
+    shared_array<char> data(new char[len]);
+    fseek(file, 0, SEEK_SET);
+    size_t rd=fread(static_cast<void *> (data.get()), 1, len, file);
+    if(rd < len)
+    {
         _crackle_errorcode= errFileIO;
+    } else {
+        this->readBuffer(data, len);
     }
+    fclose(file);
 }
 
 /****************************************************************************/
@@ -311,9 +416,7 @@ void Crackle::PDFDocument::readBuffer(shared_array<char> data_, size_t length_)
     MemStream *stream=new MemStream(_data.get(), 0, _datalen, _dict.get());
     _open(stream);
 
-    Spine::Sha256 hash;
-    hash.update(reinterpret_cast< unsigned char * > (data_.get()), length_);
-    _filehash=Spine::Fingerprint::binaryFingerprintIri(hash.calculateHash());
+    // the file hash is calculated on demand by filehash()
     if(this->isOK()) {
         _updateAnnotations();
     }
@@ -656,6 +759,8 @@ void Crackle::PDFDocument::_extractLinks()
 
 void Crackle::PDFDocument::_updateAnnotations()
 {
+    // Anchors, outline and links are all read with the document locked
+    boost::lock_guard<boost::recursive_mutex> g(_mutexDoc);
     Catalog *catalog(_doc->getCatalog());
 
 #ifdef UTOPIA_SPINE_BACKEND_POPPLER
@@ -725,6 +830,7 @@ std::string Crackle::PDFDocument::data()
 
 string Crackle::PDFDocument::title()
 {
+    boost::lock_guard<boost::recursive_mutex> g(_mutexDoc);
     return getPDFInfo(_doc, "Title");
 }
 
@@ -732,6 +838,7 @@ string Crackle::PDFDocument::title()
 
 string Crackle::PDFDocument::subject()
 {
+    boost::lock_guard<boost::recursive_mutex> g(_mutexDoc);
     return getPDFInfo(_doc, "Subject");
 }
 
@@ -739,6 +846,7 @@ string Crackle::PDFDocument::subject()
 
 string Crackle::PDFDocument::keywords()
 {
+    boost::lock_guard<boost::recursive_mutex> g(_mutexDoc);
     return getPDFInfo(_doc, "Keywords");
 }
 
@@ -746,6 +854,7 @@ string Crackle::PDFDocument::keywords()
 
 string Crackle::PDFDocument::author()
 {
+    boost::lock_guard<boost::recursive_mutex> g(_mutexDoc);
     return getPDFInfo(_doc, "Author");
 }
 
@@ -753,6 +862,7 @@ string Crackle::PDFDocument::author()
 
 string Crackle::PDFDocument::creator()
 {
+    boost::lock_guard<boost::recursive_mutex> g(_mutexDoc);
     return getPDFInfo(_doc, "Creator");
 }
 
@@ -760,6 +870,7 @@ string Crackle::PDFDocument::creator()
 
 string Crackle::PDFDocument::producer()
 {
+    boost::lock_guard<boost::recursive_mutex> g(_mutexDoc);
     return getPDFInfo(_doc, "Producer");
 }
 
@@ -767,7 +878,7 @@ string Crackle::PDFDocument::producer()
 
 time_t Crackle::PDFDocument::creationDate()
 {
-
+    boost::lock_guard<boost::recursive_mutex> g(_mutexDoc);
     return getPDFInfoDate(_doc, "CreationDate");
 }
 
@@ -775,6 +886,7 @@ time_t Crackle::PDFDocument::creationDate()
 
 time_t Crackle::PDFDocument::modificationDate()
 {
+    boost::lock_guard<boost::recursive_mutex> g(_mutexDoc);
     return getPDFInfoDate(_doc, "ModDate");
 }
 
@@ -783,6 +895,14 @@ time_t Crackle::PDFDocument::modificationDate()
 // generate SHA-256 hash of file
 string Crackle::PDFDocument::filehash()
 {
+    boost::lock_guard<boost::mutex> g(_mutexFilehash);
+
+    if(_filehash.empty() && _data) {
+        Spine::Sha256 hash;
+        hash.update(reinterpret_cast< unsigned char * > (_data.get()), _datalen);
+        _filehash=Spine::Fingerprint::binaryFingerprintIri(hash.calculateHash());
+    }
+
     return _filehash;
 }
 
@@ -811,55 +931,141 @@ void Crackle::PDFDocument::_initialise()
 
 void Crackle::PDFDocument::_open(BaseStream *stream_)
 {
+    boost::lock_guard<boost::recursive_mutex> g(_mutexDoc);
     _doc      = boost::shared_ptr<PDFDoc>(new PDFDoc(stream_));
 
-    if (_doc->isOk()) {
-        _textDevice=boost::shared_ptr<CrackleTextOutputDev>(new CrackleTextOutputDev ((char *)0, gFalse, 0.0, gFalse, gFalse));
+    if (!_doc->isOk()) {
+        _crackle_errorcode=errOpenFile;
+    }
+}
+
+/****************************************************************************/
+
+Crackle::PDFDocument::RenderContext *Crackle::PDFDocument::_newRenderContext()
+{
+    RenderContext *context(new RenderContext);
+
+    // stream ownership is passed to PDFDoc; the data itself is shared
+    MemStream *stream=new MemStream(_data.get(), 0, _datalen, _dict.get());
+    context->doc = boost::shared_ptr<PDFDoc>(new PDFDoc(stream));
 
-        SplashColor paperColour;
-        paperColour[0] = 255;
-        paperColour[1] = 255;
-        paperColour[2] = 255;
+    context->textDevice=boost::shared_ptr<CrackleTextOutputDev>(new CrackleTextOutputDev ((char *)0, gFalse, 0.0, gFalse, gFalse));
+
+    SplashColor paperColour;
+    paperColour[0] = 255;
+    paperColour[1] = 255;
+    paperColour[2] = 255;
 
 #ifdef UTOPIA_SPINE_BACKEND_POPPLER
-        // defaults setup anti aliasing for screen
-        _renderDevice=boost::shared_ptr<SplashOutputDev>(new SplashOutputDev(splashModeRGB8, 3, gFalse, paperColour, gTrue));
+    // defaults setup anti aliasing for screen
+    context->renderDevice=boost::shared_ptr<SplashOutputDev>(new SplashOutputDev(splashModeRGB8, 3, gFalse, paperColour, gTrue));
 
   #ifdef HAVE_POPPLER_SPLASH_SET_FONT_ANTIALIAS
-        // newer versions of poppler no longer sets font anti-aliasing in constructor
-        _printDevice=boost::shared_ptr<SplashOutputDev>(new SplashOutputDev(splashModeRGB8, 3, gFalse, paperColour, gTrue));
-        _printDevice->setFontAntialias(gFalse);
+    // newer versions of poppler no longer sets font anti-aliasing in constructor
+    context->printDevice=boost::shared_ptr<SplashOutputDev>(new SplashOutputDev(splashModeRGB8, 3, gFalse, paperColour, gTrue));
+    context->printDevice->setFontAntialias(gFalse);
   #else
-        _printDevice=boost::shared_ptr<SplashOutputDev>(new SplashOutputDev(splashModeRGB8, 3, gFalse, paperColour, gTrue, gFalse));
-        // original
+    context->printDevice=boost::shared_ptr<SplashOutputDev>(new SplashOutputDev(splashModeRGB8, 3, gFalse, paperColour, gTrue, gFalse));
+    // original
   #endif
 
   #ifdef HAVE_POPPLER_SPLASH_SET_VECTOR_ANTIALIAS
-        _printDevice->setVectorAntialias(gFalse);
+    context->printDevice->setVectorAntialias(gFalse);
   #endif
 
 #else // XPDF
-        _renderDevice=boost::shared_ptr<SplashOutputDev>(new SplashOutputDev(splashModeRGB8, 3, gFalse, paperColour, gTrue, gTrue));
-        _printDevice=boost::shared_ptr<SplashOutputDev>(new SplashOutputDev(splashModeRGB8, 3, gFalse, paperColour, gTrue, gFalse));
+    context->renderDevice=boost::shared_ptr<SplashOutputDev>(new SplashOutputDev(splashModeRGB8, 3, gFalse, paperColour, gTrue, gTrue));
+    context->printDevice=boost::shared_ptr<SplashOutputDev>(new SplashOutputDev(splashModeRGB8, 3, gFalse, paperColour, gTrue, gFalse));
 #endif
 
 #ifdef UTOPIA_SPINE_BACKEND_POPPLER
-        _renderDevice->startDoc(_doc.get());
-        _printDevice->startDoc(_doc.get());
+    context->renderDevice->startDoc(context->doc.get());
+    context->printDevice->startDoc(context->doc.get());
 #else // XPDF
-        _renderDevice->startDoc(_doc->getXRef());
-        _printDevice->startDoc(_doc->getXRef());
+    context->renderDevice->startDoc(context->doc->getXRef());
+    context->printDevice->startDoc(context->doc->getXRef());
 #endif
 
-    } else {
-        _crackle_errorcode=errOpenFile;
+    return context;
+}
+
+/****************************************************************************/
+
+Crackle::PDFDocument::RenderContextHandle Crackle::PDFDocument::_acquireRenderContext()
+{
+    boost::unique_lock<boost::mutex> lock(_mutexRenderContexts);
+
+    while (_idleRenderContexts.empty()) {
+        size_t count(_renderContexts.size() + _pendingRenderContexts);
+        if (count < _maxRenderContexts) {
+            // opening a PDFDoc can be slow, so do so without the lock held
+            ++_pendingRenderContexts;
+            lock.unlock();
+            RenderContext *context(_newRenderContext());
+            lock.lock();
+            --_pendingRenderContexts;
+            _renderContexts.push_back(boost::shared_ptr<RenderContext>(context));
+            _idleRenderContexts.push_back(context);
+        } else {
+            _renderContextReleased.wait(lock);
+        }
+    }
+
+    RenderContext *context(_idleRenderContexts.back());
+    _idleRenderContexts.pop_back();
+
+    return RenderContextHandle(context, boost::bind(&Crackle::PDFDocument::_releaseRenderContext, this, _1));
+}
+
+/****************************************************************************/
+
+void Crackle::PDFDocument::_releaseRenderContext(RenderContext *context_)
+{
+    {
+        boost::lock_guard<boost::mutex> g(_mutexRenderContexts);
+
+        // drop surplus contexts if the pool has since been shrunk
+        if (_renderContexts.size() > _maxRenderContexts) {
+            std::vector< boost::shared_ptr<RenderContext> >::iterator i(_renderContexts.begin());
+            while (i != _renderContexts.end() && i->get() != context_) {
+                ++i;
+            }
+            if (i != _renderContexts.end()) {
+                _renderContexts.erase(i);
+            }
+        } else {
+            _idleRenderContexts.push_back(context_);
+        }
     }
+
+    _renderContextReleased.notify_all();
+}
+
+/****************************************************************************/
+
+size_t Crackle::PDFDocument::maxRenderContexts() const
+{
+    boost::lock_guard<boost::mutex> g(_mutexRenderContexts);
+    return _maxRenderContexts;
+}
+
+/****************************************************************************/
+
+void Crackle::PDFDocument::setMaxRenderContexts(size_t max_)
+{
+    {
+        boost::lock_guard<boost::mutex> g(_mutexRenderContexts);
+        _maxRenderContexts = std::max(max_, (size_t) 1);
+    }
+
+    _renderContextReleased.notify_all();
 }
 
 /****************************************************************************/
 
 Crackle::PDFDocument::ViewMode Crackle::PDFDocument::viewMode()
 {
+    boost::lock_guard<boost::recursive_mutex> g(_mutexDoc);
     ViewMode res=ViewNone;
 
     XRef *xref(_doc->getXRef());
@@ -900,6 +1106,7 @@ Crackle::PDFDocument::ViewMode Crackle::PDFDocument::viewMode()
 
 Crackle::PDFDocument::PageLayout Crackle::PDFDocument::pageLayout()
 {
+    boost::lock_guard<boost::recursive_mutex> g(_mutexDoc);
     PageLayout res=LayoutNone;
 
     XRef *xref(_doc->getXRef());
@@ -933,6 +1140,7 @@ Crackle::PDFDocument::PageLayout Crackle::PDFDocument::pageLayout()
 
 string Crackle::PDFDocument::metadata()
 {
+    boost::lock_guard<boost::recursive_mutex> g(_mutexDoc);
     string result;
     GString *md(_doc->readMetadata());
     if(md) {
@@ -946,6 +1154,7 @@ string Crackle::PDFDocument::metadata()
 
 size_t Crackle::PDFDocument::size()
 {
+    boost::lock_guard<boost::recursive_mutex> g(_mutexDoc);
     size_t sz(0);
     if(this->isOK()) {
         sz=_doc->getNumPages();
@@ -984,8 +1193,7 @@ Crackle::PDFDocument::operator[](int idx_)
     boost::lock_guard<boost::mutex> g(_mutexPageMap);
     std::map<int,PDFPage *>::const_iterator i=_pageMap.find(idx_);
     if(i==_pageMap.end()) {
-      _pageMap[idx_]= new PDFPage(this, idx_+1, _textDevice,
-                                  _renderDevice, _printDevice);
+      _pageMap[idx_]= new PDFPage(this, idx_+1);
     }
 
     return(*(_pageMap[idx_]));
@@ -993,6 +1201,28 @@ Crackle::PDFDocument::operator[](int idx_)
 
 /****************************************************************************/
 
+void Crackle::PDFDocument::extractAll(size_t threads_,
+                                      ExtractProgressCallback callback_,
+                                      void * userdef_)
+{
+    ExtractAllState state(this->size(), callback_, userdef_);
+
+    size_t workers(threads_ > 0 ? threads_ : this->maxRenderContexts());
+    workers = std::min(workers, state.total);
+
+    if (workers <= 1) {
+        extractAllWorker(this, &state);
+    } else {
+        boost::thread_group group;
+        for (size_t i = 0; i < workers; ++i) {
+            group.create_thread(boost::bind(&extractAllWorker, this, &state));
+        }
+        group.join_all();
+    }
+}
+
+/****************************************************************************/
+
 boost::shared_ptr<Spine::Cursor> Crackle::PDFDocument::newCursor(int page_)
 {
     return boost::shared_ptr<Spine::Cursor>(new PDFCursor(this, page_));
@@ -1047,6 +1277,7 @@ string Crackle::PDFDocument::uniqueID()
 
 string Crackle::PDFDocument::pdfFileID()
 {
+    boost::lock_guard<boost::recursive_mutex> g(_mutexDoc);
 
     if(!_docid.empty()) {
         return _docid;
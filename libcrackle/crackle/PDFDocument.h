@@ -42,6 +42,7 @@
 #include <boost/shared_ptr.hpp>
 #include <boost/shared_array.hpp>
 #include <boost/thread.hpp>
+#include <vector>
 
 #ifdef UTOPIA_SPINE_BACKEND_POPPLER
 #ifndef GList
@@ -69,7 +70,9 @@ namespace Crackle
      * PDFDocument
      *
      * The root of the PDF tree. Can be constructed from memory or a file.
-     * An individual document is not reentrant but distinct documents are.
+     * Distinct documents are fully reentrant. Within a document, rendering
+     * and text extraction draw on a pool of render contexts, so different
+     * pages of the same document may also be processed concurrently.
      *
      * Represents a collection of pages from a PDF.
      * PDFPage instances are created lazily.
@@ -82,6 +85,7 @@ namespace Crackle
     public:
 
         typedef Crackle::PDFCursor cursor;
+        typedef void (*ExtractProgressCallback)(void *, size_t, size_t);
 
         class const_iterator
             : public std::iterator<std::random_access_iterator_tag, Crackle::PDFPage>
@@ -224,6 +228,9 @@ namespace Crackle
         bool isOK();
         const char *errorString();
 
+        // Large files are memory mapped rather than copied (except on
+        // Windows), in which case they must not be truncated or replaced in
+        // place while the document is open
         void readFile(const char * filename_);
         void readBuffer(boost::shared_array<char> data_, size_t length_);
         void close();
@@ -256,6 +263,19 @@ namespace Crackle
 
         Spine::DocumentHandle clone();
 
+        // Upper bound on the number of pages that may be rendered or
+        // extracted concurrently (defaults to the number of cores)
+        size_t maxRenderContexts() const;
+        void setMaxRenderContexts(size_t max_);
+
+        // Extract the text and images of every page up front, spread over
+        // up to threads_ workers (0 uses maxRenderContexts()). The callback,
+        // if given, is invoked from the workers with the number of pages
+        // completed so far and the total; calls are never concurrent.
+        void extractAll(size_t threads_ = 0,
+                        ExtractProgressCallback callback_ = 0,
+                        void * userdef_ = 0);
+
     private:
 
         // Do not copy or assign
@@ -275,21 +295,43 @@ namespace Crackle
         boost::shared_ptr<PDFDoc> _doc;
         boost::shared_ptr<Object> _dict;
 
+        // xpdf loads parts of a document lazily, so all use of _doc (page
+        // geometry, metadata, outline and links) is serialised
+        mutable boost::recursive_mutex _mutexDoc;
+
         // pages are created on demand, but conceptually the document
         // remains const
         mutable std::map<int, Crackle::PDFPage *> _pageMap;
         mutable boost::mutex _mutexPageMap;
 
-        mutable boost::mutex _mutexDocument;
-        static boost::mutex _globalMutexDocument;
-
         boost::shared_ptr<PDFDoc> xpdfDoc() { return _doc; }
 
         friend class PDFPage;
 
-        boost::shared_ptr<CrackleTextOutputDev>  _textDevice;
-        boost::shared_ptr<SplashOutputDev> _renderDevice;
-        boost::shared_ptr<SplashOutputDev> _printDevice;
+        // A render context is an xpdf document with its own output devices.
+        // Each context opens its own PDFDoc over the same data, apart from
+        // _doc, so that contexts can be driven independently of each other
+        // and of the document's other accessors.
+        struct RenderContext {
+            boost::shared_ptr<PDFDoc> doc;
+            boost::shared_ptr<CrackleTextOutputDev> textDevice;
+            boost::shared_ptr<SplashOutputDev> renderDevice;
+            boost::shared_ptr<SplashOutputDev> printDevice;
+        };
+        typedef boost::shared_ptr<RenderContext> RenderContextHandle;
+
+        // Blocks until a context is free; it is returned to the pool when
+        // the last copy of the handle is released
+        RenderContextHandle _acquireRenderContext();
+        void _releaseRenderContext(RenderContext *context_);
+        RenderContext *_newRenderContext();
+
+        std::vector< boost::shared_ptr<RenderContext> > _renderContexts;
+        std::vector< RenderContext * > _idleRenderContexts;
+        size_t _maxRenderContexts;
+        size_t _pendingRenderContexts;
+        mutable boost::mutex _mutexRenderContexts;
+        boost::condition_variable _renderContextReleased;
 
         int _crackle_errorcode;
         mutable bool _fonts_counted;
@@ -297,6 +339,7 @@ namespace Crackle
         mutable std::string _uuid;
         mutable std::string _docid;
         mutable std::string _filehash;
+        mutable boost::mutex _mutexFilehash;
 
         boost::shared_array<char> _data;
         long _datalen;
@@ -31,6 +31,7 @@
 #include <spine/Image.h>
 #include <crackle/ImageCollection.h>
 #include <crackle/CrackleTextOutputDev.h>
+#include <crackle/PDFTextLayout.h>
 #include <crackle/PDFTextRegionCollection.h>
 #include <crackle/PDFFontCollection.h>
 #include <crackle/xpdfapi.h>
@@ -54,22 +55,15 @@ using namespace boost;
 using namespace Spine;
 using namespace Crackle;
 
-Crackle::PDFPage::PDFPage (PDFDocument * doc_, unsigned int page_,
-                           boost::shared_ptr<CrackleTextOutputDev> textDevice_,
-                           boost::shared_ptr<SplashOutputDev> renderDevice_,
-                           boost::shared_ptr<SplashOutputDev> printDevice_)
-  : _doc(doc_), _page(page_), _textDevice(textDevice_),
-    _renderDevice(renderDevice_),
-    _printDevice(printDevice_),
+Crackle::PDFPage::PDFPage (PDFDocument * doc_, unsigned int page_)
+  : _doc(doc_), _page(page_),
     _sharedData(boost::shared_ptr<SharedData>(new SharedData))
 {
     //std::cerr << "+++ PAG " << this << std::endl;
 }
 
 Crackle::PDFPage::PDFPage (const PDFPage &rhs_)
-    : _doc(rhs_._doc), _page(rhs_._page), _textDevice(rhs_._textDevice),
-      _renderDevice(rhs_._renderDevice),
-      _printDevice(rhs_._printDevice),
+    : _doc(rhs_._doc), _page(rhs_._page),
       _sharedData(rhs_._sharedData)
 {
     //std::cerr << "+++ PAG " << this << std::endl;
@@ -77,7 +71,7 @@ Crackle::PDFPage::PDFPage (const PDFPage &rhs_)
 
 Crackle::PDFPage::~PDFPage ()
 {
-    //std::cerr << "--- PAG " << this << " " << _textDevice.use_count() << std::endl;
+    //std::cerr << "--- PAG " << this << std::endl;
 }
 
 PDFPage &Crackle::PDFPage::operator= (const PDFPage &rhs_)
@@ -87,9 +81,6 @@ PDFPage &Crackle::PDFPage::operator= (const PDFPage &rhs_)
         _sharedData=rhs_._sharedData;
         _doc=rhs_._doc;
         _page=rhs_._page;
-        _textDevice=rhs_._textDevice;
-        _renderDevice=rhs_._renderDevice;
-        _printDevice=rhs_._printDevice;
     }
 
     return *this;
@@ -102,6 +93,7 @@ int Crackle::PDFPage::pageNumber() const
 
 BoundingBox Crackle::PDFPage::boundingBox() const
 {
+    boost::lock_guard<boost::recursive_mutex> g(_doc->_mutexDoc);
     int rotate = _doc->xpdfDoc()->getCatalog()->getPage(_page)->getRotate();
     PDFRectangle *rect=_doc->xpdfDoc()->getCatalog()->getPage(_page)->getCropBox();
     //PDFRectangle *rect=_doc->xpdfDoc()->getCatalog()->getPage(_page)->getTrimBox();
@@ -140,12 +132,14 @@ BoundingBox Crackle::PDFPage::boundingBox() const
 
 Spine::BoundingBox Crackle::PDFPage::mediaBox() const
 {
+    boost::lock_guard<boost::recursive_mutex> g(_doc->_mutexDoc);
     PDFRectangle *rect=_doc->xpdfDoc()->getCatalog()->getPage(_page)->getMediaBox();
     return BoundingBox(rect->x1, rect->y1, rect->x2, rect->y2);
 }
 
 int Crackle::PDFPage::rotation() const
 {
+    boost::lock_guard<boost::recursive_mutex> g(_doc->_mutexDoc);
     return _doc->xpdfDoc()->getPageRotate(_page);
 }
 
@@ -167,20 +161,20 @@ Spine::Image Crackle::PDFPage::render(size_t width_,
                                       size_t height_,
                                       bool antialias_) const
 {
-    Crackle::PDFDocument::_globalMutexDocument.lock();
-
-    double w(_doc->xpdfDoc()->getPageCropWidth(_page));
-    double h(_doc->xpdfDoc()->getPageCropHeight(_page));
-    /*
-      double w(_doc->xpdfDoc()->getCatalog()->getPage(_page)->getTrimBox()->x2 - _doc->xpdfDoc()->getCatalog()->getPage(_page)->getTrimBox()->x1);
-      double h(_doc->xpdfDoc()->getCatalog()->getPage(_page)->getTrimBox()->y2 - _doc->xpdfDoc()->getCatalog()->getPage(_page)->getTrimBox()->y1);
-    */
-    if (_doc->xpdfDoc()->getPageRotate(_page) % 180) // Swap if rotated by 90 / 270 degrees
+    double w, h;
     {
-        double tmp(w); w=h; h=tmp;
+        boost::lock_guard<boost::recursive_mutex> g(_doc->_mutexDoc);
+        w = _doc->xpdfDoc()->getPageCropWidth(_page);
+        h = _doc->xpdfDoc()->getPageCropHeight(_page);
+        /*
+          double w(_doc->xpdfDoc()->getCatalog()->getPage(_page)->getTrimBox()->x2 - _doc->xpdfDoc()->getCatalog()->getPage(_page)->getTrimBox()->x1);
+          double h(_doc->xpdfDoc()->getCatalog()->getPage(_page)->getTrimBox()->y2 - _doc->xpdfDoc()->getCatalog()->getPage(_page)->getTrimBox()->y1);
+        */
+        if (_doc->xpdfDoc()->getPageRotate(_page) % 180) // Swap if rotated by 90 / 270 degrees
+        {
+            double tmp(w); w=h; h=tmp;
+        }
     }
-    Crackle::PDFDocument::_globalMutexDocument.unlock();
-
 
     double fit_resolution_w = (72.0 * width_) / w;
     double fit_resolution_h = (72.0 * height_) / h;
@@ -191,11 +185,15 @@ Spine::Image Crackle::PDFPage::render(size_t width_,
 
 Spine::Image Crackle::PDFPage::render(double resolution_, bool antialias_) const
 {
-    boost::lock_guard<boost::mutex> g(Crackle::PDFDocument::_globalMutexDocument);
-    _doc->xpdfDoc()->displayPage(_renderDevice.get(), _page, resolution_,
-                                 resolution_, 0, gFalse, gFalse, gFalse);
+    // Read before taking a context, so no context is held while waiting
+    // on the document lock
+    BoundingBox bbox(this->boundingBox());
+
+    PDFDocument::RenderContextHandle context(_doc->_acquireRenderContext());
+    context->doc->displayPage(context->renderDevice.get(), _page, resolution_,
+                              resolution_, 0, gFalse, gFalse, gFalse);
 
-    SplashBitmap *bitmap(_renderDevice->getBitmap());
+    SplashBitmap *bitmap(context->renderDevice->getBitmap());
 
     size_t length= bitmap->getWidth() * 3 * bitmap->getHeight();
     char *data=reinterpret_cast<char *>(bitmap->getDataPtr());
@@ -206,7 +204,7 @@ Spine::Image Crackle::PDFPage::render(double resolution_, bool antialias_) const
     }
 
     return Image(Image::RGB, bitmap->getWidth(), bitmap->getHeight(),
-                 this->boundingBox(),data,length);
+                 bbox,data,length);
 }
 
 Spine::Image Crackle::PDFPage::renderArea(const Spine::BoundingBox & slice,
@@ -233,24 +231,24 @@ Spine::Image Crackle::PDFPage::renderArea(const Spine::BoundingBox & slice,
                                           double resolutionY_,
                                           bool antialias_) const
 {
-    boost::lock_guard<boost::mutex> g(Crackle::PDFDocument::_globalMutexDocument);
     double resolutionScaleX(72.0 / resolutionX_);
     double resolutionScaleY(72.0 / resolutionY_);
     Spine::BoundingBox scaledSlice(slice.x1 / resolutionScaleX, slice.y1 / resolutionScaleX,
                                    slice.x2 / resolutionScaleY, slice.y2 / resolutionScaleY);
 
+    PDFDocument::RenderContextHandle context(_doc->_acquireRenderContext());
     boost::shared_ptr<SplashOutputDev> dev;
     if(antialias_) {
-      dev = _renderDevice;
+      dev = context->renderDevice;
     } else {
-      dev = _printDevice;
+      dev = context->printDevice;
     }
 
-    _doc->xpdfDoc()->displayPageSlice(dev.get(), _page, resolutionX_,
-                                      resolutionY_, 0, gFalse, gFalse, gFalse,
-                                      (int) scaledSlice.x1, (int) scaledSlice.y1,
-                                      (int) (scaledSlice.x2-scaledSlice.x1),
-                                      (int) (scaledSlice.y2-scaledSlice.y1));
+    context->doc->displayPageSlice(dev.get(), _page, resolutionX_,
+                                   resolutionY_, 0, gFalse, gFalse, gFalse,
+                                   (int) scaledSlice.x1, (int) scaledSlice.y1,
+                                   (int) (scaledSlice.x2-scaledSlice.x1),
+                                   (int) (scaledSlice.y2-scaledSlice.y1));
 
     SplashBitmap *bitmap(dev->getBitmap());
 
@@ -268,25 +266,38 @@ Spine::Image Crackle::PDFPage::renderArea(const Spine::BoundingBox & slice,
 
 void Crackle::PDFPage::_extractTextAndImages() const
 {
+    boost::lock_guard<boost::mutex> d(_mutexDisplayPage);
+
+    // another thread may have extracted this page while we waited
     {
-        boost::lock_guard<boost::mutex> g(Crackle::PDFDocument::_globalMutexDocument);
+        boost::lock_guard<boost::mutex> g(_mutexSharedData);
+        if (_sharedData->_text) {
+            return;
+        }
+    }
 
-        double w(_doc->xpdfDoc()->getPageMediaWidth(_page));
-        double h(_doc->xpdfDoc()->getPageMediaHeight(_page));
+    PDFDocument::RenderContextHandle context(_doc->_acquireRenderContext());
 
-        PDFRectangle *rect=_doc->xpdfDoc()->getCatalog()->getPage(_page)->getMediaBox();
+    double w(context->doc->getPageMediaWidth(_page));
+    double h(context->doc->getPageMediaHeight(_page));
 
-        double resolution_w = (72.0 * (rect->x2-rect->x1)) / w;
-        double resolution_h = (72.0 * (rect->y2-rect->y1)) / h;
+    PDFRectangle *rect=context->doc->getCatalog()->getPage(_page)->getMediaBox();
 
-        _doc->xpdfDoc()->displayPage(_textDevice.get(), _page, resolution_w, resolution_h,
-                                     0, gFalse, gFalse, gFalse);
-    }
+    double resolution_w = (72.0 * (rect->x2-rect->x1)) / w;
+    double resolution_h = (72.0 * (rect->y2-rect->y1)) / h;
+
+    context->doc->displayPage(context->textDevice.get(), _page, resolution_w, resolution_h,
+                              0, gFalse, gFalse, gFalse);
+
+    // Lay the coalesced text out flat, for the text classes to view
+    boost::shared_ptr<CrackleTextPage> textpage(context->textDevice->takeText());
+    boost::shared_ptr<PDFTextLayout> layout(new PDFTextLayout(textpage.get()));
 
     boost::lock_guard<boost::mutex> g(_mutexSharedData);
-    _sharedData->_textpage=boost::shared_ptr<CrackleTextPage> (_textDevice->takeText());
-    _sharedData->_text= boost::shared_ptr<PDFTextRegionCollection> (new PDFTextRegionCollection(_sharedData->_textpage->getFlows()));
-    _sharedData->_images=boost::shared_ptr<ImageCollection>(_textDevice->pageImages());
+    _sharedData->_textpage=textpage;
+    _sharedData->_layout=layout;
+    _sharedData->_text= boost::shared_ptr<PDFTextRegionCollection> (new PDFTextRegionCollection(layout.get(), 0, layout->regionBoxes.size()));
+    _sharedData->_images=boost::shared_ptr<ImageCollection>(context->textDevice->pageImages());
 }
 
 const Crackle::PDFTextRegionCollection &Crackle::PDFPage::regions() const
@@ -44,14 +44,13 @@
 class PDFDoc;
 class CrackleTextPage;
 
-class CrackleTextOutputDev;
-class SplashOutputDev;
 class SplashBitmap;
 
 namespace Crackle
 {
 
     class ImageCollection;
+    struct PDFTextLayout;
 
     class PDFPage : public Spine::Page
     {
@@ -104,10 +103,7 @@ namespace Crackle
 
         friend class PDFDocument;
 
-        PDFPage (PDFDocument * doc_, unsigned int page_,
-                 boost::shared_ptr<CrackleTextOutputDev> textDevice_,
-                 boost::shared_ptr<SplashOutputDev> renderDevice_,
-                 boost::shared_ptr<SplashOutputDev> printDevice_);
+        PDFPage (PDFDocument * doc_, unsigned int page_);
 
         PDFPage &operator=(const PDFPage& rhs_);
 
@@ -121,16 +117,13 @@ namespace Crackle
         mutable PDFDocument * _doc;
         unsigned int _page;
 
-        mutable boost::shared_ptr<CrackleTextOutputDev> _textDevice;
-        mutable boost::shared_ptr<SplashOutputDev> _renderDevice;
-        mutable boost::shared_ptr<SplashOutputDev> _printDevice;
-
         // This struct is reference counted and shared between all copies
         // of this page. The data contained within is generated lazilly.
         // Creating this struct therefore allows copies to be made before
         // that data is instantiated and yet still get updated across
         // the shared instances.
         struct SharedData {
+            boost::shared_ptr<PDFTextLayout>     _layout;
             boost::shared_ptr<PDFTextRegionCollection> _text;
             boost::shared_ptr<ImageCollection>   _images;
             boost::shared_ptr<CrackleTextPage>      _textpage;
@@ -139,6 +132,9 @@ namespace Crackle
 
         mutable boost::shared_ptr<SharedData> _sharedData;
         mutable boost::mutex _mutexSharedData;
+
+        // Serialises text extraction of this page so that concurrent
+        // callers wait for a single extraction rather than repeating it
         mutable boost::mutex _mutexDisplayPage;
 
     };
@@ -28,16 +28,16 @@
  ****************************************************************************/
 
 #include <crackle/PDFTextBlock.h>
+#include <crackle/PDFTextLayout.h>
 #include <crackle/PDFTextLineCollection.h>
 #include <crackle/PDFTextWordCollection.h>
-#include <crackle/CrackleTextOutputDev.h>
 
 using namespace std;
 using namespace Spine;
 using namespace Crackle;
 
 Crackle::PDFTextBlock::PDFTextBlock(const PDFTextBlock &rhs_)
-    : _block(rhs_._block), _lines(0)
+    : _layout(rhs_._layout), _index(rhs_._index), _lines(0)
 {}
 
 Crackle::PDFTextBlock& Crackle::PDFTextBlock::operator=(const Crackle::PDFTextBlock &rhs_)
@@ -45,7 +45,8 @@ Crackle::PDFTextBlock& Crackle::PDFTextBlock::operator=(const Crackle::PDFTextBl
     if(&rhs_!=this) {
         delete _lines;
         _lines=0;
-        _block=rhs_._block;
+        _layout=rhs_._layout;
+        _index=rhs_._index;
     }
     return *this;
 }
@@ -57,40 +58,31 @@ Crackle::PDFTextBlock::~PDFTextBlock()
 
 BoundingBox Crackle::PDFTextBlock::boundingBox() const
 {
-    BoundingBox b;
-    _block->getBBox(&b.x1,&b.y1,&b.x2,&b.y2);
-    return b;
+    return _layout->blockBoxes[_index];
 }
 
 int Crackle::PDFTextBlock::rotation() const
 {
-    return (_block->getRotation());
+    return _layout->blockRotations[_index];
 }
 
-Crackle::PDFTextBlock::PDFTextBlock(wrapped_class *block_)
-    : _block(block_), _lines(0)
+Crackle::PDFTextBlock::PDFTextBlock(const PDFTextLayout *layout_, size_t index_)
+    : _layout(layout_), _index(index_), _lines(0)
 {}
 
 bool Crackle::PDFTextBlock::operator==(const PDFTextBlock &rhs_) const
 {
-    return _block==rhs_._block;
+    return _layout==rhs_._layout && _index==rhs_._index;
 }
 
 const PDFTextLineCollection &Crackle::PDFTextBlock::lines() const
 {
     if(!_lines) {
-        _lines=new PDFTextLineCollection(_block->getLines());
+        _lines=new PDFTextLineCollection(_layout, _layout->blockStart[_index], _layout->blockStart[_index+1]);
     }
     return *_lines;
 }
 
-void Crackle::PDFTextBlock::advance()
-{
-    delete _lines;
-    _lines=0;
-    _block=_block->getNext();
-}
-
 string Crackle::PDFTextBlock::text() const
 {
     string text;
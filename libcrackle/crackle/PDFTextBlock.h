@@ -36,8 +36,6 @@
 #include <spine/Block.h>
 #include <string>
 
-class CrackleTextBlock;
-
 namespace Crackle
 {
 
@@ -57,14 +55,11 @@ namespace Crackle
 
     private:
 
-        typedef CrackleTextBlock wrapped_class;
-
-        PDFTextBlock(wrapped_class *block_);
+        PDFTextBlock(const PDFTextLayout *layout_, size_t index_);
         friend class SimpleCollection<PDFTextBlock>;
 
-        void advance();
-
-        mutable wrapped_class *_block;
+        const PDFTextLayout *_layout;
+        size_t _index;
         mutable SimpleCollection<PDFTextLine> *_lines;
     };
 
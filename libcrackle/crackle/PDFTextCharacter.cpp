@@ -28,21 +28,21 @@
  ****************************************************************************/
 
 #include <crackle/PDFTextCharacter.h>
-#include <crackle/CrackleTextOutputDev.h>
+#include <crackle/PDFTextLayout.h>
 
 using namespace Spine;
 using namespace Crackle;
 using namespace std;
 
 Crackle::PDFTextCharacter::PDFTextCharacter(const PDFTextCharacter &rhs_)
-    : _word(rhs_._word), _idx(rhs_._idx)
+    : _layout(rhs_._layout), _index(rhs_._index)
 {}
 
 Crackle::PDFTextCharacter& Crackle::PDFTextCharacter::operator=(const Crackle::PDFTextCharacter &rhs_)
 {
     if(&rhs_!=this) {
-        _word=rhs_._word;
-        _idx=rhs_._idx;
+        _layout=rhs_._layout;
+        _index=rhs_._index;
     }
     return *this;
 }
@@ -53,36 +53,26 @@ Crackle::PDFTextCharacter::~PDFTextCharacter()
 
 BoundingBox Crackle::PDFTextCharacter::boundingBox() const
 {
-    BoundingBox b;
-    _word->getCharBBox(_idx, &b.x1,&b.y1,&b.x2,&b.y2);
-    return b;
+    return _layout->charBoxes[_index];
 }
 
-Crackle::PDFTextCharacter::PDFTextCharacter(wrapped_class *word_, int idx_)
-    : _word(word_), _idx(idx_)
+Crackle::PDFTextCharacter::PDFTextCharacter(const PDFTextLayout *layout_, size_t index_)
+    : _layout(layout_), _index(index_)
 {}
 
 bool Crackle::PDFTextCharacter::operator==(const PDFTextCharacter &rhs_) const
 {
-    return _word==rhs_._word && _idx==rhs_._idx;
-}
-
-void Crackle::PDFTextCharacter::advance()
-{
-    ++_idx;
-    if(_idx >= _word->getLength()) {
-        *this=PDFTextCharacter(0); // so the iterator == end()
-    }
+    return _layout==rhs_._layout && _index==rhs_._index;
 }
 
 PDFFont Crackle::PDFTextCharacter::font() const
 {
-    return PDFFont(_word->getFontInfo()->getFont());
+    return PDFFont(_layout->fonts[_layout->wordFonts[_layout->charWords[_index]]]);
 }
 
 double Crackle::PDFTextCharacter::fontSize() const
 {
-    return _word->getFontSize();
+    return _layout->wordFontSizes[_layout->charWords[_index]];
 }
 
 string Crackle::PDFTextCharacter::fontName() const
@@ -92,33 +82,32 @@ string Crackle::PDFTextCharacter::fontName() const
 
 int Crackle::PDFTextCharacter::rotation() const
 {
-    return _word->getRotation();
+    return _layout->wordRotations[_layout->charWords[_index]];
 }
 
 bool Crackle::PDFTextCharacter::spaceAfter() const
 {
-    return (_idx==_word->getLength()-1)
-        && (_word->getSpaceAfter()==gTrue);
+    size_t word(_layout->charWords[_index]);
+    return (_index+1==_layout->wordStart[word+1])
+        && (_layout->wordFlags[word] & PDFTextLayout::SpaceAfter) != 0;
 }
 
 bool Crackle::PDFTextCharacter::underlined() const
 {
-    return _word->isUnderlined()==gTrue;
+    return (_layout->wordFlags[_layout->charWords[_index]] & PDFTextLayout::Underlined) != 0;
 }
 
 double Crackle::PDFTextCharacter::baseline() const
 {
-    return _word->getBaseline();
+    return _layout->wordBaselines[_layout->charWords[_index]];
 }
 
 Color Crackle::PDFTextCharacter::color() const
 {
-    Color result;
-    _word->getColor(&result.r,&result.g,&result.b);
-    return result;
+    return _layout->wordColors[_layout->charWords[_index]];
 }
 
 utf8::uint32_t Crackle::PDFTextCharacter::charcode() const
 {
-    return _word->getChar(_idx);
+    return _layout->charcodes[_index];
 }
@@ -38,9 +38,6 @@
 #include <string>
 #include <utf8/unicode.h>
 
-class CrackleTextWord;
-
-
 namespace Crackle
 {
 
@@ -66,16 +63,11 @@ namespace Crackle
 
     private:
 
-        typedef CrackleTextWord wrapped_class;
-
-        PDFTextCharacter(wrapped_class *word_, int idx_ = 0);
+        PDFTextCharacter(const PDFTextLayout *layout_, size_t index_);
         friend class SimpleCollection<PDFTextCharacter>;
-        friend class PDFTextWord;
-
-        void advance();
 
-        mutable wrapped_class *_word;
-        mutable int _idx;
+        const PDFTextLayout *_layout;
+        size_t _index;
     };
 
 }
@@ -37,19 +37,6 @@
 namespace Crackle
 {
 
-    template<>
-    class SimpleCollection< PDFTextCharacter > : public std::vector< PDFTextCharacter >
-    {
-        typedef std::vector< PDFTextCharacter > _Base;
-
-    public:
-        SimpleCollection(const std::vector< PDFTextCharacter > & characters)
-            : _Base(characters)
-            {}
-
-        friend class PDFTextWord;
-    };
-
     typedef SimpleCollection< PDFTextCharacter > PDFTextCharacterCollection;
 
 }
@@ -0,0 +1,112 @@
+/*****************************************************************************
+ *  
+ *   This file is part of the libcrackle library.
+ *       Copyright (c) 2008-2017 Lost Island Labs
+ *           <info@utopiadocs.com>
+ *   
+ *   The libcrackle library is free software: you can redistribute it and/or
+ *   modify it under the terms of the GNU AFFERO GENERAL PUBLIC LICENSE
+ *   VERSION 3 as published by the Free Software Foundation.
+ *   
+ *   The libcrackle library is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Affero
+ *   General Public License for more details.
+ *   
+ *   You should have received a copy of the GNU Affero General Public License
+ *   along with the libcrackle library. If not, see
+ *   <http://www.gnu.org/licenses/>
+ *  
+ *****************************************************************************/
+
+/*****************************************************************************
+ *
+ * PDFTextLayout.cpp
+ *
+ * Copyright 2008 Advanced Interfaces Group
+ *
+ ****************************************************************************/
+
+#include <crackle/PDFTextLayout.h>
+#include <crackle/CrackleTextOutputDev.h>
+#include <crackle/xpdfapi.h>
+
+#include <map>
+
+using namespace Spine;
+using namespace Crackle;
+using namespace std;
+
+Crackle::PDFTextLayout::PDFTextLayout(CrackleTextPage * page_)
+{
+    map< CrackleTextFontInfo *, int > fontIndex;
+
+    for (CrackleTextFlow * flow = page_->getFlows(); flow; flow = flow->getNext()) {
+        regionStart.push_back(blockStart.size());
+        BoundingBox rb;
+        flow->getBBox(&rb.x1, &rb.y1, &rb.x2, &rb.y2);
+        regionBoxes.push_back(rb);
+
+        for (CrackleTextBlock * block = flow->getBlocks(); block; block = block->getNext()) {
+            blockStart.push_back(lineStart.size());
+            BoundingBox bb;
+            block->getBBox(&bb.x1, &bb.y1, &bb.x2, &bb.y2);
+            blockBoxes.push_back(bb);
+            blockRotations.push_back(block->getRotation());
+
+            for (CrackleTextLine * line = block->getLines(); line; line = line->getNext()) {
+                lineStart.push_back(wordStart.size());
+                BoundingBox lb;
+                line->getBBox(&lb.x1, &lb.y1, &lb.x2, &lb.y2);
+                lineBoxes.push_back(lb);
+                lineRotations.push_back(line->getRotation());
+                lineHyphenated.push_back(line->isHyphenated() != gFalse);
+                lineTextStart.push_back(lineText.size());
+                lineText += unicode2UnicodeString(line->getText(), line->getLength());
+
+                for (CrackleTextWord * word = line->getWords(); word; word = word->getNext()) {
+                    wordStart.push_back(charcodes.size());
+                    wordTextStart.push_back(text.size());
+                    BoundingBox wb;
+                    word->getBBox(&wb.x1, &wb.y1, &wb.x2, &wb.y2);
+                    wordBoxes.push_back(wb);
+                    wordFontSizes.push_back(word->getFontSize());
+                    wordBaselines.push_back(word->getBaseline());
+                    wordRotations.push_back(word->getRotation());
+                    Color color;
+                    word->getColor(&color.r, &color.g, &color.b);
+                    wordColors.push_back(color);
+                    wordFlags.push_back((word->getSpaceAfter() ? SpaceAfter : 0) |
+                                        (word->isUnderlined() ? Underlined : 0));
+
+                    // Fonts are shared between words, so are only stored once
+                    CrackleTextFontInfo * fontInfo = word->getFontInfo();
+                    map< CrackleTextFontInfo *, int >::iterator found(fontIndex.find(fontInfo));
+                    if (found == fontIndex.end()) {
+                        found = fontIndex.insert(make_pair(fontInfo, (int) fonts.size())).first;
+                        fonts.push_back(fontInfo->getFont());
+                        fontNames.push_back(gstring2UnicodeString(fontInfo->getFontName()));
+                    }
+                    wordFonts.push_back(found->second);
+
+                    for (int i = 0; i < word->getLength(); ++i) {
+                        charcodes.push_back(word->getChar(i));
+                        BoundingBox cb;
+                        word->getCharBBox(i, &cb.x1, &cb.y1, &cb.x2, &cb.y2);
+                        charBoxes.push_back(cb);
+                        charWords.push_back(wordBoxes.size() - 1);
+                    }
+                    text += unicode2UnicodeString(word->getUnicodeText(), word->getLength());
+                }
+            }
+        }
+    }
+
+    // Close off each level's ranges
+    regionStart.push_back(blockStart.size());
+    blockStart.push_back(lineStart.size());
+    lineStart.push_back(wordStart.size());
+    lineTextStart.push_back(lineText.size());
+    wordStart.push_back(charcodes.size());
+    wordTextStart.push_back(text.size());
+}
@@ -0,0 +1,101 @@
+/*****************************************************************************
+ *  
+ *   This file is part of the libcrackle library.
+ *       Copyright (c) 2008-2017 Lost Island Labs
+ *           <info@utopiadocs.com>
+ *   
+ *   The libcrackle library is free software: you can redistribute it and/or
+ *   modify it under the terms of the GNU AFFERO GENERAL PUBLIC LICENSE
+ *   VERSION 3 as published by the Free Software Foundation.
+ *   
+ *   The libcrackle library is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Affero
+ *   General Public License for more details.
+ *   
+ *   You should have received a copy of the GNU Affero General Public License
+ *   along with the libcrackle library. If not, see
+ *   <http://www.gnu.org/licenses/>
+ *  
+ *****************************************************************************/
+
+#ifndef PDFTEXTLAYOUT_INCL_
+#define PDFTEXTLAYOUT_INCL_
+
+/*****************************************************************************
+ *
+ * PDFTextLayout.h
+ *
+ * A page's text laid out as flat arrays, one set per level of the text
+ * hierarchy. Each word, line, block and region owns a contiguous range of
+ * the level below it, running from its entry in the corresponding *Start
+ * array up to the next entry (each *Start array has one more element than
+ * there are items at that level). The layout is built once from the
+ * coalesced CrackleTextPage, and the PDFText* classes are views onto it.
+ *
+ ****************************************************************************/
+
+#include <spine/BoundingBox.h>
+#include <spine/Color.h>
+#include <utf8/unicode.h>
+
+#include <string>
+#include <vector>
+
+class CrackleTextPage;
+class GfxFont;
+
+namespace Crackle
+{
+
+    struct PDFTextLayout
+    {
+        PDFTextLayout(CrackleTextPage * page_);
+
+        enum WordFlags {
+            SpaceAfter = 0x1,
+            Underlined = 0x2
+        };
+
+        // Characters
+        std::vector< utf8::uint32_t > charcodes;
+        std::vector< Spine::BoundingBox > charBoxes;
+        std::vector< size_t > charWords; // into words
+
+        // Words
+        std::vector< size_t > wordStart; // into characters
+        std::vector< size_t > wordTextStart; // into text
+        std::vector< Spine::BoundingBox > wordBoxes;
+        std::vector< int > wordFonts; // into fonts
+        std::vector< double > wordFontSizes;
+        std::vector< double > wordBaselines;
+        std::vector< Spine::Color > wordColors;
+        std::vector< int > wordRotations;
+        std::vector< unsigned char > wordFlags;
+        std::string text; // normalised UTF-8 of every word, end to end
+
+        // Lines
+        std::vector< size_t > lineStart; // into words
+        std::vector< Spine::BoundingBox > lineBoxes;
+        std::vector< int > lineRotations;
+        std::vector< bool > lineHyphenated;
+        std::vector< size_t > lineTextStart; // into lineText
+        std::string lineText;
+
+        // Blocks
+        std::vector< size_t > blockStart; // into lines
+        std::vector< Spine::BoundingBox > blockBoxes;
+        std::vector< int > blockRotations;
+
+        // Regions
+        std::vector< size_t > regionStart; // into blocks
+        std::vector< Spine::BoundingBox > regionBoxes;
+
+        // Fonts
+        std::vector< GfxFont * > fonts;
+        std::vector< std::string > fontNames;
+    };
+
+}
+
+#endif /* PDFTEXTLAYOUT_INCL_ */
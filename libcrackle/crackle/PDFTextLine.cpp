@@ -28,16 +28,15 @@
  ****************************************************************************/
 
 #include <crackle/PDFTextLine.h>
-#include <crackle/CrackleTextOutputDev.h>
+#include <crackle/PDFTextLayout.h>
 #include <crackle/PDFTextWordCollection.h>
-#include <crackle/xpdfapi.h>
 
 using namespace std;
 using namespace Spine;
 using namespace Crackle;
 
 Crackle::PDFTextLine::PDFTextLine(const PDFTextLine &rhs_)
-    : _line(rhs_._line), _words(0)
+    : _layout(rhs_._layout), _index(rhs_._index), _words(0)
 {}
 
 Crackle::PDFTextLine& Crackle::PDFTextLine::operator=(const Crackle::PDFTextLine &rhs_)
@@ -45,7 +44,8 @@ Crackle::PDFTextLine& Crackle::PDFTextLine::operator=(const Crackle::PDFTextLine
     if(&rhs_!=this) {
         delete _words;
         _words=0;
-        _line=rhs_._line;
+        _layout=rhs_._layout;
+        _index=rhs_._index;
     }
     return *this;
 }
@@ -57,46 +57,38 @@ Crackle::PDFTextLine::~PDFTextLine()
 
 BoundingBox Crackle::PDFTextLine::boundingBox() const
 {
-    BoundingBox b;
-    _line->getBBox(&b.x1,&b.y1,&b.x2,&b.y2);
-    return b;
+    return _layout->lineBoxes[_index];
 }
 
 bool Crackle::PDFTextLine::hyphenated() const
 {
-    return (_line->isHyphenated()!=gFalse);
+    return _layout->lineHyphenated[_index];
 }
 
 int Crackle::PDFTextLine::rotation() const
 {
-    return (_line->getRotation());
+    return _layout->lineRotations[_index];
 }
 
-Crackle::PDFTextLine::PDFTextLine(wrapped_class *flow_)
-    : _line(flow_), _words(0)
+Crackle::PDFTextLine::PDFTextLine(const PDFTextLayout *layout_, size_t index_)
+    : _layout(layout_), _index(index_), _words(0)
 {}
 
 bool Crackle::PDFTextLine::operator==(const PDFTextLine &rhs_) const
 {
-    return _line==rhs_._line;
+    return _layout==rhs_._layout && _index==rhs_._index;
 }
 
 const Crackle::PDFTextWordCollection &Crackle::PDFTextLine::words() const
 {
     if(!_words) {
-        _words=new PDFTextWordCollection(_line->getWords());
+        _words=new PDFTextWordCollection(_layout, _layout->lineStart[_index], _layout->lineStart[_index+1]);
     }
     return *_words;
 }
 
-void Crackle::PDFTextLine::advance()
-{
-    delete _words;
-    _words=0;
-    _line=_line->getNext();
-}
-
 string Crackle::PDFTextLine::text() const
 {
-    return unicode2UnicodeString(_line->getText(), _line->getLength());
+    size_t from(_layout->lineTextStart[_index]);
+    return _layout->lineText.substr(from, _layout->lineTextStart[_index+1] - from);
 }
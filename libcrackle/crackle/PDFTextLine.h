@@ -36,8 +36,6 @@
 #include <spine/Line.h>
 #include <string>
 
-class CrackleTextLine;
-
 namespace Crackle
 {
 
@@ -58,14 +56,11 @@ namespace Crackle
 
     private:
 
-        typedef CrackleTextLine wrapped_class;
-
-        PDFTextLine(wrapped_class *line_);
-
+        PDFTextLine(const PDFTextLayout *layout_, size_t index_);
         friend class SimpleCollection<PDFTextLine>;
-        void advance();
 
-        mutable wrapped_class *_line;
+        const PDFTextLayout *_layout;
+        size_t _index;
         mutable SimpleCollection<PDFTextWord> *_words;
     };
 
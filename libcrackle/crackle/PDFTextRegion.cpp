@@ -28,19 +28,19 @@
  ****************************************************************************/
 
 #include <crackle/PDFTextRegion.h>
-#include <crackle/CrackleTextOutputDev.h>
 #include <crackle/PDFTextBlockCollection.h>
+#include <crackle/PDFTextLayout.h>
 
 using namespace std;
 using namespace Spine;
 using namespace Crackle;
 
-Crackle::PDFTextRegion::PDFTextRegion(wrapped_class *flow_)
-    : _flow(flow_), _blocks(0)
+Crackle::PDFTextRegion::PDFTextRegion(const PDFTextLayout *layout_, size_t index_)
+    : _layout(layout_), _index(index_), _blocks(0)
 {}
 
 Crackle::PDFTextRegion::PDFTextRegion(const PDFTextRegion &rhs_)
-    : _flow(rhs_._flow), _blocks(0)
+    : _layout(rhs_._layout), _index(rhs_._index), _blocks(0)
 {}
 
 Crackle::PDFTextRegion& Crackle::PDFTextRegion::operator=(const Crackle::PDFTextRegion &rhs_)
@@ -48,7 +48,8 @@ Crackle::PDFTextRegion& Crackle::PDFTextRegion::operator=(const Crackle::PDFText
     if(&rhs_!=this) {
         delete _blocks;
         _blocks=0;
-        _flow=rhs_._flow;
+        _layout=rhs_._layout;
+        _index=rhs_._index;
     }
     return *this;
 }
@@ -61,28 +62,19 @@ Crackle::PDFTextRegion::~PDFTextRegion()
 const PDFTextBlockCollection &Crackle::PDFTextRegion::blocks() const
 {
     if(!_blocks) {
-        _blocks=new PDFTextBlockCollection(_flow->getBlocks());
+        _blocks=new PDFTextBlockCollection(_layout, _layout->regionStart[_index], _layout->regionStart[_index+1]);
     }
     return *_blocks;
 }
 
 BoundingBox Crackle::PDFTextRegion::boundingBox() const
 {
-    BoundingBox b;
-    _flow->getBBox(&b.x1,&b.y1,&b.x2,&b.y2);
-    return b;
+    return _layout->regionBoxes[_index];
 }
 
 bool Crackle::PDFTextRegion::operator==(const PDFTextRegion &rhs_) const
 {
-    return _flow==rhs_._flow;
-}
-
-void Crackle::PDFTextRegion::advance()
-{
-    delete _blocks;
-    _blocks=0;
-    _flow=_flow->getNext();
+    return _layout==rhs_._layout && _index==rhs_._index;
 }
 
 string Crackle::PDFTextRegion::text() const
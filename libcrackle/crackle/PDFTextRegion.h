@@ -36,8 +36,6 @@
 #include <spine/Region.h>
 #include <string>
 
-class CrackleTextFlow;
-
 namespace Crackle
 {
 
@@ -57,14 +55,11 @@ namespace Crackle
 
     private:
 
-        typedef CrackleTextFlow wrapped_class;
-
-        PDFTextRegion(wrapped_class *flow_);
+        PDFTextRegion(const PDFTextLayout *layout_, size_t index_);
         friend class SimpleCollection<PDFTextRegion>;
 
-        void advance();
-
-        mutable wrapped_class *_flow;
+        const PDFTextLayout *_layout;
+        size_t _index;
         mutable SimpleCollection<PDFTextBlock> *_blocks;
     };
 
@@ -29,16 +29,15 @@
 
 #include <crackle/PDFTextWord.h>
 #include <crackle/PDFTextCharacterCollection.h>
-#include <crackle/CrackleTextOutputDev.h>
+#include <crackle/PDFTextLayout.h>
 #include <crackle/PDFFont.h>
-#include <crackle/xpdfapi.h>
 
 using namespace Spine;
 using namespace Crackle;
 using namespace std;
 
 Crackle::PDFTextWord::PDFTextWord(const PDFTextWord &rhs_)
-    : _word(rhs_._word), _characters(0)
+    : _layout(rhs_._layout), _index(rhs_._index), _characters(0)
 {}
 
 Crackle::PDFTextWord& Crackle::PDFTextWord::operator=(const Crackle::PDFTextWord &rhs_)
@@ -46,7 +45,8 @@ Crackle::PDFTextWord& Crackle::PDFTextWord::operator=(const Crackle::PDFTextWord
     if(&rhs_!=this) {
         delete _characters;
         _characters=0;
-        _word=rhs_._word;
+        _layout=rhs_._layout;
+        _index=rhs_._index;
     }
     return *this;
 }
@@ -58,75 +58,63 @@ Crackle::PDFTextWord::~PDFTextWord()
 
 BoundingBox Crackle::PDFTextWord::boundingBox() const
 {
-    BoundingBox b;
-    _word->getBBox(&b.x1,&b.y1,&b.x2,&b.y2);
-    return b;
+    return _layout->wordBoxes[_index];
 }
 
-Crackle::PDFTextWord::PDFTextWord(wrapped_class *word_)
-    : _word(word_), _characters(0)
+Crackle::PDFTextWord::PDFTextWord(const PDFTextLayout *layout_, size_t index_)
+    : _layout(layout_), _index(index_), _characters(0)
 {}
 
 bool Crackle::PDFTextWord::operator==(const PDFTextWord &rhs_) const
 {
-    return _word==rhs_._word;
+    return _layout==rhs_._layout && _index==rhs_._index;
 }
 
 const PDFTextCharacterCollection &Crackle::PDFTextWord::characters() const
 {
     if(!_characters) {
-        std::vector< PDFTextCharacter > chars;
-        for (int i = 0; i < _word->getLength(); ++i) { chars.push_back(PDFTextCharacter(_word, i)); }
-        _characters=new PDFTextCharacterCollection(chars);
+        _characters=new PDFTextCharacterCollection(_layout, _layout->wordStart[_index], _layout->wordStart[_index+1]);
     }
     return *_characters;
 }
 
-void Crackle::PDFTextWord::advance()
-{
-    delete _characters;
-    _characters=0;
-    _word=_word->nextWord();
-}
-
 double Crackle::PDFTextWord::fontSize() const
 {
-    return _word->getFontSize();
+    return _layout->wordFontSizes[_index];
 }
 
 string Crackle::PDFTextWord::fontName() const
 {
-    return gstring2UnicodeString(_word->getFontInfo()->getFontName());
+    return _layout->fontNames[_layout->wordFonts[_index]];
 }
 
 int Crackle::PDFTextWord::rotation() const
 {
-    return _word->getRotation();
+    return _layout->wordRotations[_index];
 }
 
 bool Crackle::PDFTextWord::spaceAfter() const
 {
-    return _word->getSpaceAfter()==gTrue;
+    return (_layout->wordFlags[_index] & PDFTextLayout::SpaceAfter) != 0;
 }
 
 bool Crackle::PDFTextWord::underlined() const
 {
-    return _word->isUnderlined()==gTrue;
+    return (_layout->wordFlags[_index] & PDFTextLayout::Underlined) != 0;
 }
 
 double Crackle::PDFTextWord::baseline() const
 {
-    return _word->getBaseline();
+    return _layout->wordBaselines[_index];
 }
 
 string Crackle::PDFTextWord::text() const
 {
-    return unicode2UnicodeString(_word->getUnicodeText(), _word->getLength());
+    size_t from(_layout->wordTextStart[_index]);
+    return _layout->text.substr(from, _layout->wordTextStart[_index+1] - from);
 }
 
 Color Crackle::PDFTextWord::color() const
 {
-    Color result;
-    _word->getColor(&result.r,&result.g,&result.b);
-    return result;
+    return _layout->wordColors[_index];
 }
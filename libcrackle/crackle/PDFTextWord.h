@@ -38,8 +38,6 @@
 #include <spine/BoundingBox.h>
 #include <string>
 
-class CrackleTextWord;
-
 namespace Crackle
 {
 
@@ -65,15 +63,11 @@ namespace Crackle
 
     private:
 
-        typedef CrackleTextWord wrapped_class;
-
-        PDFTextWord(wrapped_class *word_);
-        friend class SimpleCollection<PDFTextCharacter>;
+        PDFTextWord(const PDFTextLayout *layout_, size_t index_);
         friend class SimpleCollection<PDFTextWord>;
 
-        void advance();
-
-        mutable wrapped_class *_word;
+        const PDFTextLayout *_layout;
+        size_t _index;
         mutable SimpleCollection<PDFTextCharacter> *_characters;
     };
 
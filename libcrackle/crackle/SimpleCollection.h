@@ -26,7 +26,7 @@
  *
  * SimpleCollection.h
  *
- * Simple STL-style proxying class for singly linked list
+ * Simple STL-style proxying class for a range of a PDFTextLayout
  *
  * Copyright 2008 Advanced Interfaces Group
  *
@@ -162,19 +162,22 @@ namespace Crackle
 */
 
 
+    struct PDFTextLayout;
+
     template< class T_PROXY >
     class SimpleCollection : public std::vector< T_PROXY >
     {
         typedef std::vector< T_PROXY > _Base;
 
     public:
-        SimpleCollection(typename T_PROXY::wrapped_class * ptr)
+        // Views of the items [first, last) of one level of a page's layout
+        SimpleCollection(const PDFTextLayout * layout, size_t first, size_t last)
             : _Base()
             {
-                while (ptr)
+                _Base::reserve(last - first);
+                for (size_t i = first; i < last; ++i)
                 {
-                    _Base::push_back(T_PROXY(ptr));
-                    ptr = ptr->getNext();
+                    _Base::push_back(T_PROXY(layout, i));
                 }
             }
 
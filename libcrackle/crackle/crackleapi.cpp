@@ -59,3 +59,14 @@ SpineDocument new_CrackleDocumentFromBuffer(const char *buffer, size_t size, Spi
     }
     return result;
 }
+
+void CrackleDocument_extractAll(SpineDocument doc, size_t threads, CrackleProgressCallback callback, void *userdef, SpineError *error)
+{
+    PDFDocument *pdf(doc ? dynamic_cast< PDFDocument * >(doc->_handle.get()) : 0);
+
+    if(pdf && pdf->isOK()) {
+        pdf->extractAll(threads, callback, userdef);
+    } else if (error) {
+        *error=SpineError_InvalidType;
+    }
+}
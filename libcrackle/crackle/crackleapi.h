@@ -28,9 +28,14 @@
 extern "C" {
 #endif
 
+    typedef void (*CrackleProgressCallback)(void *userdef, size_t completed, size_t total);
+
     SpineDocument new_CrackleDocument(const char *filename, SpineError *error);
     SpineDocument new_CrackleDocumentFromBuffer(const char *buffer, size_t size, SpineError *error);
 
+    /* Extract every page in parallel; threads of 0 picks a sensible default */
+    void CrackleDocument_extractAll(SpineDocument doc, size_t threads, CrackleProgressCallback callback, void *userdef, SpineError *error);
+
 #ifdef __cplusplus
 }
 
@@ -64,6 +64,13 @@ namespace Papyro
         virtual QStringList handleableEvents() { return QStringList(); }
         virtual bool handleEvent(const QString & event, Spine::DocumentHandle document, const QVariantMap & kwargs = QVariantMap()) { return false; }
 
+        // Annotation concepts read and created when handling an event ("*"
+        // meaning any), so that a handler can start as soon as whatever
+        // produces its inputs has finished, rather than waiting for every
+        // handler of earlier events
+        virtual QStringList consumedConcepts(const QString & event) { return QStringList("*"); }
+        virtual QStringList producedConcepts(const QString & event) { return QStringList("*"); }
+
         /** Lookup framework **/
 
         virtual std::set< Spine::AnnotationHandle > lookup(Spine::DocumentHandle document, const std::string & phrase, const QVariantMap & kwargs = QVariantMap())
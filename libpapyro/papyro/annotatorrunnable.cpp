@@ -32,6 +32,7 @@
 #include <papyro/annotatorrunnable.h>
 #include <papyro/utils.h>
 
+#include <QElapsedTimer>
 #include <QMutex>
 
 namespace Papyro
@@ -44,7 +45,9 @@ namespace Papyro
     public:
         AnnotatorRunnablePrivate()
             : runnable(true),
-              mutex(QMutex::Recursive)
+              mutex(QMutex::Recursive),
+              waited(0),
+              elapsed(0)
             {}
 
         boost::shared_ptr< Annotator > annotator;
@@ -53,7 +56,14 @@ namespace Papyro
         QVariantMap kwargs;
         bool runnable;
         QString title;
+        QStringList consumes;
+        QStringList produces;
         QMutex mutex;
+
+        // Timing
+        QElapsedTimer timer;
+        qint64 waited;
+        qint64 elapsed;
     }; // class AnnotatorRunnablePrivate
 
 
@@ -73,6 +83,9 @@ namespace Papyro
         d->kwargs = kwargs;
 
         d->title = qStringFromUnicode(d->annotator->title());
+        d->consumes = d->annotator->consumedConcepts(eventName);
+        d->produces = d->annotator->producedConcepts(eventName);
+        d->timer.start();
     }
 
     AnnotatorRunnable::~AnnotatorRunnable()
@@ -86,6 +99,46 @@ namespace Papyro
         d->annotator->cancel();
     }
 
+    const QStringList & AnnotatorRunnable::consumes() const
+    {
+        return d->consumes;
+    }
+
+    bool AnnotatorRunnable::dependsOn(const AnnotatorRunnable * other) const
+    {
+        // Anything might depend on an annotator that doesn't say what it
+        // produces, and vice versa
+        if (d->consumes.contains("*") || other->d->produces.contains("*")) {
+            return true;
+        }
+        foreach (const QString & concept, d->consumes) {
+            if (other->d->produces.contains(concept)) {
+                return true;
+            }
+        }
+
+        // Nor should anything be produced before an earlier annotator has
+        // finished consuming what was there before it
+        if (!d->produces.isEmpty() && other->d->consumes.contains("*")) {
+            return true;
+        }
+        if (!other->d->consumes.isEmpty() && d->produces.contains("*")) {
+            return true;
+        }
+        foreach (const QString & concept, d->produces) {
+            if (other->d->consumes.contains(concept)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    qint64 AnnotatorRunnable::elapsed() const
+    {
+        QMutexLocker guard(&d->mutex);
+        return d->elapsed;
+    }
+
     const QString & AnnotatorRunnable::eventName() const
     {
         return d->eventName;
@@ -97,12 +150,26 @@ namespace Papyro
         return d->runnable;
     }
 
+    const QStringList & AnnotatorRunnable::produces() const
+    {
+        return d->produces;
+    }
+
     void AnnotatorRunnable::run()
     {
+        {
+            QMutexLocker guard(&d->mutex);
+            d->waited = d->timer.restart();
+        }
+
         if (isRunnable())
         {
             Q_EMIT started();
             d->annotator->handleEvent(d->eventName, d->document, d->kwargs);
+            {
+                QMutexLocker guard(&d->mutex);
+                d->elapsed = d->timer.elapsed();
+            }
             Q_EMIT finished(false);
         }
         else
@@ -122,5 +189,11 @@ namespace Papyro
         return d->title;
     }
 
+    qint64 AnnotatorRunnable::waited() const
+    {
+        QMutexLocker guard(&d->mutex);
+        return d->waited;
+    }
+
 } // namespace Papyro
 
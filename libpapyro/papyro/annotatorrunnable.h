@@ -40,6 +40,7 @@
 #include <QObject>
 #include <QRunnable>
 #include <QString>
+#include <QStringList>
 
 class QVariant;
 
@@ -55,12 +56,17 @@ namespace Papyro
         AnnotatorRunnable(boost::shared_ptr< Annotator > annotator, const QString & eventName, Spine::DocumentHandle document, const QVariantMap & kwargs = QVariantMap());
         ~AnnotatorRunnable();
 
-        bool isRunnable() const;
+        const QStringList & consumes() const;
+        bool dependsOn(const AnnotatorRunnable * other) const;
+        qint64 elapsed() const;
         const QString & eventName() const;
+        bool isRunnable() const;
+        const QStringList & produces() const;
         void run();
         void setProgress(qreal progress);
         void skip();
         const QString & title() const;
+        qint64 waited() const;
 
     signals:
         void started();
@@ -61,6 +61,8 @@ namespace Papyro
         d->running = 0;
         d->finished = 0;
         d->futureQueued = 0;
+        d->phase = 0;
+        d->lastQueuedPhase = -1;
     }
 
     AnnotatorRunnablePool::~AnnotatorRunnablePool()
@@ -70,9 +72,25 @@ namespace Papyro
         delete d;
     }
 
+    void AnnotatorRunnablePool::cancel()
+    {
+        // Interrupt running annotators, then skip the rest
+        QListIterator< AnnotatorRunnable * > runnable(findChildren< AnnotatorRunnable * >());
+        while (runnable.hasNext())
+        {
+            AnnotatorRunnable * next = runnable.next();
+            if (d->started.contains(next))
+            {
+                next->cancel();
+            }
+        }
+
+        skip();
+    }
+
     bool AnnotatorRunnablePool::isActive()
     {
-        return d->running + d->queued > 0;
+        return !d->outstanding.isEmpty();
     }
 
     void AnnotatorRunnablePool::onStarted()
@@ -82,51 +100,71 @@ namespace Papyro
             Q_EMIT started();
         }
 
+        d->started.insert(qobject_cast< AnnotatorRunnable * >(sender()));
         --d->queued;
         ++d->running;
     }
 
     void AnnotatorRunnablePool::onFinished()
     {
-        --d->running;
+        AnnotatorRunnable * runnable = qobject_cast< AnnotatorRunnable * >(sender());
+
+        // Skipped runnables finish without ever having started
+        if (d->started.remove(runnable))
+        {
+            --d->running;
+        }
+        else
+        {
+            --d->queued;
+        }
         ++d->finished;
+        d->outstanding.remove(runnable);
 
-        if (d->running + d->queued == 0)
+        // Start anything that was only waiting for this runnable
+        QMutableListIterator< AnnotatorRunnablePoolPrivate::Waiting > w_iter(d->waiting);
+        while (w_iter.hasNext())
         {
-            // FIXME only Q_EMIT this when not future queues exist?
-            Q_EMIT finished();
+            AnnotatorRunnablePoolPrivate::Waiting & waiting = w_iter.next();
+            waiting.dependencies.remove(runnable);
+            if (waiting.dependencies.isEmpty())
+            {
+                AnnotatorRunnable * ready = waiting.runnable;
+                int priority = waiting.priority;
+                w_iter.remove();
+                --d->futureQueued;
+                _start(ready, priority);
+            }
+        }
 
-            // Dequeue futures until something is queued, or nothing left
-            bool stop = false;
-            int size = d->futureQueues.size();
-            while (--size >= 0 && !d->futureQueues.isEmpty() && !stop)
+        // Reach any sync points that no longer have anything to wait for
+        // (each waits for a superset of what the one before it waits for,
+        // so they are always reached in order)
+        QMutableListIterator< AnnotatorRunnablePoolPrivate::SyncPoint > s_iter(d->syncPoints);
+        while (s_iter.hasNext())
+        {
+            s_iter.next().outstanding.remove(runnable);
+        }
+        while (!d->syncPoints.isEmpty() && d->syncPoints.first().outstanding.isEmpty())
+        {
+            AnnotatorRunnablePoolPrivate::SyncPoint syncPoint(d->syncPoints.takeFirst());
+
+            // Let people know this pool just synced
+            Q_EMIT synced();
+
+            QListIterator< SyncPointEmitter * > emitters(syncPoint.emitters);
+            while (emitters.hasNext())
             {
-                // Let people know this pool just synced
-                Q_EMIT synced();
-
-                QList< QPair< AnnotatorRunnable *, int > > futureQueue(d->futureQueues.takeFirst());
-                SyncPointEmitter * emitter = d->futureEmitters.takeFirst();
-
-                // Queue next set of runnables
-                if (!futureQueue.isEmpty())
-                {
-                    QListIterator< QPair< AnnotatorRunnable *, int > > f_iter(futureQueue);
-                    while (f_iter.hasNext())
-                    {
-                        QPair< AnnotatorRunnable *, int > info(f_iter.next());
-                        _start(info.first, info.second);
-                        --d->futureQueued;
-                    }
-                    stop = true;
-                }
-
-                if (emitter)
-                {
-                    emitter->emitSyncPoint();
-                    delete emitter;
-                }
+                SyncPointEmitter * emitter = emitters.next();
+                emitter->emitSyncPoint();
+                delete emitter;
             }
         }
+
+        if (d->outstanding.isEmpty())
+        {
+            Q_EMIT finished();
+        }
     }
 
     void AnnotatorRunnablePool::skip()
@@ -139,31 +177,31 @@ namespace Papyro
             runnable.next()->skip();
         }
 
-        // Remove future queues
-        QListIterator< QList< QPair< AnnotatorRunnable *, int > > > futureQueues(d->futureQueues);
-        while (futureQueues.hasNext())
+        // Release any runnables still waiting on others, so that they too
+        // can finish (having been skipped)
+        QList< AnnotatorRunnablePoolPrivate::Waiting > waiting(d->waiting);
+        d->waiting.clear();
+        QListIterator< AnnotatorRunnablePoolPrivate::Waiting > w_iter(waiting);
+        while (w_iter.hasNext())
         {
-            QListIterator< QPair< AnnotatorRunnable *, int > > futureQueue(futureQueues.next());
-            while (futureQueue.hasNext())
-            {
-                delete futureQueue.next().first;
-                --d->futureQueued;
-            }
+            const AnnotatorRunnablePoolPrivate::Waiting & next = w_iter.next();
+            --d->futureQueued;
+            _start(next.runnable, next.priority);
         }
-        d->futureQueues.clear();
 
         // Emit all pending sync points
-        QListIterator< SyncPointEmitter * > emitters(d->futureEmitters);
-        while (emitters.hasNext())
+        QListIterator< AnnotatorRunnablePoolPrivate::SyncPoint > syncPoints(d->syncPoints);
+        while (syncPoints.hasNext())
         {
-            SyncPointEmitter * emitter = emitters.next();
-            if (emitter)
+            QListIterator< SyncPointEmitter * > emitters(syncPoints.next().emitters);
+            while (emitters.hasNext())
             {
+                SyncPointEmitter * emitter = emitters.next();
                 emitter->emitSyncPoint();
                 delete emitter;
             }
         }
-        d->futureEmitters.clear();
+        d->syncPoints.clear();
 
         // Sync for further runnables
         sync();
@@ -190,13 +228,33 @@ namespace Papyro
     {
         runnable->setParent(this);
 
-        if (d->futureQueues.isEmpty())
+        // Wait only for those runnables of earlier phases that produce
+        // something this runnable consumes, or consume something it produces
+        QSet< AnnotatorRunnable * > dependencies;
+        QMapIterator< AnnotatorRunnable *, int > o_iter(d->outstanding);
+        while (o_iter.hasNext())
+        {
+            o_iter.next();
+            if (o_iter.value() < d->phase && runnable->dependsOn(o_iter.key()))
+            {
+                dependencies.insert(o_iter.key());
+            }
+        }
+
+        d->outstanding[runnable] = d->phase;
+        d->lastQueuedPhase = d->phase;
+
+        if (dependencies.isEmpty())
         {
             _start(runnable, priority);
         }
         else
         {
-            d->futureQueues.back().append(qMakePair(runnable, priority));
+            AnnotatorRunnablePoolPrivate::Waiting waiting;
+            waiting.runnable = runnable;
+            waiting.priority = priority;
+            waiting.dependencies = dependencies;
+            d->waiting.append(waiting);
             ++d->futureQueued;
         }
     }
@@ -209,29 +267,53 @@ namespace Papyro
 
     void AnnotatorRunnablePool::sync(const QObject * receiver, const char * method, Qt::ConnectionType type)
     {
-        // If reciever/method pair is specified, then sync (or Q_EMIT synced() immediately if queue is empty)
+        SyncPointEmitter * emitter = 0;
         if (receiver && method)
         {
-            SyncPointEmitter * emitter = new SyncPointEmitter(this);
+            emitter = new SyncPointEmitter(this);
             connect(emitter, SIGNAL(synced()), receiver, method, type);
+        }
 
-            if (d->running + d->queued == 0)
+        // Q_EMIT synced() immediately if there's nothing to wait for
+        if (d->outstanding.isEmpty())
+        {
+            if (emitter)
             {
                 emitter->emitSyncPoint();
                 delete emitter;
             }
-            else
+        }
+        // Add a new sync point if anything was queued since the last one
+        else if (d->lastQueuedPhase == d->phase || d->syncPoints.isEmpty())
+        {
+            AnnotatorRunnablePoolPrivate::SyncPoint syncPoint;
+            ++d->phase;
+            syncPoint.outstanding = QSet< AnnotatorRunnable * >::fromList(d->outstanding.keys());
+            if (emitter)
             {
-                d->futureQueues.append(QList< QPair< AnnotatorRunnable *, int > >());
-                d->futureEmitters.append(emitter);
+                syncPoint.emitters.append(emitter);
             }
+            d->syncPoints.append(syncPoint);
+        }
+        else if (emitter)
+        {
+            d->syncPoints.back().emitters.append(emitter);
         }
-        // Add a new sync point if required
-        else if (d->running + d->queued > 0 && (d->futureQueues.isEmpty() || !d->futureQueues.back().isEmpty()))
+    }
+
+    QMap< QString, qint64 > AnnotatorRunnablePool::timings() const
+    {
+        QMap< QString, qint64 > timings;
+        QListIterator< AnnotatorRunnable * > runnable(findChildren< AnnotatorRunnable * >());
+        while (runnable.hasNext())
         {
-            d->futureQueues.append(QList< QPair< AnnotatorRunnable *, int > >());
-            d->futureEmitters.append(0);
+            AnnotatorRunnable * next = runnable.next();
+            if (next->elapsed() > 0)
+            {
+                timings[QString("%1 (%2)").arg(next->title()).arg(next->eventName())] += next->elapsed();
+            }
         }
+        return timings;
     }
 
     void AnnotatorRunnablePool::waitForDone()
@@ -33,7 +33,9 @@
 #define PAPYRO_ANNOTATORRUNNABLEPOOL_H
 
 #include <QList>
+#include <QMap>
 #include <QObject>
+#include <QString>
 #include <QThreadPool>
 
 namespace Papyro
@@ -55,12 +57,14 @@ namespace Papyro
         AnnotatorRunnablePool(QObject * parent = 0);
         virtual ~AnnotatorRunnablePool();
 
+        void cancel();
         bool isActive();
         void skip();
         void start(QList< AnnotatorRunnable * > runnables, int priority = 0);
         void start(AnnotatorRunnable * runnable, int priority = 0);
         void sync();
         void sync(const QObject * receiver, const char * method, Qt::ConnectionType type = Qt::AutoConnection);
+        QMap< QString, qint64 > timings() const; // Milliseconds spent per annotator and event
         void waitForDone();
 
     Q_SIGNALS:
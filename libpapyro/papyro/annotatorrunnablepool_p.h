@@ -33,8 +33,9 @@
 #define PAPYRO_ANNOTATORRUNNABLEPOOL_P_H
 
 #include <QList>
+#include <QMap>
 #include <QObject>
-#include <QPair>
+#include <QSet>
 #include <QThreadPool>
 
 namespace Papyro
@@ -73,8 +74,29 @@ namespace Papyro
         int finished;
         int futureQueued;
 
-        QList< QList< QPair< AnnotatorRunnable *, int > > > futureQueues;
-        QList< SyncPointEmitter * > futureEmitters;
+        // Runnables are queued in phases separated by sync points. A
+        // runnable waits only for those of earlier phases it depends on.
+        int phase;
+        int lastQueuedPhase;
+        QMap< AnnotatorRunnable *, int > outstanding; // runnable -> phase
+        QSet< AnnotatorRunnable * > started;
+
+        struct Waiting
+        {
+            AnnotatorRunnable * runnable;
+            int priority;
+            QSet< AnnotatorRunnable * > dependencies;
+        };
+        QList< Waiting > waiting;
+
+        // A sync point is reached once everything queued before it finishes
+        struct SyncPoint
+        {
+            QSet< AnnotatorRunnable * > outstanding;
+            QList< SyncPointEmitter * > emitters;
+        };
+        QList< SyncPoint > syncPoints;
+
         QThreadPool threadPool;
 
     }; // class AnnotatorRunnablePoolPrivate;
@@ -36,6 +36,7 @@
 #include <papyro/bibliographicmimedata_p.h>
 #include <papyro/exporter.h>
 #include <papyro/librarymodel.h>
+#include <papyro/objectstore.h>
 
 #include <QCheckBox>
 #include <QDateTime>
@@ -275,20 +276,25 @@ namespace Athenaeum
             bool unlink = unlinkCheck && unlinkCheck->isChecked();
             foreach (const QModelIndex & index, doomed) {
                 CitationHandle citation = index.data(Citation::ItemRole).value< CitationHandle >();
+                QUrl path(index.data(Citation::ObjectFileRole).toUrl());
                 citation->setField(Citation::DateImportedRole, QVariant());
-                if (unlink) {
-                    QUrl path(index.data(Citation::ObjectFileRole).toUrl());
-                    if (path.isLocalFile()) {
+                Athenaeum::Bibliography * master = libraryModel->master();
+                master->removeItem(citation);
+                if (unlink && path.isLocalFile()) {
+                    // Only delete files no other citation still refers to
+                    ObjectStore * objectStore = libraryModel->objectStore();
+                    if (!objectStore || objectStore->references(path.toLocalFile()) == 0) {
                         QFile file(path.toLocalFile());
                         if (file.exists()) {
                             // Delete from filesystem
                             file.remove();
                         }
+                        if (objectStore) {
+                            objectStore->remove(path.toLocalFile());
+                            objectStore->sync();
+                        }
                     }
                 }
-                Athenaeum::Bibliography * master = libraryModel->master();
-                citation->setField(Athenaeum::Citation::DateImportedRole, QVariant());
-                master->removeItem(citation);
             }
         }
     }
@@ -132,6 +132,7 @@ namespace Athenaeum
             case BibliographicSearchBox::SearchTitle:
             case BibliographicSearchBox::SearchAuthors:
             case BibliographicSearchBox::SearchAbstract:
+            case BibliographicSearchBox::SearchFullText:
                 searchDomainLabel->setText(searchDomainActions.value(action).first() + ":");
                 searchDomainLabel->show();
                 break;
@@ -232,6 +233,13 @@ namespace Athenaeum
             d->searchDomainMenu->addAction(action);
             d->searchDomainActions[action] << "abstract";
         }
+        {
+            QAction * action = new QAction("Full Text", actionGroup);
+            action->setProperty("searchDomain", QVariant::fromValue(BibliographicSearchBox::SearchFullText));
+            action->setCheckable(true);
+            d->searchDomainMenu->addAction(action);
+            d->searchDomainActions[action] << "text" << "fulltext";
+        }
 
         d->searchDomainButton->setMenu(d->searchDomainMenu);
         d->searchDomainButton->setPopupMode(QToolButton::InstantPopup);
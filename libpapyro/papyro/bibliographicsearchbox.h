@@ -52,6 +52,7 @@ namespace Athenaeum
             SearchTitle,
             SearchAuthors,
             SearchAbstract,
+            SearchFullText,
 
             InvalidSearch
         };
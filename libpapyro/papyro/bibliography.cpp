@@ -85,14 +85,8 @@ namespace Athenaeum
     void BibliographyPrivate::onCitationChanged(int role, QVariant oldValue)
     {
         if (Citation * citation = dynamic_cast< Citation * >(sender())) {
-            int row = 0;
-            foreach (CitationHandle candidate, items) {
-                if (candidate.get() == citation) {
-                    break;
-                }
-                ++row;
-            }
-            if (row < items.count()) {
+            int row = rowOf(citation);
+            if (row >= 0) {
                 QModelIndex index(bibliography->index(row, 0));
                 QVector< int > roles; roles << Qt::DisplayRole << role;
                 emit dataChanged(index, index, roles);
@@ -100,6 +94,15 @@ namespace Athenaeum
         }
     }
 
+    void BibliographyPrivate::reindex(int from)
+    {
+        for (int row = from; row < items.size(); ++row) {
+            if (const Citation * item = items.at(row).get()) {
+                rows[item] = row;
+            }
+        }
+    }
+
     void BibliographyPrivate::removeItemIds(const CitationHandle & item)
     {
         QVariantMap ids(item->field(Citation::IdentifiersRole).toMap());
@@ -114,6 +117,11 @@ namespace Athenaeum
                    this, SLOT(onCitationChanged(int, QVariant)));
     }
 
+    int BibliographyPrivate::rowOf(const Citation * item) const
+    {
+        return rows.value(item, -1);
+    }
+
 
 
 
@@ -143,11 +151,13 @@ namespace Athenaeum
                 }
             }
             if (newItems.size() > 0) {
-                beginInsertRows(QModelIndex(), rowCount(), rowCount() + newItems.size() - 1);
+                int first = rowCount();
+                beginInsertRows(QModelIndex(), first, first + newItems.size() - 1);
                 d->items += newItems;
                 foreach (const CitationHandle & item, newItems) {
                     d->addItemIds(item);
                 }
+                d->reindex(first);
                 endInsertRows();
             }
         }
@@ -159,6 +169,7 @@ namespace Athenaeum
         d->items.clear();
         d->itemsByKey.clear();
         d->itemsById.clear();
+        d->rows.clear();
         endRemoveRows();
     }
 
@@ -342,9 +353,10 @@ namespace Athenaeum
     void Bibliography::insertItems(CitationHandle before, const QVector< CitationHandle > & items)
     {
         if (!items.isEmpty()) {
-            int idx = 0;
-            QVector< CitationHandle >::iterator where(d->items.begin());
-            while (where != d->items.end() && *where != before) { ++where; ++idx; }
+            int idx = before ? d->rowOf(before.get()) : -1;
+            if (idx < 0) {
+                idx = d->items.size();
+            }
             QVector< CitationHandle > newItems;
             foreach (CitationHandle item, items) {
                 QString key = item->field(Citation::KeyRole).toString();
@@ -355,12 +367,14 @@ namespace Athenaeum
                 }
             }
             if (newItems.count() > 0) {
+                int first = idx;
                 beginInsertRows(QModelIndex(), idx, idx + newItems.count() - 1);
-                d->items.insert(where, newItems.count(), CitationHandle());
+                d->items.insert(idx, newItems.count(), CitationHandle());
                 foreach (CitationHandle item, newItems) {
                     d->items[idx++] = item;
                     d->addItemIds(item);
                 }
+                d->reindex(first);
                 endInsertRows();
             }
         }
@@ -375,6 +389,7 @@ namespace Athenaeum
         if (count > 0) {
             beginInsertRows(parent, row, row + count - 1);
             d->items.insert(row, count, CitationHandle());
+            d->reindex(row);
             endInsertRows();
         }
 
@@ -465,6 +480,7 @@ namespace Athenaeum
                     d->items[idx++] = item;
                     d->addItemIds(item);
                 }
+                d->reindex();
                 endInsertRows();
             }
         }
@@ -477,7 +493,7 @@ namespace Athenaeum
 
     bool Bibliography::removeItem(CitationHandle item)
     {
-        int row = d->items.indexOf(item);
+        int row = item ? d->rowOf(item.get()) : -1;
         if (row >= 0) {
             // Remove item
             return removeRow(row);
@@ -497,10 +513,14 @@ namespace Athenaeum
             beginRemoveRows(parent, row, row + count - 1);
             for (int i = row; i < row + count; ++i) {
                 CitationHandle item = d->items[i];
-                d->itemsByKey.remove(item->field(Citation::KeyRole).toString());
-                d->removeItemIds(item);
+                if (item) {
+                    d->itemsByKey.remove(item->field(Citation::KeyRole).toString());
+                    d->removeItemIds(item);
+                    d->rows.remove(item.get());
+                }
             }
             d->items.remove(row, count);
+            d->reindex(row);
             endRemoveRows();
             return true;
         }
@@ -585,6 +605,8 @@ namespace Athenaeum
             taken = d->items.at(idx);
             d->items.remove(idx);
             d->itemsByKey.remove(taken->field(Citation::KeyRole).toString());
+            d->rows.remove(taken.get());
+            d->reindex(idx);
             endRemoveRows();
         }
 
@@ -35,6 +35,7 @@
 #include <papyro/bibliography.h>
 #include <papyro/citation.h>
 
+#include <QHash>
 #include <QMap>
 #include <QMutex>
 #include <QObject>
@@ -58,8 +59,10 @@ namespace Athenaeum
 
         QMutex mutex;
         QVector< CitationHandle > items;
-        QMap< QString, CitationHandle > itemsByKey;
+        QHash< QString, CitationHandle > itemsByKey;
         QMap< QString, CitationHandle > itemsById;
+        // Row of each item, kept up to date as items are inserted and removed
+        QHash< const Citation *, int > rows;
         qreal progress;
         AbstractBibliography::State state;
         bool readOnly;
@@ -67,7 +70,9 @@ namespace Athenaeum
         PersistenceModel * persistenceModel;
 
         void addItemIds(const CitationHandle & item);
+        void reindex(int from = 0);
         void removeItemIds(const CitationHandle & item);
+        int rowOf(const Citation * item) const;
 
     signals:
         void dataChanged(const QModelIndex & topLeft,
@@ -46,6 +46,7 @@
 #include <QMetaProperty>
 #include <QMimeData>
 #include <QNetworkReply>
+#include <QSet>
 #include <QThreadPool>
 #include <QUrl>
 #include <QDebug>
@@ -81,7 +82,7 @@ namespace Athenaeum
             for (int row = first; row <= last; ++row) {
                 QModelIndex idx = sourceModel->index(row, 0, parent);
                 QString key = sourceModel->data(idx, Citation::KeyRole).toString();
-                int doomed = keys.indexOf(key);
+                int doomed = rowOf(key);
                 if (doomed >= 0) {
                     collection->removeRow(doomed);
                 }
@@ -89,6 +90,21 @@ namespace Athenaeum
         }
     }
 
+    void CollectionPrivate::reindex(int from)
+    {
+        for (int row = from; row < keys.size(); ++row) {
+            const QString & key = keys.at(row);
+            if (!key.isEmpty()) {
+                rows[key] = row;
+            }
+        }
+    }
+
+    int CollectionPrivate::rowOf(const QString & key) const
+    {
+        return rows.value(key, -1);
+    }
+
 
 
 
@@ -104,19 +120,25 @@ namespace Athenaeum
         if (d->sourceBibliography && !items.isEmpty()) {
             QVector< CitationHandle > newItems;
             QVector< QString > newKeys;
+            QSet< QString > seen;
             foreach (CitationHandle item, items) {
                 QString key = item->field(Citation::KeyRole).toString();
                 if (!d->sourceBibliography->itemForKey(key)) {
                     newItems << item;
                 }
-                if (!d->keys.contains(key)) {
+                if (d->rowOf(key) < 0 && !seen.contains(key)) {
+                    seen.insert(key);
                     newKeys << key;
                 }
             }
-            beginInsertRows(QModelIndex(), rowCount(), rowCount() + newKeys.size());
             d->sourceBibliography->appendItems(newItems);
-            d->keys += newKeys;
-            endInsertRows();
+            if (!newKeys.isEmpty()) {
+                int first = rowCount();
+                beginInsertRows(QModelIndex(), first, first + newKeys.size() - 1);
+                d->keys += newKeys;
+                d->reindex(first);
+                endInsertRows();
+            }
         }
     }
 
@@ -124,6 +146,7 @@ namespace Athenaeum
     {
         beginRemoveRows(QModelIndex(), 0, d->keys.size() - 1);
         d->keys.clear();
+        d->rows.clear();
         endRemoveRows();
     }
 
@@ -300,28 +323,34 @@ namespace Athenaeum
         if (!items.isEmpty() && d->sourceBibliography) {
             QVector< CitationHandle > newItems;
             QVector< QString > newKeys;
+            QSet< QString > seen;
             foreach (CitationHandle item, items) {
                 QString key = item->field(Citation::KeyRole).toString();
                 if (!d->sourceBibliography->itemForKey(key)) {
                     newItems << item;
                 }
-                if (!d->keys.contains(key)) {
+                if (d->rowOf(key) < 0 && !seen.contains(key)) {
+                    seen.insert(key);
                     newKeys << key;
                 }
             }
 
-            int idx = 0;
-            QString beforeKey = before->field(Citation::KeyRole).toString();
-            QVector< QString >::iterator where(d->keys.begin());
-            while (where != d->keys.end() && *where != beforeKey) { ++where; ++idx; }
+            int idx = before ? d->rowOf(before->field(Citation::KeyRole).toString()) : -1;
+            if (idx < 0) {
+                idx = d->keys.size();
+            }
 
-            beginInsertRows(QModelIndex(), idx, idx + newKeys.count() - 1);
             d->sourceBibliography->appendItems(newItems);
-            d->keys.insert(where, newKeys.count(), QString());
-            foreach (const QString & key, newKeys) {
-                d->keys[idx++] = key;
+            if (!newKeys.isEmpty()) {
+                int first = idx;
+                beginInsertRows(QModelIndex(), idx, idx + newKeys.count() - 1);
+                d->keys.insert(idx, newKeys.count(), QString());
+                foreach (const QString & key, newKeys) {
+                    d->keys[idx++] = key;
+                }
+                d->reindex(first);
+                endInsertRows();
             }
-            endInsertRows();
         }
     }
 
@@ -333,6 +362,7 @@ namespace Athenaeum
 
         beginInsertRows(parent, row, row + count - 1);
         d->keys.insert(row, count, QString());
+        d->reindex(row);
         endInsertRows();
 
         return true;
@@ -361,7 +391,7 @@ namespace Athenaeum
         if (d->sourceBibliography) {
             if (CitationHandle found = d->sourceBibliography->itemForId(id)) {
                 QString key(found->field(Citation::KeyRole).toString());
-                if (!key.isEmpty() && d->keys.contains(key)) {
+                if (!key.isEmpty() && d->rowOf(key) >= 0) {
                     return found;
                 }
             }
@@ -371,7 +401,7 @@ namespace Athenaeum
 
     CitationHandle Collection::itemForKey(const QString & key) const
     {
-        if (d->sourceBibliography && d->keys.contains(key)) {
+        if (d->sourceBibliography && d->rowOf(key) >= 0) {
             return d->sourceBibliography->itemForKey(key);
         } else {
             return CitationHandle();
@@ -428,7 +458,7 @@ namespace Athenaeum
     void Collection::prependItems(const QVector< CitationHandle > & items)
     {
         CitationHandle before;
-        if (d->keys.isEmpty()) {
+        if (!d->keys.isEmpty()) {
             before = d->sourceBibliography->itemForKey(d->keys.first());
         }
         insertItems(before, items);
@@ -442,10 +472,9 @@ namespace Athenaeum
     bool Collection::removeItem(CitationHandle item)
     {
         QString key = item->field(Citation::KeyRole).toString();
-        int idx = d->keys.indexOf(key);
+        int idx = d->rowOf(key);
         if (idx >= 0) {
-            d->keys.remove(idx);
-            return true;
+            return removeRow(idx);
         }
 
         // Not found
@@ -460,7 +489,11 @@ namespace Athenaeum
             return false;
         } else {
             beginRemoveRows(parent, row, row + count - 1);
+            for (int i = row; i < row + count; ++i) {
+                d->rows.remove(d->keys.at(i));
+            }
             d->keys.remove(row, count);
+            d->reindex(row);
             endRemoveRows();
             return true;
         }
@@ -530,7 +563,9 @@ namespace Athenaeum
         if (d->sourceBibliography && idx >= 0 && idx < d->keys.size()) {
             beginRemoveRows(QModelIndex(), idx, idx);
             taken = d->sourceBibliography->itemForKey(d->keys.at(idx));
+            d->rows.remove(d->keys.at(idx));
             d->keys.remove(idx);
+            d->reindex(idx);
             endRemoveRows();
         }
 
@@ -34,6 +34,7 @@
 
 #include <papyro/collection.h>
 
+#include <QHash>
 #include <QMap>
 #include <QMutex>
 #include <QObject>
@@ -56,6 +57,8 @@ namespace Athenaeum
 
         QMutex mutex;
         QVector< QString > keys;
+        // Row of each key, kept up to date as keys are inserted and removed
+        QHash< QString, int > rows;
         qreal progress;
         AbstractBibliography::State state;
         bool readOnly;
@@ -63,6 +66,9 @@ namespace Athenaeum
 
         PersistenceModel * persistenceModel;
 
+        void reindex(int from = 0);
+        int rowOf(const QString & key) const;
+
     public slots:
         void rowsAboutToBeRemoved(const QModelIndex & parent, int first, int last);
 
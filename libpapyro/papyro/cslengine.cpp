@@ -34,6 +34,7 @@
 
 #include <boost/weak_ptr.hpp>
 
+#include <QDateTime>
 #include <QDir>
 #include <QDomDocument>
 #include <QFile>
@@ -42,10 +43,13 @@
 #include <QMutexLocker>
 #include <QResource>
 #include <QScriptEngine>
+#include <QSet>
 #include <QSettings>
 #include <QString>
 #include <QStringList>
+#include <QThread>
 #include <QVariantMap>
+#include <QWaitCondition>
 
 #include <QDebug>
 
@@ -107,6 +111,9 @@ namespace Papyro
                 QByteArray raw(citeproc.readAll());
                 xml = QString::fromUtf8(raw.constData(), raw.size());
             }
+            if (xml.isEmpty()) {
+                return engine->undefinedValue();
+            }
 
             return engine->evaluate("(" + xml + ")", Utopia::resource_path() + "/citeproc/locales/" + lang + ".json");
         }
@@ -153,18 +160,13 @@ namespace Papyro
 
 
 
-    class CSLEnginePrivate
+    // One script engine with citeproc loaded, and the styles installed in
+    // it so far
+    class CSLEngineInstance
     {
     public:
-        CSLEnginePrivate()
-            : mutex(QMutex::Recursive)
+        CSLEngineInstance()
         {
-            // Populate from settings
-            QSettings conf;
-            conf.sync();
-            conf.beginGroup("CSLEngine");
-            defaultStyle = conf.value("Default Style", "apa").toString();
-
             // Provide the environment with helper methods
             QScriptValue globalObject = engine.globalObject();
             globalObject.setProperty(QString("retrieveLocale"), engine.newFunction(retrieveLocale));
@@ -178,32 +180,115 @@ namespace Papyro
             foreach (const QString & source, sources) {
                 evaluate(&engine, resource(source), source);
             }
+        }
+
+        QScriptEngine engine;
+        QSet< QString > installedStyles;
 
-            // Grab handle for admin functions
-            QScriptValue installLocaleFn = globalObject.property("installLocale");
-            QScriptValue installStyleFn = globalObject.property("installStyle");
+    }; // class CSLEngineInstance
+
+
+
+
+    class CSLEnginePrivate
+    {
+    public:
+        struct Style
+        {
+            QString title;
+            QString path; // JSON form of the style
+        };
+
+        CSLEnginePrivate()
+            : engines(0), maximumEngines(qBound(1, QThread::idealThreadCount(), 4))
+        {
+            // Populate from settings
+            QSettings conf;
+            conf.sync();
+            conf.beginGroup("CSLEngine");
+            defaultStyle = conf.value("Default Style", "apa").toString();
 
-            // Install locales
-            QVariantMap localeMap(evaluate(&engine, "(" + resource(Utopia::resource_path() + "/citeproc/locales.json") + ")", Utopia::resource_path() + "/citeproc/locales.json").toVariant().toMap());
+            // Locales are only described here; each engine loads them as
+            // citeproc asks for them
+            QVariantMap localeMap(QJsonDocument::fromJson(resource(Utopia::resource_path() + "/citeproc/locales.json").toUtf8()).toVariant().toMap());
             QMapIterator< QString, QVariant > localeMapIter(localeMap);
             while (localeMapIter.hasNext()) {
                 localeMapIter.next();
                 QString code = localeMapIter.key();
-                QString description = localeMapIter.value().toString();
-                if (code != "description") {
-                    QString locale = resource(Utopia::resource_path() + "/citeproc/locales/" + code + ".json", false);
-                    if (!locale.isEmpty()) {
-                        QScriptValueList args;
-                        args << engine.toScriptValue(code);
-                        args << engine.toScriptValue(description);
-                        args << engine.evaluate("(" + locale + ")");
-                        installLocaleFn.call(globalObject, args);
-                        qDebug() << "CSLEngine: Loaded locale" << code;
+                if (code != "description" && QFile::exists(Utopia::resource_path() + "/citeproc/locales/" + code + ".json")) {
+                    locales[code] = localeMapIter.value().toString();
+                }
+            }
+
+            loadStyles();
+        }
+
+        ~CSLEnginePrivate()
+        {
+            qDeleteAll(idleEngines);
+        }
+
+        QString defaultStyle;
+        QMap< QString, Style > styles;
+        QVariantMap locales;
+        QMutex mutex;
+
+        // Pool of script engines
+        QList< CSLEngineInstance * > idleEngines;
+        int engines;
+        int maximumEngines;
+        QWaitCondition engineReleased;
+
+        CSLEngineInstance * acquireEngine()
+        {
+            QMutexLocker guard(&mutex);
+            while (idleEngines.isEmpty() && engines >= maximumEngines) {
+                engineReleased.wait(&mutex);
+            }
+            if (!idleEngines.isEmpty()) {
+                return idleEngines.takeLast();
+            }
+            ++engines;
+            guard.unlock();
+            return new CSLEngineInstance;
+        }
+
+        void releaseEngine(CSLEngineInstance * instance)
+        {
+            QMutexLocker guard(&mutex);
+            idleEngines.append(instance);
+            engineReleased.wakeOne();
+        }
+
+        // Find the style to use for a request, falling back to the default
+        // style and then to APA (mutex must be locked)
+        QString resolveStyle(const QString & style) const
+        {
+            QStringList candidates;
+            candidates << style << defaultStyle << "apa";
+            foreach (const QString & candidate, candidates) {
+                QMapIterator< QString, Style > iter(styles);
+                while (!candidate.isEmpty() && iter.hasNext()) {
+                    iter.next();
+                    if (iter.key().compare(candidate, Qt::CaseInsensitive) == 0) {
+                        return iter.key();
                     }
                 }
             }
+            return QString();
+        }
+
+        // Catalogue the available styles. CSL files are converted to JSON
+        // once and kept, along with their titles, in the profile's cache, so
+        // that only new or changed styles need converting.
+        void loadStyles()
+        {
+            QDir cacheDir(Utopia::profile_path(Utopia::ProfileData) + "/csl");
+            cacheDir.mkpath(".");
+            QString indexPath(cacheDir.absoluteFilePath("index.json"));
+            QVariantMap index(QJsonDocument::fromJson(resource(indexPath, false).toUtf8()).toVariant().toMap());
+            bool changed = false;
 
-            // Install styles
             QDir stylesDir(Utopia::resource_path() + "/citeproc/styles");
             QDir userStylesDir(Utopia::profile_path() + "/csl");
             QStringList filters;
@@ -214,31 +299,72 @@ namespace Papyro
             foreach (const QFileInfo & styleFileInfo, styleFiles) {
                 QString styleFile = styleFileInfo.fileName();
                 QString code = styleFile.section(".", 0, 0);
-                QString description(code);
-                description = description.replace(QRegExp("[^a-zA-Z0-9]+"), " ").trimmed();
-                QString style = resource(styleFileInfo.filePath());
-                if (styleFileInfo.suffix() == "csl") {
-                    style = xmlToJson(style);
+                QString source(styleFileInfo.absoluteFilePath());
+                qint64 modified = styleFileInfo.lastModified().toMSecsSinceEpoch();
+
+                // Use the cached conversion if it is of this very file
+                QVariantMap entry(index.value(code).toMap());
+                if (entry.value("source").toString() != source ||
+                    entry.value("modified").toLongLong() != modified ||
+                    entry.value("size").toLongLong() != styleFileInfo.size() ||
+                    !QFile::exists(entry.value("path").toString())) {
+                    QString style = resource(source);
+                    QString path(source);
+                    if (styleFileInfo.suffix() == "csl") {
+                        style = xmlToJson(style);
+                        path = cacheDir.absoluteFilePath(code + ".json");
+                        QFile converted(path);
+                        if (style.isEmpty() || !converted.open(QIODevice::WriteOnly | QIODevice::Truncate) || converted.write(style.toUtf8()) < 0) {
+                            qDebug() << "CSLEngine: Could not load style" << styleFile;
+                            continue;
+                        }
+                    }
+                    entry.clear();
+                    entry["source"] = source;
+                    entry["modified"] = modified;
+                    entry["size"] = styleFileInfo.size();
+                    entry["path"] = path;
+                    entry["title"] = styleTitle(QJsonDocument::fromJson(style.toUtf8()).toVariant());
+                    index[code] = entry;
+                    changed = true;
+                    qDebug() << "CSLEngine: Converted style" << styleFile;
                 }
-                if (!style.isEmpty()) {
-                    QScriptValueList args;
-                    args << engine.toScriptValue(code);
-                    args << engine.toScriptValue(description);
-                    args << engine.evaluate("(" + style + ")");
-                    installStyleFn.call(globalObject, args);
-                    qDebug() << "CSLEngine: Loaded style" << styleFile;
-                } else {
-                    qDebug() << "CSLEngine: Could not load style" << styleFile;
+
+                Style & style = styles[code];
+                style.title = entry.value("title").toString();
+                style.path = entry.value("path").toString();
+            }
+
+            if (changed) {
+                QFile indexFile(indexPath);
+                if (indexFile.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+                    indexFile.write(QJsonDocument::fromVariant(index).toJson());
                 }
             }
         }
 
-        ~CSLEnginePrivate()
-        {}
-
-        QString defaultStyle;
-        QScriptEngine engine;
-        QMutex mutex;
+        // The text of a JSON style's info/title element
+        static QString styleTitle(const QVariant & style)
+        {
+            QVariant node(style);
+            QStringList path;
+            path << "info" << "title";
+            foreach (const QString & name, path) {
+                QVariant found;
+                foreach (const QVariant & child, node.toMap().value("children").toList()) {
+                    if (child.toMap().value("name").toString() == name) {
+                        found = child;
+                        break;
+                    }
+                }
+                node = found;
+            }
+            QStringList text;
+            foreach (const QVariant & child, node.toMap().value("children").toList()) {
+                text << child.toString();
+            }
+            return text.join(" ");
+        }
 
     }; // class CSLEnginePrivate
 
@@ -257,51 +383,17 @@ namespace Papyro
     QVariantMap CSLEngine::availableLocales() const
     {
         QMutexLocker guard(&d->mutex);
-        QVariantMap locales;
-        QScriptValue globalObject = d->engine.globalObject();
-        QScriptValue getLocalesFn = globalObject.property("getLocales");
-        if (getLocalesFn.isFunction()) {
-            QVariantMap map(getLocalesFn.call(globalObject).toVariant().toMap());
-            if (!d->engine.hasUncaughtException()) {
-                QMapIterator< QString, QVariant > iter(map);
-                while (iter.hasNext()) {
-                    iter.next();
-                    locales[iter.key()] = iter.value();
-                }
-            } else {
-                qDebug() << "EXCEPTION";
-                qDebug() << d->engine.uncaughtException().toString();
-                foreach (QString line, d->engine.uncaughtExceptionBacktrace()) {
-                    qDebug() << line;
-                }
-                d->engine.clearExceptions();
-            }
-        }
-        return locales;
+        return d->locales;
     }
 
     QVariantMap CSLEngine::availableStyles() const
     {
         QMutexLocker guard(&d->mutex);
         QVariantMap styles;
-        QScriptValue globalObject = d->engine.globalObject();
-        QScriptValue getStylesFn = globalObject.property("getStyles");
-        if (getStylesFn.isFunction()) {
-            QVariantMap map(getStylesFn.call(globalObject).toVariant().toMap());
-            if (!d->engine.hasUncaughtException()) {
-                QMapIterator< QString, QVariant > iter(map);
-                while (iter.hasNext()) {
-                    iter.next();
-                    styles[iter.key()] = iter.value();
-                }
-            } else {
-                qDebug() << "EXCEPTION";
-                qDebug() << d->engine.uncaughtException().toString();
-                foreach (QString line, d->engine.uncaughtExceptionBacktrace()) {
-                    qDebug() << line;
-                }
-                d->engine.clearExceptions();
-            }
+        QMapIterator< QString, CSLEnginePrivate::Style > iter(d->styles);
+        while (iter.hasNext()) {
+            iter.next();
+            styles[iter.key()] = iter.value().title;
         }
         return styles;
     }
@@ -314,30 +406,56 @@ namespace Papyro
 
     QString CSLEngine::format(const QVariantMap & metadata, const QString & style)
     {
-        QMutexLocker guard(&d->mutex);
+        QString code;
+        CSLEnginePrivate::Style resolved;
+        {
+            QMutexLocker guard(&d->mutex);
+            code = d->resolveStyle(style);
+            resolved = d->styles.value(code);
+        }
+
+        CSLEngineInstance * instance = d->acquireEngine();
+        QScriptEngine & engine = instance->engine;
+        QScriptValue globalObject = engine.globalObject();
+
+        // Install the style into this engine the first time it is used here
+        if (!code.isEmpty() && !instance->installedStyles.contains(code)) {
+            QString json(resource(resolved.path));
+            if (!json.isEmpty()) {
+                QScriptValueList args;
+                args << engine.toScriptValue(code);
+                args << engine.toScriptValue(resolved.title);
+                args << evaluate(&engine, "(" + json + ")", resolved.path);
+                globalObject.property("installStyle").call(globalObject, args);
+                qDebug() << "CSLEngine: Loaded style" << code;
+            }
+            instance->installedStyles.insert(code);
+        }
+
         QString formatted;
-        QScriptValue globalObject = d->engine.globalObject();
         QScriptValue formatFn = globalObject.property("format");
         if (formatFn.isFunction()) {
             QScriptValueList args;
-            args << d->engine.toScriptValue(metadata);
-            args << d->engine.toScriptValue(style);
-            args << d->engine.toScriptValue(defaultStyle());
+            args << engine.toScriptValue(metadata);
+            args << engine.toScriptValue(code.isEmpty() ? style : code);
+            args << engine.toScriptValue(code.isEmpty() ? defaultStyle() : code);
 
             QScriptValue val = formatFn.call(globalObject, args);
-            if (!d->engine.hasUncaughtException()) {
+            if (!engine.hasUncaughtException()) {
                 formatted = val.toString();
             } else {
                 qDebug() << "EXCEPTION ---" << val.toString();;
-                qDebug() << d->engine.uncaughtException().toString();
-                foreach (QString line, d->engine.uncaughtExceptionBacktrace()) {
+                qDebug() << engine.uncaughtException().toString();
+                foreach (QString line, engine.uncaughtExceptionBacktrace()) {
                     qDebug() << line;
                 }
-                d->engine.clearExceptions();
+                engine.clearExceptions();
             }
         } else {
             qDebug() << "ERROR: format doesn't seem to be a function object";
         }
+
+        d->releaseEngine(instance);
         return formatted.trimmed();
     }
 
@@ -161,6 +161,13 @@ function format(metadata, style, defaultStyle)
 
     var sys = {
         retrieveLocale: function (name) {
+            // Locales are loaded the first time citeproc asks for them
+            if (!Utopia.locales[name]) {
+                var locale = retrieveLocale(name);
+                if (locale) {
+                    installLocale(name, name, locale);
+                }
+            }
             if (Utopia.locales[name]) {
                 return Utopia.locales[name].json;
             }
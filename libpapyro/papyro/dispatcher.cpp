@@ -47,6 +47,12 @@
 Q_DECLARE_METATYPE(Spine::AnnotationHandle);
 
 
+QDataStream & operator << (QDataStream & str, const QList< Spine::AnnotationHandle > & annotationList)
+{
+    qFatal("QList< Spine::AnnotationHandle > cannot be serialised");
+    return str;
+}
+
 QDataStream & operator >> (QDataStream & str, QList< Spine::AnnotationHandle > & annotationList)
 {
     qFatal("QList< Spine::AnnotationHandle > cannot be serialised");
@@ -33,11 +33,14 @@
 #include <papyro/documentmanager_p.h>
 
 #include <papyro/documentfactory.h>
+#include <utopia2/global.h>
 
 #include <boost/bind.hpp>
 
+#include <QDir>
 #include <QDomDocument>
 #include <QFile>
+#include <QFileInfo>
 #include <QFuture>
 #include <QFutureWatcher>
 #include <QNetworkReply>
@@ -68,6 +71,19 @@ namespace Papyro
             return encoded;
         }
 
+        // How many documents' fingerprints to keep on disk
+        const int maximumStoredFingerprints = 5000;
+
+        // Discard the least recently written fingerprint records beyond the
+        // limit; any document that needs one again simply recalculates it
+        void pruneFingerprintCache(const QString & path)
+        {
+            QFileInfoList records(QDir(path).entryInfoList(QDir::Files, QDir::Time));
+            for (int i = maximumStoredFingerprints; i < records.size(); ++i) {
+                QFile::remove(records.at(i).absoluteFilePath());
+            }
+        }
+
     }
 
 
@@ -81,6 +97,13 @@ namespace Papyro
             factories.append(factory);
         }
 
+        // Persist document fingerprints between sessions
+        QDir dataRoot(Utopia::profile_path());
+        if (dataRoot.mkpath("fingerprints")) {
+            Spine::Document::setFingerprintCachePath(QFile::encodeName(dataRoot.absoluteFilePath("fingerprints")).constData());
+            QtConcurrent::run(&pruneFingerprintCache, dataRoot.absoluteFilePath("fingerprints"));
+        }
+
         // Populate model from service manager
         for (int i = 0; i < serviceManager->count(); ++i) {
             Kend::Service * service = serviceManager->serviceAt(i);
@@ -170,6 +193,14 @@ namespace Papyro
         // Re-resolve a document
     }
 
+    void DocumentManagerPrivate::calculateFingerprints(Spine::DocumentHandle document)
+    {
+        // Fingerprinting walks the whole document, so start it in the
+        // background straight away; resolution will then find it done (or
+        // wait for it to finish) rather than stall the caller
+        QtConcurrent::run(boost::bind(&Spine::Document::fingerprints, document));
+    }
+
     void DocumentManagerPrivate::registerDocument(Kend::Service * service, Spine::DocumentHandle document)
     {
         // Start with resolving an ID for this document with
@@ -255,6 +286,7 @@ namespace Papyro
                         eventLoop.exec();
                         if ((document = future.result())) {
                             //registerDocument(document);
+                            d->calculateFingerprints(document);
                             break;
                         }
                     }
@@ -266,8 +298,24 @@ namespace Papyro
 
     Spine::DocumentHandle DocumentManager::open(const QString & filename)
     {
-        QFile file(filename);
-        return open(&file);
+        Spine::DocumentHandle document;
+        // Give factories the chance to load straight from the file (which
+        // allows them to map it rather than copy it into memory)
+        foreach (DocumentFactory * factory, d->factories) {
+            if (factory->isCapable(filename)) {
+                QEventLoop eventLoop;
+                QFutureWatcher< Spine::DocumentHandle > watcher;
+                connect(&watcher, SIGNAL(finished()), &eventLoop, SLOT(quit()));
+                QFuture< Spine::DocumentHandle > future = QtConcurrent::run(boost::bind(static_cast< Spine::DocumentHandle (DocumentFactory::*)( const QString & ) >(&DocumentFactory::create), factory, filename));
+                watcher.setFuture(future);
+                eventLoop.exec();
+                if ((document = future.result())) {
+                    d->calculateFingerprints(document);
+                    break;
+                }
+            }
+        }
+        return document;
     }
 
     void DocumentManager::registerDocument(Spine::DocumentHandle document)
@@ -71,6 +71,7 @@ namespace Papyro
         // Binary Hash -> Service -> ( Document, Resolved URI )
         QMap< QString, QMap< Kend::Service *, QPair< Spine::WeakDocumentHandle, QString > > > registry;
 
+        void calculateFingerprints(Spine::DocumentHandle document);
         void registerDocument(Kend::Service * servive, Spine::DocumentHandle document);
         QString resolveDocument(Kend::Service * servive, Spine::DocumentHandle document);
         void unregisterDocument(Kend::Service * service, Spine::DocumentHandle document);
@@ -32,6 +32,9 @@
 #include <papyro/documentproxy.h>
 #include <papyro/documentproxy_p.h>
 
+#include <QMutexLocker>
+#include <QThread>
+
 namespace Papyro
 {
 
@@ -76,10 +79,46 @@ namespace Papyro
                 proxy, SIGNAL(textSelectionChanged(std::string, Spine::TextExtentSet, bool)));
     }
 
+    void DocumentProxyPrivate::flushAnnotationsChanged()
+    {
+        QList< AnnotationsChange > pending;
+        {
+            QMutexLocker guard(&pendingAnnotationsChangesMutex);
+            pending.swap(pendingAnnotationsChanges);
+        }
+        foreach (const AnnotationsChange & change, pending) {
+            if (document) {
+                emit annotationsChanged(change.name, change.annotations, change.added);
+            }
+        }
+    }
+
     void DocumentProxyPrivate::onAnnotationsChanged(const std::string & name, const Spine::AnnotationSet & annotations, bool added)
     {
-        if (document) {
-            emit annotationsChanged(name, annotations, added);
+        if (QThread::currentThread() == thread()) {
+            // Changes made on this thread are delivered straight away, after
+            // anything still queued from elsewhere
+            flushAnnotationsChanged();
+            if (document) {
+                emit annotationsChanged(name, annotations, added);
+            }
+        } else {
+            // Annotators running elsewhere may make thousands of changes, so
+            // these are merged into batches until this thread gets to them
+            QMutexLocker guard(&pendingAnnotationsChangesMutex);
+            bool schedule = pendingAnnotationsChanges.isEmpty();
+            if (!schedule && pendingAnnotationsChanges.last().name == name && pendingAnnotationsChanges.last().added == added) {
+                pendingAnnotationsChanges.last().annotations.insert(annotations.begin(), annotations.end());
+            } else {
+                AnnotationsChange change;
+                change.name = name;
+                change.annotations = annotations;
+                change.added = added;
+                pendingAnnotationsChanges.append(change);
+            }
+            if (schedule) {
+                QMetaObject::invokeMethod(this, "flushAnnotationsChanged", Qt::QueuedConnection);
+            }
         }
     }
 
@@ -122,6 +161,11 @@ namespace Papyro
             d->document->disconnectAnyAreaSelectionChanged(slot_areaSelectionChanged, d);
             d->document->disconnectAnyTextSelectionChanged(slot_textSelectionChanged, d);
         }
+        {
+            // Changes still queued belong to the old document
+            QMutexLocker guard(&d->pendingAnnotationsChangesMutex);
+            d->pendingAnnotationsChanges.clear();
+        }
         d->document = document;
         if (d->document) {
             d->document->connectAnyAnnotationsChanged(slot_annotationsChanged, d);
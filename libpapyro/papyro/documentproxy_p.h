@@ -35,6 +35,8 @@
 #include <papyro/documentproxy.h>
 #include <spine/Document.h>
 
+#include <QList>
+#include <QMutex>
 #include <QObject>
 
 namespace Papyro
@@ -53,6 +55,7 @@ namespace Papyro
         void textSelectionChanged(std::string name, Spine::TextExtentSet extents, bool added);
 
     public slots:
+        void flushAnnotationsChanged();
         void onAnnotationsChanged(const std::string & name, const Spine::AnnotationSet & annotations, bool added);
         void onAreaSelectionChanged(const std::string & name, const Spine::AreaSet & areas, bool added);
         void onTextSelectionChanged(const std::string & name, const Spine::TextExtentSet & extents, bool added);
@@ -62,6 +65,18 @@ namespace Papyro
         Spine::DocumentHandle document;
 
         DocumentProxy::State state;
+
+        // Annotation changes made on other threads are queued here and
+        // delivered together, with consecutive changes of the same kind to
+        // the same list merged into one
+        struct AnnotationsChange
+        {
+            std::string name;
+            Spine::AnnotationSet annotations;
+            bool added;
+        };
+        QList< AnnotationsChange > pendingAnnotationsChanges;
+        QMutex pendingAnnotationsChangesMutex;
     }; // class DocumentProxy
 
 
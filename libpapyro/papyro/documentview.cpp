@@ -59,6 +59,7 @@
 #include <QMenu>
 #include <QMimeData>
 #include <QPainter>
+#include <QRegion>
 #include <QScrollBar>
 #include <QSignalMapper>
 #include <QStyle>
@@ -1373,6 +1374,7 @@ namespace Papyro
         //qDebug() << "onHorizontalScrollBarValueChanged" << value;
         layout_updatePageViewPositions();
         layout_calculateHorizontalOrigin();
+        prefetchPages();
     }
 
     void DocumentViewPrivate::onLeftToRightFlow()
@@ -1471,6 +1473,7 @@ namespace Papyro
         //qDebug() << "onVerticalScrollBarValueChanged" << value;
         layout_updatePageViewPositions();
         layout_calculateVerticalOrigin();
+        prefetchPages();
     }
 
     void DocumentViewPrivate::onWaitingForDblClickTimeout()
@@ -1515,6 +1518,74 @@ namespace Papyro
         }
     }
 
+    void DocumentViewPrivate::prefetchPages()
+    {
+        if (pageViews.isEmpty()) {
+            return;
+        }
+
+        QSize viewport(documentView->viewport()->size());
+        QRect viewRect(QPoint(documentView->horizontalScrollBar()->value(),
+                              documentView->verticalScrollBar()->value()), viewport);
+
+        // Estimate the scroll velocity, ignoring jumps (from the pager, say)
+        // and pauses, which say nothing about where the user is heading
+        QPoint delta(viewRect.topLeft() - scrolling.position);
+        int elapsed = scrolling.time.isNull() ? 0 : scrolling.time.elapsed();
+        scrolling.position = viewRect.topLeft();
+        scrolling.time.start();
+        if (elapsed <= 0 || elapsed > 500 ||
+            qAbs(delta.x()) > 2 * viewport.width() ||
+            qAbs(delta.y()) > 2 * viewport.height()) {
+            scrolling.velocity = QPointF();
+        } else {
+            scrolling.velocity = (scrolling.velocity + QPointF(delta) / elapsed) / 2.0;
+        }
+
+        // Look a second ahead in the direction of travel (between one and
+        // four viewports), or a little either way when at rest
+        QRect ahead(viewRect);
+        int reachY = qBound(viewport.height(), (int) qAbs(scrolling.velocity.y() * 1000), 4 * viewport.height());
+        int reachX = qBound(viewport.width(), (int) qAbs(scrolling.velocity.x() * 1000), 4 * viewport.width());
+        if (scrolling.velocity.y() > 0) {
+            ahead.setBottom(ahead.bottom() + reachY);
+        } else if (scrolling.velocity.y() < 0) {
+            ahead.setTop(ahead.top() - reachY);
+        } else {
+            ahead.adjust(0, -viewport.height() / 2, 0, viewport.height());
+        }
+        if (scrolling.velocity.x() > 0) {
+            ahead.setRight(ahead.right() + reachX);
+        } else if (scrolling.velocity.x() < 0) {
+            ahead.setLeft(ahead.left() - reachX);
+        }
+
+        // What is already on screen will be rendered anyway, so only the
+        // rest is prefetched, nearest first
+        QRegion offscreen(QRegion(ahead).subtracted(viewRect));
+        QMultiMap< int, QPair< PageView *, QRect > > predicted;
+        QPoint centre(viewRect.center());
+        for (size_t r = 0; r < layout.matrix.shape()[0]; ++r) {
+            for (size_t c = 0; c < layout.matrix.shape()[1]; ++c) {
+                const Layout::Cell & cell = layout.matrix[r][c];
+                if (cell.pageView) {
+                    foreach (const QRect & wanted, offscreen.intersected(QRect(cell.pos, cell.pageView->size())).rects()) {
+                        int distance = (wanted.center() - centre).manhattanLength();
+                        predicted.insert(distance, qMakePair(cell.pageView, wanted.translated(-cell.pos)));
+                    }
+                }
+            }
+        }
+
+        // Abandon the previous prediction before making a new one
+        PageView::cancelPrefetches();
+        QMapIterator< int, QPair< PageView *, QRect > > iter(predicted);
+        while (iter.hasNext()) {
+            iter.next();
+            iter.value().first->prefetch(iter.value().second);
+        }
+    }
+
     DocumentViewPrivate::InteractionState DocumentViewPrivate::primaryInteractionState() const
     {
         return interaction.states.isEmpty() ? IdleState : interaction.states.first();
@@ -1997,6 +2068,7 @@ namespace Papyro
                 layout_updatePageViewPositions();
 
                 updateScrollBars();
+                prefetchPages();
             }
             running = false;
         }
@@ -2665,6 +2737,11 @@ namespace Papyro
         }
     }
 
+    double DocumentView::prefetchHitRate() const
+    {
+        return PageView::prefetchHitRate();
+    }
+
     void DocumentView::resizeEvent(QResizeEvent * event)
     {
         d->update_layout(SizeChange);
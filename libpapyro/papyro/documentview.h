@@ -146,6 +146,7 @@ namespace Papyro
         PageFlowDirection pageFlowDirection() const;
         PageMode pageMode() const;
         PageView * pageView(int page) const;
+        double prefetchHitRate() const; // Over every view, as they share their tiles
         OptionState saveState() const;
         Spine::TextExtentSet search(const QString & term, int options=0);
         void setPageSlider(QAbstractSlider * slider);
@@ -47,6 +47,8 @@
 #include <QMap>
 #include <QObject>
 #include <QPicture>
+#include <QPointF>
+#include <QTime>
 
 class QBoxLayout;
 class QSignalMapper;
@@ -268,6 +270,13 @@ namespace Papyro
         QPoint panStartPos;
         QPoint panStartOffset;
 
+        // Scrolling, for predicting which pages to render next
+        struct {
+            QPoint position;
+            QTime time;
+            QPointF velocity; // pixels per millisecond
+        } scrolling;
+
         // Layout calculation cache
         class Layout {
         public:
@@ -341,6 +350,7 @@ namespace Papyro
         void layout_updatePageViewSizes();
         void layout_updatePageViewPositions();
 
+        void prefetchPages();
         void updatePageOutlines();
         void updateScrollBars();
         void updateScrollBarPolicies();
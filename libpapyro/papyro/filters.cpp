@@ -31,9 +31,15 @@
 
 #include <papyro/filters.h>
 #include <papyro/abstractbibliography.h>
+#include <papyro/fulltextindex.h>
 
 #include <QDateTime>
+#include <QFutureWatcher>
+#include <QPointer>
 #include <QRegExp>
+#include <QSet>
+#include <QTimer>
+#include <QtConcurrent>
 
 #include <QDebug>
 
@@ -202,6 +208,93 @@ namespace Athenaeum
 
 
 
+    class FullTextFilterPrivate
+    {
+    public:
+        QPointer< FullTextIndex > index;
+        QString string;
+        QSet< QString > keys;
+
+        // Searches run in the background once typing pauses
+        QTimer timer;
+        QFutureWatcher< QSet< QString > > watcher;
+        QString searching;
+    }; // class FullTextFilterPrivate
+
+    FullTextFilter::FullTextFilter(FullTextIndex * index, QObject * parent)
+        : AbstractFilter(parent), d(new FullTextFilterPrivate)
+    {
+        d->index = index;
+        if (index) {
+            connect(index, SIGNAL(indexChanged()), this, SLOT(onIndexChanged()));
+        }
+
+        d->timer.setSingleShot(true);
+        d->timer.setInterval(250);
+        connect(&d->timer, SIGNAL(timeout()), this, SLOT(search()));
+        connect(&d->watcher, SIGNAL(finished()), this, SLOT(onSearchFinished()));
+    }
+
+    FullTextFilter::~FullTextFilter()
+    {
+        d->watcher.waitForFinished();
+        delete d;
+    }
+
+    bool FullTextFilter::accepts(const QModelIndex & index) const
+    {
+        CitationHandle citation = index.data(Citation::ItemRole).value< CitationHandle >();
+        return citation && d->keys.contains(citation->field(Citation::KeyRole).toString());
+    }
+
+    void FullTextFilter::onIndexChanged()
+    {
+        // Newly indexed documents may now match
+        if (!d->string.isEmpty()) {
+            d->timer.start();
+        }
+    }
+
+    void FullTextFilter::onSearchFinished()
+    {
+        // Only the results for the latest text are of any use
+        if (d->searching == d->string) {
+            d->keys = d->watcher.result();
+            emit filterChanged();
+        } else if (!d->string.isEmpty()) {
+            search();
+        }
+    }
+
+    void FullTextFilter::search()
+    {
+        if (d->watcher.isRunning()) {
+            return; // Searched again when it finishes
+        }
+        if (d->index) {
+            d->searching = d->string;
+            d->watcher.setFuture(QtConcurrent::run(d->index.data(), &FullTextIndex::search, d->string));
+        } else {
+            d->keys.clear();
+            emit filterChanged();
+        }
+    }
+
+    void FullTextFilter::setFixedString(const QString & string)
+    {
+        d->string = string;
+        if (string.isEmpty()) {
+            d->timer.stop();
+            d->keys.clear();
+            emit filterChanged();
+        } else {
+            d->timer.start();
+        }
+    }
+
+
+
+
     StarredFilter::StarredFilter(QObject * parent)
         : AbstractFilter(parent)
     {}
@@ -91,6 +91,31 @@ namespace Athenaeum
 
 
 
+    class FullTextIndex;
+    class FullTextFilterPrivate;
+    class FullTextFilter : public AbstractFilter
+    {
+        Q_OBJECT
+
+    public:
+        FullTextFilter(FullTextIndex * index, QObject * parent = 0);
+        ~FullTextFilter();
+
+        bool accepts(const QModelIndex & index) const;
+        void setFixedString(const QString & string);
+
+    protected slots:
+        void onIndexChanged();
+        void onSearchFinished();
+        void search();
+
+    protected:
+        FullTextFilterPrivate * d;
+    }; // class FullTextFilter
+
+
+
+
     class StarredFilter : public AbstractFilter
     {
         Q_OBJECT
@@ -0,0 +1,469 @@
+/*****************************************************************************
+ *  
+ *   This file is part of the Utopia Documents application.
+ *       Copyright (c) 2008-2017 Lost Island Labs
+ *           <info@utopiadocs.com>
+ *   
+ *   Utopia Documents is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU GENERAL PUBLIC LICENSE VERSION 3 as
+ *   published by the Free Software Foundation.
+ *   
+ *   Utopia Documents is distributed in the hope that it will be useful, but
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ *   Public License for more details.
+ *   
+ *   In addition, as a special exception, the copyright holders give
+ *   permission to link the code of portions of this program with the OpenSSL
+ *   library under certain conditions as described in each individual source
+ *   file, and distribute linked combinations including the two.
+ *   
+ *   You must obey the GNU General Public License in all respects for all of
+ *   the code used other than OpenSSL. If you modify file(s) with this
+ *   exception, you may extend this exception to your version of the file(s),
+ *   but you are not obligated to do so. If you do not wish to do so, delete
+ *   this exception statement from your version.
+ *   
+ *   You should have received a copy of the GNU General Public License
+ *   along with Utopia Documents. If not, see <http://www.gnu.org/licenses/>
+ *  
+ *****************************************************************************/
+
+#include <papyro/fulltextindex_p.h>
+#include <papyro/fulltextindex.h>
+#include <papyro/bibliography.h>
+#include <spine/TextIndex.h>
+
+#include <QDataStream>
+#include <QDateTime>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QUrl>
+
+#include <algorithm>
+#include <iterator>
+
+#include <QDebug>
+
+namespace Athenaeum
+{
+
+    static const quint32 vocabularyMagic = 0x55544656; // "UTFV"
+    static const quint32 vocabularyVersion = 1;
+
+    FullTextIndexJob::FullTextIndexJob(const QString & key, const QString & objectFile, bool rebuild)
+        : key(key), objectFile(objectFile), rebuild(rebuild)
+    {}
+
+
+
+
+    FullTextIndexRunnable::FullTextIndexRunnable(FullTextIndexPrivate * d)
+        : d(d), documentManager(Papyro::DocumentManager::instance())
+    {}
+
+    void FullTextIndexRunnable::run()
+    {
+        FullTextIndexJob job = d->next();
+        if (job.key.isEmpty() || d->isCancelled()) {
+            return;
+        }
+
+        // Use the stored index if it is still valid, otherwise open the
+        // document and index it from scratch
+        QByteArray indexFile(QFile::encodeName(d->indexFilePath(job.key)));
+        Spine::TextIndexHandle index(new Spine::TextIndex);
+        if (job.rebuild || !index->load(indexFile.constData())) {
+            Spine::DocumentHandle document(documentManager->open(job.objectFile));
+            if (!document || d->isCancelled()) {
+                return;
+            }
+            index = document->textIndex();
+            if (!index->save(indexFile.constData())) {
+                qDebug() << "=== Could not save full-text index" << d->indexFilePath(job.key);
+            }
+        }
+
+        if (!d->isCancelled()) {
+            d->setTerms(job.key, index->terms());
+        }
+
+        // Once the queue has drained, record what has been indexed
+        QMutexLocker lock(&d->mutex);
+        if (d->dirty && d->stack.isEmpty() && !d->cancelled) {
+            d->writeVocabulary();
+        }
+    }
+
+
+
+
+    FullTextIndexPrivate::FullTextIndexPrivate(FullTextIndex * index, Bibliography * bibliography, const QDir & path)
+        : QObject(index), index(index), bibliography(bibliography), path(path), mutex(QMutex::Recursive), cancelled(false), nextDocumentId(0), dirty(false)
+    {
+        // Index in the background, one document at a time
+        threadPool.setMaxThreadCount(1);
+
+        connect(bibliography, SIGNAL(dataChanged(const QModelIndex &, const QModelIndex &, const QVector< int > &)),
+                this, SLOT(onDataChanged(const QModelIndex &, const QModelIndex &, const QVector< int > &)));
+        connect(bibliography, SIGNAL(rowsInserted(const QModelIndex &, int, int)),
+                this, SLOT(onRowsInserted(const QModelIndex &, int, int)));
+        connect(bibliography, SIGNAL(rowsAboutToBeRemoved(const QModelIndex &, int, int)),
+                this, SLOT(onRowsAboutToBeRemoved(const QModelIndex &, int, int)));
+
+        // Start from what was indexed last time, then pick up anything in the
+        // bibliography that has changed since or was never indexed
+        readVocabulary();
+        if (bibliography->rowCount() > 0) {
+            onRowsInserted(QModelIndex(), 0, bibliography->rowCount() - 1);
+        }
+    }
+
+    FullTextIndexPrivate::~FullTextIndexPrivate()
+    {
+        cancel();
+        threadPool.waitForDone();
+        if (dirty) {
+            writeVocabulary();
+        }
+    }
+
+    void FullTextIndexPrivate::cancel()
+    {
+        QMutexLocker lock(&mutex);
+        cancelled = true;
+        stack.clear();
+    }
+
+    QString FullTextIndexPrivate::indexFilePath(const QString & key) const
+    {
+        return path.absoluteFilePath(key);
+    }
+
+    bool FullTextIndexPrivate::isCancelled() const
+    {
+        QMutexLocker lock(&mutex);
+        return cancelled;
+    }
+
+    FullTextIndexJob FullTextIndexPrivate::next()
+    {
+        // Most recently added documents first
+        QMutexLocker lock(&mutex);
+        if (!stack.isEmpty()) {
+            return stack.takeLast();
+        }
+        return FullTextIndexJob();
+    }
+
+    void FullTextIndexPrivate::queue(CitationHandle citation)
+    {
+        QString key(citation->field(Citation::KeyRole).toString());
+        QUrl objectUrl(citation->field(Citation::ObjectFileRole).toUrl());
+        if (key.isEmpty() || !objectUrl.isLocalFile()) {
+            return;
+        }
+
+        QFileInfo objectFile(objectUrl.toLocalFile());
+        if (!objectFile.exists()) {
+            return;
+        }
+
+        // An index older than its document needs rebuilding
+        QFileInfo indexFile(indexFilePath(key));
+        bool rebuild = !indexFile.exists() || indexFile.lastModified() < objectFile.lastModified();
+
+        QMutexLocker lock(&mutex);
+        if (!rebuild && documentIds.contains(key)) {
+            return; // Already in the vocabulary
+        }
+        if (!cancelled) {
+            stack.append(FullTextIndexJob(key, objectFile.absoluteFilePath(), rebuild));
+            FullTextIndexRunnable * runnable = new FullTextIndexRunnable(this);
+            runnable->setAutoDelete(true);
+            threadPool.start(runnable);
+        }
+    }
+
+    bool FullTextIndexPrivate::readVocabulary()
+    {
+        QFile file(vocabularyPath());
+        if (!file.open(QIODevice::ReadOnly)) {
+            return false;
+        }
+        QDataStream stream(&file);
+        stream.setVersion(QDataStream::Qt_5_0);
+        quint32 magic = 0, version = 0, documents = 0, termCount = 0;
+        stream >> magic >> version >> documents;
+        if (stream.status() != QDataStream::Ok || magic != vocabularyMagic || version != vocabularyVersion || documents > file.size()) {
+            return false;
+        }
+
+        // Documents are stored in order, and renumbered from zero
+        QMap< QString, int > ids;
+        QMap< int, QString > keys;
+        for (quint32 id = 0; id < documents; ++id) {
+            QString key;
+            stream >> key;
+            ids[key] = id;
+            keys[id] = key;
+        }
+        std::map< std::string, std::vector< int > > loaded;
+        stream >> termCount;
+        for (quint32 t = 0; t < termCount && stream.status() == QDataStream::Ok; ++t) {
+            QByteArray term;
+            quint32 count = 0;
+            stream >> term >> count;
+            if (count > documents) {
+                return false;
+            }
+            std::vector< int > & containing = loaded[std::string(term.constData(), term.size())];
+            containing.reserve(count);
+            for (quint32 i = 0; i < count; ++i) {
+                quint32 id = 0;
+                stream >> id;
+                if (id >= documents || (!containing.empty() && (int) id <= containing.back())) {
+                    return false;
+                }
+                containing.push_back(id);
+            }
+        }
+        if (stream.status() != QDataStream::Ok) {
+            return false;
+        }
+
+        QMutexLocker lock(&mutex);
+        terms.swap(loaded);
+        documentIds = ids;
+        documentKeys = keys;
+        nextDocumentId = documents;
+        return true;
+    }
+
+    void FullTextIndexPrivate::remove(const QString & key)
+    {
+        // Only done when a document is removed or reindexed, so it's not
+        // worth keeping each document's own terms to hand for this
+        QMutexLocker lock(&mutex);
+        int id = documentIds.value(key, -1);
+        if (id >= 0) {
+            std::map< std::string, std::vector< int > >::iterator found(terms.begin());
+            while (found != terms.end()) {
+                std::vector< int >::iterator doc(std::lower_bound(found->second.begin(), found->second.end(), id));
+                if (doc != found->second.end() && *doc == id) {
+                    found->second.erase(doc);
+                }
+                if (found->second.empty()) {
+                    terms.erase(found++);
+                } else {
+                    ++found;
+                }
+            }
+            documentKeys.remove(id);
+            documentIds.remove(key);
+            dirty = true;
+        }
+    }
+
+    void FullTextIndexPrivate::setTerms(const QString & key, const std::vector< std::string > & newTerms)
+    {
+        {
+            QMutexLocker lock(&mutex);
+            remove(key);
+            int id = nextDocumentId++;
+            std::vector< std::string >::const_iterator term(newTerms.begin());
+            std::vector< std::string >::const_iterator end(newTerms.end());
+            for (; term != end; ++term) {
+                terms[*term].push_back(id);
+            }
+            documentIds[key] = id;
+            documentKeys[id] = key;
+            dirty = true;
+        }
+        emit indexChanged();
+    }
+
+    QString FullTextIndexPrivate::vocabularyPath() const
+    {
+        return path.absoluteFilePath(".vocabulary");
+    }
+
+    bool FullTextIndexPrivate::writeVocabulary()
+    {
+        QMutexLocker lock(&mutex);
+        QSaveFile file(vocabularyPath());
+        if (!file.open(QIODevice::WriteOnly)) {
+            return false;
+        }
+        QDataStream stream(&file);
+        stream.setVersion(QDataStream::Qt_5_0);
+
+        // Document ids have gaps where documents were removed, so they are
+        // stored by their rank instead
+        QMap< int, quint32 > ranks;
+        quint32 rank = 0;
+        stream << vocabularyMagic << vocabularyVersion << (quint32) documentKeys.size();
+        QMapIterator< int, QString > document(documentKeys);
+        while (document.hasNext()) {
+            document.next();
+            ranks[document.key()] = rank++;
+            stream << document.value();
+        }
+        stream << (quint32) terms.size();
+        std::map< std::string, std::vector< int > >::const_iterator term(terms.begin());
+        std::map< std::string, std::vector< int > >::const_iterator end(terms.end());
+        for (; term != end; ++term) {
+            stream << QByteArray::fromRawData(term->first.data(), (int) term->first.size()) << (quint32) term->second.size();
+            std::vector< int >::const_iterator id(term->second.begin());
+            std::vector< int >::const_iterator idEnd(term->second.end());
+            for (; id != idEnd; ++id) {
+                stream << ranks.value(*id);
+            }
+        }
+        if (stream.status() != QDataStream::Ok) {
+            file.cancelWriting();
+        }
+        if (!file.commit()) {
+            return false;
+        }
+        dirty = false;
+        return true;
+    }
+
+    void FullTextIndexPrivate::onDataChanged(const QModelIndex & from, const QModelIndex & to, const QVector< int > & roles)
+    {
+        // Only a new object file needs (re)indexing
+        if (roles.isEmpty() || roles.contains(Citation::ObjectFileRole)) {
+            for (int row = from.row(); row <= to.row(); ++row) {
+                CitationHandle citation(bibliography->data(bibliography->index(row, 0, from.parent()), Citation::ItemRole).value< CitationHandle >());
+                if (citation) {
+                    queue(citation);
+                }
+            }
+        }
+    }
+
+    void FullTextIndexPrivate::onRowsInserted(const QModelIndex & parent, int from, int to)
+    {
+        for (int row = from; row <= to; ++row) {
+            CitationHandle citation(bibliography->data(bibliography->index(row, 0, parent), Citation::ItemRole).value< CitationHandle >());
+            if (citation) {
+                queue(citation);
+            }
+        }
+    }
+
+    void FullTextIndexPrivate::onRowsAboutToBeRemoved(const QModelIndex & parent, int from, int to)
+    {
+        bool removed = false;
+        for (int row = from; row <= to; ++row) {
+            CitationHandle citation(bibliography->data(bibliography->index(row, 0, parent), Citation::ItemRole).value< CitationHandle >());
+            if (citation) {
+                QString key(citation->field(Citation::KeyRole).toString());
+                remove(key);
+                QFile::remove(indexFilePath(key));
+                removed = true;
+            }
+        }
+        if (removed) {
+            emit indexChanged();
+        }
+    }
+
+
+
+
+    FullTextIndex::FullTextIndex(Bibliography * bibliography, const QDir & path, QObject * parent)
+        : QObject(parent), d(new FullTextIndexPrivate(this, bibliography, path))
+    {
+        connect(d, SIGNAL(indexChanged()), this, SIGNAL(indexChanged()));
+    }
+
+    FullTextIndex::~FullTextIndex()
+    {}
+
+    void FullTextIndex::cancel()
+    {
+        d->cancel();
+    }
+
+    bool FullTextIndex::isIndexed(const QString & key) const
+    {
+        QMutexLocker lock(&d->mutex);
+        return d->documentIds.contains(key);
+    }
+
+    QSet< QString > FullTextIndex::search(const QString & text) const
+    {
+        QSet< QString > keys;
+
+        QString query(text.trimmed());
+        bool phrase = query.size() > 1 && query.startsWith('"') && query.endsWith('"');
+        std::vector< std::string > queryTerms(Spine::TextIndex::tokenize(query.toUtf8().constData()));
+        if (queryTerms.empty()) {
+            return keys;
+        }
+
+        // Find the documents containing every term
+        QList< QString > candidates;
+        {
+            QMutexLocker lock(&d->mutex);
+            std::vector< int > matches;
+            for (size_t i = 0; i < queryTerms.size(); ++i) {
+                const std::string & term(queryTerms[i]);
+                std::vector< int > documents;
+                if (!phrase && i == queryTerms.size() - 1) {
+                    // The last word may still be being typed, so match it as
+                    // a prefix of any indexed term
+                    std::map< std::string, std::vector< int > >::const_iterator iter(d->terms.lower_bound(term));
+                    std::map< std::string, std::vector< int > >::const_iterator end(d->terms.end());
+                    for (; iter != end && iter->first.compare(0, term.size(), term) == 0; ++iter) {
+                        std::vector< int > merged;
+                        std::set_union(documents.begin(), documents.end(), iter->second.begin(), iter->second.end(), std::back_inserter(merged));
+                        documents.swap(merged);
+                    }
+                } else {
+                    std::map< std::string, std::vector< int > >::const_iterator found(d->terms.find(term));
+                    if (found != d->terms.end()) {
+                        documents = found->second;
+                    }
+                }
+
+                if (i == 0) {
+                    matches.swap(documents);
+                } else {
+                    std::vector< int > intersection;
+                    std::set_intersection(matches.begin(), matches.end(), documents.begin(), documents.end(), std::back_inserter(intersection));
+                    matches.swap(intersection);
+                }
+                if (matches.empty()) {
+                    break;
+                }
+            }
+
+            std::vector< int >::const_iterator id(matches.begin());
+            std::vector< int >::const_iterator end(matches.end());
+            for (; id != end; ++id) {
+                candidates << d->documentKeys.value(*id);
+            }
+        }
+
+        // Phrases need their word order checking against each document's
+        // stored index
+        if (phrase && queryTerms.size() > 1) {
+            QByteArray utf8(query.mid(1, query.size() - 2).toUtf8());
+            foreach (const QString & key, candidates) {
+                Spine::TextIndex index;
+                if (index.load(QFile::encodeName(d->indexFilePath(key)).constData()) && index.contains(utf8.constData())) {
+                    keys.insert(key);
+                }
+            }
+        } else {
+            keys = candidates.toSet();
+        }
+
+        return keys;
+    }
+
+} // namespace Athenaeum
@@ -0,0 +1,79 @@
+/*****************************************************************************
+ *  
+ *   This file is part of the Utopia Documents application.
+ *       Copyright (c) 2008-2017 Lost Island Labs
+ *           <info@utopiadocs.com>
+ *   
+ *   Utopia Documents is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU GENERAL PUBLIC LICENSE VERSION 3 as
+ *   published by the Free Software Foundation.
+ *   
+ *   Utopia Documents is distributed in the hope that it will be useful, but
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ *   Public License for more details.
+ *   
+ *   In addition, as a special exception, the copyright holders give
+ *   permission to link the code of portions of this program with the OpenSSL
+ *   library under certain conditions as described in each individual source
+ *   file, and distribute linked combinations including the two.
+ *   
+ *   You must obey the GNU General Public License in all respects for all of
+ *   the code used other than OpenSSL. If you modify file(s) with this
+ *   exception, you may extend this exception to your version of the file(s),
+ *   but you are not obligated to do so. If you do not wish to do so, delete
+ *   this exception statement from your version.
+ *   
+ *   You should have received a copy of the GNU General Public License
+ *   along with Utopia Documents. If not, see <http://www.gnu.org/licenses/>
+ *  
+ *****************************************************************************/
+
+#ifndef ATHENAEUM_FULLTEXTINDEX_H
+#define ATHENAEUM_FULLTEXTINDEX_H
+
+#include <QDir>
+#include <QObject>
+#include <QSet>
+#include <QString>
+
+namespace Athenaeum
+{
+
+    class Bibliography;
+
+    // Maintains, in the background, a full-text index of every document in a
+    // bibliography that has an object file, so that the whole library can be
+    // searched by content.
+
+    class FullTextIndexPrivate;
+    class FullTextIndex : public QObject
+    {
+        Q_OBJECT
+
+    public:
+        FullTextIndex(Bibliography * bibliography, const QDir & path, QObject * parent = 0);
+        ~FullTextIndex();
+
+        bool isIndexed(const QString & key) const;
+
+        // Keys of the citations whose documents contain all the words of the
+        // given text (the last of which may be incomplete), or contain it as
+        // an exact phrase if it is wrapped in double quotes; phrases are
+        // checked against the stored indexes, so this is best done off the
+        // GUI thread (it is safe to call from any thread)
+        QSet< QString > search(const QString & text) const;
+
+    public slots:
+        void cancel();
+
+    signals:
+        void indexChanged();
+
+    protected:
+        FullTextIndexPrivate * d;
+    }; // class FullTextIndex
+
+} // namespace Athenaeum
+
+#endif // ATHENAEUM_FULLTEXTINDEX_H
@@ -0,0 +1,139 @@
+/*****************************************************************************
+ *  
+ *   This file is part of the Utopia Documents application.
+ *       Copyright (c) 2008-2017 Lost Island Labs
+ *           <info@utopiadocs.com>
+ *   
+ *   Utopia Documents is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU GENERAL PUBLIC LICENSE VERSION 3 as
+ *   published by the Free Software Foundation.
+ *   
+ *   Utopia Documents is distributed in the hope that it will be useful, but
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ *   Public License for more details.
+ *   
+ *   In addition, as a special exception, the copyright holders give
+ *   permission to link the code of portions of this program with the OpenSSL
+ *   library under certain conditions as described in each individual source
+ *   file, and distribute linked combinations including the two.
+ *   
+ *   You must obey the GNU General Public License in all respects for all of
+ *   the code used other than OpenSSL. If you modify file(s) with this
+ *   exception, you may extend this exception to your version of the file(s),
+ *   but you are not obligated to do so. If you do not wish to do so, delete
+ *   this exception statement from your version.
+ *   
+ *   You should have received a copy of the GNU General Public License
+ *   along with Utopia Documents. If not, see <http://www.gnu.org/licenses/>
+ *  
+ *****************************************************************************/
+
+#ifndef ATHENAEUM_FULLTEXTINDEX_P_H
+#define ATHENAEUM_FULLTEXTINDEX_P_H
+
+#include <papyro/documentmanager.h>
+#include <papyro/citation.h>
+#include <boost/shared_ptr.hpp>
+
+#include <QDir>
+#include <QList>
+#include <QMap>
+#include <QModelIndex>
+#include <QMutex>
+#include <QObject>
+#include <QRunnable>
+#include <QThreadPool>
+#include <QVector>
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace Athenaeum
+{
+
+    class Bibliography;
+    class FullTextIndex;
+
+    class FullTextIndexJob
+    {
+    public:
+        FullTextIndexJob(const QString & key = QString(), const QString & objectFile = QString(), bool rebuild = false);
+
+        QString key;
+        QString objectFile;
+        bool rebuild;
+    }; // class FullTextIndexJob
+
+
+
+
+    class FullTextIndexPrivate : public QObject
+    {
+        Q_OBJECT
+
+    public:
+        FullTextIndexPrivate(FullTextIndex * index, Bibliography * bibliography, const QDir & path);
+        ~FullTextIndexPrivate();
+
+        FullTextIndex * index;
+        Bibliography * bibliography;
+        QDir path;
+        QThreadPool threadPool;
+
+        // Guards everything below
+        mutable QMutex mutex;
+        bool cancelled;
+        QList< FullTextIndexJob > stack;
+
+        // Documents are numbered in the order they are indexed, so that each
+        // term's list of documents stays sorted
+        std::map< std::string, std::vector< int > > terms;
+        QMap< QString, int > documentIds;
+        QMap< int, QString > documentKeys;
+        int nextDocumentId;
+
+        // The terms of every document are kept together in the vocabulary
+        // file, so that starting up doesn't mean reading every stored index;
+        // this says whether it needs writing again
+        bool dirty;
+
+        QString indexFilePath(const QString & key) const;
+        bool isCancelled() const;
+        FullTextIndexJob next();
+        void queue(CitationHandle citation);
+        bool readVocabulary();
+        void remove(const QString & key);
+        void setTerms(const QString & key, const std::vector< std::string > & documentTerms);
+        QString vocabularyPath() const;
+        bool writeVocabulary();
+
+    signals:
+        void indexChanged();
+
+    public slots:
+        void cancel();
+        void onDataChanged(const QModelIndex &, const QModelIndex &, const QVector< int > & roles = QVector< int >());
+        void onRowsInserted(const QModelIndex &, int, int);
+        void onRowsAboutToBeRemoved(const QModelIndex &, int, int);
+    }; // class FullTextIndexPrivate
+
+
+
+
+    class FullTextIndexRunnable : public QRunnable
+    {
+    public:
+        FullTextIndexRunnable(FullTextIndexPrivate * d);
+
+        void run();
+
+    protected:
+        FullTextIndexPrivate * d;
+        boost::shared_ptr< Papyro::DocumentManager > documentManager;
+    }; // class FullTextIndexRunnable
+
+} // namespace Athenaeum
+
+#endif // ATHENAEUM_FULLTEXTINDEX_P_H
@@ -34,6 +34,8 @@
 #include <papyro/collection.h>
 #include <papyro/bibliographicmimedata_p.h>
 #include <papyro/filters.h>
+#include <papyro/fulltextindex.h>
+#include <papyro/objectstore.h>
 #include <papyro/resolverqueue.h>
 #include <papyro/persistencemodel.h>
 #include <papyro/remotequerybibliography.h>
@@ -44,11 +46,14 @@
 
 #include <QDateTime>
 #include <QDir>
+#include <QFile>
+#include <QFutureWatcher>
 #include <QMimeData>
 #include <QPixmap>
 #include <QRegularExpression>
 #include <QStandardPaths>
 #include <QThreadPool>
+#include <QtConcurrent>
 #include <QUrl>
 #include <QUuid>
 
@@ -119,12 +124,17 @@ namespace Athenaeum
           master(0),
           starred(0),
           recent(0),
+          resolverQueue(0),
+          fullTextIndex(0),
+          objectStore(0),
           noCollectionPlaceholder(true),
           noWatchPlaceholder(true)
     {}
 
     LibraryModelPrivate::~LibraryModelPrivate()
-    {}
+    {
+        importPool.waitForDone();
+    }
 
     void LibraryModelPrivate::connectModel(QAbstractItemModel * model)
     {
@@ -191,9 +201,13 @@ namespace Athenaeum
                     CitationHandle citation = index.data(Citation::ItemRole).value< CitationHandle >();
                     QUrl oldObjectPath(citation->field(Citation::ObjectFileRole).toUrl());
                     QString newObjectPath(m->getObjectFilePath(citation));
-                    if (oldObjectPath.isValid() && oldObjectPath.toLocalFile() != newObjectPath) {
+                    // Objects shared with other citations stay where they are
+                    if (oldObjectPath.isValid() && oldObjectPath.toLocalFile() != newObjectPath &&
+                        objectStore->references(oldObjectPath.toLocalFile()) <= 1) {
                         // Move the file and update the object path
                         if (QFile::rename(oldObjectPath.toLocalFile(), newObjectPath)) {
+                            objectStore->move(oldObjectPath.toLocalFile(), newObjectPath);
+                            objectStore->sync();
                             citation->setField(Citation::ObjectFileRole, QUrl::fromLocalFile(newObjectPath));
                         }
                     }
@@ -259,6 +273,11 @@ namespace Athenaeum
             master->persistenceModel()->save(master);
         }
         foreach (QAbstractItemModel * model, models) {
+            // Collections still waiting to be loaded have nothing to save yet
+            Collection * collection = qobject_cast< Collection * >(model);
+            if (collection && unloadedCollections.contains(collection)) {
+                continue;
+            }
             AbstractBibliography * bibliography = qobject_cast< AbstractBibliography * >(model);
             if (bibliography && bibliography->persistenceModel() && bibliography->persistenceModel()->isSaveable()) {
                 bibliography->persistenceModel()->save(model);
@@ -266,6 +285,46 @@ namespace Athenaeum
         }
     }
 
+    void LibraryModelPrivate::onImportFinished()
+    {
+        QFutureWatcher< ObjectFileImportBatch > * watcher = static_cast< QFutureWatcher< ObjectFileImportBatch > * >(sender());
+        ObjectFileImportBatch batch(watcher->result());
+        watcher->deleteLater();
+        objectStore->sync();
+
+        QVector< CitationHandle > citations;
+        QSet< QString > hashes;
+        int skipped = 0;
+        for (int i = 0; i < batch.candidates.size(); ++i) {
+            const ObjectFileImport & import(batch.imports.at(i));
+            if (import.duplicate || (!import.hash.isEmpty() && hashes.contains(import.hash))) {
+                ++skipped;
+                continue;
+            }
+            hashes << import.hash;
+            if (!import.stored.isEmpty()) {
+                batch.candidates[i]->setField(Citation::ObjectFileRole, QUrl::fromLocalFile(import.stored));
+            }
+            citations << batch.candidates[i];
+        }
+
+        // Commit them all with a single insertion, which the resolver queue
+        // then picks up in one go
+        master->appendItems(citations);
+        emit m->filesImported(citations.size(), skipped);
+    }
+
+    void LibraryModelPrivate::onMasterLoaded()
+    {
+        foreach (Collection * collection, unloadedCollections) {
+            if (collection) {
+                collection->setState(AbstractBibliography::IdleState);
+                collection->persistenceModel()->load(collection);
+            }
+        }
+        unloadedCollections.clear();
+    }
+
     QModelIndex LibraryModelPrivate::searchParentIndex() const
     {
         return m->index(5, 0);
@@ -311,8 +370,15 @@ namespace Athenaeum
                 // Ready to kick off any resolution that needs doing
                 d->resolverQueue = new ResolverQueue(d->master, this);
 
+                // Keep the documents' full text indexed alongside their objects
+                d->fullTextIndex = new FullTextIndex(d->master, masterDir.absoluteFilePath("fulltext"), this);
+
+                // Keep track of the object files by their content
+                d->objectStore = new ObjectStore(d->master, masterDir.absoluteFilePath("objects.json"), this);
+
                 Athenaeum::LocalPersistenceModel * persistenceModel = new Athenaeum::LocalPersistenceModel(masterDir.absolutePath(), d->master);
                 d->master->setPersistenceModel(persistenceModel);
+                connect(persistenceModel, SIGNAL(loaded(bool)), d, SLOT(onMasterLoaded()));
                 persistenceModel->load(d->master);
                 d->starred = new SortFilterProxyModel(this);
                 d->starred->setFilter(new StarredFilter(d->starred));
@@ -335,7 +401,10 @@ namespace Athenaeum
                         Collection * collection = new Collection(d->master, this);
                         Athenaeum::CollectionPersistenceModel * persistenceModel = new Athenaeum::CollectionPersistenceModel(dir.absoluteFilePath(), collection);
                         collection->setPersistenceModel(persistenceModel);
-                        persistenceModel->load(collection);
+                        // Collections refer to the master's items, so can only be
+                        // loaded once it has been
+                        collection->setState(AbstractBibliography::BusyState);
+                        d->unloadedCollections.append(collection);
                         appendModel(collection);
                     }
                 } else {
@@ -646,6 +715,11 @@ namespace Athenaeum
         }
     }
 
+    FullTextIndex * LibraryModel::fullTextIndex() const
+    {
+        return d->fullTextIndex;
+    }
+
     static QString sanitise(QString input)
     {
         static QRegularExpression special("[^\\w\\p{Pd}\\p{Ps}\\p{Pe}\\p{Pi}\\p{Pf}\\p{Pc}]+", QRegularExpression::UseUnicodePropertiesOption);
@@ -740,6 +814,51 @@ namespace Athenaeum
         return QVariant();
     }
 
+    // Copy a batch's files into the object store, one after another as
+    // they contend for the same disk anyway
+    static ObjectFileImportBatch importObjectFiles(ObjectStore * objectStore, ObjectFileImportBatch batch)
+    {
+        for (int i = 0; i < batch.imports.size(); ++i) {
+            ObjectFileImport & import(batch.imports[i]);
+
+            // Checking by content first means a duplicate is never copied,
+            // let alone parsed or resolved
+            import.hash = ObjectStore::hashFile(import.source);
+            QString existing(objectStore->find(import.hash));
+            import.duplicate = !existing.isEmpty() && objectStore->references(existing) > 0;
+            if (!import.duplicate) {
+                import.stored = objectStore->store(import.source, import.destination, import.hash);
+            }
+        }
+        return batch;
+    }
+
+    int LibraryModel::importFiles(const QList< QUrl > & urls)
+    {
+        QDateTime now(QDateTime::currentDateTime());
+        ObjectFileImportBatch batch;
+        foreach (const QUrl & url, urls) {
+            if (url.isLocalFile()) {
+                CitationHandle citation(new Citation);
+                citation->setField(Citation::OriginatingUriRole, url);
+                citation->setField(Citation::DateImportedRole, now);
+                ObjectFileImport import = { url.toLocalFile(), getObjectFilePath(citation, ".pdf"), QString(), QString(), false };
+                batch.candidates << citation;
+                batch.imports << import;
+            }
+        }
+
+        // Stream the files into the object store in the background (unresolved
+        // citations are named by their unique keys, so no two copies clash);
+        // the citations are added once they have all been copied
+        if (!batch.imports.isEmpty()) {
+            QFutureWatcher< ObjectFileImportBatch > * watcher = new QFutureWatcher< ObjectFileImportBatch >(d);
+            connect(watcher, SIGNAL(finished()), d, SLOT(onImportFinished()));
+            watcher->setFuture(QtConcurrent::run(&d->importPool, &importObjectFiles, d->objectStore, batch));
+        }
+        return batch.imports.size();
+    }
+
     QModelIndex LibraryModel::index(int row, int column, const QModelIndex & parent) const
     {
         if (!parent.isValid()) {
@@ -941,6 +1060,11 @@ namespace Athenaeum
         return QModelIndex();
     }
 
+    ObjectStore * LibraryModel::objectStore() const
+    {
+        return d->objectStore;
+    }
+
     QModelIndex LibraryModel::parent(const QModelIndex & index) const
     {
         // Get this index's model
@@ -1061,11 +1185,10 @@ namespace Athenaeum
     bool LibraryModel::saveObjectFile(CitationHandle citation, const QByteArray & data, const QString & ext) const
     {
         if (citation && !data.isEmpty()) {
-            QString filePath = getObjectFilePath(citation, ext);
-            QFile file(filePath);
-            if (file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
-                file.write(data);
-                file.close();
+            // Identical content already in the library is shared, not copied
+            QString filePath = d->objectStore->store(data, getObjectFilePath(citation, ext));
+            if (!filePath.isEmpty()) {
+                d->objectStore->sync();
                 citation->setField(Athenaeum::Citation::ObjectFileRole, QUrl::fromLocalFile(filePath));
                 return true;
             }
@@ -38,12 +38,15 @@
 
 #include <QAbstractItemModel>
 #include <QDir>
+#include <QUrl>
 
 class QSortFilterProxyModel;
 
 namespace Athenaeum
 {
 
+    class FullTextIndex;
+    class ObjectStore;
     class RemoteQueryBibliography;
     class ResolverQueue;
 
@@ -93,6 +96,9 @@ namespace Athenaeum
         bool hasObjectFile(CitationHandle citation, const QString & ext = QString(".pdf"));
         bool saveObjectFile(CitationHandle citation, const QByteArray & data, const QString & ext = QString(".pdf")) const;
 
+        // Import local files into the master library as a single batch
+        int importFiles(const QList< QUrl > & urls);
+
         void appendModel(QAbstractItemModel * model);
         void insertModel(QAbstractItemModel * before, QAbstractItemModel * model);
         QAbstractItemModel * modelAt(int idx) const;
@@ -109,6 +115,8 @@ namespace Athenaeum
         bool removeSearch(QAbstractItemModel * model);
 
         ResolverQueue * resolverQueue() const;
+        FullTextIndex * fullTextIndex() const;
+        ObjectStore * objectStore() const;
 
         /////////////////////////////////////////////////////////////////////////////////
         // AbstractItemModel methods
@@ -137,6 +145,11 @@ namespace Athenaeum
 
         static boost::shared_ptr< LibraryModel > instance();
 
+    signals:
+        // A batch from importFiles() is in, less any whose content was
+        // already in the library
+        void filesImported(int imported, int skipped);
+
     protected:
         LibraryModelPrivate * d;
 
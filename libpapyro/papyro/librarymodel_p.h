@@ -37,9 +37,11 @@
 #include <QList>
 #include <QMap>
 #include <QObject>
+#include <QPointer>
 #include <QRunnable>
 #include <QStringList>
 #include <QThreadPool>
+#include <QVector>
 #include <QWeakPointer>
 
 #include <QDebug>
@@ -63,10 +65,30 @@ namespace Athenaeum
     };
 
     class Bibliography;
+    class Collection;
+    class FullTextIndex;
+    class ObjectStore;
     class RemoteQueryBibliography;
     class ResolverQueue;
     class SortFilterProxyModel;
 
+    // A local file being copied into the object store
+    struct ObjectFileImport
+    {
+        QString source;
+        QString destination;
+        QString hash;
+        QString stored; // Where its content ended up in the object store
+        bool duplicate; // Is its content already in the library?
+    };
+
+    // Files imported together, with a citation for each
+    struct ObjectFileImportBatch
+    {
+        QVector< CitationHandle > candidates;
+        QVector< ObjectFileImport > imports;
+    };
+
     class LibraryModel;
     class LibraryModelPrivate : public QObject
     {
@@ -86,6 +108,10 @@ namespace Athenaeum
         QList< RemoteQueryBibliography * > searches;
         QStringList mimeTypes;
         ResolverQueue * resolverQueue;
+        FullTextIndex * fullTextIndex;
+        ObjectStore * objectStore;
+        QThreadPool importPool; // Copying imported files into the object store
+        QList< QPointer< Collection > > unloadedCollections;
 
         bool noCollectionPlaceholder;
         bool noWatchPlaceholder;
@@ -106,6 +132,8 @@ namespace Athenaeum
     public slots:
         // Update of underlying models
         void onDataChanged(const QModelIndex &, const QModelIndex &, const QVector< int > & roles = QVector< int >());
+        void onImportFinished();
+        void onMasterLoaded();
         void onRowsAboutToBeRemoved(const QModelIndex &, int, int);
         void onRowsInserted(const QModelIndex &, int, int);
         void onRowsRemoved(const QModelIndex &, int, int);
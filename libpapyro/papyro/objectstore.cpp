@@ -0,0 +1,398 @@
+/*****************************************************************************
+ *  
+ *   This file is part of the Utopia Documents application.
+ *       Copyright (c) 2008-2017 Lost Island Labs
+ *           <info@utopiadocs.com>
+ *   
+ *   Utopia Documents is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU GENERAL PUBLIC LICENSE VERSION 3 as
+ *   published by the Free Software Foundation.
+ *   
+ *   Utopia Documents is distributed in the hope that it will be useful, but
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ *   Public License for more details.
+ *   
+ *   In addition, as a special exception, the copyright holders give
+ *   permission to link the code of portions of this program with the OpenSSL
+ *   library under certain conditions as described in each individual source
+ *   file, and distribute linked combinations including the two.
+ *   
+ *   You must obey the GNU General Public License in all respects for all of
+ *   the code used other than OpenSSL. If you modify file(s) with this
+ *   exception, you may extend this exception to your version of the file(s),
+ *   but you are not obligated to do so. If you do not wish to do so, delete
+ *   this exception statement from your version.
+ *   
+ *   You should have received a copy of the GNU General Public License
+ *   along with Utopia Documents. If not, see <http://www.gnu.org/licenses/>
+ *  
+ *****************************************************************************/
+
+
+#include <papyro/objectstore_p.h>
+#include <papyro/objectstore.h>
+#include <papyro/bibliography.h>
+
+#include <QCryptographicHash>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QUrl>
+
+#if defined(Q_OS_LINUX)
+#  include <fcntl.h>
+#  include <sys/ioctl.h>
+#  include <unistd.h>
+#  include <linux/fs.h>
+#elif defined(Q_OS_MAC)
+#  include <Availability.h>
+#  if __MAC_OS_X_VERSION_MAX_ALLOWED >= 101200
+#    include <sys/clonefile.h>
+#  endif
+#endif
+
+namespace Athenaeum
+{
+
+    // Make a copy-on-write clone of a file, where the filesystem supports it
+    static bool cloneFile(const QString & from, const QString & to)
+    {
+        QByteArray source(QFile::encodeName(from));
+        QByteArray destination(QFile::encodeName(to));
+#if defined(Q_OS_LINUX) && defined(FICLONE)
+        bool cloned = false;
+        int in = ::open(source.constData(), O_RDONLY);
+        if (in >= 0) {
+            int out = ::open(destination.constData(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+            if (out >= 0) {
+                cloned = (::ioctl(out, FICLONE, in) == 0);
+                ::close(out);
+                if (!cloned) {
+                    ::unlink(destination.constData());
+                }
+            }
+            ::close(in);
+        }
+        return cloned;
+#elif defined(Q_OS_MAC) && __MAC_OS_X_VERSION_MAX_ALLOWED >= 101200
+        return ::clonefile(source.constData(), destination.constData(), 0) == 0;
+#else
+        Q_UNUSED(source);
+        Q_UNUSED(destination);
+        return false;
+#endif
+    }
+
+
+
+
+    ObjectStoreRunnable::ObjectStoreRunnable(ObjectStorePrivate * d)
+        : d(d)
+    {}
+
+    void ObjectStoreRunnable::run()
+    {
+        QString path;
+        while (!(path = d->nextUnhashed()).isEmpty()) {
+            QString digest(ObjectStore::hashFile(path));
+            QMutexLocker lock(&d->mutex);
+            if (!d->cancelled && !digest.isEmpty() && !d->digests.contains(path)) {
+                d->add(digest, path);
+            }
+        }
+    }
+
+
+
+
+    ObjectStorePrivate::ObjectStorePrivate(ObjectStore * store, Bibliography * bibliography, const QString & indexPath)
+        : QObject(store), store(store), bibliography(bibliography), indexPath(indexPath), mutex(QMutex::Recursive), cancelled(false), dirty(false)
+    {
+        // Digest older object files in the background, one at a time
+        threadPool.setMaxThreadCount(1);
+
+        load();
+
+        connect(bibliography, SIGNAL(dataChanged(const QModelIndex &, const QModelIndex &, const QVector< int > &)),
+                this, SLOT(onDataChanged(const QModelIndex &, const QModelIndex &, const QVector< int > &)));
+        connect(bibliography, SIGNAL(rowsInserted(const QModelIndex &, int, int)),
+                this, SLOT(onRowsInserted(const QModelIndex &, int, int)));
+        connect(bibliography, SIGNAL(rowsAboutToBeRemoved(const QModelIndex &, int, int)),
+                this, SLOT(onRowsAboutToBeRemoved(const QModelIndex &, int, int)));
+
+        // Pick up anything already in the bibliography
+        if (bibliography->rowCount() > 0) {
+            onRowsInserted(QModelIndex(), 0, bibliography->rowCount() - 1);
+        }
+    }
+
+    ObjectStorePrivate::~ObjectStorePrivate()
+    {
+        {
+            QMutexLocker lock(&mutex);
+            cancelled = true;
+            unhashed.clear();
+        }
+        threadPool.waitForDone();
+    }
+
+    void ObjectStorePrivate::add(const QString & hash, const QString & path)
+    {
+        QMutexLocker lock(&mutex);
+        forget(path);
+        objects[hash] = path;
+        digests[path] = hash;
+        dirty = true;
+    }
+
+    void ObjectStorePrivate::forget(const QString & path)
+    {
+        QMutexLocker lock(&mutex);
+        QString hash(digests.take(path));
+        if (!hash.isEmpty()) {
+            if (objects.value(hash) == path) {
+                objects.remove(hash);
+            }
+            dirty = true;
+        }
+    }
+
+    void ObjectStorePrivate::load()
+    {
+        QFile file(indexPath);
+        if (file.open(QIODevice::ReadOnly)) {
+            QVariantMap index(QJsonDocument::fromJson(file.readAll()).toVariant().toMap());
+            QMapIterator< QString, QVariant > iter(index);
+            while (iter.hasNext()) {
+                iter.next();
+                QString path(iter.value().toString());
+                objects[iter.key()] = path;
+                digests[path] = iter.key();
+            }
+        }
+    }
+
+    QString ObjectStorePrivate::nextUnhashed()
+    {
+        QMutexLocker lock(&mutex);
+        return (cancelled || unhashed.isEmpty()) ? QString() : unhashed.takeFirst();
+    }
+
+    void ObjectStorePrivate::onDataChanged(const QModelIndex & from, const QModelIndex & to, const QVector< int > & roles)
+    {
+        if (roles.isEmpty() || roles.contains(Citation::ObjectFileRole)) {
+            for (int row = from.row(); row <= to.row(); ++row) {
+                CitationHandle citation(bibliography->data(bibliography->index(row, 0, from.parent()), Citation::ItemRole).value< CitationHandle >());
+                if (citation) {
+                    track(citation);
+                }
+            }
+        }
+    }
+
+    void ObjectStorePrivate::onRowsInserted(const QModelIndex & parent, int from, int to)
+    {
+        for (int row = from; row <= to; ++row) {
+            CitationHandle citation(bibliography->data(bibliography->index(row, 0, parent), Citation::ItemRole).value< CitationHandle >());
+            if (citation) {
+                track(citation);
+            }
+        }
+    }
+
+    void ObjectStorePrivate::onRowsAboutToBeRemoved(const QModelIndex & parent, int from, int to)
+    {
+        for (int row = from; row <= to; ++row) {
+            CitationHandle citation(bibliography->data(bibliography->index(row, 0, parent), Citation::ItemRole).value< CitationHandle >());
+            if (citation) {
+                untrack(citation);
+            }
+        }
+    }
+
+    void ObjectStorePrivate::track(CitationHandle citation)
+    {
+        QString key(citation->field(Citation::KeyRole).toString());
+        QUrl objectUrl(citation->field(Citation::ObjectFileRole).toUrl());
+        QString path(objectUrl.isLocalFile() ? objectUrl.toLocalFile() : QString());
+
+        QMutexLocker lock(&mutex);
+        if (key.isEmpty() || citationObjects.value(key) == path) {
+            return;
+        }
+
+        untrack(citation);
+        if (!path.isEmpty()) {
+            citationObjects[key] = path;
+            ++references[path];
+
+            // Anything not yet known by its content needs digesting
+            if (!digests.contains(path) && !cancelled) {
+                bool idle = unhashed.isEmpty();
+                unhashed.append(path);
+                if (idle) {
+                    ObjectStoreRunnable * runnable = new ObjectStoreRunnable(this);
+                    runnable->setAutoDelete(true);
+                    threadPool.start(runnable);
+                }
+            }
+        }
+    }
+
+    void ObjectStorePrivate::untrack(CitationHandle citation)
+    {
+        QString key(citation->field(Citation::KeyRole).toString());
+
+        QMutexLocker lock(&mutex);
+        QString path(citationObjects.take(key));
+        if (!path.isEmpty() && --references[path] <= 0) {
+            references.remove(path);
+        }
+    }
+
+
+
+
+    ObjectStore::ObjectStore(Bibliography * bibliography, const QString & indexPath, QObject * parent)
+        : QObject(parent), d(new ObjectStorePrivate(this, bibliography, indexPath))
+    {}
+
+    ObjectStore::~ObjectStore()
+    {
+        sync();
+    }
+
+    QString ObjectStore::find(const QString & hash) const
+    {
+        QMutexLocker lock(&d->mutex);
+        QString path(d->objects.value(hash));
+        if (!path.isEmpty() && !QFileInfo(path).exists()) {
+            // Deleted behind our back
+            d->forget(path);
+            path.clear();
+        }
+        return path;
+    }
+
+    QString ObjectStore::hash(const QByteArray & data)
+    {
+        return QString::fromLatin1(QCryptographicHash::hash(data, QCryptographicHash::Sha256).toHex());
+    }
+
+    QString ObjectStore::hashFile(const QString & path)
+    {
+        QFile file(path);
+        if (file.open(QIODevice::ReadOnly)) {
+            QCryptographicHash hash(QCryptographicHash::Sha256);
+            if (hash.addData(&file)) {
+                return QString::fromLatin1(hash.result().toHex());
+            }
+        }
+        return QString();
+    }
+
+    void ObjectStore::move(const QString & from, const QString & to)
+    {
+        QMutexLocker lock(&d->mutex);
+        QString hash(d->digests.value(from));
+        if (!hash.isEmpty()) {
+            d->forget(from);
+            d->add(hash, to);
+        }
+    }
+
+    int ObjectStore::references(const QString & path) const
+    {
+        QMutexLocker lock(&d->mutex);
+        return d->references.value(path, 0);
+    }
+
+    void ObjectStore::remove(const QString & path)
+    {
+        d->forget(path);
+    }
+
+    QString ObjectStore::store(const QString & sourcePath, const QString & path, const QString & hash)
+    {
+        QString digest(hash.isEmpty() ? hashFile(sourcePath) : hash);
+        if (digest.isEmpty()) {
+            return QString();
+        }
+
+        // Already have it?
+        QString existing(find(digest));
+        if (!existing.isEmpty()) {
+            return existing;
+        }
+
+        if (!cloneFile(sourcePath, path) && !QFile::copy(sourcePath, path)) {
+            return QString();
+        }
+
+        // Another thread may have stored the same content in the meantime
+        QMutexLocker lock(&d->mutex);
+        existing = find(digest);
+        if (!existing.isEmpty() && existing != path) {
+            QFile::remove(path);
+            return existing;
+        }
+        d->add(digest, path);
+        return path;
+    }
+
+    QString ObjectStore::store(const QByteArray & data, const QString & path)
+    {
+        QString digest(hash(data));
+
+        // Already have it?
+        QString existing(find(digest));
+        if (!existing.isEmpty()) {
+            return existing;
+        }
+
+        QFile file(path);
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate) || file.write(data) != data.size()) {
+            return QString();
+        }
+        file.close();
+
+        QMutexLocker lock(&d->mutex);
+        d->add(digest, path);
+        return path;
+    }
+
+    bool ObjectStore::sync()
+    {
+        QVariantMap index;
+        {
+            QMutexLocker lock(&d->mutex);
+            if (!d->dirty) {
+                return true;
+            }
+            QHashIterator< QString, QString > iter(d->objects);
+            while (iter.hasNext()) {
+                iter.next();
+                index[iter.key()] = iter.value();
+            }
+            d->dirty = false;
+        }
+
+        // Write to a scratch file first so a partial index is never loaded
+        QString scratch(d->indexPath + ".tmp");
+        QFile file(scratch);
+        if (file.open(QIODevice::WriteOnly | QIODevice::Truncate) &&
+            file.write(QJsonDocument::fromVariant(index).toJson(QJsonDocument::Compact)) >= 0) {
+            file.close();
+            QFile::remove(d->indexPath);
+            if (QFile::rename(scratch, d->indexPath)) {
+                return true;
+            }
+        }
+        QMutexLocker lock(&d->mutex);
+        d->dirty = true;
+        return false;
+    }
+
+} // namespace Athenaeum
@@ -0,0 +1,89 @@
+/*****************************************************************************
+ *  
+ *   This file is part of the Utopia Documents application.
+ *       Copyright (c) 2008-2017 Lost Island Labs
+ *           <info@utopiadocs.com>
+ *   
+ *   Utopia Documents is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU GENERAL PUBLIC LICENSE VERSION 3 as
+ *   published by the Free Software Foundation.
+ *   
+ *   Utopia Documents is distributed in the hope that it will be useful, but
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ *   Public License for more details.
+ *   
+ *   In addition, as a special exception, the copyright holders give
+ *   permission to link the code of portions of this program with the OpenSSL
+ *   library under certain conditions as described in each individual source
+ *   file, and distribute linked combinations including the two.
+ *   
+ *   You must obey the GNU General Public License in all respects for all of
+ *   the code used other than OpenSSL. If you modify file(s) with this
+ *   exception, you may extend this exception to your version of the file(s),
+ *   but you are not obligated to do so. If you do not wish to do so, delete
+ *   this exception statement from your version.
+ *   
+ *   You should have received a copy of the GNU General Public License
+ *   along with Utopia Documents. If not, see <http://www.gnu.org/licenses/>
+ *  
+ *****************************************************************************/
+
+
+#ifndef ATHENAEUM_OBJECTSTORE_H
+#define ATHENAEUM_OBJECTSTORE_H
+
+#include <QByteArray>
+#include <QObject>
+#include <QString>
+
+namespace Athenaeum
+{
+
+    class Bibliography;
+
+    // Keeps track of a bibliography's object files by the SHA-256 of their
+    // content (the digest behind PDFDocument::filehash()) and by how many
+    // citations refer to each, so that the same document is only ever
+    // stored once however many times it is imported.
+
+    class ObjectStorePrivate;
+    class ObjectStore : public QObject
+    {
+        Q_OBJECT
+
+    public:
+        ObjectStore(Bibliography * bibliography, const QString & indexPath, QObject * parent = 0);
+        ~ObjectStore();
+
+        // Hex SHA-256 digests of some content
+        static QString hash(const QByteArray & data);
+        static QString hashFile(const QString & path);
+
+        // Path of the stored object with the given digest, if there is one
+        QString find(const QString & hash) const;
+        // How many citations refer to an object file
+        int references(const QString & path) const;
+
+        // Store a file or some data at the given path, unless the same
+        // content is already stored, returning the path of the stored
+        // object (or an empty string on failure). Files are cloned rather
+        // than copied where the filesystem allows it. These may be called
+        // from any thread.
+        QString store(const QString & sourcePath, const QString & path, const QString & hash = QString());
+        QString store(const QByteArray & data, const QString & path);
+
+        // An object file has been moved or deleted
+        void move(const QString & from, const QString & to);
+        void remove(const QString & path);
+
+        // Write the index to disk
+        bool sync();
+
+    protected:
+        ObjectStorePrivate * d;
+    }; // class ObjectStore
+
+} // namespace Athenaeum
+
+#endif // ATHENAEUM_OBJECTSTORE_H
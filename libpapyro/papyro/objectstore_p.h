@@ -0,0 +1,108 @@
+/*****************************************************************************
+ *  
+ *   This file is part of the Utopia Documents application.
+ *       Copyright (c) 2008-2017 Lost Island Labs
+ *           <info@utopiadocs.com>
+ *   
+ *   Utopia Documents is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU GENERAL PUBLIC LICENSE VERSION 3 as
+ *   published by the Free Software Foundation.
+ *   
+ *   Utopia Documents is distributed in the hope that it will be useful, but
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ *   Public License for more details.
+ *   
+ *   In addition, as a special exception, the copyright holders give
+ *   permission to link the code of portions of this program with the OpenSSL
+ *   library under certain conditions as described in each individual source
+ *   file, and distribute linked combinations including the two.
+ *   
+ *   You must obey the GNU General Public License in all respects for all of
+ *   the code used other than OpenSSL. If you modify file(s) with this
+ *   exception, you may extend this exception to your version of the file(s),
+ *   but you are not obligated to do so. If you do not wish to do so, delete
+ *   this exception statement from your version.
+ *   
+ *   You should have received a copy of the GNU General Public License
+ *   along with Utopia Documents. If not, see <http://www.gnu.org/licenses/>
+ *  
+ *****************************************************************************/
+
+
+#ifndef ATHENAEUM_OBJECTSTORE_P_H
+#define ATHENAEUM_OBJECTSTORE_P_H
+
+#include <papyro/citation.h>
+
+#include <QHash>
+#include <QList>
+#include <QModelIndex>
+#include <QMutex>
+#include <QObject>
+#include <QRunnable>
+#include <QThreadPool>
+#include <QVector>
+
+namespace Athenaeum
+{
+
+    class Bibliography;
+    class ObjectStore;
+
+    class ObjectStorePrivate : public QObject
+    {
+        Q_OBJECT
+
+    public:
+        ObjectStorePrivate(ObjectStore * store, Bibliography * bibliography, const QString & indexPath);
+        ~ObjectStorePrivate();
+
+        ObjectStore * store;
+        Bibliography * bibliography;
+        QString indexPath;
+        QThreadPool threadPool;
+
+        // Guards everything below
+        mutable QMutex mutex;
+        bool cancelled;
+        bool dirty;
+        QHash< QString, QString > objects; // digest -> path
+        QHash< QString, QString > digests; // path -> digest
+        QHash< QString, int > references; // path -> citation count
+        QHash< QString, QString > citationObjects; // citation key -> path
+        QList< QString > unhashed; // paths still to be digested
+
+        void add(const QString & hash, const QString & path);
+        void forget(const QString & path);
+        void load();
+        QString nextUnhashed();
+        void track(CitationHandle citation);
+        void untrack(CitationHandle citation);
+
+    public slots:
+        void onDataChanged(const QModelIndex &, const QModelIndex &, const QVector< int > & roles = QVector< int >());
+        void onRowsInserted(const QModelIndex &, int, int);
+        void onRowsAboutToBeRemoved(const QModelIndex &, int, int);
+    }; // class ObjectStorePrivate
+
+
+
+
+    // Digests, in the background, object files that were stored before
+    // they were tracked by content
+
+    class ObjectStoreRunnable : public QRunnable
+    {
+    public:
+        ObjectStoreRunnable(ObjectStorePrivate * d);
+
+        void run();
+
+    protected:
+        ObjectStorePrivate * d;
+    }; // class ObjectStoreRunnable
+
+} // namespace Athenaeum
+
+#endif // ATHENAEUM_OBJECTSTORE_P_H
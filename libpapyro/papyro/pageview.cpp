@@ -78,6 +78,7 @@
 #include <QSettings>
 #include <QSignalMapper>
 #include <QTemporaryFile>
+#include <QThread>
 #include <QTime>
 #include <QTimer>
 #include <QToolTip>
@@ -380,71 +381,290 @@ bool operator < (const QRectF & lhs, const QRectF & rhs)
 namespace Papyro
 {
 
-    /// PageViewRenderThread //////////////////////////////////////////////////////////////////////
+    /// PageViewTileCache /////////////////////////////////////////////////////////////////////////
 
-    PageViewRenderThread::PageViewRenderThread(PageView * pageView)
-        : QThread(pageView), _pageView(pageView), _dirty(false)
+    const int PageViewTileCache::tileSize;
+    const int PageViewTileCache::minimumLevel;
+    const int PageViewTileCache::maximumLevel;
+
+    PageViewTileCache::PageViewTileCache()
+        : QObject(QCoreApplication::instance()), _generation(0), _requests(0), _prefetchers(0), _hits(0), _misses(0), _documentSerial(0)
+    {
+        // Rendered tiles are shared by every window, up to 256MB of pixels
+        _tiles.setMaxCost(256 * 1024 * 1024);
+
+        // Leave a core free for the interface
+        _threadPool.setMaxThreadCount(qMax(1, QThread::idealThreadCount() - 1));
+    }
+
+    void PageViewTileCache::cancelPrefetches()
+    {
+        // Abandon the prefetches yet to start, letting go of their documents
+        QList< PageViewTileRenderer * > abandoned;
+        {
+            QMutexLocker guard(&_mutex);
+            ++_generation;
+            abandoned.swap(_prefetchQueue);
+            foreach (PageViewTileRenderer * renderer, abandoned) {
+                _pending.remove(renderer->tileKey());
+            }
+        }
+        qDeleteAll(abandoned);
+    }
+
+    void PageViewTileCache::clear(const QString & pageKey, const PageView * view)
+    {
+        // Other views may still be showing the same page
+        {
+            QMutexLocker guard(&_mutex);
+            QMap< QString, QMap< const PageView *, int > >::iterator wanted(_wanted.find(pageKey));
+            if (wanted != _wanted.end()) {
+                wanted.value().remove(view);
+                if (!wanted.value().isEmpty()) {
+                    return;
+                }
+                _wanted.erase(wanted);
+            }
+        }
+
+        foreach (const QString & key, _pageTiles.take(pageKey)) {
+            _tiles.remove(key);
+            _prefetched.remove(key);
+        }
+    }
+
+    QString PageViewTileCache::documentKey(Spine::DocumentHandle document)
     {
-        QObject::connect(this, SIGNAL(finished()), pageView, SLOT(renderThreadFinished()));
+        // Forget documents that have since gone away
+        QMutableMapIterator< const Spine::Document *, QPair< boost::weak_ptr< Spine::Document >, int > > iter(_documents);
+        while (iter.hasNext()) {
+            iter.next();
+            if (iter.value().first.expired()) {
+                iter.remove();
+            }
+        }
+
+        QMap< const Spine::Document *, QPair< boost::weak_ptr< Spine::Document >, int > >::iterator found(_documents.find(document.get()));
+        if (found == _documents.end()) {
+            found = _documents.insert(document.get(), qMakePair(boost::weak_ptr< Spine::Document >(document), ++_documentSerial));
+        }
+        return QString::number(found.value().second);
     }
 
-    PageViewRenderThread::~PageViewRenderThread() {}
+    PageViewTileCache * PageViewTileCache::instance()
+    {
+        static PageViewTileCache * cache = new PageViewTileCache;
+        return cache;
+    }
 
-    bool PageViewRenderThread::isDirty()
+    double PageViewTileCache::hitRate() const
     {
-        QMutexLocker lock(&this->_mutex);
-        return this->_dirty;
+        return (_hits + _misses) > 0 ? _hits / (double) (_hits + _misses) : 0.0;
     }
 
-    QImage PageViewRenderThread::image()
+    bool PageViewTileCache::isWanted(const QString & pageKey, int level, const QString & tileKey)
     {
-        QMutexLocker lock(&this->_mutex);
-        return this->_image;
+        QMutexLocker guard(&_mutex);
+        QMap< QString, int >::const_iterator pending(_pending.find(tileKey));
+        if (pending == _pending.end() || (pending.value() >= 0 && pending.value() != _generation)) {
+            return false;
+        }
+
+        // Wanted if any view showing the page is at this level or finer
+        foreach (int wanted, _wanted.value(pageKey)) {
+            if (level <= wanted) {
+                return true;
+            }
+        }
+        return false;
     }
 
-    void PageViewRenderThread::run()
+    int PageViewTileCache::levelFor(double scale)
     {
-        // Get parameters of this rendering
-        QSize size;
-        QColor paper;
-        this->getTarget(&size, &paper);
-        Spine::Image i;
+        // Round up, so that tiles are never magnified
+        int level = scale > 0 ? (int) ceil(2.0 * log(scale) / log(2.0) - 0.01) : minimumLevel;
+        return qBound(minimumLevel, level, maximumLevel);
+    }
 
-        // Render
+    void PageViewTileCache::onTileRendered(const QString & pageKey, const QString & tileKey, const QImage & image)
+    {
+        bool prefetched = false;
+        bool wanted = false;
         {
-            QMutexLocker lock(&this->_globalMutex);
-            if (this->_pageView) {
-              i = this->_pageView->page()->render(size_t(size.width()),
-                                                  size_t(size.height()));
+            QMutexLocker guard(&_mutex);
+            prefetched = _pending.take(tileKey) >= 0;
+            wanted = _wanted.contains(pageKey);
+        }
+
+        // A page cleared while this tile was rendering no longer wants it
+        if (wanted && !image.isNull()) {
+            if (prefetched) {
+                _prefetched.insert(tileKey);
             }
+            QPixmap * pixmap = new QPixmap(QPixmap::fromImage(image));
+            _tiles.insert(tileKey, pixmap, pixmap->width() * pixmap->height() * pixmap->depth() / 8);
+            _pageTiles[pageKey].insert(tileKey);
+            emit tileRendered(pageKey);
         }
+    }
 
-        // Set image
-        QMutexLocker lock(&this->_mutex);
-        this->_image = qImageFromSpineImage(&i);
+    void PageViewTileCache::request(Spine::DocumentHandle document, int pageNumber, const QString & pageKey, int level, int column, int row, bool prefetch)
+    {
+        const QString key(tileKey(pageKey, level, column, row));
+        if (_tiles.contains(key)) {
+            if (!prefetch && _prefetched.remove(key)) {
+                ++_hits;
+            }
+            return;
+        }
+
+        _prefetched.remove(key); // Evicted before it was shown
+
+        QMutexLocker guard(&_mutex);
+        QMap< QString, int >::iterator pending(_pending.find(key));
+        if (prefetch) {
+            if (pending == _pending.end()) {
+                // Prefetches are queued here rather than in the pool, so that
+                // they can be abandoned; they always come after tiles on
+                // screen, nearest (first requested) first
+                _pending[key] = _generation;
+                _prefetchQueue.append(new PageViewTileRenderer(document, pageNumber, pageKey, level, column, row));
+                if (_prefetchers < _threadPool.maxThreadCount()) {
+                    ++_prefetchers;
+                    _threadPool.start(new PageViewTilePrefetcher, -1);
+                }
+            } else if (pending.value() >= 0) {
+                pending.value() = _generation;
+            }
+        } else {
+            if (pending == _pending.end()) {
+                ++_misses;
+                // Later requests are for more recently exposed areas, so
+                // render them first
+                _pending[key] = -1;
+                _threadPool.start(new PageViewTileRenderer(document, pageNumber, pageKey, level, column, row), ++_requests);
+            } else if (pending.value() >= 0) {
+                // Still waiting for a prefetch, which jumps the queue unless
+                // it has already started
+                ++_misses;
+                pending.value() = -1;
+                for (int i = 0; i < _prefetchQueue.size(); ++i) {
+                    if (_prefetchQueue.at(i)->tileKey() == key) {
+                        _threadPool.start(_prefetchQueue.takeAt(i), ++_requests);
+                        break;
+                    }
+                }
+            }
+        }
     }
 
-    void PageViewRenderThread::setTarget(QSize size, QColor color)
+    void PageViewTileCache::runPrefetch()
     {
-        QMutexLocker lock(&this->_mutex);
-        if (size != this->_size ||
-            color != this->_color)
+        PageViewTileRenderer * renderer = 0;
         {
-            this->_dirty = true;
+            QMutexLocker guard(&_mutex);
+            if (_prefetchQueue.isEmpty()) {
+                --_prefetchers;
+                return;
+            }
+            renderer = _prefetchQueue.takeFirst();
+        }
+
+        renderer->run();
+        delete renderer;
+
+        // Go back to the end of the pool's queue, so that any tiles that have
+        // since come on screen are rendered before the next prefetch
+        QMutexLocker guard(&_mutex);
+        if (_prefetchQueue.isEmpty()) {
+            --_prefetchers;
+        } else {
+            _threadPool.start(new PageViewTilePrefetcher, -1);
         }
-        this->_size = size;
-        this->_color = color;
     }
 
-    void PageViewRenderThread::getTarget(QSize * size, QColor * color)
+    double PageViewTileCache::scaleOf(int level)
     {
-        QMutexLocker lock(&this->_mutex);
-        *size = this->_size * Utopia::retinaScaling();
-        *color = this->_color;
-        this->_dirty = false;
+        return pow(2.0, level / 2.0);
     }
 
-    QMutex PageViewRenderThread::_globalMutex;
+    void PageViewTileCache::setWanted(const QString & pageKey, const PageView * view, int level)
+    {
+        QMutexLocker guard(&_mutex);
+        _wanted[pageKey][view] = level;
+    }
+
+    QPixmap PageViewTileCache::tile(const QString & pageKey, int level, int column, int row)
+    {
+        QPixmap * pixmap = _tiles.object(tileKey(pageKey, level, column, row));
+        return pixmap ? *pixmap : QPixmap();
+    }
+
+    QString PageViewTileCache::tileKey(const QString & pageKey, int level, int column, int row)
+    {
+        return QString("%1/%2/%3/%4").arg(pageKey).arg(level).arg(column).arg(row);
+    }
+
+
+
+
+    /// PageViewTileRenderer //////////////////////////////////////////////////////////////////////
+
+    PageViewTileRenderer::PageViewTileRenderer(Spine::DocumentHandle document, int pageNumber, const QString & pageKey, int level, int column, int row)
+        : _document(document), _pageNumber(pageNumber), _pageKey(pageKey), _level(level), _column(column), _row(row)
+    {}
+
+    void PageViewTileRenderer::run()
+    {
+        PageViewTileCache * cache = PageViewTileCache::instance();
+        QImage image;
+
+        // Don't bother if the page has since been zoomed out past this
+        // level, or if this was a prefetch that is no longer predicted
+        const QString tileKey(this->tileKey());
+        if (_document && cache->isWanted(_pageKey, _level, tileKey)) {
+            Spine::CursorHandle cursor(_document->newCursor(_pageNumber));
+            if (const Spine::Page * page = cursor->page()) {
+                Spine::BoundingBox bb(page->boundingBox());
+                double scale = PageViewTileCache::scaleOf(_level);
+                QRectF levelRect(0, 0, (bb.x2 - bb.x1) * scale, (bb.y2 - bb.y1) * scale);
+                QRectF tileRect(QRectF(_column * PageViewTileCache::tileSize,
+                                       _row * PageViewTileCache::tileSize,
+                                       PageViewTileCache::tileSize,
+                                       PageViewTileCache::tileSize) & levelRect);
+                if (!tileRect.isEmpty()) {
+                    Spine::BoundingBox slice(tileRect.left() / scale, tileRect.top() / scale,
+                                             tileRect.right() / scale, tileRect.bottom() / scale);
+                    Spine::Image rendered(page->renderArea(slice, 72.0 * scale));
+                    image = qImageFromSpineImage(&rendered);
+                }
+            }
+        }
+
+        // The cache lives in the GUI thread
+        QMetaObject::invokeMethod(cache, "onTileRendered", Qt::QueuedConnection,
+                                  Q_ARG(QString, _pageKey),
+                                  Q_ARG(QString, tileKey),
+                                  Q_ARG(QImage, image));
+    }
+
+
+
+
+    QString PageViewTileRenderer::tileKey() const
+    {
+        return PageViewTileCache::tileKey(_pageKey, _level, _column, _row);
+    }
+
+
+
+
+    /// PageViewTilePrefetcher ////////////////////////////////////////////////////////////////////
+
+    void PageViewTilePrefetcher::run()
+    {
+        PageViewTileCache::instance()->runPrefetch();
+    }
 
 
 
@@ -457,17 +677,11 @@ namespace Papyro
           userTransformDegrees(0),
           rotateMapper(0),
           rotateMenu(0),
-          renderThread(new PageViewRenderThread(pageView)),
-          imageCache(QString(":page-cache:%1").arg((qlonglong) pageView->window())),
           dragging(false),
           multiClick(false),
           tripleClick(false),
           imageFormatManager(Utopia::ImageFormatManager::instance())
-    {
-        // Seems reasonable that no more than 20 pages will be visible at once
-        // in a single window
-        imageCache.setMaximumSize(20);
-    }
+    {}
 
     void PageViewPrivate::browseUrl(const QString & url, const QString & target)
     {
@@ -479,6 +693,43 @@ namespace Papyro
         emit urlRequested(url, target);
     }
 
+    // Draw the tiles of a zoom level that cover the target rectangle (in
+    // canvas coordinates), returning false if any of them were missing. With
+    // no painter, this just checks (and optionally requests) the tiles.
+    bool PageViewPrivate::drawTiles(QPainter * painter, const QRectF & target, const QSizeF & canvasSize, int level, bool render, bool prefetch)
+    {
+        PageViewTileCache * cache = PageViewTileCache::instance();
+        QSizeF levelSize(pageSize() * PageViewTileCache::scaleOf(level));
+        double toCanvas = canvasSize.width() / levelSize.width();
+        QRectF levelTarget(target.left() / toCanvas, target.top() / toCanvas,
+                           target.width() / toCanvas, target.height() / toCanvas);
+        levelTarget &= QRectF(QPointF(0, 0), levelSize);
+
+        bool complete = true;
+        int size = PageViewTileCache::tileSize;
+        int firstColumn = (int) floor(levelTarget.left() / size);
+        int lastColumn = (int) ceil(levelTarget.right() / size) - 1;
+        int firstRow = (int) floor(levelTarget.top() / size);
+        int lastRow = (int) ceil(levelTarget.bottom() / size) - 1;
+        for (int row = firstRow; row <= lastRow; ++row) {
+            for (int column = firstColumn; column <= lastColumn; ++column) {
+                if (render) {
+                    cache->request(document, pageView->pageNumber(), cacheName, level, column, row, prefetch);
+                }
+                QPixmap tile(cache->tile(cacheName, level, column, row));
+                if (tile.isNull()) {
+                    complete = false;
+                } else if (painter) {
+                    QRectF tileRect(QRectF(column * size, row * size, size, size) & QRectF(QPointF(0, 0), levelSize));
+                    painter->drawPixmap(QRectF(tileRect.left() * toCanvas, tileRect.top() * toCanvas,
+                                              tileRect.width() * toCanvas, tileRect.height() * toCanvas),
+                                       tile, QRectF(QPointF(0, 0), tile.size()));
+                }
+            }
+        }
+        return complete;
+    }
+
     QRectF PageViewPrivate::mediaRect() const
     {
         Spine::BoundingBox bb(cursor->page()->mediaBox());
@@ -501,6 +752,12 @@ namespace Papyro
         return pageRect().size();
     }
 
+    // The zoom level whose tiles are at least as sharp as the screen
+    int PageViewPrivate::tileLevel(const QSizeF & canvasSize) const
+    {
+        return PageViewTileCache::levelFor(canvasSize.width() * Utopia::retinaScaling() / pageSize().width());
+    }
+
     // Set interaction state for mouse press
     void PageViewPrivate::setMousePressPos(const QPoint & pos)
     {
@@ -764,14 +1021,16 @@ namespace Papyro
         return path.simplified();
     }
 
+    void PageView::cancelPrefetches()
+    {
+        PageViewTileCache::instance()->cancelPrefetches();
+    }
+
     void PageView::clear()
     {
         // Disconnect from model
         d->documentProxy.reset();
 
-        // Wait for render thread
-        d->renderThread->wait();
-
         // Clear overlays
         clearSpotlights();
         clearTemporaryFocus();
@@ -792,8 +1051,8 @@ namespace Papyro
         d->linkedWidgets.clear();
         d->embeddedRects.clear();
 
-        // Clear image cache
-        d->imageCache.clear();
+        // Forget this page's tiles
+        PageViewTileCache::instance()->clear(d->cacheName, this);
 
         // Zero state
         d->previousSelectedImageCursor.reset();
@@ -1078,6 +1337,9 @@ namespace Papyro
         // Passthru
         connect(d, SIGNAL(urlRequested(const QUrl &, const QString &)), this, SIGNAL(urlRequested(const QUrl &, const QString &)));
 
+        // Tiled rendering
+        connect(PageViewTileCache::instance(), SIGNAL(tileRendered(const QString &)), this, SLOT(onTileRendered(const QString &)));
+
         // Phrase lookups
         std::set< PhraseLookup * > phraseLookups = Utopia::instantiateAllExtensions< PhraseLookup >();
         BOOST_FOREACH(PhraseLookup * lookup, phraseLookups)
@@ -1215,24 +1477,16 @@ namespace Papyro
     {
     }
 
-    const Spine::Page * PageView::page() const
+    void PageView::onTileRendered(const QString & pageKey)
     {
-        return d->cursor->page();
+        if (pageKey == d->cacheName) {
+            update();
+        }
     }
 
-    QPixmap PageView::pageImage(QSize size, QColor paper)
+    const Spine::Page * PageView::page() const
     {
-        QPixmap pageImage = d->imageCache.get(d->cacheName);
-
-        if (size != pageImage.size()) {
-            d->renderThread->setTarget(size, paper);
-            bool running = d->renderThread->isRunning();
-            if (!running) {
-                d->renderThread->start();
-            }
-        }
-
-        return pageImage;
+        return d->cursor->page();
     }
 
     int PageView::pageNumber() const
@@ -1268,13 +1522,28 @@ namespace Papyro
             // Find the size of the page (before user transform) in screen
             // coordinates
             QSize pImageSize = d->unapplyUserTransform(size()).toSize();
-            QPixmap pImage = pageImage(d->unapplyUserTransform(size()).toSize());
-
-            if (pImage.isNull())
+            QTransform transform(generateTransform(d->userTransformDegrees, pImageSize));
+            QRectF exposed(transform.inverted().mapRect(QRectF(event->rect())) & QRectF(QPointF(0, 0), pImageSize));
+
+            // Choose the zoom level whose tiles are at least as sharp as the
+            // screen, and a coarse one that covers the page in a tile or so
+            PageViewTileCache * cache = PageViewTileCache::instance();
+            QSizeF pagePoints(d->pageSize());
+            int level = d->tileLevel(pImageSize);
+            int previewLevel = qMin(level, PageViewTileCache::levelFor(PageViewTileCache::tileSize / qMax(pagePoints.width(), pagePoints.height())));
+            cache->setWanted(d->cacheName, this, level);
+
+            // Request any missing tiles, then fill in with whatever coarser
+            // tiles are available while they render
+            bool complete = d->drawTiles(0, exposed, pImageSize, level, true);
+            bool previewed = complete || d->drawTiles(0, exposed, pImageSize, previewLevel, true);
+
+            painter.fillRect(rect(), Qt::white);
+            if (!previewed)
             {
                 // Draw "PDF" while page is being rendered
+                painter.save();
                 painter.setRenderHint(QPainter::Antialiasing);
-                painter.fillRect(rect(), Qt::white);
                 QRect spinner = rect();
                 if (spinner.width() > spinner.height())
                 {
@@ -1292,69 +1561,61 @@ namespace Papyro
                 painter.setFont(font);
                 painter.setPen(QColor(0, 0, 0, 50));
                 painter.drawText(spinner, Qt::AlignCenter, "PDF");
+                painter.restore();
+            }
 
-                // If active spotlight, grey out
-                if (!d->spotlightsHidden && !d->darkness.isEmpty())
-                {
-                    painter.setCompositionMode(QPainter::CompositionMode_Multiply);
-                    painter.setPen(Qt::NoPen);
-                    painter.setBrush(QColor(0, 0, 0, 100));
-                    painter.drawRect(rect().adjusted(0, 0, 1, 1));
+            painter.setTransform(transform, true);
+
+            // Render the page tiles to the widget, coarsest first
+            painter.save();
+            painter.setRenderHint(QPainter::SmoothPixmapTransform);
+            painter.setClipRect(exposed);
+            if (!complete && previewLevel < level) {
+                d->drawTiles(&painter, exposed, pImageSize, previewLevel, false);
+                for (int fallback = qMax(previewLevel + 1, level - 4); fallback < level; ++fallback) {
+                    d->drawTiles(&painter, exposed, pImageSize, fallback, false);
                 }
             }
-            else
-            {
-                QTransform transform(generateTransform(d->userTransformDegrees, pImageSize));
-                painter.setTransform(transform, true);
-
-                // Render the page image to the widget
+            d->drawTiles(&painter, exposed, pImageSize, level, false);
+            painter.restore();
+
+            // Scale to current zoom
+            painter.scale(width() / (double) pSize.width(),
+                          height() / (double) pSize.height());
+            //painter.translate(-0.5, -0.5);
+
+            // Antialias
+            painter.setRenderHint(QPainter::Antialiasing, true);
+            painter.setRenderHint(QPainter::TextAntialiasing, true);
+            painter.setPen(Qt::NoPen);
+            painter.setBrush(QColor(255, 0, 0, 80));
+            painter.setCompositionMode(QPainter::CompositionMode_Multiply);
+
+            if (!d->spotlightsHidden) {
+                // Render search spotlights
                 painter.save();
-                painter.setRenderHint(QPainter::SmoothPixmapTransform);
-                foreach (QRect rect, event->region().rects()) {
-                    rect = transform.mapRect(rect);
-                    painter.drawPixmap(rect, pImage, rect);
-                }
-                painter.drawPixmap(QRect(QPoint(0, 0), pImageSize), pImage);
-                painter.restore();
-
-                // Scale to current zoom
-                painter.scale(width() / (double) pSize.width(),
-                              height() / (double) pSize.height());
-                //painter.translate(-0.5, -0.5);
-
-                // Antialias
-                painter.setRenderHint(QPainter::Antialiasing, true);
-                painter.setRenderHint(QPainter::TextAntialiasing, true);
-                painter.setPen(Qt::NoPen);
-                painter.setBrush(QColor(255, 0, 0, 80));
                 painter.setCompositionMode(QPainter::CompositionMode_Multiply);
 
-                if (!d->spotlightsHidden) {
-                    // Render search spotlights
-                    painter.save();
-                    painter.setCompositionMode(QPainter::CompositionMode_Multiply);
-
-                    painter.setPen(Qt::NoPen);
-                    painter.setBrush(QColor(0, 0, 0, 50));
-                    painter.drawPath(d->darkness);
-
-                    painter.setPen(QColor(140, 140, 0));
-                    QPen pen(painter.pen());
-                    pen.setWidth(2);
-                    painter.setPen(pen);
-                    painter.setBrush(QColor(255, 255, 0, 200));
-                    painter.drawPath(d->bubble);
-                    painter.restore();
-                }
+                painter.setPen(Qt::NoPen);
+                painter.setBrush(QColor(0, 0, 0, 50));
+                painter.drawPath(d->darkness);
+
+                painter.setPen(QColor(140, 140, 0));
+                QPen pen(painter.pen());
+                pen.setWidth(2);
+                painter.setPen(pen);
+                painter.setBrush(QColor(255, 255, 0, 200));
+                painter.drawPath(d->bubble);
+                painter.restore();
+            }
 
-                if (!d->temporaryFocusHidden) {
-                    painter.save();
-                    painter.setCompositionMode(QPainter::CompositionMode_Multiply);
-                    painter.setPen(QColor(0, 200, 0, 220));
-                    painter.setBrush(QColor(0, 220, 0, 80));
-                    painter.drawPath(d->temporaryFocus);
-                    painter.restore();
-                }
+            if (!d->temporaryFocusHidden) {
+                painter.save();
+                painter.setCompositionMode(QPainter::CompositionMode_Multiply);
+                painter.setPen(QColor(0, 200, 0, 220));
+                painter.setBrush(QColor(0, 220, 0, 80));
+                painter.drawPath(d->temporaryFocus);
+                painter.restore();
             }
         }
     }
@@ -1368,6 +1629,29 @@ namespace Papyro
         }
     }
 
+    double PageView::prefetchHitRate()
+    {
+        return PageViewTileCache::instance()->hitRate();
+    }
+
+    void PageView::prefetch(const QRect & rect)
+    {
+        if (!isNull()) {
+            QSize pImageSize = d->unapplyUserTransform(size()).toSize();
+            QTransform transform(generateTransform(d->userTransformDegrees, pImageSize));
+            QRectF target(QRectF(QPointF(0, 0), pImageSize));
+            if (!rect.isNull()) {
+                target &= transform.inverted().mapRect(QRectF(rect));
+            }
+
+            if (!target.isEmpty()) {
+                int level = d->tileLevel(pImageSize);
+                PageViewTileCache::instance()->setWanted(d->cacheName, this, level);
+                d->drawTiles(0, target, pImageSize, level, true, true);
+            }
+        }
+    }
+
     void PageView::recomputeDarkness()
     {
         // Darken whole page
@@ -1444,13 +1728,6 @@ namespace Papyro
         d->temporaryFocus.setFillRule(Qt::WindingFill);
     }
 
-    void PageView::renderThreadFinished()
-    {
-        QPixmap pageImage = QPixmap::fromImage(d->renderThread->image());
-        d->imageCache.put(pageImage, d->cacheName);
-        update();
-    }
-
     void PageView::resizeEvent(QResizeEvent * event)
     {
         QWidget::resizeEvent(event);
@@ -1627,7 +1904,12 @@ namespace Papyro
             connect(defaultAction, SIGNAL(toggled(bool)), resetAction, SLOT(setDisabled(bool)));
         }
 
-        d->cacheName = QString("%1-%2").arg(pageNumber).arg((qulonglong) document().get());
+        // Tiles are keyed by document instance, as hashing its content here
+        // would hold up the first paint
+        if (!d->cacheName.isEmpty()) {
+            PageViewTileCache::instance()->clear(d->cacheName, this);
+        }
+        d->cacheName = QString("%1-%2").arg(pageNumber).arg(PageViewTileCache::instance()->documentKey(document()));
     }
 
     void PageView::setRotation(int degrees)
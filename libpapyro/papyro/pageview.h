@@ -121,6 +121,7 @@ namespace Papyro
         QRectF pageRect(bool transformed = false) const;
         QSizeF pageSize(bool transformed = false) const;
         void populateContextMenuAt(QMenu * menu, const QPoint & pos);
+        void prefetch(const QRect & rect = QRect()); // Render ahead of being shown
         void resizeToHeight(int h);
         void resizeToSize(const QSize & size);
         void resizeToWidth(int w);
@@ -141,6 +142,8 @@ namespace Papyro
         // Public static helpers methods
         static QPainterPath asPath(const Spine::TextExtentHandle & extent, int pageNumber);
         static QPainterPath asPath(const Spine::TextSelection & selection, int pageNumber);
+        static void cancelPrefetches();
+        static double prefetchHitRate();
 
     public slots:
         void setHorizontalZoom(double zoom);
@@ -172,7 +175,6 @@ namespace Papyro
         void recomputeDarkness();
         void recomputeTemporaryFocus();
         void resizeEvent(QResizeEvent * event);
-        QPixmap pageImage(QSize size, QColor paperColour = Qt::white);
         void paintEvent(QPaintEvent * event);
 
     protected Q_SLOTS:
@@ -180,7 +182,7 @@ namespace Papyro
         void copyEmailAddress();
         void executePhraseLookup(int idx);
         void onMousePressTimeout();
-        void renderThreadFinished();
+        void onTileRendered(const QString & pageKey);
         void saveImageAs();
 
     private:
@@ -51,13 +51,14 @@
 #  include <spine/Region.h>
 #  include <spine/TextIterator.h>
 #  include <spine/TextSelection.h>
+#  include <boost/weak_ptr.hpp>
 #endif
 
 #include <utopia2/auth/qt/conversation.h>
 #include <utopia2/networkaccessmanager.h>
-#include <utopia2/qt/cache.h>
 #include <utopia2/qt/imageformatmanager.h>
 
+#include <QCache>
 #include <QColor>
 #include <QImage>
 #include <QList>
@@ -72,46 +73,117 @@
 #include <QPointF>
 #include <QRect>
 #include <QRectF>
+#include <QRunnable>
+#include <QSet>
 #include <QSize>
 #include <QString>
 #include <QSvgRenderer>
-#include <QThread>
+#include <QThreadPool>
 #include <QTime>
 #include <QTimer>
 #include <QTransform>
 
+class QPainter;
 class QSignalMapper;
 
 namespace Papyro
 {
 
-    class PageViewRenderThread : public QThread
+    class PageViewTileRenderer;
+
+    // Pages are rendered in square tiles at a discrete set of zoom levels,
+    // each a factor of sqrt(2) larger than the last, so that only the
+    // visible part of a page is ever rendered, and tiles can be reused
+    // across small changes of zoom.
+    class PageViewTileCache : public QObject
     {
         Q_OBJECT
 
     public:
-        PageViewRenderThread(PageView * pageView);
-        ~PageViewRenderThread();
+        static const int tileSize = 256;
+        static const int minimumLevel = -12;
+        static const int maximumLevel = 16;
+
+        static PageViewTileCache * instance();
+
+        // Discrete zoom levels
+        static int levelFor(double scale);
+        static double scaleOf(int level);
+
+        // Prefetched tiles are rendered after any tiles on screen, and
+        // are abandoned if not yet started when the prediction changes
+        void cancelPrefetches();
+        void clear(const QString & pageKey, const PageView * view);
+        QString documentKey(Spine::DocumentHandle document); // Unique to this document instance
+        double hitRate() const; // Of tiles shown, how many were prefetched
+        bool isWanted(const QString & pageKey, int level, const QString & tileKey);
+        void request(Spine::DocumentHandle document, int pageNumber, const QString & pageKey, int level, int column, int row, bool prefetch = false);
+        void runPrefetch(); // Called from the pool to render the next prefetch
+        void setWanted(const QString & pageKey, const PageView * view, int level);
+        QPixmap tile(const QString & pageKey, int level, int column, int row);
+
+        static QString tileKey(const QString & pageKey, int level, int column, int row);
 
-        bool isDirty();
-        QImage image();
-        void run();
-        void setTarget(QSize size, QColor color);
+    signals:
+        void tileRendered(const QString & pageKey);
 
     protected:
-        void getTarget(QSize * size, QColor * color);
+        PageViewTileCache();
+
+    protected slots:
+        void onTileRendered(const QString & pageKey, const QString & tileKey, const QImage & image);
 
     private:
-        QPointer< PageView > _pageView;
-        QSize _size;
-        QColor _color;
+        // Rendered tiles shared by every page view, limited by size in bytes
+        QCache< QString, QPixmap > _tiles;
+        QMap< QString, QSet< QString > > _pageTiles; // page -> tiles (some perhaps since evicted)
+        QThreadPool _threadPool;
         QMutex _mutex;
-        QImage _image;
-        bool _dirty;
+        QMap< QString, int > _pending; // tile -> prefetch generation, or -1 if on screen
+        QMap< QString, QMap< const PageView *, int > > _wanted; // page -> view -> level
+        int _generation;
+        int _requests;
+
+        // Prefetches yet to start, and how many runnables are taking them
+        QList< PageViewTileRenderer * > _prefetchQueue;
+        int _prefetchers;
 
-        static QMutex _globalMutex;
+        // How many tiles were ready (having been prefetched) when first shown
+        QSet< QString > _prefetched;
+        int _hits;
+        int _misses;
+
+        // Documents seen, each with a serial that is never reused, as a
+        // later document may be allocated where an earlier one was
+        QMap< const Spine::Document *, QPair< boost::weak_ptr< Spine::Document >, int > > _documents;
+        int _documentSerial;
+
+    }; // class PageViewTileCache
+
+    class PageViewTileRenderer : public QRunnable
+    {
+    public:
+        PageViewTileRenderer(Spine::DocumentHandle document, int pageNumber, const QString & pageKey, int level, int column, int row);
+
+        void run();
+        QString tileKey() const;
+
+    private:
+        Spine::DocumentHandle _document;
+        int _pageNumber;
+        QString _pageKey;
+        int _level;
+        int _column;
+        int _row;
+
+    }; // class PageViewTileRenderer
+
+    class PageViewTilePrefetcher : public QRunnable
+    {
+    public:
+        void run();
 
-    }; // class PageViewRenderThread
+    }; // class PageViewTilePrefetcher
 
 
 
@@ -161,10 +233,10 @@ namespace Papyro
         // Decorations
         PageView::PageDecorations decorations;
 
-        // Image cache
+        // Tiled page rendering
         QString cacheName;
-        boost::scoped_ptr< PageViewRenderThread > renderThread;
-        Utopia::Cache< QPixmap > imageCache;
+        bool drawTiles(QPainter * painter, const QRectF & target, const QSizeF & canvasSize, int level, bool render, bool prefetch = false);
+        int tileLevel(const QSizeF & canvasSize) const;
 
         // Mouse press/release variables
         QPoint mousePressPos;
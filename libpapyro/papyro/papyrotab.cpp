@@ -53,6 +53,7 @@
 #include <papyro/librarymodel.h>
 #include <papyro/citation.h>
 
+#include <utopia2/global.h>
 #include <utopia2/qt/flowbrowser.h>
 #include <utopia2/qt/spinner.h>
 #include <utopia2/qt/hidpi.h>
@@ -60,8 +61,11 @@
 #include <QAction>
 #include <QApplication>
 #include <QClipboard>
+#include <QDateTime>
 #include <QDesktopServices>
 #include <QDesktopWidget>
+#include <QDir>
+#include <QFile>
 #include <QFileInfo>
 #include <QJsonDocument>
 #include <QLabel>
@@ -69,10 +73,14 @@
 #include <QMenu>
 #include <QNetworkReply>
 #include <QPainter>
+#include <QRegExp>
 #include <QResizeEvent>
+#include <QSet>
 #include <QSplitterHandle>
 #include <QStackedLayout>
+#include <QThread>
 #include <QVBoxLayout>
+#include <QtConcurrent>
 
 #include <QDebug>
 
@@ -222,16 +230,120 @@ namespace Papyro
 
 
 
+    // Once built, a document's text index narrows down every search of it
+    static void buildTextIndex(Spine::DocumentHandle document)
+    {
+        document->textIndex();
+    }
+
+
+
+
+    /// PagerThumbnailRenderer ////////////////////////////////////////////////////////////////
+
+    // How many documents' thumbnails to keep on disk
+    static const int maximumStoredThumbnailDocuments = 200;
+
+    // Open (creating if necessary) a document's thumbnail store, marking it as
+    // recently used and discarding the least recently used stores beyond the limit
+    static QString openThumbnailStore(const std::string & filehashDigest)
+    {
+        QDir root(Utopia::profile_path(Utopia::ProfileData) + "/thumbnails");
+        // Stores are named by the digest that ends the fingerprint IRI, so that
+        // each is a single directory directly beneath the root
+        QRegExp digest("[0-9A-Fa-f]+");
+        QString name(QString::fromStdString(filehashDigest));
+        if (!digest.exactMatch(name) || !root.mkpath(name)) {
+            return QString();
+        }
+        QFile used(root.absoluteFilePath(name + "/used"));
+        if (used.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            used.write(QDateTime::currentDateTime().toString(Qt::ISODate).toUtf8());
+            used.close();
+        }
+
+        QMap< QDateTime, QString > stores;
+        foreach (const QString & store, root.entryList(QDir::Dirs | QDir::NoDotAndDotDot)) {
+            if (!digest.exactMatch(store)) {
+                // Not a store of ours (e.g. left over from when they were
+                // named by the whole fingerprint), so leave it well alone
+                continue;
+            }
+            stores.insertMulti(QFileInfo(root.absoluteFilePath(store + "/used")).lastModified(), store);
+        }
+        QMapIterator< QDateTime, QString > iter(stores);
+        for (int excess = stores.size() - maximumStoredThumbnailDocuments; excess > 0 && iter.hasNext(); --excess) {
+            iter.next();
+            if (iter.value() != name) {
+                QDir(root.absoluteFilePath(iter.value())).removeRecursively();
+            }
+        }
+
+        return root.absoluteFilePath(name);
+    }
+
+    PagerThumbnailRenderer::PagerThumbnailRenderer(QObject * target, int generation, Spine::DocumentHandle document, int index, const QSize & size, const QString & storePath)
+        : _target(target), _generation(generation), _document(document), _index(index), _size(size), _storePath(storePath)
+    {}
+
+    void PagerThumbnailRenderer::run()
+    {
+        // Thumbnails should never compete with the page view's own rendering
+        QThread::currentThread()->setPriority(QThread::LowPriority);
+
+        QString stored;
+        QImage image;
+        if (!_storePath.isEmpty()) {
+            stored = QString("%1/%2-%3x%4.png").arg(_storePath).arg(_index + 1).arg(_size.width()).arg(_size.height());
+            image.load(stored, "PNG");
+        }
+
+        if (image.isNull() && _document) {
+            Spine::CursorHandle cursor(_document->newCursor(_index + 1));
+            if (const Spine::Page * page = cursor->page()) {
+                Spine::Image rendered(page->render(size_t(_size.width()), size_t(_size.height())));
+                image = qImageFromSpineImage(&rendered);
+
+                // Write to a scratch file first so a partial thumbnail is never loaded
+                if (!stored.isEmpty() && !image.isNull() && image.save(stored + ".tmp", "PNG")) {
+                    QFile::remove(stored);
+                    QFile::rename(stored + ".tmp", stored);
+                }
+            }
+        }
+
+        QMetaObject::invokeMethod(_target, "onPagerImageRendered", Qt::QueuedConnection,
+                                  Q_ARG(int, _generation), Q_ARG(int, _index), Q_ARG(QImage, image));
+    }
+
+    PagerStoreOpener::PagerStoreOpener(QObject * target, int generation, Spine::DocumentHandle document)
+        : _target(target), _generation(generation), _document(document)
+    {}
+
+    void PagerStoreOpener::run()
+    {
+        // Hashing the document and tidying the stores can both take a while
+        QString path(openThumbnailStore(_document->filehashDigest()));
+        QMetaObject::invokeMethod(_target, "onPagerStoreOpened", Qt::QueuedConnection,
+                                  Q_ARG(int, _generation), Q_ARG(QString, path));
+    }
+
+
+
+
     /// PapyroTabPrivate ////////////////////////////////////////////////////////////////
 
     PapyroTabPrivate::PapyroTabPrivate(PapyroTab * tab)
         : QObject(tab), tab(tab), progress(-1.0), state(PapyroTab::UninitialisedState),
-          documentManager(DocumentManager::instance()), activeSelectionProcessorAction(0),
-          ready(false)
+          documentManager(DocumentManager::instance()), pagerGeneration(0), pagerPending(0),
+          activeSelectionProcessorAction(0), ready(false)
     {
         // Create a new bus for this tab
         setBus(new Utopia::Bus(this));
 
+        // Leave most of the machine to the page view and annotators
+        pagerPool.setMaxThreadCount(qMax(1, QThread::idealThreadCount() / 2));
+
         // Collect decorators
         foreach (Decorator * decorator, Utopia::instantiateAllExtensions< Decorator >()) {
             decorators.append(decorator);
@@ -243,6 +355,8 @@ namespace Papyro
     PapyroTabPrivate::~PapyroTabPrivate()
     {
         cancelRunnables();
+        cancelPagerImages();
+        pagerPool.waitForDone();
 
         // Delete decorator extensions
         while (!decorators.isEmpty()) {
@@ -250,6 +364,15 @@ namespace Papyro
         }
     }
 
+    void PapyroTabPrivate::cancelPagerImages()
+    {
+        // Anything still in flight will be ignored when it arrives
+        pagerPool.clear();
+        pagerQueue.clear();
+        pagerPending = 0;
+        ++pagerGeneration;
+    }
+
     void PapyroTabPrivate::cancelRunnables()
     {
         annotatorPool.skip();
@@ -524,18 +647,15 @@ namespace Papyro
 
     void PapyroTabPrivate::loadNextPagerImage()
     {
-        if (document()) {
-            if (pagerQueue.isEmpty()) {
-                pagerTimer.stop();
-            } else {
+        // Only hand the pool as many pages as it can work on at once, so that
+        // requestImage() can still reorder the rest of the queue
+        if (Spine::DocumentHandle doc = document()) {
+            while (!pagerQueue.isEmpty() && pagerPending < pagerPool.maxThreadCount()) {
                 int i = pagerQueue.dequeue();
-                PageView * pageView = documentView->pageView(i+1);
-                const Spine::Page * page = document()->newCursor(i+1)->page();
-                QSize size = pageView->pageSize().toSize();
+                QSize size = documentView->pageView(i+1)->pageSize().toSize();
                 size.scale(QSize(120, 120), Qt::KeepAspectRatio);
-                Spine::Image spineImage = page->render(size_t(size.width()),
-                                                       size_t(size.height()));
-                pager->replace(i, QPixmap::fromImage(qImageFromSpineImage(&spineImage)).transformed(pageView->userTransform()));
+                pagerPool.start(new PagerThumbnailRenderer(this, pagerGeneration, doc, i, size, pagerStorePath));
+                ++pagerPending;
             }
         } else {
             pagerQueue.clear();
@@ -557,7 +677,8 @@ namespace Papyro
     {
 #ifdef UTOPIA_BUILD_DEBUG
         AnnotatorRunnable * runnable = qobject_cast< AnnotatorRunnable * >(sender());
-        qDebug() << "Runnable FINISHED:" << runnable->title();
+        qDebug() << "Runnable FINISHED:" << runnable->title() << runnable->eventName()
+                 << "waited" << runnable->waited() << "ms, ran" << runnable->elapsed() << "ms";
 #endif
         --activeAnnotators;
 
@@ -658,17 +779,25 @@ namespace Papyro
     {
         if (document()) {
             if (name.empty()) {
-                QMap< int, int > pageMarkers;
-                for (size_t page = 1; page <= document()->numberOfPages(); ++page) {
-                    pageMarkers[page-1] = 0;
+                // Only the pages these annotations touch can have changed
+                QSet< int > pages;
+                foreach (Spine::AnnotationHandle annotation, annotations) {
+                    for (Spine::Annotation::const_iterator area(annotation->begin()); area != annotation->end(); ++area) {
+                        pages.insert(area->page);
+                    }
+                }
+                foreach (int page, pages) {
+                    pagerMarkers[page-1] = 0;
                     foreach (Spine::AnnotationHandle annotation, document()->annotationsAt(page)) {
                         if (!annotation->hasProperty("session:volatile")) {
-                            pageMarkers[page-1] += 1;
+                            pagerMarkers[page-1] += 1;
                             break; // FIXME this ignores cardinality
                         }
                     }
                 }
-                pager->setAnnotations(pageMarkers);
+                if (!pages.isEmpty()) {
+                    pager->setAnnotations(pagerMarkers);
+                }
 
                 if (added) {
                     foreach (Spine::AnnotationHandle annotation, annotations) {
@@ -1309,6 +1438,25 @@ namespace Papyro
         }
     }
 
+    void PapyroTabPrivate::onPagerImageRendered(int generation, int index, QImage image)
+    {
+        if (generation == pagerGeneration) {
+            --pagerPending;
+            if (!image.isNull()) {
+                pager->replace(index, QPixmap::fromImage(image).transformed(documentView->pageView(index+1)->userTransform()));
+            }
+            loadNextPagerImage();
+        }
+    }
+
+    void PapyroTabPrivate::onPagerStoreOpened(int generation, QString path)
+    {
+        // Thumbnails rendered from now on are loaded from and saved to the store
+        if (generation == pagerGeneration) {
+            pagerStorePath = path;
+        }
+    }
+
     void PapyroTabPrivate::onPagerPageClicked(int index)
     {
         documentView->showPage(index + 1);
@@ -1400,14 +1548,23 @@ namespace Papyro
             // Go to page/anchor/text according to params
             documentView->showPage(params);
 
-            // Start the pager off generating thumbnails
+            // Start the pager off generating thumbnails, or loading them from
+            // the store if this document has been seen before (once the store
+            // has been found in the background, ahead of any thumbnails)
+            cancelPagerImages();
+            pagerStorePath.clear();
+            pagerPool.start(new PagerStoreOpener(this, pagerGeneration, document), 1);
+            pagerMarkers.clear();
             for (size_t i = 0; i < document->numberOfPages(); ++i) {
+                pagerMarkers[i] = 0;
                 pager->rename(pager->append(), QString("%1").arg(i+1));
                 pagerQueue.append(i);
             }
-            connect(&pagerTimer, SIGNAL(timeout()), this, SLOT(loadNextPagerImage()));
-            pagerTimer.setInterval(0);
-            pagerTimer.start();
+            loadNextPagerImage();
+
+            // Index the document's text in the background, so that searching
+            // it soon needn't mean extracting the text of every page
+            QtConcurrent::run(&buildTextIndex, document);
 
             // Start the flowbrowser off generating images
             // Begin by finding all the bitmap bounding boxes
@@ -2230,6 +2387,7 @@ namespace Papyro
         d->cancelRunnables();
 
         // Clear pager
+        d->cancelPagerImages();
         d->pager->clear();
         d->actionTogglePager->setChecked(false);
         d->actionTogglePager->setEnabled(false);
@@ -48,11 +48,14 @@
 #  include <boost/shared_ptr.hpp>
 #endif
 
+#include <QImage>
 #include <QObject>
 #include <QQueue>
+#include <QRunnable>
 #include <QSignalMapper>
 #include <QString>
 #include <QSvgRenderer>
+#include <QThreadPool>
 #include <QTime>
 #include <QTimer>
 #include <QUrl>
@@ -122,6 +125,40 @@ namespace Papyro
 
 
 
+    class PagerThumbnailRenderer : public QRunnable
+    {
+    public:
+        PagerThumbnailRenderer(QObject * target, int generation, Spine::DocumentHandle document, int index, const QSize & size, const QString & storePath);
+
+        void run();
+
+    private:
+        QObject * _target;
+        int _generation;
+        Spine::DocumentHandle _document;
+        int _index;
+        QSize _size;
+        QString _storePath;
+
+    }; // class PagerThumbnailRenderer
+
+    class PagerStoreOpener : public QRunnable
+    {
+    public:
+        PagerStoreOpener(QObject * target, int generation, Spine::DocumentHandle document);
+
+        void run();
+
+    private:
+        QObject * _target;
+        int _generation;
+        Spine::DocumentHandle _document;
+
+    }; // class PagerStoreOpener
+
+
+
+
     class PapyroTabPrivate : public QObject, public Utopia::BusAgent, public Utopia::NetworkAccessManagerMixin
     {
         Q_OBJECT
@@ -201,9 +238,16 @@ namespace Papyro
         QList< Spine::Area > imageAreas;
         QList< Spine::TextExtentHandle > chemicalExtents;
 
-        // Management of the page
-        QTimer pagerTimer;
+        // Management of the pager's thumbnails, which are rendered in the
+        // background and kept on disk per document
+        QThreadPool pagerPool;
         QQueue< int > pagerQueue;
+        int pagerGeneration;
+        int pagerPending;
+        QString pagerStorePath;
+        QMap< int, int > pagerMarkers;
+
+        // Management of the page
         QMap< int, int > areaAnnotationCountByPage;
         QMap< int, int > textAnnotationCountByPage;
 
@@ -252,6 +296,7 @@ namespace Papyro
         void knownChanged(bool known);
 
     public slots:
+        void cancelPagerImages();
         void cancelRunnables();
 
         // Annotation framework
@@ -295,6 +340,8 @@ namespace Papyro
         void onLookupStopped();
         void onNetworkReplyFinished();
         void onNetworkReplyDownloadProgress(qint64, qint64);
+        void onPagerImageRendered(int generation, int index, QImage image);
+        void onPagerStoreOpened(int generation, QString path);
         void onPagerPageClicked(int index);
         void onProgressLinksLabelLinkActivated(const QString & link);
         void onQuickSearchBarSearchForText(QString text);
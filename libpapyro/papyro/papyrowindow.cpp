@@ -150,7 +150,7 @@ namespace Papyro
 
 
     PapyroWindowPrivate::PapyroWindowPrivate(PapyroWindow * publicObject)
-        : Utopia::AbstractWindowPrivate(publicObject), interactionMode(DocumentView::SelectingMode), highlightingColor(Qt::yellow)
+        : Utopia::AbstractWindowPrivate(publicObject), interactionMode(DocumentView::SelectingMode), highlightingColor(Qt::yellow), pendingImports(0)
     {
         recentUrlHelper = PapyroRecentUrlHelper::instance();
         printer = Printer::instance();
@@ -597,10 +597,12 @@ namespace Papyro
             standardFilters[Athenaeum::BibliographicSearchBox::SearchTitle] = new Athenaeum::TextFilter(QString(), Athenaeum::Citation::TitleRole - Qt::UserRole, Qt::DisplayRole, this);
             standardFilters[Athenaeum::BibliographicSearchBox::SearchAuthors] = new Athenaeum::TextFilter(QString(), Athenaeum::Citation::AuthorsRole - Qt::UserRole, Qt::DisplayRole, this);
             standardFilters[Athenaeum::BibliographicSearchBox::SearchAbstract] = new Athenaeum::TextFilter(QString(), Athenaeum::Citation::AbstractRole - Qt::UserRole, Qt::DisplayRole, this);
+            standardFilters[Athenaeum::BibliographicSearchBox::SearchFullText] = new Athenaeum::FullTextFilter(Athenaeum::LibraryModel::instance()->fullTextIndex(), this);
             Athenaeum::ORFilter * orFilter = new Athenaeum::ORFilter(standardFilters.values(), this);
             standardFilters[Athenaeum::BibliographicSearchBox::SearchAll] = orFilter;
 
             libraryModel = Athenaeum::LibraryModel::instance();
+            connect(libraryModel.get(), SIGNAL(filesImported(int, int)), this, SLOT(onFilesImported(int, int)));
 /*
             // Load libraries from disk
             QDir dataRoot(Utopia::profile_path());
@@ -1591,6 +1593,26 @@ namespace Papyro
         }
     }
 
+    void PapyroWindowPrivate::onFilesImported(int imported, int skipped)
+    {
+        // Only the window they were dropped on reports on them
+        if (pendingImports == 0) {
+            return;
+        }
+        --pendingImports;
+
+        // Files whose content is already in the library are not imported
+        // again, so say why they haven't appeared
+        if (skipped > 0) {
+            QMessageBox::information(window(), "Already in library",
+                                     QString("%1 dropped file%2 already in your library,"
+                                             " so %3 not imported again.")
+                                     .arg(skipped)
+                                     .arg(skipped > 1 ? "s are" : " is")
+                                     .arg(skipped > 1 ? "were" : "was"));
+        }
+    }
+
     void PapyroWindowPrivate::onFilterRequested(const QString & text, Athenaeum::BibliographicSearchBox::SearchDomain searchDomain)
     {
         // Filter can only be done on collections
@@ -1606,6 +1628,8 @@ namespace Papyro
             foreach (Athenaeum::AbstractFilter * filter, standardFilters.values()) {
                 if (Athenaeum::TextFilter * textFilter = qobject_cast< Athenaeum::TextFilter * >(filter)) {
                     textFilter->setFixedString(text);
+                } else if (Athenaeum::FullTextFilter * fullTextFilter = qobject_cast< Athenaeum::FullTextFilter * >(filter)) {
+                    fullTextFilter->setFixedString(text);
                 }
             }
             filterProxyModel->setFilter(standardFilters.value(searchDomain, 0));
@@ -2610,24 +2634,20 @@ namespace Papyro
                 if (!supportedUrls.isEmpty()) {
                     // Saving PDF URLs
                     event->acceptProposedAction();
+                    QList< QUrl > localUrls;
                     QListIterator< QUrl > urls(supportedUrls);
                     while (urls.hasNext()) {
                         QUrl url(urls.next());
                         // If this is a local URL, copy the file
                         if (url.isLocalFile()) {
-                            Athenaeum::CitationHandle citation = Athenaeum::CitationHandle(new Athenaeum::Citation);
-                            citation->setField(Athenaeum::Citation::OriginatingUriRole, url);
-                            citation->setField(Athenaeum::Citation::DateImportedRole, QDateTime::currentDateTime());
-                            Athenaeum::Bibliography * master = d->libraryModel->master();
-                            master->appendItem(citation);
-                            QFile file(url.toLocalFile());
-                            if (file.open(QIODevice::ReadOnly)) {
-                                QByteArray data = file.readAll();
-                                d->libraryModel->saveObjectFile(citation, data, ".pdf");
-                            }
+                            localUrls << url;
                         } else { // Else fetch it first then save it
                         }
                     }
+                    // Local files are imported as a single batch
+                    if (!localUrls.isEmpty() && d->libraryModel->importFiles(localUrls) > 0) {
+                        ++d->pendingImports;
+                    }
                 }
             } else {
                 QList< QUrl > supportedUrls(d->checkForSupportedUrls(event->mimeData()));
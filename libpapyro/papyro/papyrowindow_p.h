@@ -214,6 +214,7 @@ namespace Papyro
 
         // Remote searching / library
         boost::shared_ptr< Athenaeum::LibraryModel > libraryModel;
+        int pendingImports; // Batches dropped on this window still being imported
         Athenaeum::SortFilterProxyModel * filterProxyModel;
         Athenaeum::AggregatingProxyModel * aggregatingProxyModel;
         QMap< int, Athenaeum::AbstractFilter * > standardFilters;
@@ -315,6 +316,7 @@ namespace Papyro
         void onClose();
         void onCornerButtonClicked(bool checked);
         void onCurrentTabChanged(int index);
+        void onFilesImported(int imported, int skipped);
         void onFilterRequested(const QString & text, Athenaeum::BibliographicSearchBox::SearchDomain searchDomain);
         void onHighlightingModeOptionsRequested();
         void onHighlightingModeOptionChosen();
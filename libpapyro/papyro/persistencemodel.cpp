@@ -30,6 +30,7 @@
  *****************************************************************************/
 
 #include <papyro/persistencemodel.h>
+#include <papyro/persistencemodel_p.h>
 
 #include <papyro/abstractbibliography.h>
 #include <papyro/collection.h>
@@ -37,11 +38,19 @@
 #include <papyro/cJSON.h>
 
 #include <QAbstractItemModel>
+#include <QDataStream>
 #include <QDateTime>
 #include <QDebug>
+#include <QFile>
+#include <QHash>
 #include <QMetaProperty>
+#include <QSaveFile>
 #include <QSet>
 #include <QTextStream>
+#include <QThread>
+#include <QtConcurrent>
+
+#include <algorithm>
 
 namespace Athenaeum
 {
@@ -110,36 +119,433 @@ namespace Athenaeum
 
 
 
-    class LocalPersistenceModelPrivate
+    /////////////////////////////////////////////////////////////////////////////////////
+    // The master library is stored as a binary snapshot of every citation, plus an
+    // append-only journal of the citations changed or removed since that snapshot
+    // was taken. Saving appends to the journal; once the journal grows large enough
+    // it is folded into a fresh snapshot. Both files are memory mapped to load.
+
+    static const quint32 snapshotMagic = 0x55544c53; // "UTLS"
+    static const quint32 journalMagic = 0x55544c4a; // "UTLJ"
+    static const quint32 storageVersion = 1;
+    static const quint8 endOfFields = 0xff;
+
+    enum JournalOperation {
+        PutOperation = 1,
+        RemoveOperation
+    }; // enum JournalOperation
+
+    static void writeCitation(QDataStream & stream, const CitationHandle & item)
     {
-    public:
-        LocalPersistenceModelPrivate()
-            : purged(false)
-        {}
+        for (int role = Qt::UserRole; role < Citation::PersistentRoleCount; ++role) {
+            QVariant value(item->field(role));
+            if (role == Citation::FlagsRole && value.isValid()) {
+                value = (int) value.value< Citation::Flags >();
+            }
+            // Only built in types can be streamed
+            if (value.isValid() && value.userType() < QMetaType::User) {
+                stream << (quint8) (role - Qt::UserRole) << value;
+            }
+        }
+        stream << endOfFields;
+    }
 
-        QDir path;
-        bool purged;
+    static CitationHandle readCitation(QDataStream & stream)
+    {
+        CitationHandle item(new Citation);
+        quint8 offset = 0;
+        stream >> offset;
+        while (stream.status() == QDataStream::Ok && offset != endOfFields) {
+            QVariant value;
+            stream >> value;
+            int role = Qt::UserRole + offset;
+            if (role == Citation::FlagsRole) {
+                value = QVariant::fromValue(Citation::Flags(value.toInt()));
+            }
+            if (role < Citation::PersistentRoleCount) {
+                item->setField(role, value);
+            }
+            stream >> offset;
+        }
+        item->setClean();
+        return stream.status() == QDataStream::Ok ? item : CitationHandle();
+    }
+
+    // Map a whole file into memory, falling back to reading it in if that fails
+    static QByteArray mapFile(QFile & file)
+    {
+        QByteArray data;
+        if (file.open(QIODevice::ReadOnly) && file.size() > 0) {
+            if (uchar * mapped = file.map(0, file.size())) {
+                data = QByteArray::fromRawData(reinterpret_cast< const char * >(mapped), file.size());
+            } else {
+                data = file.readAll();
+            }
+        }
+        return data;
+    }
+
+
+
+
+    LocalPersistenceModelPrivate::LocalPersistenceModelPrivate(LocalPersistenceModel * persistenceModel)
+        : QObject(persistenceModel), persistenceModel(persistenceModel), purged(false), loading(0), generation(0), journalRecords(0), journalSize(0)
+    {
+        qRegisterMetaType< QVector< Athenaeum::CitationHandle > >("QVector<Athenaeum::CitationHandle>");
+
+        // Items are read in the background, and added to the model in chunks
+        connect(this, SIGNAL(itemsRead(QVector< Athenaeum::CitationHandle >)),
+                this, SLOT(onItemsRead(QVector< Athenaeum::CitationHandle >)), Qt::QueuedConnection);
+        connect(this, SIGNAL(readFinished(bool)),
+                this, SLOT(onReadFinished(bool)), Qt::QueuedConnection);
+    }
+
+    LocalPersistenceModelPrivate::~LocalPersistenceModelPrivate()
+    {
+        reader.waitForFinished();
+    }
+
+    bool LocalPersistenceModelPrivate::appendJournal(const QList< CitationHandle > & changed, const QStringList & removed)
+    {
+        QFile journalFile(journalPath());
+        if (!journalFile.open(QIODevice::ReadWrite)) {
+            return false;
+        }
+
+        // Drop anything left over from an interrupted write, or a stale journal
+        if (!journalFile.resize(journalSize)) {
+            return false;
+        }
+        journalFile.seek(journalSize);
+
+        QDataStream stream(&journalFile);
+        stream.setVersion(QDataStream::Qt_5_0);
+        if (journalSize == 0) {
+            stream << journalMagic << storageVersion << generation;
+        }
+
+        QByteArray record;
+        foreach (CitationHandle item, changed) {
+            record.clear();
+            QDataStream recordStream(&record, QIODevice::WriteOnly);
+            recordStream.setVersion(QDataStream::Qt_5_0);
+            recordStream << (quint8) PutOperation << item->field(Citation::KeyRole).toString();
+            writeCitation(recordStream, item);
+            stream << (quint32) record.size() << qChecksum(record.constData(), record.size());
+            stream.writeRawData(record.constData(), record.size());
+        }
+        foreach (const QString & key, removed) {
+            record.clear();
+            QDataStream recordStream(&record, QIODevice::WriteOnly);
+            recordStream.setVersion(QDataStream::Qt_5_0);
+            recordStream << (quint8) RemoveOperation << key;
+            stream << (quint32) record.size() << qChecksum(record.constData(), record.size());
+            stream.writeRawData(record.constData(), record.size());
+        }
+
+        journalFile.close();
+        if (stream.status() != QDataStream::Ok || journalFile.error() != QFile::NoError) {
+            return false;
+        }
+        journalRecords += changed.size() + removed.size();
+        journalSize = journalFile.size();
+        return true;
+    }
+
+    bool LocalPersistenceModelPrivate::imprint() const
+    {
+        return path.mkpath("objects") && path.mkpath("fulltext");
+    }
 
-        bool imprint() const
-        {
-            return path.mkpath("jsondb/.scratch") && path.mkpath("objects");
+    QString LocalPersistenceModelPrivate::journalPath() const
+    {
+        return path.absoluteFilePath("journal");
+    }
+
+    void LocalPersistenceModelPrivate::onItemsRead(QVector< CitationHandle > items)
+    {
+        if (AbstractBibliography * bibliography = qobject_cast< AbstractBibliography * >(loading)) {
+            bibliography->appendItems(items);
+            // Appending marks items as dirty, but these are already persisted
+            foreach (CitationHandle item, items) {
+                item->setClean();
+            }
         }
+    }
 
-    }; // class LocalPersistenceModelPrivate
+    void LocalPersistenceModelPrivate::onReadFinished(bool success)
+    {
+        if (AbstractBibliography * bibliography = qobject_cast< AbstractBibliography * >(loading)) {
+            bibliography->setState(success ? AbstractBibliography::IdleState : AbstractBibliography::CorruptState);
+        }
+        loading = 0;
+        emit persistenceModel->loaded(success);
+    }
+
+    void LocalPersistenceModelPrivate::read()
+    {
+        // Read the snapshot and replay the journal on top of it. Libraries that
+        // predate the snapshot are read from their old JSON database, and
+        // converted when they are next saved.
+        bool success = true;
+        QVector< CitationHandle > items;
+        if (!QFile::exists(snapshotPath()) && QFile::exists(scratchSnapshotPath())) {
+            // Earlier versions replaced the snapshot by removing it and then
+            // renaming its replacement into place; if they were interrupted in
+            // between, the replacement is only usable if it is complete
+            if (readSnapshot(scratchSnapshotPath(), items)) {
+                QFile::rename(scratchSnapshotPath(), snapshotPath());
+            } else {
+                QFile::remove(scratchSnapshotPath());
+            }
+            items.clear();
+            generation = 0;
+        }
+        if (QFile::exists(snapshotPath())) {
+            if ((success = readSnapshot(snapshotPath(), items))) {
+                readJournal(items);
+                foreach (CitationHandle item, items) {
+                    persisted.insert(item->field(Citation::KeyRole).toString());
+                }
+            }
+        } else {
+            success = readJson(items, 0);
+        }
+
+        // Hand the items over to the GUI thread a chunk at a time, so that the
+        // library can be drawn while the rest of it is still arriving
+        static const int chunkSize = 500;
+        QThread * target = thread();
+        for (int i = 0; i < items.size(); i += chunkSize) {
+            QVector< CitationHandle > chunk(items.mid(i, chunkSize));
+            foreach (CitationHandle item, chunk) {
+                item->moveToThread(target);
+            }
+            emit itemsRead(chunk);
+        }
+        emit readFinished(success);
+    }
+
+    bool LocalPersistenceModelPrivate::readJournal(QVector< CitationHandle > & items)
+    {
+        journalRecords = 0;
+        journalSize = 0;
+
+        QFile journalFile(journalPath());
+        QByteArray data(mapFile(journalFile));
+        QDataStream stream(data);
+        stream.setVersion(QDataStream::Qt_5_0);
+        quint32 magic = 0, version = 0, journalGeneration = 0;
+        stream >> magic >> version >> journalGeneration;
+        if (stream.status() != QDataStream::Ok || magic != journalMagic || version != storageVersion || journalGeneration != generation) {
+            // No journal for this snapshot
+            return true;
+        }
+        journalSize = stream.device()->pos();
+
+        QHash< QString, int > index;
+        for (int i = 0; i < items.size(); ++i) {
+            index[items.at(i)->field(Citation::KeyRole).toString()] = i;
+        }
+
+        // Replay each complete record in turn, stopping at the first torn one
+        while (!stream.atEnd()) {
+            quint32 length = 0;
+            quint16 checksum = 0;
+            stream >> length >> checksum;
+            qint64 start = stream.device()->pos();
+            if (stream.status() != QDataStream::Ok || length > data.size() - start) {
+                break;
+            }
+            QByteArray record(QByteArray::fromRawData(data.constData() + start, length));
+            if (qChecksum(record.constData(), record.size()) != checksum) {
+                break;
+            }
+            stream.skipRawData(length);
+
+            QDataStream recordStream(record);
+            recordStream.setVersion(QDataStream::Qt_5_0);
+            quint8 operation = 0;
+            QString key;
+            recordStream >> operation >> key;
+            if (operation == PutOperation) {
+                if (CitationHandle item = readCitation(recordStream)) {
+                    QHash< QString, int >::const_iterator found(index.find(key));
+                    if (found == index.end()) {
+                        index[key] = items.size();
+                        items << item;
+                    } else {
+                        items[found.value()] = item;
+                    }
+                }
+            } else if (operation == RemoveOperation) {
+                QHash< QString, int >::iterator found(index.find(key));
+                if (found != index.end()) {
+                    items[found.value()].reset();
+                    index.erase(found);
+                }
+            }
+            ++journalRecords;
+            journalSize = stream.device()->pos();
+        }
+
+        // Sweep up the removed citations
+        items.erase(std::remove(items.begin(), items.end(), CitationHandle()), items.end());
+        return true;
+    }
+
+    bool LocalPersistenceModelPrivate::readJson(QVector< CitationHandle > & items, QString * errorMsg)
+    {
+        bool success = true;
+
+        static QRegExp dataFileRegExp("[a-f0-9]{2}");
+
+        QDir jsonDir(path);
+        if (!jsonDir.cd("jsondb")) {
+            return success;
+        }
+        QDir scratchDir(jsonDir);
+        scratchDir.cd(".scratch");
+
+        /////////////////////////////////////////////////////////////////////////
+        // For purposes of working out which files should be read or discarded,
+        // check when the scratch manifest was written (if one exists)
+
+        bool hasScratch = scratchDir.exists(".manifest");
+        QDateTime scratchModified;
+        if (hasScratch) { scratchModified = QFileInfo(scratchDir.absoluteFilePath(".manifest")).lastModified(); }
+
+        /////////////////////////////////////////////////////////////////////////
+        // Collect a list of all possible DB item files (union of jsondb and
+        // scratch dirs) that have the correct modified times.
+
+        QMap< QString, QFileInfo > manifest;
+        if (hasScratch) {
+            foreach (QFileInfo fileInfo, scratchDir.entryInfoList(QDir::Files)) {
+                QDateTime fileLastModified = fileInfo.lastModified();
+                QString baseName = fileInfo.baseName();
+                if (fileLastModified >= scratchModified && dataFileRegExp.exactMatch(baseName)) {
+                    manifest[baseName] = fileInfo;
+                }
+            }
+        }
+        foreach (QFileInfo fileInfo, jsonDir.entryInfoList(QDir::Files)) {
+            QDateTime fileLastModified = fileInfo.lastModified();
+            QString baseName = fileInfo.baseName();
+            if (dataFileRegExp.exactMatch(baseName)) {
+                if (!manifest.contains(baseName) || (hasScratch && fileLastModified >= scratchModified)) {
+                    manifest[baseName] = fileInfo;
+                }
+            }
+        }
+
+        /////////////////////////////////////////////////////////////////////////
+        // Load each appropriate file from disk.
+
+        QMapIterator< QString, QFileInfo > iter(manifest);
+        while (iter.hasNext()) {
+            iter.next();
+            QFile dataFile(iter.value().absoluteFilePath());
+            if (dataFile.open(QIODevice::ReadOnly | QIODevice::Text)) {
+                QByteArray data(dataFile.readAll());
+                if (cJSON * json = cJSON_Parse(data.constData())) {
+                    int count = cJSON_GetArraySize(json);
+                    for (int i = 0; i < count; ++i) {
+                        if (cJSON * item = cJSON_GetArrayItem(json, i)) {
+                            items << Citation::fromJson(item);
+                        }
+                    }
+                    cJSON_Delete(json);
+                } else {
+                    if (errorMsg) { *errorMsg = "Failed to parse one or more of the data files."; }
+                    success = false;
+                }
+                dataFile.close();
+            } else {
+                if (errorMsg) { *errorMsg = "Failed to read one or more of the data files."; }
+                success = false;
+            }
+        }
+
+        return success;
+    }
+
+    bool LocalPersistenceModelPrivate::readSnapshot(const QString & fileName, QVector< CitationHandle > & items)
+    {
+        QFile snapshotFile(fileName);
+        QByteArray data(mapFile(snapshotFile));
+        QDataStream stream(data);
+        stream.setVersion(QDataStream::Qt_5_0);
+        quint32 magic = 0, version = 0, count = 0;
+        stream >> magic >> version >> generation >> count;
+        if (stream.status() != QDataStream::Ok || magic != snapshotMagic || version != storageVersion) {
+            return false;
+        }
+
+        // Every citation takes at least a byte, so a damaged count can't be
+        // allowed to reserve more than that
+        items.reserve(items.size() + (int) qMin< qint64 >(count, data.size()));
+        for (quint32 i = 0; i < count; ++i) {
+            if (CitationHandle item = readCitation(stream)) {
+                items << item;
+            } else {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    QString LocalPersistenceModelPrivate::scratchSnapshotPath() const
+    {
+        return path.absoluteFilePath("snapshot.tmp");
+    }
+
+    QString LocalPersistenceModelPrivate::snapshotPath() const
+    {
+        return path.absoluteFilePath("snapshot");
+    }
+
+    bool LocalPersistenceModelPrivate::writeSnapshot(const QVector< CitationHandle > & items)
+    {
+        // QSaveFile writes to a scratch file and renames it over the old snapshot
+        // only once it is complete, so there is always a whole snapshot on disk
+        QSaveFile snapshotFile(snapshotPath());
+        if (!snapshotFile.open(QIODevice::WriteOnly)) {
+            return false;
+        }
+        QDataStream stream(&snapshotFile);
+        stream.setVersion(QDataStream::Qt_5_0);
+        stream << snapshotMagic << storageVersion << (generation + 1) << (quint32) items.size();
+        foreach (CitationHandle item, items) {
+            writeCitation(stream, item);
+        }
+        if (stream.status() != QDataStream::Ok) {
+            snapshotFile.cancelWriting();
+        }
+        if (!snapshotFile.commit()) {
+            return false;
+        }
+
+        // The old journal is now stale, as its generation no longer matches
+        ++generation;
+        QFile::remove(journalPath());
+        QFile::remove(scratchSnapshotPath());
+        journalRecords = 0;
+        journalSize = 0;
+        return true;
+    }
 
 
 
 
     LocalPersistenceModel::LocalPersistenceModel(const QDir & path, QObject * parent)
-        : PersistenceModel(parent), d(new LocalPersistenceModelPrivate)
+        : PersistenceModel(parent), d(new LocalPersistenceModelPrivate(this))
     {
         d->path = path;
     }
 
     LocalPersistenceModel::~LocalPersistenceModel()
-    {
-        delete d;
-    }
+    {}
 
     bool LocalPersistenceModel::isLoadable() const
     {
@@ -164,14 +570,9 @@ namespace Athenaeum
         if (AbstractBibliography * bibliography = qobject_cast< AbstractBibliography * >(model)) {
 
             static QRegExp metadataRegExp("(\\w[\\w_\\d]+)\\s*=\\s*(\\S.*)?");
-            static QRegExp dataFileRegExp("[a-f0-9]{2}");
 
             // Only existing paths can be loaded
             if (d->imprint()) {
-                QDir jsonDir(d->path);
-                jsonDir.cd("jsondb");
-                QDir scratchDir(jsonDir);
-                scratchDir.cd(".scratch");
 
                 /////////////////////////////////////////////////////////////////////////////
                 // Read metadata
@@ -198,70 +599,12 @@ namespace Athenaeum
                     metadataFile.close();
 
                     /////////////////////////////////////////////////////////////////////////
-                    // For purposes of working out which files should be read or discarded,
-                    // check when the scratch manifest was written (if one exists)
-
-                    bool hasScratch = scratchDir.exists(".manifest");
-                    QDateTime scratchModified;
-                    if (hasScratch) { scratchModified = QFileInfo(scratchDir.absoluteFilePath(".manifest")).lastModified(); }
-
-                    /////////////////////////////////////////////////////////////////////////
-                    // Collect a list of all possible DB item files (union of jsondb and
-                    // scratch dirs) that have the correct modified times.
-
-                    QMap< QString, QFileInfo > manifest;
-                    if (hasScratch) {
-                        foreach (QFileInfo fileInfo, scratchDir.entryInfoList(QDir::Files)) {
-                            QDateTime fileLastModified = fileInfo.lastModified();
-                            QString baseName = fileInfo.baseName();
-                            //qDebug() << "found scratch file" << baseName << fileLastModified << scratchModified << (fileLastModified >= scratchModified);
-                            if (fileLastModified >= scratchModified && dataFileRegExp.exactMatch(baseName)) {
-                                manifest[baseName] = fileInfo;
-                            }
-                        }
-                    }
-                    foreach (QFileInfo fileInfo, jsonDir.entryInfoList(QDir::Files)) {
-                        QDateTime fileLastModified = fileInfo.lastModified();
-                        QString baseName = fileInfo.baseName();
-                        //qDebug() << "found jsondb file" << baseName << fileLastModified << scratchModified << (fileLastModified >= scratchModified);
-                        if (dataFileRegExp.exactMatch(baseName)) {
-                            if (!manifest.contains(baseName) || (hasScratch && fileLastModified >= scratchModified)) {
-                                manifest[baseName] = fileInfo;
-                            }
-                        }
-                    }
+                    // Read the items themselves in the background
 
-                    /////////////////////////////////////////////////////////////////////////
-                    // Load each appropriate file from disk, adding its items to the model.
-
-                    QMapIterator< QString, QFileInfo > iter(manifest);
-                    while (iter.hasNext()) {
-                        iter.next();
-                        QFile dataFile(iter.value().absoluteFilePath());
-                        if (dataFile.open(QIODevice::ReadOnly | QIODevice::Text)) {
-                            QByteArray data(dataFile.readAll());
-                            if (cJSON * json = cJSON_Parse(data.constData())) {
-                                QVector< CitationHandle > newItems;
-                                int count = cJSON_GetArraySize(json);
-                                for (int i = 0; i < count; ++i) {
-                                    if (cJSON * item = cJSON_GetArrayItem(json, i)) {
-                                        newItems << Citation::fromJson(item);
-                                    }
-                                }
-                                if (!newItems.isEmpty()) {
-                                    // Add items to model
-                                    bibliography->prependItems(newItems);
-                                }
-                                cJSON_Delete(json);
-                            } else {
-                                if (errorMsg) { *errorMsg = "Failed to parse one or more of the data files."; }
-                                success = false;
-                            }
-                            dataFile.close();
-                        } else {
-                            if (errorMsg) { *errorMsg = "Failed to read one or more of the data files."; }
-                            success = false;
-                        }
+                    if (!d->loading) {
+                        d->loading = model;
+                        bibliography->setState(AbstractBibliography::BusyState);
+                        d->reader = QtConcurrent::run(d, &LocalPersistenceModelPrivate::read);
                     }
 
                 } else {
@@ -275,6 +618,7 @@ namespace Athenaeum
 
             if (!success) {
                 bibliography->setState(AbstractBibliography::CorruptState);
+                QMetaObject::invokeMethod(d->persistenceModel, "loaded", Qt::QueuedConnection, Q_ARG(bool, false));
             }
         } else {
             if (errorMsg) { *errorMsg = "Not a bibliography."; }
@@ -302,13 +646,16 @@ namespace Athenaeum
     bool LocalPersistenceModel::save(QAbstractItemModel * model) const
     {
         bool success = true;
-        bool incremental = true;
         QString * errorMsg = 0;
 
         if (AbstractBibliography * bibliography = qobject_cast< AbstractBibliography * >(model)) {
 
-            // If this is a purged model, completely remove it from the filesystem
-            if (bibliography->state() == AbstractBibliography::PurgedState) {
+            if (d->loading) {
+                // Saving a partially loaded model would lose the rest of it
+                if (errorMsg) { *errorMsg = "Still loading."; }
+                success = false;
+            } else if (bibliography->state() == AbstractBibliography::PurgedState) {
+                // If this is a purged model, completely remove it from the filesystem
                 if (d->path.exists()) {
                     if (!removeDir(d->path)) {
                         if (errorMsg) { *errorMsg = "Unable to remove the collection's directory."; }
@@ -316,10 +663,6 @@ namespace Athenaeum
                     }
                 }
             } else if (d->imprint()) { // Ensure DB exists and is writable
-                QDir jsonDir(d->path);
-                jsonDir.cd("jsondb");
-                QDir scratchDir(jsonDir);
-                scratchDir.cd(".scratch");
 
                 /////////////////////////////////////////////////////////////////////////////
                 // Write metadata
@@ -344,99 +687,38 @@ namespace Athenaeum
                     metadataFile.close();
 
                     /////////////////////////////////////////////////////////////////////////
-                    // Compile list of all items that need to be written to the database.
-
-                    QMap< QString, QList< CitationHandle > > dirty;
-                    QSet< QString > clean;
-                    QVectorIterator< CitationHandle > iter(bibliography->items());
-                    while (iter.hasNext()) {
-                        CitationHandle item = iter.next();
-                        if (!incremental || item->isDirty()) {
-                            dirty[item->field(Citation::KeyRole).toString().mid(0, 2)].append(item);
-                        } else {
-                            clean.insert(item->field(Citation::KeyRole).toString().mid(0, 2));
-                        }
-                    }
-                    clean.subtract(dirty.keys().toSet());
-
-                    /////////////////////////////////////////////////////////////////////////
-                    // Mark for removal any file that is no longer needed
-
-                    foreach (QFileInfo fileInfo, jsonDir.entryInfoList(QDir::Files)) {
-                        QString baseName = fileInfo.baseName();
-                        if (!clean.contains(baseName) && !dirty.contains(baseName)) {
-                            dirty[baseName]; // Ensure an empty dirty list, to be deleted later
+                    // Compile lists of the items that have changed or been removed since
+                    // they were last persisted.
+
+                    QVector< CitationHandle > items(bibliography->items());
+                    QList< CitationHandle > changed;
+                    QSet< QString > keys;
+                    foreach (CitationHandle item, items) {
+                        QString key(item->field(Citation::KeyRole).toString());
+                        keys.insert(key);
+                        if (item->isDirty() || !d->persisted.contains(key)) {
+                            changed << item;
                         }
                     }
+                    QStringList removed(QSet< QString >(d->persisted).subtract(keys).toList());
 
                     /////////////////////////////////////////////////////////////////////////
-                    // Write into the scratch directory a manifest of all the files that need
-                    // to be written. If this fails, the database cannot be saved
-
-                    QFile scratchManifestFile(scratchDir.filePath(".manifest"));
-                    if (scratchManifestFile.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text)) {
-                        scratchManifestFile.write(QStringList(dirty.keys()).join("\n").toUtf8());
-                        scratchManifestFile.close();
-
-                        /////////////////////////////////////////////////////////////////////
-                        // Now write all the items that need saving into the scratch directory
-
-                        QMapIterator< QString, QList< CitationHandle > > toWrite(dirty);
-                        while (toWrite.hasNext()) {
-                            toWrite.next();
-                            QFile scratchFile(scratchDir.filePath(toWrite.key()));
-                            QFile destinationFile(jsonDir.filePath(toWrite.key()));
-                            if (!scratchFile.exists() || scratchFile.remove()) {
-                                QList< cJSON * > itemsToWrite;
-                                foreach (CitationHandle item, toWrite.value()) {
-                                    itemsToWrite << item->toJson();
-                                }
-                                if (itemsToWrite.isEmpty()) {
-                                    // Remove the file, as it is empty and therefore no longer needed
-                                    destinationFile.remove();
-                                } else if (scratchFile.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text)) {
-                                    cJSON * json = cJSON_CreateArray();
-                                    foreach (cJSON * item, itemsToWrite) {
-                                        cJSON_AddItemToArray(json, item);
-                                    }
-                                    char * str = cJSON_PrintUnformatted(json);
-                                    scratchFile.write(str);
-                                    free(str);
-                                    cJSON_Delete(json);
-                                    scratchFile.close();
-
-                                    if (true) { // FIXME check for item->write() above returning NULL
-                                        // Relatively atomic move, ish
-                                        if (!(destinationFile.exists() && !destinationFile.remove()) &&
-                                            QFile::copy(scratchFile.fileName(), destinationFile.fileName())) {
-                                            // Success!
-                                            foreach (CitationHandle item, toWrite.value()) {
-                                                item->setClean();
-                                            }
-                                        } else {
-                                            if (errorMsg) { *errorMsg = "Unable to copy the scratch file into place."; }
-                                            success = false;
-                                            break;
-                                        }
-                                    } else {
-                                        if (errorMsg) { *errorMsg = "Unable to generate scratch data for " + toWrite.key() + "."; }
-                                        success = false;
-                                        break;
-                                    }
-                                } else {
-                                    if (errorMsg) { *errorMsg = "Unable to open the scratch file."; }
-                                    success = false;
-                                    break;
-                                }
-                            } else {
-                                if (errorMsg) { *errorMsg = "Unable to remove old scratch file."; }
-                                success = false;
-                                break;
+                    // Append the changes to the journal, or fold everything into a new
+                    // snapshot if the journal has grown too long to be worth replaying.
+
+                    if (!changed.isEmpty() || !removed.isEmpty() || !QFile::exists(d->snapshotPath())) {
+                        int records = d->journalRecords + changed.size() + removed.size();
+                        bool compact = !QFile::exists(d->snapshotPath()) || records > qMax(1024, items.size() / 2);
+                        if (compact ? d->writeSnapshot(items) : d->appendJournal(changed, removed)) {
+                            // Success!
+                            d->persisted = keys;
+                            foreach (CitationHandle item, compact ? items.toList() : changed) {
+                                item->setClean();
                             }
+                        } else {
+                            if (errorMsg) { *errorMsg = "Unable to write to the database."; }
+                            success = false;
                         }
-                    } else {
-                        if (errorMsg) { *errorMsg = "Unable to write the scratch manifest file."; }
-                        success = false;
                     }
                 } else {
                     if (errorMsg) { *errorMsg = "Cannot write to metadata file."; }
@@ -84,10 +84,15 @@ namespace Athenaeum
         virtual bool isPurgeable() const;
         virtual bool isSaveable() const;
 
+        // Items are loaded in the background and added to the model a chunk at
+        // a time; loaded() is emitted once they are all in place
         virtual bool load(QAbstractItemModel * model) const;
         virtual bool purge() const;
         virtual bool save(QAbstractItemModel * model) const;
 
+    signals:
+        void loaded(bool success);
+
     private:
         LocalPersistenceModelPrivate * d;
     }; // class LocalPersistenceModelPrivate
@@ -0,0 +1,103 @@
+/*****************************************************************************
+ *  
+ *   This file is part of the Utopia Documents application.
+ *       Copyright (c) 2008-2017 Lost Island Labs
+ *           <info@utopiadocs.com>
+ *   
+ *   Utopia Documents is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU GENERAL PUBLIC LICENSE VERSION 3 as
+ *   published by the Free Software Foundation.
+ *   
+ *   Utopia Documents is distributed in the hope that it will be useful, but
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ *   Public License for more details.
+ *   
+ *   In addition, as a special exception, the copyright holders give
+ *   permission to link the code of portions of this program with the OpenSSL
+ *   library under certain conditions as described in each individual source
+ *   file, and distribute linked combinations including the two.
+ *   
+ *   You must obey the GNU General Public License in all respects for all of
+ *   the code used other than OpenSSL. If you modify file(s) with this
+ *   exception, you may extend this exception to your version of the file(s),
+ *   but you are not obligated to do so. If you do not wish to do so, delete
+ *   this exception statement from your version.
+ *   
+ *   You should have received a copy of the GNU General Public License
+ *   along with Utopia Documents. If not, see <http://www.gnu.org/licenses/>
+ *  
+ *****************************************************************************/
+
+
+#ifndef ATHENAEUM_PERSISTENCEMODEL_P_H
+#define ATHENAEUM_PERSISTENCEMODEL_P_H
+
+#include <papyro/citation.h>
+
+#include <QDir>
+#include <QFuture>
+#include <QObject>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+class QAbstractItemModel;
+
+namespace Athenaeum
+{
+
+    class LocalPersistenceModel;
+
+    class LocalPersistenceModelPrivate : public QObject
+    {
+        Q_OBJECT
+
+    public:
+        LocalPersistenceModelPrivate(LocalPersistenceModel * persistenceModel);
+        ~LocalPersistenceModelPrivate();
+
+        LocalPersistenceModel * persistenceModel;
+        QDir path;
+        bool purged;
+
+        // Model being loaded in the background, if any; nothing is saved
+        // until it has been completely loaded
+        QAbstractItemModel * loading;
+        QFuture< void > reader;
+
+        // Generation of the snapshot on disk; a journal from any other
+        // generation is stale and is ignored
+        quint32 generation;
+        // Number of records in the journal, and the extent of those records
+        // (anything beyond it is the remains of an interrupted write)
+        int journalRecords;
+        qint64 journalSize;
+        // Keys of the citations currently persisted
+        QSet< QString > persisted;
+
+        bool imprint() const;
+        QString journalPath() const;
+        QString scratchSnapshotPath() const;
+        QString snapshotPath() const;
+
+        bool appendJournal(const QList< CitationHandle > & changed, const QStringList & removed);
+        void read();
+        bool readJournal(QVector< CitationHandle > & items);
+        bool readJson(QVector< CitationHandle > & items, QString * errorMsg);
+        bool readSnapshot(const QString & fileName, QVector< CitationHandle > & items);
+        bool writeSnapshot(const QVector< CitationHandle > & items);
+
+    signals:
+        void itemsRead(QVector< Athenaeum::CitationHandle > items);
+        void readFinished(bool success);
+
+    protected slots:
+        void onItemsRead(QVector< Athenaeum::CitationHandle > items);
+        void onReadFinished(bool success);
+    }; // class LocalPersistenceModelPrivate
+
+} // namespace Athenaeum
+
+#endif // ATHENAEUM_PERSISTENCEMODEL_P_H
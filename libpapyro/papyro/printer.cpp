@@ -43,59 +43,170 @@
 #include <QPrintDialog>
 #include <QPrinter>
 #include <QProgressDialog>
+#include <QThreadPool>
+#include <qmath.h>
+
+namespace
+{
+
+    // Pages whose bitmaps would be larger than this are rendered and printed
+    // in horizontal bands of roughly bandBytes each
+    const qint64 maxPageBytes = 64 * 1024 * 1024;
+    const qint64 bandBytes = 16 * 1024 * 1024;
+
+}
 
 namespace Papyro
 {
 
+    PrinterBandRenderer::PrinterBandRenderer(PrinterThread * thread, int sequence, const PrinterBand & band)
+        : _thread(thread), _sequence(sequence), _band(band)
+    {}
+
+    void PrinterBandRenderer::run()
+    {
+        QImage image;
+        Spine::CursorHandle cursor(_thread->document->newCursor(_band.page));
+        if (const Spine::Page * page = cursor->page()) {
+            if (_band.height > 0) {
+                // Pixel rows as page points, nudged so that they round back
+                // to the same rows when the slice is rasterised
+                double scale = 72.0 / _band.resolution;
+                Spine::BoundingBox slice(0, (_band.top + 0.25) * scale,
+                                         (_band.pageSize.width() + 0.5) * scale,
+                                         (_band.top + _band.height + 0.5) * scale);
+                Spine::Image rendered(page->renderArea(slice, double(_band.resolution), Printer::antialias));
+                image = qImageFromSpineImage(&rendered);
+            } else {
+                Spine::Image rendered(page->render(double(_band.resolution), Printer::antialias));
+                image = qImageFromSpineImage(&rendered);
+            }
+        }
+        _thread->bandFinished(_sequence, image);
+    }
+
+
+
+
+
     PrinterThread::PrinterThread(QObject * parent, Spine::DocumentHandle document, QPrinter * printer)
-        : QThread(parent), document(document), printer(printer), cancelled(false), mutex(QMutex::Recursive)
+        : QThread(parent), document(document), printer(printer), cancelled(false)
     {}
 
+    void PrinterThread::bandFinished(int sequence, const QImage & image)
+    {
+        QMutexLocker guard(&mutex);
+        rendered[sequence] = image;
+        bandRendered.wakeAll();
+    }
+
     void PrinterThread::cancel()
     {
         QMutexLocker guard(&mutex);
         cancelled = true;
+        bandRendered.wakeAll();
     }
 
     void PrinterThread::run()
     {
-        mutex.lock();
-
-        if (!cancelled) {
-
-            // Which pages to print
-            int step = 1;
-            int fromPage = printer->printRange() == QPrinter::PageRange ?
-              printer->fromPage() : 1;
-            int toPage = printer->printRange() == QPrinter::PageRange ?
-              printer->toPage() : document->numberOfPages();
-            int resolution = qMin(printer->resolution(),
-                                  Printer::maxResolution);
-
-            // The order to print them in
-            if (printer->pageOrder() == QPrinter::LastPageFirst) {
-                step = -1;
-                qSwap(fromPage, toPage);
+        QMutexLocker guard(&mutex);
+
+        if (cancelled) {
+            return;
+        }
+
+        // Which pages to print
+        int step = 1;
+        int fromPage = printer->printRange() == QPrinter::PageRange ?
+          printer->fromPage() : 1;
+        int toPage = printer->printRange() == QPrinter::PageRange ?
+          printer->toPage() : document->numberOfPages();
+        int resolution = qMin(printer->resolution(),
+                              Printer::maxResolution);
+
+        // The order to print them in
+        if (printer->pageOrder() == QPrinter::LastPageFirst) {
+            step = -1;
+            qSwap(fromPage, toPage);
+        }
+
+        // Split the pages into bands, in the order they are to be printed
+        QList< PrinterBand > bands;
+        int pages = qAbs(toPage - fromPage) + 1;
+        for (int i = 0; i < pages; ++i) {
+            PrinterBand band;
+            band.page = fromPage + i * step;
+            band.resolution = resolution;
+            band.top = 0;
+            band.height = 0;
+            band.newPage = (i > 0);
+            band.lastOfPage = true;
+
+            Spine::CursorHandle cursor(document->newCursor(band.page));
+            if (const Spine::Page * page = cursor->page()) {
+                Spine::BoundingBox bb(page->boundingBox());
+                band.pageSize = QSize(qCeil(bb.width() * resolution / 72.0),
+                                      qCeil(bb.height() * resolution / 72.0));
             }
 
-            int count = 0;
-            for (int page = fromPage; page <= toPage && !cancelled; page += step) {
-                mutex.unlock();
-                Spine::Image image(document->newCursor(page)->page()
-                                   ->render(resolution, Printer::antialias));
-                QImage pageImage(qImageFromSpineImage(&image));
-                mutex.lock();
+            qint64 rowBytes = qint64(band.pageSize.width()) * 4;
+            if (rowBytes > 0 && rowBytes * band.pageSize.height() > maxPageBytes) {
+                int bandHeight = qMax(1, int(bandBytes / rowBytes));
+                for (int top = 0; top < band.pageSize.height(); top += bandHeight) {
+                    band.top = top;
+                    band.height = qMin(bandHeight, band.pageSize.height() - top);
+                    band.newPage = (i > 0 && top == 0);
+                    band.lastOfPage = (top + band.height >= band.pageSize.height());
+                    bands << band;
+                }
+            } else {
+                bands << band;
+            }
+        }
 
-                emit imageGenerated(pageImage, (page == fromPage));
-                emit progressChanged(++count);
+        // Render ahead on a pool of threads, holding no more than a window's
+        // worth of bitmaps that have yet to be printed
+        QThreadPool pool;
+        pool.setMaxThreadCount(qMax(1, QThread::idealThreadCount()));
+        int window = pool.maxThreadCount() + 1;
+        int queued = 0;
+        int count = 0;
+        for (int next = 0; next < bands.size() && !cancelled; ++next) {
+            while (queued < bands.size() && queued < next + window) {
+                pool.start(new PrinterBandRenderer(this, queued, bands.at(queued)));
+                ++queued;
             }
 
+            while (!cancelled && !rendered.contains(next)) {
+                bandRendered.wait(&mutex);
+            }
             if (cancelled) {
-                printer->abort();
+                break;
             }
+
+            const PrinterBand & band = bands.at(next);
+            QImage image(rendered.take(next));
+            QSize pageSize(band.height > 0 ? band.pageSize : image.size());
+
+            // Blocks until the band has been printed
+            guard.unlock();
+            emit imageGenerated(image, band.top, pageSize, band.newPage);
+            if (band.lastOfPage) {
+                emit progressChanged(++count);
+            }
+            guard.relock();
         }
 
-        mutex.unlock();
+        // Renderers report back under the mutex, so let them finish first
+        pool.clear();
+        guard.unlock();
+        pool.waitForDone();
+        guard.relock();
+        rendered.clear();
+
+        if (cancelled) {
+            printer->abort();
+        }
     }
 
 
@@ -156,21 +267,21 @@ namespace Papyro
         printer = 0;
     }
 
-    void PrinterPrivate::onImageGenerated(QImage image, bool first)
+    void PrinterPrivate::onImageGenerated(QImage image, int top, QSize pageSize, bool newPage)
     {
-        if (!first) {
+        if (newPage) {
             printer->newPage();
         }
 
         QRect viewport(painter->viewport());
-        QSize size(image.size());
+        QSize size(pageSize);
         size.scale(viewport.size(), Qt::KeepAspectRatio);
         QPoint centring(qAbs(viewport.width() - size.width()) / 2.0,
                         qAbs(viewport.height() - size.height()) / 2.0);
 
         painter->setViewport(QRect(viewport.topLeft() + centring, size));
-        painter->setWindow(image.rect());
-        painter->drawImage(0, 0, image);
+        painter->setWindow(QRect(QPoint(0, 0), pageSize));
+        painter->drawImage(0, top, image);
         painter->setViewport(viewport);
     }
 
@@ -228,7 +339,8 @@ namespace Papyro
 
                     PrinterThread * thread = new PrinterThread(this, document, d->printer);
 
-                    connect(thread, SIGNAL(imageGenerated(QImage,bool)), d, SLOT(onImageGenerated(QImage,bool)));
+                    // Blocking, so that bitmaps don't pile up waiting to be printed
+                    connect(thread, SIGNAL(imageGenerated(QImage,int,QSize,bool)), d, SLOT(onImageGenerated(QImage,int,QSize,bool)), Qt::BlockingQueuedConnection);
                     connect(thread, SIGNAL(finished()), d, SLOT(onFinished()));
                     connect(thread, SIGNAL(finished()), thread, SLOT(deleteLater()));
 
@@ -37,9 +37,13 @@
 #endif
 
 #include <QImage>
+#include <QMap>
 #include <QMutex>
 #include <QObject>
+#include <QRunnable>
+#include <QSize>
 #include <QThread>
+#include <QWaitCondition>
 
 class QPainter;
 class QPrinter;
@@ -47,6 +51,40 @@ class QPrinter;
 namespace Papyro
 {
 
+    // A horizontal strip of a page to be printed (the whole page unless the
+    // page is too large to render in one go)
+    struct PrinterBand
+    {
+        int page;
+        int resolution;
+        int top;
+        int height; // In pixels, or 0 for the whole page
+        QSize pageSize;
+        bool newPage;
+        bool lastOfPage;
+    };
+
+
+
+
+    class PrinterThread;
+    class PrinterBandRenderer : public QRunnable
+    {
+    public:
+        PrinterBandRenderer(PrinterThread * thread, int sequence, const PrinterBand & band);
+
+        void run();
+
+    private:
+        PrinterThread * _thread;
+        int _sequence;
+        PrinterBand _band;
+
+    }; // class PrinterBandRenderer
+
+
+
+
     class PrinterThread : public QThread
     {
         Q_OBJECT
@@ -62,7 +100,7 @@ namespace Papyro
 
     signals:
         void progressChanged(int progress);
-        void imageGenerated(QImage image, bool first);
+        void imageGenerated(QImage image, int top, QSize pageSize, bool newPage);
 
     private:
         Spine::DocumentHandle document;
@@ -70,6 +108,14 @@ namespace Papyro
         bool cancelled;
         QMutex mutex;
 
+        // Bands rendered ahead of printing, by sequence number
+        QMap< int, QImage > rendered;
+        QWaitCondition bandRendered;
+
+        void bandFinished(int sequence, const QImage & image);
+
+        friend class PrinterBandRenderer;
+
     }; // class PrinterThread
 
 
@@ -95,7 +141,7 @@ namespace Papyro
 
     public slots:
         void onFinished();
-        void onImageGenerated(QImage image, bool first);
+        void onImageGenerated(QImage image, int top, QSize pageSize, bool newPage);
 
     signals:
         void progressChanged(int progress);
@@ -39,6 +39,7 @@
 #include <QFile>
 #include <QPointer>
 #include <QRunnable>
+#include <QThread>
 #include <QThreadPool>
 #include <QUrl>
 
@@ -56,8 +57,68 @@ namespace Athenaeum
 
 
 
+    ResolverDocumentPermit::ResolverDocumentPermit(QSemaphore * semaphore)
+        : semaphore(semaphore)
+    {}
+
+    ResolverDocumentPermit::~ResolverDocumentPermit()
+    {
+        semaphore->release();
+    }
+
+
+
+
+    ResolverDocumentRunnable::ResolverDocumentRunnable(ResolverQueuePrivate * d, const ResolverJob & job, int priority)
+        : d(d), job(job), priority(priority), cancelled(false), documentManager(Papyro::DocumentManager::instance())
+    {}
+
+    void ResolverDocumentRunnable::cancel()
+    {
+        QMutexLocker guard(&mutex);
+        cancelled = true;
+    }
+
+    bool ResolverDocumentRunnable::isCancelled()
+    {
+        QMutexLocker guard(&mutex);
+        return cancelled;
+    }
+
+    void ResolverDocumentRunnable::run()
+    {
+        // Only parse documents whose citations the resolvers will look at
+        AbstractBibliography::State state = job.citation->field(Citation::StateRole).value< AbstractBibliography::State >();
+        QDateTime dateResolved = job.citation->field(Citation::DateResolvedRole).toDateTime();
+        if (dateResolved.isValid() || state != AbstractBibliography::IdleState) {
+            return;
+        }
+
+        // Don't get too far ahead of the resolvers, as every document parsed
+        // here is held in memory until its citation has been resolved (the
+        // permit goes back whenever the job is dropped, however that happens)
+        while (!isCancelled() && d) {
+            if (d->openDocuments.tryAcquire(1, 100)) {
+                job.permit.reset(new ResolverDocumentPermit(&d->openDocuments));
+                QUrl originatingUri(job.citation->field(Citation::OriginatingUriRole).toUrl());
+                QFile originatingFile(originatingUri.toLocalFile());
+                if (originatingFile.open(QIODevice::ReadOnly)) {
+                    job.document = documentManager->open(&originatingFile);
+                }
+                if (!isCancelled()) {
+                    d->resolve(job, priority);
+                }
+                job = ResolverJob();
+                break;
+            }
+        }
+    }
+
+
+
+
     ResolverQueueRunnable::ResolverQueueRunnable(ResolverQueuePrivate * d)
-        : d(d), cancelled(false), mutex(QMutex::Recursive), documentManager(Papyro::DocumentManager::instance())
+        : d(d), cancelled(false), mutex(QMutex::Recursive)
     {
         // Collect all the resolvers in order
         _ResolverMap::const_iterator iter(d->resolvers.begin());
@@ -92,16 +153,6 @@ namespace Athenaeum
                 if (!dateResolved.isValid() && state == AbstractBibliography::IdleState) {
                     citation->setField(Citation::StateRole, QVariant::fromValue(AbstractBibliography::BusyState));
 
-                    if (!next.document) {
-                        QUrl originatingUri(citation->field(Citation::OriginatingUriRole).toUrl());
-                        if (originatingUri.isLocalFile()) {
-                            QFile originatingFile(originatingUri.toLocalFile());
-                            if (originatingFile.open(QIODevice::ReadOnly)) {
-                                next.document = documentManager->open(&originatingFile);
-                            }
-                        }
-                    }
-
                     QVariantMap qCitation = citation->toMap();
                     QVariantMap provenance = qCitation["provenance"].toMap();
                     QVariantList sources = provenance["sources"].toList();
@@ -166,17 +217,30 @@ namespace Athenaeum
         foreach (Resolver * resolver, Utopia::instantiateAllExtensions< Resolver >()) {
             resolvers[resolver->weight()].push_back(boost::shared_ptr< Resolver >(resolver));
         }
+
+        // Resolvers mostly wait on the network, so can run wider than the
+        // CPU bound document parsing that feeds them
+        threadPool.setMaxThreadCount(qMax(4, 2 * QThread::idealThreadCount()));
+        openDocuments.release(2 * threadPool.maxThreadCount());
     }
 
     ResolverQueuePrivate::~ResolverQueuePrivate()
     {
         cancel();
+        documentPool.waitForDone();
         threadPool.waitForDone();
+
+        // Permits must go back before openDocuments is destroyed
+        stack.clear();
     }
 
     void ResolverQueuePrivate::cancel()
     {
         emit (cancelled());
+
+        // Waiting jobs will now never run, so drop them and their documents
+        QMutexLocker lock(&mutex);
+        stack.clear();
     }
 
     ResolverJob ResolverQueuePrivate::next()
@@ -190,9 +254,23 @@ namespace Athenaeum
     }
 
     void ResolverQueuePrivate::queue(CitationHandle citation, int priority)
+    {
+        QUrl originatingUri(citation->field(Citation::OriginatingUriRole).toUrl());
+        if (originatingUri.isLocalFile()) {
+            // Parse local files on their own pool before resolving them
+            ResolverDocumentRunnable * runnable = new ResolverDocumentRunnable(this, ResolverJob(citation), priority);
+            connect(this, SIGNAL(cancelled()), runnable, SLOT(cancel()), Qt::DirectConnection);
+            runnable->setAutoDelete(true);
+            documentPool.start(runnable, priority);
+        } else {
+            resolve(ResolverJob(citation), priority);
+        }
+    }
+
+    void ResolverQueuePrivate::resolve(const ResolverJob & job, int priority)
     {
         QMutexLocker lock(&mutex);
-        stack.append(ResolverJob(citation));
+        stack.append(job);
         ResolverQueueRunnable * runnable = new ResolverQueueRunnable(this);
         connect(this, SIGNAL(cancelled()), runnable, SLOT(cancel()), Qt::DirectConnection);
         runnable->setAutoDelete(true);
@@ -224,6 +302,14 @@ namespace Athenaeum
 
     void ResolverQueuePrivate::unqueue(CitationHandle citation)
     {
+        // Dropping a waiting job also frees any document opened for it
+        QMutexLocker lock(&mutex);
+        QMutableListIterator< ResolverJob > iter(stack);
+        while (iter.hasNext()) {
+            if (iter.next().citation == citation) {
+                iter.remove();
+            }
+        }
     }
 
 
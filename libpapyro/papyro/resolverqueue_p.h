@@ -42,6 +42,7 @@
 #include <QMutex>
 #include <QPointer>
 #include <QRunnable>
+#include <QSemaphore>
 #include <QThreadPool>
 
 #include <map>
@@ -54,6 +55,21 @@ namespace Athenaeum
 
     typedef std::map< int, std::vector< boost::shared_ptr< Resolver > > > _ResolverMap;
 
+    // A slot in ResolverQueuePrivate::openDocuments, given back when the
+    // last copy of the job holding it is dropped
+    class ResolverDocumentPermit
+    {
+    public:
+        ResolverDocumentPermit(QSemaphore * semaphore);
+        ~ResolverDocumentPermit();
+
+    protected:
+        QSemaphore * semaphore;
+    }; // class ResolverDocumentPermit
+
+
+
+
     class ResolverJob
     {
     public:
@@ -64,6 +80,7 @@ namespace Athenaeum
         CitationHandle citation;
         Resolver::Purposes purposes;
         Spine::DocumentHandle document;
+        boost::shared_ptr< ResolverDocumentPermit > permit; // Held if the document was opened ahead of time
     }; // class ResolverJob
 
 
@@ -79,6 +96,7 @@ namespace Athenaeum
 
         ResolverJob next();
         void queue(CitationHandle citation, int priority = -1);
+        void resolve(const ResolverJob & job, int priority = -1);
         void unqueue(CitationHandle citation);
 
     signals:
@@ -95,12 +113,40 @@ namespace Athenaeum
         QList< ResolverJob > stack;
         QMutex mutex;
         _ResolverMap resolvers;
-        QThreadPool threadPool;
+        QThreadPool threadPool; // Resolvers (network bound)
+        QThreadPool documentPool; // Document parsing (CPU bound)
+        QSemaphore openDocuments; // Documents that may be waiting for the resolvers
     }; // class ResolverQueuePrivate
 
 
 
 
+    class ResolverDocumentRunnable : public QObject, public QRunnable
+    {
+        Q_OBJECT
+
+    public:
+        ResolverDocumentRunnable(ResolverQueuePrivate * d, const ResolverJob & job, int priority);
+
+        bool isCancelled();
+        void run();
+
+    public slots:
+        void cancel();
+
+    protected:
+        QPointer< ResolverQueuePrivate > d;
+        ResolverJob job;
+        int priority;
+        bool cancelled;
+        QMutex mutex;
+        boost::shared_ptr< Papyro::DocumentManager > documentManager;
+
+    }; // class ResolverDocumentRunnable
+
+
+
+
     class ResolverQueueRunnable : public QObject, public QRunnable
     {
         Q_OBJECT
@@ -120,7 +166,6 @@ namespace Athenaeum
         boost::shared_ptr< Resolver > running;
         bool cancelled;
         QMutex mutex;
-        boost::shared_ptr< Papyro::DocumentManager > documentManager;
 
     }; // class ResolverQueueRunnable
 
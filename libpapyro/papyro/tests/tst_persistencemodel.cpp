@@ -0,0 +1,211 @@
+/*****************************************************************************
+ *  
+ *   This file is part of the Utopia Documents application.
+ *       Copyright (c) 2008-2017 Lost Island Labs
+ *           <info@utopiadocs.com>
+ *   
+ *   Utopia Documents is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU GENERAL PUBLIC LICENSE VERSION 3 as
+ *   published by the Free Software Foundation.
+ *   
+ *   Utopia Documents is distributed in the hope that it will be useful, but
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ *   Public License for more details.
+ *   
+ *   In addition, as a special exception, the copyright holders give
+ *   permission to link the code of portions of this program with the OpenSSL
+ *   library under certain conditions as described in each individual source
+ *   file, and distribute linked combinations including the two.
+ *   
+ *   You must obey the GNU General Public License in all respects for all of
+ *   the code used other than OpenSSL. If you modify file(s) with this
+ *   exception, you may extend this exception to your version of the file(s),
+ *   but you are not obligated to do so. If you do not wish to do so, delete
+ *   this exception statement from your version.
+ *   
+ *   You should have received a copy of the GNU General Public License
+ *   along with Utopia Documents. If not, see <http://www.gnu.org/licenses/>
+ *  
+ *****************************************************************************/
+
+#include <papyro/bibliography.h>
+#include <papyro/citation.h>
+#include <papyro/persistencemodel.h>
+
+#include <QFile>
+#include <QMap>
+#include <QSignalSpy>
+#include <QTemporaryDir>
+#include <QtTest>
+
+using namespace Athenaeum;
+
+static CitationHandle makeCitation(const QString & key, const QString & title)
+{
+    CitationHandle item(new Citation);
+    item->setField(Citation::KeyRole, key);
+    item->setField(Citation::TitleRole, title);
+    return item;
+}
+
+// Load a library afresh, returning the title of each citation by key
+static QMap< QString, QString > loadTitles(const QDir & path, bool * clean = 0)
+{
+    QMap< QString, QString > titles;
+    Bibliography bibliography;
+    LocalPersistenceModel persistenceModel(path);
+    QSignalSpy loaded(&persistenceModel, SIGNAL(loaded(bool)));
+    if (persistenceModel.load(&bibliography) && (!loaded.isEmpty() || loaded.wait()) && loaded.first().first().toBool()) {
+        if (clean) { *clean = true; }
+        foreach (CitationHandle item, bibliography.items()) {
+            titles[item->field(Citation::KeyRole).toString()] = item->field(Citation::TitleRole).toString();
+            if (clean && item->isDirty()) { *clean = false; }
+        }
+    }
+    return titles;
+}
+
+static void truncateFile(const QString & fileName, qint64 by)
+{
+    QFile file(fileName);
+    QVERIFY(file.open(QIODevice::ReadWrite));
+    QVERIFY(file.resize(file.size() - by));
+}
+
+
+
+
+class TestPersistenceModel : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init()
+    {
+        QVERIFY(directory.isValid());
+        path = QDir(directory.path());
+        path.mkpath("library");
+        path.cd("library");
+    }
+
+    void cleanup()
+    {
+        QDir(path).removeRecursively();
+    }
+
+    // Changes saved since the snapshot are replayed on top of it, and what is
+    // loaded is clean
+    void replaysJournal()
+    {
+        Bibliography bibliography;
+        bibliography.appendItems(QVector< CitationHandle >() << makeCitation("a", "A") << makeCitation("b", "B") << makeCitation("c", "C"));
+        LocalPersistenceModel persistenceModel(path);
+        QVERIFY(persistenceModel.save(&bibliography));
+        QVERIFY(QFile::exists(path.absoluteFilePath("snapshot")));
+
+        bibliography.itemForKey("a")->setField(Citation::TitleRole, "A2");
+        bibliography.removeItem(bibliography.itemForKey("b"));
+        bibliography.appendItems(QVector< CitationHandle >() << makeCitation("d", "D"));
+        QVERIFY(persistenceModel.save(&bibliography));
+        QVERIFY(QFile::exists(path.absoluteFilePath("journal")));
+
+        bool clean = false;
+        QMap< QString, QString > expected;
+        expected["a"] = "A2";
+        expected["c"] = "C";
+        expected["d"] = "D";
+        QCOMPARE(loadTitles(path, &clean), expected);
+        QVERIFY(clean);
+    }
+
+    // A record torn by an interrupted write is ignored, along with anything
+    // after it, and is overwritten by the next save
+    void ignoresTornRecord()
+    {
+        Bibliography bibliography;
+        bibliography.appendItems(QVector< CitationHandle >() << makeCitation("a", "A") << makeCitation("b", "B") << makeCitation("c", "C"));
+        {
+            LocalPersistenceModel persistenceModel(path);
+            QVERIFY(persistenceModel.save(&bibliography));
+            bibliography.itemForKey("a")->setField(Citation::TitleRole, "A2");
+            bibliography.removeItem(bibliography.itemForKey("c"));
+            QVERIFY(persistenceModel.save(&bibliography));
+        }
+
+        // Tear the last record (the removal of c)
+        truncateFile(path.absoluteFilePath("journal"), 2);
+        QMap< QString, QString > expected;
+        expected["a"] = "A2";
+        expected["b"] = "B";
+        expected["c"] = "C";
+        QCOMPARE(loadTitles(path), expected);
+
+        // Saving again from a loaded library replaces the torn record
+        Bibliography reloaded;
+        LocalPersistenceModel persistenceModel(path);
+        QSignalSpy loaded(&persistenceModel, SIGNAL(loaded(bool)));
+        QVERIFY(persistenceModel.load(&reloaded));
+        QVERIFY(loaded.wait());
+        reloaded.itemForKey("b")->setField(Citation::TitleRole, "B2");
+        QVERIFY(persistenceModel.save(&reloaded));
+        expected["b"] = "B2";
+        QCOMPARE(loadTitles(path), expected);
+    }
+
+    // A journal left over from an earlier snapshot is never replayed
+    void ignoresStaleJournal()
+    {
+        Bibliography bibliography;
+        bibliography.appendItems(QVector< CitationHandle >() << makeCitation("a", "A"));
+        LocalPersistenceModel persistenceModel(path);
+        QVERIFY(persistenceModel.save(&bibliography));
+        bibliography.itemForKey("a")->setField(Citation::TitleRole, "A2");
+        QVERIFY(persistenceModel.save(&bibliography));
+        QVERIFY(QFile::copy(path.absoluteFilePath("journal"), path.absoluteFilePath("journal.old")));
+
+        // Without a snapshot, the next save writes a new one from scratch
+        bibliography.itemForKey("a")->setField(Citation::TitleRole, "A3");
+        QVERIFY(QFile::remove(path.absoluteFilePath("snapshot")));
+        QVERIFY(persistenceModel.save(&bibliography));
+        QVERIFY(!QFile::exists(path.absoluteFilePath("journal")));
+        QVERIFY(QFile::rename(path.absoluteFilePath("journal.old"), path.absoluteFilePath("journal")));
+
+        QMap< QString, QString > expected;
+        expected["a"] = "A3";
+        QCOMPARE(loadTitles(path), expected);
+    }
+
+    // A complete replacement snapshot left behind by an interrupted save is
+    // recovered, and an incomplete one is discarded
+    void recoversScratchSnapshot()
+    {
+        Bibliography bibliography;
+        bibliography.appendItems(QVector< CitationHandle >() << makeCitation("a", "A") << makeCitation("b", "B"));
+        {
+            LocalPersistenceModel persistenceModel(path);
+            QVERIFY(persistenceModel.save(&bibliography));
+        }
+        QVERIFY(QFile::rename(path.absoluteFilePath("snapshot"), path.absoluteFilePath("snapshot.tmp")));
+
+        QMap< QString, QString > expected;
+        expected["a"] = "A";
+        expected["b"] = "B";
+        QCOMPARE(loadTitles(path), expected);
+        QVERIFY(QFile::exists(path.absoluteFilePath("snapshot")));
+        QVERIFY(!QFile::exists(path.absoluteFilePath("snapshot.tmp")));
+
+        QVERIFY(QFile::rename(path.absoluteFilePath("snapshot"), path.absoluteFilePath("snapshot.tmp")));
+        truncateFile(path.absoluteFilePath("snapshot.tmp"), 2);
+        QCOMPARE(loadTitles(path), QMap< QString, QString >());
+        QVERIFY(!QFile::exists(path.absoluteFilePath("snapshot.tmp")));
+    }
+
+private:
+    QTemporaryDir directory;
+    QDir path;
+};
+
+QTEST_GUILESS_MAIN(TestPersistenceModel)
+
+#include "tst_persistencemodel.moc"
@@ -62,6 +62,21 @@ Spine::DocumentHandle CrackleDocumentFactory::create(const QByteArray & bytes)
     return Spine::DocumentHandle(document);
 }
 
+Spine::DocumentHandle CrackleDocumentFactory::create(const QString & filename)
+{
+    // Let crackle map the file itself rather than copying it into memory
+    Crackle::PDFDocument * document = new Crackle::PDFDocument();
+    document->readFile(filename.toUtf8().constData());
+    if(!document->isOK()) {
+        delete document;
+
+        // Fall back to reading the file through Qt
+        return Papyro::DocumentFactory::create(filename);
+    }
+
+    return Spine::DocumentHandle(document);
+}
+
 bool CrackleDocumentFactory::isCapable(const QString & filename)
 {
     return true;
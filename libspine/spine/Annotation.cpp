@@ -85,6 +85,8 @@ namespace Spine
 
         std::list< CapabilityHandle > capabilities;
 
+        std::list< std::pair< Annotation::AreasChangedSignal, void * > > areasChangedSubscribers;
+
         bool equalRegions(const AnnotationPrivate &rhs_) const
         {
             return area.areas == rhs_.area.areas &&
@@ -108,6 +110,15 @@ namespace Spine
                 uniquePages.insert(area.page);
             }
         }
+
+        void emitAreasChanged(Annotation * annotation)
+        {
+            std::list< std::pair< Annotation::AreasChangedSignal, void * > >::const_iterator i;
+            for (i = areasChangedSubscribers.begin(); i != areasChangedSubscribers.end(); ++i)
+            {
+                (i->first)(i->second, annotation);
+            }
+        }
     };
 
     Annotation::Annotation()
@@ -140,8 +151,9 @@ namespace Spine
         if (!exists)
         {
             d->area.areas.insert(area);
+            d->recache();
+            d->emitAreasChanged(this);
         }
-        d->recache();
         return !exists;
     }
 
@@ -179,8 +191,9 @@ namespace Spine
                 d->text.extents.insert(extent);
                 std::list< Area > boxes(extent->areas());
                 d->text.areas.insert(boxes.begin(), boxes.end());
+                d->recache();
+                d->emitAreasChanged(this);
             }
-            d->recache();
             return !exists;
         }
         else
@@ -219,6 +232,12 @@ namespace Spine
         d->properties.clear();
     }
 
+    void Annotation::connectAreasChanged(AreasChangedSignal subscriber, void * userdef)
+    {
+        boost::lock_guard< boost::recursive_mutex > guard(d->mutex);
+        d->areasChangedSubscribers.push_back(std::make_pair(subscriber, userdef));
+    }
+
     bool Annotation::contains(int page)
     {
         boost::lock_guard< boost::recursive_mutex > guard(d->mutex);
@@ -252,6 +271,12 @@ namespace Spine
         return false;
     }
 
+    void Annotation::disconnectAreasChanged(AreasChangedSignal subscriber, void * userdef)
+    {
+        boost::lock_guard< boost::recursive_mutex > guard(d->mutex);
+        d->areasChangedSubscribers.remove(std::make_pair(subscriber, userdef));
+    }
+
     Annotation::iterator Annotation::end()
     {
         boost::lock_guard< boost::recursive_mutex > guard(d->mutex);
@@ -332,7 +357,11 @@ namespace Spine
     {
         boost::lock_guard< boost::recursive_mutex > guard(d->mutex);
         bool ret = d->area.areas.erase(area) > 0;
-        d->recache();
+        if (ret)
+        {
+            d->recache();
+            d->emitAreasChanged(this);
+        }
         return ret;
     }
 
@@ -361,8 +390,9 @@ namespace Spine
                         d->text.areas.erase(found);
                     }
                 }
+                d->recache();
+                d->emitAreasChanged(this);
             }
-            d->recache();
             return exists;
         }
         else
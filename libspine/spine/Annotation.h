@@ -52,6 +52,7 @@ namespace Spine {
     public:
         typedef AreaSet::iterator iterator;
         typedef AreaSet::const_iterator const_iterator;
+        typedef void (*AreasChangedSignal)(void *, Annotation *);
 
         Annotation();
         Annotation(const Annotation &rhs_);
@@ -88,6 +89,12 @@ namespace Spine {
         void setPublic(bool isPublic);
         std::string text(const std::string & joiner = " ") const;
 
+        // Subscribers are told whenever an area or extent is added or
+        // removed. They are called with the annotation locked, so should do
+        // no more than take note of the change.
+        void connectAreasChanged(AreasChangedSignal subscriber, void * userdef);
+        void disconnectAreasChanged(AreasChangedSignal subscriber, void * userdef);
+
         bool operator==(const Annotation &rhs_) const;
 
         // Are there any capabilities registered for the given annotation
@@ -35,6 +35,7 @@
 #include <spine/Region.h>
 #include <spine/Image.h>
 #include <spine/Annotation.h>
+#include <spine/SpatialIndex.h>
 #include <spine/utility.h>
 #include <spine/fingerprint.h>
 
@@ -42,6 +43,8 @@
 #include <locale>
 #include <cstdlib>
 #include <cwctype>
+#include <cstdio>
+#include <fstream>
 
 #include <string>
 #include <utf8/unicode.h>
@@ -85,6 +88,31 @@ namespace {
 
         return result;
     }
+
+    boost::mutex & fingerprintCachePathMutex()
+    {
+        static boost::mutex mutex;
+        return mutex;
+    }
+
+    string & fingerprintCachePathStorage()
+    {
+        static string path;
+        return path;
+    }
+
+    // Version tag of the on-disk fingerprint record
+    const char * const fingerprintCacheVersion = "utopia-fingerprints-1";
+
+    // The cache file for a given file hash digest
+    string fingerprintCacheFile(const string & digest)
+    {
+        string path(Spine::Document::fingerprintCachePath());
+        if (path.empty() || digest.empty()) {
+            return string();
+        }
+        return path + "/" + digest;
+    }
 }
 
 /****************************************************************************/
@@ -132,6 +160,59 @@ namespace Spine
         mutable string charhash2;
         mutable string imagehash1;
         mutable string imagehash2;
+        bool fingerprintsCalculated;
+        mutable boost::recursive_mutex fingerprintsMutex;
+
+        bool loadFingerprints(const string & digest_)
+        {
+            string filename(fingerprintCacheFile(digest_));
+            if (filename.empty()) {
+                return false;
+            }
+
+            ifstream file(filename.c_str());
+            string version;
+            if (!getline(file, version) || version != fingerprintCacheVersion) {
+                return false;
+            }
+
+            string hashes[4];
+            for (int i = 0; i < 4; ++i) {
+                if (!getline(file, hashes[i])) {
+                    return false;
+                }
+            }
+
+            charhash1 = hashes[0];
+            charhash2 = hashes[1];
+            imagehash1 = hashes[2];
+            imagehash2 = hashes[3];
+            return true;
+        }
+
+        void saveFingerprints(const string & digest_)
+        {
+            string filename(fingerprintCacheFile(digest_));
+            if (filename.empty()) {
+                return;
+            }
+
+            // Write to a scratch file first so readers never see a partial record
+            string scratch(filename + ".tmp");
+            {
+                ofstream file(scratch.c_str(), ios::out | ios::trunc);
+                file << fingerprintCacheVersion << "\n"
+                     << charhash1 << "\n" << charhash2 << "\n"
+                     << imagehash1 << "\n" << imagehash2 << "\n";
+                if (!file) {
+                    file.close();
+                    remove(scratch.c_str());
+                    return;
+                }
+            }
+            remove(filename.c_str());
+            rename(scratch.c_str(), filename.c_str());
+        }
         mutable string pmid;
         mutable string doi;
         mutable string pii;
@@ -147,6 +228,160 @@ namespace Spine
         map< string, list< pair< AnnotationsChangedSignal, void * > > > annotationSubscribers;
         mutable boost::recursive_mutex annotationsMutex;
 
+        // Spatial index of each list's annotation areas, used for hit testing,
+        // along with the set of annotations on each page. Areas are recorded
+        // when an annotation is added to a list; those that have no areas at
+        // that point are kept aside and indexed the first time they are seen
+        // with some. Annotations report later changes to their areas, which
+        // are noted in changedAnnotations and reindexed before the next hit
+        // test.
+        struct AnnotationIndex
+        {
+            map< int, SpatialIndex< AnnotationHandle > > pages;
+            map< int, AnnotationSet > annotationsByPage;
+            map< AnnotationHandle, std::list< Area > > areas;
+            map< Annotation *, AnnotationHandle > handles;
+            AnnotationSet unplaced;
+        };
+        mutable map< string, AnnotationIndex > annotationIndices;
+
+        // Annotations whose areas have changed since they were indexed. This
+        // has its own mutex as changes are reported with the annotation locked
+        set< Annotation * > changedAnnotations;
+        boost::mutex changedAnnotationsMutex;
+
+        static void onAreasChanged(void * userdef, Annotation * annotation)
+        {
+            DocumentPrivate * d = static_cast< DocumentPrivate * >(userdef);
+            boost::lock_guard<boost::mutex> g(d->changedAnnotationsMutex);
+            d->changedAnnotations.insert(annotation);
+        }
+
+        static bool indexAnnotation(AnnotationIndex & index, AnnotationHandle annotation)
+        {
+            index.handles[annotation.get()] = annotation;
+            std::list< Area > & areas = index.areas[annotation];
+            for (Annotation::const_iterator i(annotation->begin()); i != annotation->end(); ++i) {
+                index.pages[i->page].insert(i->boundingBox, annotation);
+                index.annotationsByPage[i->page].insert(annotation);
+                areas.push_back(*i);
+            }
+            if (areas.empty()) {
+                index.areas.erase(annotation);
+                index.unplaced.insert(annotation);
+                return false;
+            }
+            return true;
+        }
+
+        static void unindexAnnotation(AnnotationIndex & index, AnnotationHandle annotation)
+        {
+            map< AnnotationHandle, std::list< Area > >::iterator found(index.areas.find(annotation));
+            if (found != index.areas.end()) {
+                BOOST_FOREACH(const Area & area, found->second) {
+                    map< int, SpatialIndex< AnnotationHandle > >::iterator page(index.pages.find(area.page));
+                    if (page != index.pages.end()) {
+                        page->second.remove(area.boundingBox, annotation);
+                        if (page->second.empty()) {
+                            index.pages.erase(page);
+                        }
+                    }
+                    map< int, AnnotationSet >::iterator onPage(index.annotationsByPage.find(area.page));
+                    if (onPage != index.annotationsByPage.end()) {
+                        onPage->second.erase(annotation);
+                        if (onPage->second.empty()) {
+                            index.annotationsByPage.erase(onPage);
+                        }
+                    }
+                }
+                index.areas.erase(found);
+            }
+            index.unplaced.erase(annotation);
+            index.handles.erase(annotation.get());
+        }
+
+        // Reindex any annotations whose areas have changed, and index any
+        // that have gained areas since being added
+        void placeAnnotations(AnnotationIndex & index)
+        {
+            set< Annotation * > changed;
+            {
+                boost::lock_guard<boost::mutex> g(changedAnnotationsMutex);
+                changed.swap(changedAnnotations);
+            }
+            if (!changed.empty()) {
+                map< string, AnnotationIndex >::iterator list(annotationIndices.begin());
+                for (; list != annotationIndices.end(); ++list) {
+                    BOOST_FOREACH(Annotation * raw, changed) {
+                        map< Annotation *, AnnotationHandle >::iterator found(list->second.handles.find(raw));
+                        if (found != list->second.handles.end()) {
+                            AnnotationHandle annotation(found->second);
+                            unindexAnnotation(list->second, annotation);
+                            indexAnnotation(list->second, annotation);
+                        }
+                    }
+                }
+            }
+
+            AnnotationSet unplaced;
+            unplaced.swap(index.unplaced);
+            BOOST_FOREACH(AnnotationHandle annotation, unplaced) {
+                indexAnnotation(index, annotation);
+            }
+        }
+
+        // Inverted index of the document's words, built on first use
+        TextIndexHandle textIndex;
+        boost::mutex textIndexMutex;
+
+        // Spatial index of each page's words, built on first use by cursorAt.
+        // Each entry holds a cursor positioned on the word and the word's
+        // position in page order, so that overlapping hits resolve to the
+        // same word a linear walk would have found first.
+        typedef pair< size_t, CursorHandle > IndexedWord;
+        map< int, SpatialIndex< IndexedWord > > wordIndices;
+        boost::mutex wordIndicesMutex;
+
+        // Query the page's word index, building it first if need be. The
+        // page's text is walked without the lock held; should another thread
+        // build the same index meanwhile, its copy is the one kept.
+        template< typename OutputIterator >
+        OutputIterator queryWords(Document * document, int page, double x, double y, OutputIterator out)
+        {
+            {
+                boost::lock_guard<boost::mutex> g(wordIndicesMutex);
+                map< int, SpatialIndex< IndexedWord > >::const_iterator found(wordIndices.find(page));
+                if (found != wordIndices.end()) {
+                    return found->second.query(x, y, out);
+                }
+            }
+
+            SpatialIndex< IndexedWord > index;
+            CursorHandle cursor(document->newCursor(page));
+            size_t order = 0;
+            while (cursor->region()) {
+                while (cursor->block()) {
+                    while (cursor->line()) {
+                        while (const Word * word = cursor->word()) {
+                            index.insert(word->boundingBox(), IndexedWord(order++, cursor->clone()));
+                            cursor->nextWord();
+                        }
+                        cursor->nextLine();
+                    }
+                    cursor->nextBlock();
+                }
+                cursor->nextRegion();
+            }
+
+            boost::lock_guard<boost::mutex> g(wordIndicesMutex);
+            map< int, SpatialIndex< IndexedWord > >::iterator found(wordIndices.find(page));
+            if (found == wordIndices.end()) {
+                found = wordIndices.insert(make_pair(page, SpatialIndex< IndexedWord >())).first;
+                found->second.swap(index);
+            }
+            return found->second.query(x, y, out);
+        }
+
         void emitAnnotationsChanged(const string & name, const AnnotationSet & annotations, bool added)
         {
             string any;
@@ -247,15 +482,31 @@ namespace Spine
         d->userdef = userdef_;
         d->deathRowScratchId = newScratchId();
         d->imageBased = DocumentPrivate::Unknown;
+        d->fingerprintsCalculated = false;
     }
 
     Document::~Document()
     {
+        // Annotations may outlive the document, so stop them reporting to it
+        {
+            boost::lock_guard<boost::recursive_mutex> g(d->annotationsMutex);
+            map< Annotation *, size_t >::const_iterator i(d->annotationsByIdRefCount.begin());
+            for (; i != d->annotationsByIdRefCount.end(); ++i) {
+                i->first->disconnectAreasChanged(&DocumentPrivate::onAreasChanged, d);
+            }
+        }
         delete d;
     }
 
     string Document::uniqueID() {return "";} // specific to derived class
 
+    string Document::filehashDigest()
+    {
+        string hash(this->filehash());
+        string::size_type slash(hash.rfind('/'));
+        return slash == string::npos ? hash : hash.substr(slash + 1);
+    }
+
     string Document::title() {return "";}
     string Document::subject() {return "";}
     string Document::keywords() {return "";}
@@ -353,37 +604,95 @@ namespace Spine
         return d->imageBased == DocumentPrivate::ImageBased;
     }
 
+    void Document::setFingerprintCachePath(const string & path_)
+    {
+        boost::lock_guard<boost::mutex> g(fingerprintCachePathMutex());
+        fingerprintCachePathStorage() = path_;
+    }
+
+    string Document::fingerprintCachePath()
+    {
+        boost::lock_guard<boost::mutex> g(fingerprintCachePathMutex());
+        return fingerprintCachePathStorage();
+    }
+
     string Document::characterFingerprint1()
     {
-        if(d->charhash1.empty()) {
-            this->calculateCharacterFingerprints();
+        boost::lock_guard<boost::recursive_mutex> g(d->fingerprintsMutex);
+        if(!d->fingerprintsCalculated) {
+            this->calculateFingerprints();
         }
         return d->charhash1;
     }
 
     string Document::characterFingerprint2()
     {
-        if(d->charhash2.empty()) {
-            this->calculateCharacterFingerprints();
+        boost::lock_guard<boost::recursive_mutex> g(d->fingerprintsMutex);
+        if(!d->fingerprintsCalculated) {
+            this->calculateFingerprints();
         }
         return d->charhash2;
     }
 
-    // generate SHA-256 hash of characters
+    string Document::imageFingerprint1()
+    {
+        boost::lock_guard<boost::recursive_mutex> g(d->fingerprintsMutex);
+        if(!d->fingerprintsCalculated) {
+            this->calculateFingerprints();
+        }
+        return d->imagehash1;
+    }
+
+    string Document::imageFingerprint2()
+    {
+        boost::lock_guard<boost::recursive_mutex> g(d->fingerprintsMutex);
+        if(!d->fingerprintsCalculated) {
+            this->calculateFingerprints();
+        }
+        return d->imagehash2;
+    }
+
     void Document::calculateCharacterFingerprints()
     {
-        Sha256 hash1;
-        Sha256 hash2;
+        this->calculateFingerprints();
+    }
+
+    void Document::calculateImageFingerprints()
+    {
+        this->calculateFingerprints();
+    }
+
+    // generate SHA-256 hashes of characters and images in a single pass
+    // over the document, or fetch them from the fingerprint cache
+    void Document::calculateFingerprints()
+    {
+        boost::lock_guard<boost::recursive_mutex> g(d->fingerprintsMutex);
+        if (d->fingerprintsCalculated) {
+            return;
+        }
+
+        string digest(this->filehashDigest());
+        if (d->loadFingerprints(digest)) {
+            d->fingerprintsCalculated = true;
+            return;
+        }
+
+        Sha256 charHash1;
+        Sha256 charHash2;
+        Sha256 imageHash1;
+        Sha256 imageHash2;
         unsigned char data[4];
 
         CursorHandle c(this->newCursor());
 
         const Character *txtchr;
         const Word *wrd;
+        const Image *img;
 
         for( ; c->page(); c->nextPage()) {
 
             int pg(c->page()->pageNumber());
+            Spine::BoundingBox pageBox(c->page()->boundingBox());
 
             // iterate over words but not advancing page
             while ( (wrd=c->word()) ) {
@@ -394,18 +703,18 @@ namespace Spine
 
                         // ignore 1 inch margin
                         if(txtchr->boundingBox().x1 >= 72.0 &&
-                           txtchr->boundingBox().x2 <= c->page()->boundingBox().x2-72.0 &&
+                           txtchr->boundingBox().x2 <= pageBox.x2-72.0 &&
                            txtchr->boundingBox().y1 >= 72.0 &&
-                           txtchr->boundingBox().y2 <= c->page()->boundingBox().y2-72.0)
+                           txtchr->boundingBox().y2 <= pageBox.y2-72.0)
                         {
                             utf8::uint32_t ch(txtchr->charcode());
                             data[0]=(ch & 0xff000000) >> 24;
                             data[1]=(ch & 0x00ff0000) >> 16;
                             data[2]=(ch & 0x0000ff00) >> 8;
                             data[3]=(ch & 0x000000ff);
-                            hash1.update(data, 4);
+                            charHash1.update(data, 4);
                             if (pg>1) {
-                                hash2.update(data, 4);
+                                charHash2.update(data, 4);
                             }
                         }
                         c->nextCharacter();
@@ -413,63 +722,21 @@ namespace Spine
                 }
                 c->nextWord(WithinPage);
             }
-        }
-
-        if(hash1.isValid()) {
-            d->charhash1=Fingerprint::character1FingerprintIri(hash1.calculateHash());
-        } else {
-            d->charhash1.clear();
-        }
-
-        if(hash2.isValid()) {
-            d->charhash2=Fingerprint::character2FingerprintIri(hash2.calculateHash());
-        } else {
-            d->charhash2.clear();
-        }
-    }
-
-    string Document::imageFingerprint1()
-    {
-        if(d->imagehash1.empty()) {
-            this->calculateImageFingerprints();
-        }
-        return d->imagehash1;
-    }
-
-    string Document::imageFingerprint2()
-    {
-        if(d->imagehash2.empty()) {
-            this->calculateImageFingerprints();
-        }
-        return d->imagehash2;
-    }
-
-    void Document::calculateImageFingerprints()
-    {
-        Sha256 hash1;
-        Sha256 hash2;
-
-        CursorHandle c(this->newCursor());
-        const Image *img;
-
-        for( ; c->page(); c->nextPage()) {
-
-            int pg(c->page()->pageNumber());
 
             // iterate over images on same page
             while( (img=c->image()) ) {
                 if((img->boundingBox().width() * img->boundingBox().height()) > 5000.0) {
 
                     if(img->boundingBox().x2 > 72.0 &&
-                       img->boundingBox().x1 < c->page()->boundingBox().x2-72.0 &&
+                       img->boundingBox().x1 < pageBox.x2-72.0 &&
                        img->boundingBox().y2 > 72.0  &&
-                       img->boundingBox().y1 < c->page()->boundingBox().y2-72.0)
+                       img->boundingBox().y1 < pageBox.y2-72.0)
                     {
-                        unsigned char *data(reinterpret_cast<unsigned char *>(img->data().get()));
+                        unsigned char *imgdata(reinterpret_cast<unsigned char *>(img->data().get()));
                         size_t size(img->size());
-                        hash1.update(data, size);
+                        imageHash1.update(imgdata, size);
                         if (pg>1) {
-                            hash2.update(data, size);
+                            imageHash2.update(imgdata, size);
                         }
                     }
                 }
@@ -477,16 +744,32 @@ namespace Spine
             }
         }
 
-        if(hash1.isValid()) {
-            d->imagehash1=Fingerprint::image1FingerprintIri(string(hash1.calculateHash()));
+        if(charHash1.isValid()) {
+            d->charhash1=Fingerprint::character1FingerprintIri(charHash1.calculateHash());
+        } else {
+            d->charhash1.clear();
+        }
+
+        if(charHash2.isValid()) {
+            d->charhash2=Fingerprint::character2FingerprintIri(charHash2.calculateHash());
+        } else {
+            d->charhash2.clear();
+        }
+
+        if(imageHash1.isValid()) {
+            d->imagehash1=Fingerprint::image1FingerprintIri(string(imageHash1.calculateHash()));
         } else {
             d->imagehash1.clear();
         }
-        if(hash2.isValid()) {
-            d->imagehash2=Fingerprint::image2FingerprintIri(string(hash2.calculateHash()));
+
+        if(imageHash2.isValid()) {
+            d->imagehash2=Fingerprint::image2FingerprintIri(string(imageHash2.calculateHash()));
         } else {
             d->imagehash2.clear();
         }
+
+        d->fingerprintsCalculated = true;
+        d->saveFingerprints(digest);
     }
 
     /****************************************************************************/
@@ -636,15 +919,57 @@ namespace Spine
 
     TextExtentSet Document::search(const string & regexp, int options)
     {
+        // Once the document's text index has been built, a literal search
+        // need only extract the text of the pages on which it could match
+        TextIndexHandle index;
+        if (!(options & RegExp)) {
+            boost::lock_guard<boost::mutex> g(d->textIndexMutex);
+            index = d->textIndex;
+        }
+        vector< int > pages;
+        if (index && index->pages(regexp, (options & WholeWordsOnly) != 0, pages)) {
+            TextExtentSet matches;
+            size_t first = 0;
+            while (first < pages.size()) {
+                // Search runs of consecutive pages together, so that matches
+                // across a page break are still found
+                size_t last = first;
+                while (last + 1 < pages.size() && pages[last + 1] == pages[last] + 1) {
+                    ++last;
+                }
+                TextIterator from(newCursor(pages[first]));
+                TextIterator to(pages[last] < (int) numberOfPages() ? TextIterator(newCursor(pages[last] + 1)) : end());
+                TextExtentSet found(TextExtentHandle(new TextExtent(from, to))->search(regexp, options));
+                matches.insert(found.begin(), found.end());
+                first = last + 1;
+            }
+            return matches;
+        }
+
         return searchFrom(begin(), regexp, options);
     }
 
+    vector< TextExtentSet > Document::search(const vector< string > & regexps, int options)
+    {
+        TextExtentHandle h(_cachedExtent(begin(), end()));
+        return (*h).search(regexps, options);
+    }
+
     TextExtentSet Document::searchFrom(const TextIterator & start, const string & regexp, int options)
     {
         TextExtentHandle h(_cachedExtent(start, end()));
         return (*h).search(regexp, options);
     }
 
+    TextIndexHandle Document::textIndex()
+    {
+        boost::lock_guard<boost::mutex> g(d->textIndexMutex);
+        if (!d->textIndex) {
+            d->textIndex = TextIndexHandle(new TextIndex(*this));
+        }
+        return d->textIndex;
+    }
+
     TextExtentHandle Document::substr(int start, int len)
     {
         TextExtentHandle h(_cachedExtent(begin(), end()));
@@ -669,40 +994,28 @@ namespace Spine
 
         if (cursor->image() == 0)
         {
-            while (const Region * region = cursor->region())
+            // Find candidate words from the page's spatial index, and try
+            // them in page order
+            vector< DocumentPrivate::IndexedWord > words;
+            d->queryWords(this, page, x, y, back_inserter(words));
+            sort(words.begin(), words.end());
+
+            BOOST_FOREACH(const DocumentPrivate::IndexedWord & word, words)
             {
-                if (region->boundingBox().contains(x, y))
+                CursorHandle candidate(word.second->clone());
+                while (const Character * character = candidate->character())
                 {
-                    while (const Block * block = cursor->block())
+                    if (character->boundingBox().contains(x, y))
                     {
-                        if (block->boundingBox().contains(x, y))
-                        {
-                            while (const Line * line = cursor->line())
-                            {
-                                if (line->boundingBox().contains(x, y))
-                                {
-                                    while (const Word * word = cursor->word())
-                                    {
-                                        if (word->boundingBox().contains(x, y))
-                                        {
-                                            while (const Character * character = cursor->character())
-                                            {
-                                                if (character->boundingBox().contains(x, y))
-                                                {
-                                                    return cursor;
-                                                }
-                                                cursor->nextCharacter();
-                                            }
-                                        }
-                                        cursor->nextWord();
-                                    }
-                                }
-                                cursor->nextLine();
-                            }
-                        }
-                        cursor->nextBlock();
+                        return candidate;
                     }
+                    candidate->nextCharacter();
                 }
+            }
+
+            // Nothing hit, so leave the cursor past the page's last region
+            while (cursor->region())
+            {
                 cursor->nextRegion();
             }
         }
@@ -845,6 +1158,7 @@ namespace Spine
                     if (d->annotationsByIdRefCount.find(ann_.get()) == d->annotationsByIdRefCount.end()) {
                         d->annotationsByIdRefCount[ann_.get()] = 0;
                         ann_->setProperty("concrete", "1");
+                        ann_->connectAreasChanged(&DocumentPrivate::onAreasChanged, d);
                     }
                     if (d->annotationsByParentIdRefCount.find(ann_.get()) == d->annotationsByParentIdRefCount.end()) {
                         d->annotationsByParentIdRefCount[ann_.get()] = 0;
@@ -853,6 +1167,8 @@ namespace Spine
                     d->annotationsById[id].insert(ann_);
                     d->annotationsByIdRefCount[ann_.get()] += 1;
 
+                    DocumentPrivate::indexAnnotation(d->annotationIndices[list], ann_);
+
                     //cerr << "+++++ addAnnotation " << list << " - " << parent << endl;
                     if (!parent.empty()) {
                         d->annotationsByParentId[parent].insert(ann_);
@@ -883,6 +1199,8 @@ namespace Spine
 
                 // Remove the annotation
                 if (d->annotations[list].erase(ann_) > 0) {
+                    DocumentPrivate::unindexAnnotation(d->annotationIndices[list], ann_);
+
                     // Remove reference count if no longer needed, and make no longer
                     // concrete
                     d->annotationsByIdRefCount[ann_.get()] -= 1;
@@ -890,6 +1208,9 @@ namespace Spine
                         d->annotationsByIdRefCount.erase(ann_.get());
                         d->annotationsById[id].erase(ann_);
                         ann_->setProperty("concrete", "0");
+                        ann_->disconnectAreasChanged(&DocumentPrivate::onAreasChanged, d);
+                        boost::lock_guard<boost::mutex> g(d->changedAnnotationsMutex);
+                        d->changedAnnotations.erase(ann_.get());
                     }
 
                     //cerr << "+++++ removeAnnotation " << list << " - " << parent << endl;
@@ -910,14 +1231,23 @@ namespace Spine
     {
         boost::lock_guard<boost::recursive_mutex> g(d->annotationsMutex);
         AnnotationSet found;
-        map< string, AnnotationSet >::const_iterator found_list(d->annotations.find(list));
-        if (found_list != d->annotations.end())
+        map< string, DocumentPrivate::AnnotationIndex >::iterator found_list(d->annotationIndices.find(list));
+        if (found_list != d->annotationIndices.end())
         {
-            BOOST_FOREACH(AnnotationHandle annotation, found_list->second)
+            DocumentPrivate::AnnotationIndex & index = found_list->second;
+            d->placeAnnotations(index);
+
+            // Candidates from the index are checked against the annotation's
+            // current areas, in case they have changed since it was indexed
+            map< int, AnnotationSet >::const_iterator found_page(index.annotationsByPage.find(page));
+            if (found_page != index.annotationsByPage.end())
             {
-                if (annotation->contains(page))
+                BOOST_FOREACH(AnnotationHandle annotation, found_page->second)
                 {
-                    found.insert(annotation);
+                    if (annotation->contains(page))
+                    {
+                        found.insert(annotation);
+                    }
                 }
             }
         }
@@ -928,14 +1258,25 @@ namespace Spine
     {
         boost::lock_guard<boost::recursive_mutex> g(d->annotationsMutex);
         AnnotationSet found;
-        map< string, AnnotationSet >::const_iterator found_list(d->annotations.find(list));
-        if (found_list != d->annotations.end())
+        map< string, DocumentPrivate::AnnotationIndex >::iterator found_list(d->annotationIndices.find(list));
+        if (found_list != d->annotationIndices.end())
         {
-            BOOST_FOREACH(AnnotationHandle annotation, found_list->second)
+            DocumentPrivate::AnnotationIndex & index = found_list->second;
+            d->placeAnnotations(index);
+
+            // Candidates from the index are checked against the annotation's
+            // current areas, in case they have changed since it was indexed
+            map< int, SpatialIndex< AnnotationHandle > >::const_iterator found_page(index.pages.find(page));
+            if (found_page != index.pages.end())
             {
-                if (annotation->contains(page, x, y))
+                AnnotationSet candidates;
+                found_page->second.query(x, y, inserter(candidates, candidates.end()));
+                BOOST_FOREACH(AnnotationHandle annotation, candidates)
                 {
-                    found.insert(annotation);
+                    if (annotation->contains(page, x, y))
+                    {
+                        found.insert(annotation);
+                    }
                 }
             }
         }
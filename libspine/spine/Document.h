@@ -37,6 +37,7 @@
 #include <spine/Image.h>
 #include <spine/TextIterator.h>
 #include <spine/TextSelection.h>
+#include <spine/TextIndex.h>
 #include <spine/spineapi.h>
 
 #include <boost/shared_ptr.hpp>
@@ -119,6 +120,7 @@ namespace Spine
         virtual std::string pii();
         virtual std::string uniqueID(); // specific to derived class
         virtual std::string filehash() = 0;
+        std::string filehashDigest(); // The digest that ends the filehash() IRI
         virtual void calculateCharacterFingerprints();
         virtual void calculateImageFingerprints();
         virtual std::string characterFingerprint1();
@@ -138,6 +140,11 @@ namespace Spine
         virtual std::string creator();
         virtual std::string producer();
 
+        // Directory in which calculated fingerprints are persisted, keyed by
+        // file hash; an empty path (the default) disables the cache
+        static void setFingerprintCachePath(const std::string & path_);
+        static std::string fingerprintCachePath();
+
         std::string newScratchId(const std::string & name = std::string()) const;
         std::string deletedItemsScratchId() const;
 
@@ -159,11 +166,17 @@ namespace Spine
         TextIterator begin();
         TextIterator end();
         TextExtentSet search(const std::string & term, int options = DefaultSearchOptions);
+        std::vector< TextExtentSet > search(const std::vector< std::string > & terms, int options = DefaultSearchOptions);
         TextExtentSet searchFrom(const TextIterator & start, const std::string & term, int options = DefaultSearchOptions);
+        // Built on first use; until then, search() extracts all of the text
+        TextIndexHandle textIndex();
         TextExtentHandle resolveExtent(int page1, double x1, double y1, int page2, double x2, double y2);
         virtual std::string text();
         TextExtentHandle substr(int start, int len);
 
+        // Character and image fingerprints together, in one pass
+        virtual void calculateFingerprints();
+
         // Annotations
         std::list< std::string > annotationLists() const;
         std::set< AnnotationHandle > annotations(const std::string & list = std::string()) const;
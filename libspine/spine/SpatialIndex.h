@@ -0,0 +1,194 @@
+/*****************************************************************************
+ *
+ *   This file is part of the libspine library.
+ *       Copyright (c) 2008-2017 Lost Island Labs
+ *           <info@utopiadocs.com>
+ *
+ *   The libspine library is free software: you can redistribute it and/or
+ *   modify it under the terms of the GNU AFFERO GENERAL PUBLIC LICENSE
+ *   VERSION 3 as published by the Free Software Foundation.
+ *
+ *   The libspine library is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Affero
+ *   General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Affero General Public License
+ *   along with the libspine library. If not, see
+ *   <http://www.gnu.org/licenses/>
+ *
+ *****************************************************************************/
+
+#ifndef LIBSPINE_SPATIALINDEX_INCL_
+#define LIBSPINE_SPATIALINDEX_INCL_
+
+#include <spine/BoundingBox.h>
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <utility>
+#include <vector>
+
+/*****************************************************************************
+ *
+ * SpatialIndex.h
+ *
+ * A sparse uniform grid over a page's coordinate space, used to answer
+ * point queries ("which boxes contain (x, y)?") without visiting every box.
+ * Each value is filed under every grid cell its bounding box overlaps, so a
+ * query only inspects the single cell containing the point. Boxes that
+ * would span too many cells (full page highlights, for example) are kept
+ * aside in a short list that every query checks.
+ *
+ ****************************************************************************/
+
+namespace Spine {
+
+    template< typename ValueType >
+    class SpatialIndex
+    {
+        typedef std::pair< BoundingBox, ValueType > Entry;
+        typedef std::pair< long, long > Cell;
+        typedef std::map< Cell, std::vector< Entry > > CellMap;
+
+    public:
+        SpatialIndex(double cellSize_ = 32.0, long maxCells_ = 64)
+            : _cellSize(cellSize_), _maxCells(maxCells_), _size(0)
+            {}
+
+        void clear()
+            {
+                _cells.clear();
+                _large.clear();
+                _size = 0;
+            }
+
+        void swap(SpatialIndex & other_)
+            {
+                std::swap(_cellSize, other_._cellSize);
+                std::swap(_maxCells, other_._maxCells);
+                std::swap(_size, other_._size);
+                _cells.swap(other_._cells);
+                _large.swap(other_._large);
+            }
+
+        bool empty() const
+            {
+                return _size == 0;
+            }
+
+        size_t size() const
+            {
+                return _size;
+            }
+
+        void insert(const BoundingBox & bb_, const ValueType & value_)
+            {
+                BoundingBox bb(bb_.normalized());
+                Entry entry(bb, value_);
+                long cx1, cy1, cx2, cy2;
+                _cellRange(bb, &cx1, &cy1, &cx2, &cy2);
+                if ((cx2 - cx1 + 1) * (cy2 - cy1 + 1) > _maxCells) {
+                    _large.push_back(entry);
+                } else {
+                    for (long cy = cy1; cy <= cy2; ++cy) {
+                        for (long cx = cx1; cx <= cx2; ++cx) {
+                            _cells[Cell(cx, cy)].push_back(entry);
+                        }
+                    }
+                }
+                ++_size;
+            }
+
+        // Remove one entry previously inserted with this box and value
+        bool remove(const BoundingBox & bb_, const ValueType & value_)
+            {
+                BoundingBox bb(bb_.normalized());
+                long cx1, cy1, cx2, cy2;
+                _cellRange(bb, &cx1, &cy1, &cx2, &cy2);
+                bool removed = false;
+                if ((cx2 - cx1 + 1) * (cy2 - cy1 + 1) > _maxCells) {
+                    removed = _erase(_large, bb, value_);
+                } else {
+                    for (long cy = cy1; cy <= cy2; ++cy) {
+                        for (long cx = cx1; cx <= cx2; ++cx) {
+                            typename CellMap::iterator found(_cells.find(Cell(cx, cy)));
+                            if (found != _cells.end() && _erase(found->second, bb, value_)) {
+                                removed = true;
+                                if (found->second.empty()) {
+                                    _cells.erase(found);
+                                }
+                            }
+                        }
+                    }
+                }
+                if (removed) {
+                    --_size;
+                }
+                return removed;
+            }
+
+        // Write every value whose box contains the point to out_ (in no
+        // particular order; a value inserted with several boxes that all
+        // contain the point is written once per box)
+        template< typename OutputIterator >
+        OutputIterator query(double x_, double y_, OutputIterator out_) const
+            {
+                typename CellMap::const_iterator found(_cells.find(Cell(_cellOf(x_), _cellOf(y_))));
+                if (found != _cells.end()) {
+                    out_ = _collect(found->second, x_, y_, out_);
+                }
+                return _collect(_large, x_, y_, out_);
+            }
+
+    private:
+        double _cellSize;
+        long _maxCells;
+        size_t _size;
+        CellMap _cells;
+        std::vector< Entry > _large;
+
+        long _cellOf(double v_) const
+            {
+                return static_cast< long >(std::floor(v_ / _cellSize));
+            }
+
+        void _cellRange(const BoundingBox & bb_, long * cx1_, long * cy1_, long * cx2_, long * cy2_) const
+            {
+                *cx1_ = _cellOf(bb_.x1);
+                *cy1_ = _cellOf(bb_.y1);
+                *cx2_ = _cellOf(bb_.x2);
+                *cy2_ = _cellOf(bb_.y2);
+            }
+
+        static bool _erase(std::vector< Entry > & entries_, const BoundingBox & bb_, const ValueType & value_)
+            {
+                typename std::vector< Entry >::iterator i(entries_.begin());
+                typename std::vector< Entry >::iterator i_end(entries_.end());
+                for (; i != i_end; ++i) {
+                    if (i->first == bb_ && i->second == value_) {
+                        entries_.erase(i);
+                        return true;
+                    }
+                }
+                return false;
+            }
+
+        template< typename OutputIterator >
+        static OutputIterator _collect(const std::vector< Entry > & entries_, double x_, double y_, OutputIterator out_)
+            {
+                typename std::vector< Entry >::const_iterator i(entries_.begin());
+                typename std::vector< Entry >::const_iterator i_end(entries_.end());
+                for (; i != i_end; ++i) {
+                    if (i->first.contains(x_, y_)) {
+                        *out_++ = i->second;
+                    }
+                }
+                return out_;
+            }
+    };
+
+}
+
+#endif /* LIBSPINE_SPATIALINDEX_INCL_ */
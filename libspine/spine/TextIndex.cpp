@@ -0,0 +1,475 @@
+/*****************************************************************************
+ *
+ *   This file is part of the libspine library.
+ *       Copyright (c) 2008-2017 Lost Island Labs
+ *           <info@utopiadocs.com>
+ *
+ *   The libspine library is free software: you can redistribute it and/or
+ *   modify it under the terms of the GNU AFFERO GENERAL PUBLIC LICENSE
+ *   VERSION 3 as published by the Free Software Foundation.
+ *
+ *   The libspine library is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Affero
+ *   General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Affero General Public License
+ *   along with the libspine library. If not, see
+ *   <http://www.gnu.org/licenses/>
+ *
+ *****************************************************************************/
+
+#include <spine/TextIndex.h>
+#include <spine/Document.h>
+#include <spine/Page.h>
+#include <spine/Word.h>
+
+#include <boost/cstdint.hpp>
+#include <boost/foreach.hpp>
+#include <utf8/unicode.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <set>
+
+using namespace std;
+
+namespace
+{
+
+    // Version tag of the on-disk index (which is stored in native byte
+    // order, as it is only ever a cache of the document's text)
+    const char * const textIndexVersion = "utopia-textindex-2";
+
+    bool isTermCharacter(utf8proc_int32_t codepoint)
+    {
+        // Letters, marks and numbers
+        utf8proc_propval_t category = utf8proc_get_property(codepoint)->category;
+        return category >= UTF8PROC_CATEGORY_LU && category <= UTF8PROC_CATEGORY_NO;
+    }
+
+    bool isAscii(const string & text)
+    {
+        BOOST_FOREACH(char c, text) {
+            if (static_cast< unsigned char >(c) >= 0x80) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    template< typename T >
+    void writeValue(ostream & stream, const T & value)
+    {
+        stream.write(reinterpret_cast< const char * >(&value), sizeof(T));
+    }
+
+    // Bytes left to read from a stream of the given size
+    streamoff bytesLeft(istream & stream, streamoff size)
+    {
+        return size - (streamoff) stream.tellg();
+    }
+
+    template< typename T >
+    bool readValue(istream & stream, T & value)
+    {
+        return stream.read(reinterpret_cast< char * >(&value), sizeof(T)).good();
+    }
+
+}
+
+namespace Spine
+{
+
+    class TextIndexPrivate
+    {
+    public:
+        struct Position
+        {
+            Position(boost::int32_t page_ = 0, const BoundingBox & bb_ = BoundingBox())
+                : page(page_), x1(bb_.x1), y1(bb_.y1), x2(bb_.x2), y2(bb_.y2)
+                {}
+
+            BoundingBox boundingBox() const
+                {
+                    return BoundingBox(x1, y1, x2, y2);
+                }
+
+            boost::int32_t page;
+            float x1, y1, x2, y2;
+        };
+
+        // How a query term must match an indexed term
+        enum Affix { Exact, Prefix, Suffix, Infix };
+
+        vector< Position > positions;
+        map< string, vector< boost::uint32_t > > postings;
+
+        // Terms found in words with characters beyond ASCII, within which a
+        // search's (ASCII only) word boundary may fall
+        set< string > nonAscii;
+
+        const vector< boost::uint32_t > * find(const string & term) const
+        {
+            map< string, vector< boost::uint32_t > >::const_iterator found(postings.find(term));
+            return found == postings.end() ? 0 : &found->second;
+        }
+
+        static bool matches(const string & candidate, const string & term, Affix affix)
+        {
+            switch (affix) {
+            case Exact:
+                return candidate == term;
+            case Prefix:
+                return candidate.compare(0, term.size(), term) == 0;
+            case Suffix:
+                return candidate.size() >= term.size() && candidate.compare(candidate.size() - term.size(), term.size(), term) == 0;
+            default:
+                return candidate.find(term) != string::npos;
+            }
+        }
+
+        // Sorted positions of every indexed term that matches the given one
+        vector< boost::uint32_t > find(const string & term, Affix affix) const
+        {
+            vector< boost::uint32_t > found;
+            if (affix == Exact) {
+                if (const vector< boost::uint32_t > * exact = find(term)) {
+                    found = *exact;
+                }
+                return found;
+            }
+
+            map< string, vector< boost::uint32_t > >::const_iterator iter(affix == Prefix ? postings.lower_bound(term) : postings.begin());
+            map< string, vector< boost::uint32_t > >::const_iterator end(postings.end());
+            for (; iter != end; ++iter) {
+                if (matches(iter->first, term, affix)) {
+                    found.insert(found.end(), iter->second.begin(), iter->second.end());
+                } else if (affix == Prefix) {
+                    break;
+                }
+            }
+            sort(found.begin(), found.end());
+            return found;
+        }
+
+        // As above, but terms in nonAscii are matched by a looser affix
+        vector< boost::uint32_t > find(const string & term, Affix affix, Affix nonAsciiAffix) const
+        {
+            vector< boost::uint32_t > found(find(term, affix));
+            if (nonAsciiAffix != affix) {
+                BOOST_FOREACH(const string & candidate, nonAscii) {
+                    if (!matches(candidate, term, affix) && matches(candidate, term, nonAsciiAffix)) {
+                        const vector< boost::uint32_t > & more = postings.find(candidate)->second;
+                        found.insert(found.end(), more.begin(), more.end());
+                    }
+                }
+                sort(found.begin(), found.end());
+            }
+            return found;
+        }
+
+        // Positions at which the whole phrase starts
+        vector< boost::uint32_t > match(const vector< string > & phrase) const
+        {
+            vector< vector< boost::uint32_t > > lists;
+            BOOST_FOREACH(const string & term, phrase) {
+                lists.push_back(find(term, Exact));
+            }
+            return match(lists);
+        }
+
+        // Positions at which consecutive terms are found in each list in turn
+        vector< boost::uint32_t > match(const vector< vector< boost::uint32_t > > & lists) const
+        {
+            vector< boost::uint32_t > starts;
+            if (!lists.empty()) {
+                BOOST_FOREACH(boost::uint32_t start, lists[0]) {
+                    bool matched = true;
+                    for (size_t i = 1; matched && i < lists.size(); ++i) {
+                        matched = binary_search(lists[i].begin(), lists[i].end(), start + i);
+                    }
+                    if (matched) {
+                        starts.push_back(start);
+                    }
+                }
+            }
+            return starts;
+        }
+    };
+
+    TextIndex::TextIndex()
+        : d(new TextIndexPrivate)
+    {}
+
+    TextIndex::TextIndex(Document & document)
+        : d(new TextIndexPrivate)
+    {
+        CursorHandle cursor(document.newCursor());
+        while (const Word * word = cursor->word()) {
+            int page = cursor->page()->pageNumber();
+            BoundingBox bb(word->boundingBox());
+            bool ascii = isAscii(word->text());
+            BOOST_FOREACH(const string & term, tokenize(word->text())) {
+                d->postings[term].push_back(static_cast< boost::uint32_t >(d->positions.size()));
+                d->positions.push_back(TextIndexPrivate::Position(page, bb));
+                if (!ascii) {
+                    d->nonAscii.insert(term);
+                }
+            }
+            cursor->nextWord(WithinDocument);
+        }
+    }
+
+    TextIndex::~TextIndex()
+    {}
+
+    bool TextIndex::contains(const string & phrase) const
+    {
+        vector< string > terms(tokenize(phrase));
+        return !terms.empty() && !d->match(terms).empty();
+    }
+
+    bool TextIndex::empty() const
+    {
+        return d->positions.empty();
+    }
+
+    vector< TextIndex::Hit > TextIndex::find(const string & phrase) const
+    {
+        vector< Hit > hits;
+        vector< string > terms(tokenize(phrase));
+        if (!terms.empty()) {
+            BOOST_FOREACH(boost::uint32_t start, d->match(terms)) {
+                const TextIndexPrivate::Position & first = d->positions[start];
+                Hit hit(start, terms.size(), first.page, first.boundingBox());
+                for (size_t i = 1; i < terms.size(); ++i) {
+                    const TextIndexPrivate::Position & next = d->positions[start + i];
+                    if (next.page == first.page) {
+                        hit.boundingBox |= next.boundingBox();
+                    }
+                }
+                hits.push_back(hit);
+            }
+        }
+        return hits;
+    }
+
+    bool TextIndex::load(const string & filename)
+    {
+        ifstream file(filename.c_str(), ios::in | ios::binary);
+        file.seekg(0, ios::end);
+        streamoff size = file.tellg();
+        file.seekg(0, ios::beg);
+        string version;
+        if (!getline(file, version) || version != textIndexVersion) {
+            return false;
+        }
+
+        // Nothing read from the file is trusted to fit within it
+        TextIndexPrivate loaded;
+        boost::uint32_t count = 0;
+        if (!readValue(file, count) || count > bytesLeft(file, size) / (streamoff) sizeof(TextIndexPrivate::Position)) {
+            return false;
+        }
+        loaded.positions.resize(count);
+        if (count > 0 && !file.read(reinterpret_cast< char * >(&loaded.positions[0]), count * sizeof(TextIndexPrivate::Position)).good()) {
+            return false;
+        }
+
+        boost::uint32_t terms = 0;
+        if (!readValue(file, terms) || terms > bytesLeft(file, size) / (streamoff) (2 * sizeof(boost::uint32_t))) {
+            return false;
+        }
+        for (boost::uint32_t t = 0; t < terms; ++t) {
+            boost::uint32_t length = 0;
+            if (!readValue(file, length) || length > bytesLeft(file, size)) {
+                return false;
+            }
+            string term(length, '\0');
+            if (length > 0 && !file.read(&term[0], length).good()) {
+                return false;
+            }
+            vector< boost::uint32_t > & postings = loaded.postings[term];
+            if (!readValue(file, count) || count > bytesLeft(file, size) / (streamoff) sizeof(boost::uint32_t)) {
+                return false;
+            }
+            postings.resize(count);
+            if (count > 0 && !file.read(reinterpret_cast< char * >(&postings[0]), count * sizeof(boost::uint32_t)).good()) {
+                return false;
+            }
+
+            // Postings must be in order (they are binary searched) and must
+            // refer to positions that exist
+            for (boost::uint32_t i = 0; i < count; ++i) {
+                if (postings[i] >= loaded.positions.size() || (i > 0 && postings[i] <= postings[i - 1])) {
+                    return false;
+                }
+            }
+        }
+
+        if (!readValue(file, terms) || terms > bytesLeft(file, size) / (streamoff) sizeof(boost::uint32_t)) {
+            return false;
+        }
+        for (boost::uint32_t t = 0; t < terms; ++t) {
+            boost::uint32_t length = 0;
+            if (!readValue(file, length) || length > bytesLeft(file, size)) {
+                return false;
+            }
+            string term(length, '\0');
+            if (length > 0 && !file.read(&term[0], length).good()) {
+                return false;
+            }
+            if (loaded.postings.find(term) == loaded.postings.end()) {
+                return false;
+            }
+            loaded.nonAscii.insert(term);
+        }
+
+        d->positions.swap(loaded.positions);
+        d->postings.swap(loaded.postings);
+        d->nonAscii.swap(loaded.nonAscii);
+        return true;
+    }
+
+    bool TextIndex::save(const string & filename) const
+    {
+        // Write to a scratch file first so readers never see a partial index
+        string scratch(filename + ".tmp");
+        {
+            ofstream file(scratch.c_str(), ios::out | ios::trunc | ios::binary);
+            file << textIndexVersion << "\n";
+            writeValue(file, static_cast< boost::uint32_t >(d->positions.size()));
+            if (!d->positions.empty()) {
+                file.write(reinterpret_cast< const char * >(&d->positions[0]), d->positions.size() * sizeof(TextIndexPrivate::Position));
+            }
+            writeValue(file, static_cast< boost::uint32_t >(d->postings.size()));
+            map< string, vector< boost::uint32_t > >::const_iterator iter(d->postings.begin());
+            map< string, vector< boost::uint32_t > >::const_iterator end(d->postings.end());
+            for (; iter != end; ++iter) {
+                writeValue(file, static_cast< boost::uint32_t >(iter->first.size()));
+                file.write(iter->first.data(), iter->first.size());
+                writeValue(file, static_cast< boost::uint32_t >(iter->second.size()));
+                if (!iter->second.empty()) {
+                    file.write(reinterpret_cast< const char * >(&iter->second[0]), iter->second.size() * sizeof(boost::uint32_t));
+                }
+            }
+            writeValue(file, static_cast< boost::uint32_t >(d->nonAscii.size()));
+            BOOST_FOREACH(const string & term, d->nonAscii) {
+                writeValue(file, static_cast< boost::uint32_t >(term.size()));
+                file.write(term.data(), term.size());
+            }
+            if (!file) {
+                file.close();
+                remove(scratch.c_str());
+                return false;
+            }
+        }
+        remove(filename.c_str());
+        return rename(scratch.c_str(), filename.c_str()) == 0;
+    }
+
+    bool TextIndex::pages(const string & text, bool wholeWords, vector< int > & pages) const
+    {
+        vector< string > terms(tokenize(text));
+        if (terms.empty()) {
+            return false;
+        }
+
+        // Within words, the text's first term may end an indexed term, its
+        // last may start one, and a lone term may be anywhere inside one.
+        // Searches find whole words with PCRE's ASCII only \b, which also
+        // matches inside a term next to a letter beyond ASCII, so terms from
+        // such words are matched as if within words regardless.
+        vector< vector< boost::uint32_t > > lists;
+        for (size_t i = 0; i < terms.size(); ++i) {
+            TextIndexPrivate::Affix within = TextIndexPrivate::Exact;
+            if (terms.size() == 1) {
+                within = TextIndexPrivate::Infix;
+            } else if (i == 0) {
+                within = TextIndexPrivate::Suffix;
+            } else if (i == terms.size() - 1) {
+                within = TextIndexPrivate::Prefix;
+            }
+            lists.push_back(d->find(terms[i], wholeWords ? TextIndexPrivate::Exact : within, within));
+            if (lists.back().empty()) {
+                break;
+            }
+        }
+
+        pages.clear();
+        if (lists.back().empty()) {
+            return true;
+        }
+        BOOST_FOREACH(boost::uint32_t start, d->match(lists)) {
+            pages.push_back(d->positions[start].page);
+            pages.push_back(d->positions[start + terms.size() - 1].page);
+        }
+        sort(pages.begin(), pages.end());
+        pages.erase(unique(pages.begin(), pages.end()), pages.end());
+        return true;
+    }
+
+    size_t TextIndex::size() const
+    {
+        return d->positions.size();
+    }
+
+    vector< string > TextIndex::terms() const
+    {
+        vector< string > terms;
+        terms.reserve(d->postings.size());
+        map< string, vector< boost::uint32_t > >::const_iterator iter(d->postings.begin());
+        map< string, vector< boost::uint32_t > >::const_iterator end(d->postings.end());
+        for (; iter != end; ++iter) {
+            terms.push_back(iter->first);
+        }
+        return terms;
+    }
+
+    vector< string > TextIndex::tokenize(const string & text)
+    {
+        vector< string > terms;
+
+        // Case fold and normalise
+        utf8proc_uint8_t * folded = 0;
+        utf8proc_ssize_t length = utf8proc_map(reinterpret_cast< const utf8proc_uint8_t * >(text.data()),
+                                               text.size(), &folded,
+                                               utf8proc_option_t(UTF8PROC_STABLE | UTF8PROC_COMPOSE |
+                                                                 UTF8PROC_COMPAT | UTF8PROC_CASEFOLD |
+                                                                 UTF8PROC_IGNORE | UTF8PROC_STRIPCC));
+        if (length < 0) {
+            return terms;
+        }
+
+        // Split on anything that isn't part of a term
+        string term;
+        const utf8proc_uint8_t * i = folded;
+        utf8proc_ssize_t remaining = length;
+        while (remaining > 0) {
+            utf8proc_int32_t codepoint = 0;
+            utf8proc_ssize_t bytes = utf8proc_iterate(i, remaining, &codepoint);
+            if (bytes <= 0) {
+                break;
+            }
+            if (isTermCharacter(codepoint)) {
+                term.append(reinterpret_cast< const char * >(i), bytes);
+            } else if (!term.empty()) {
+                terms.push_back(term);
+                term.clear();
+            }
+            i += bytes;
+            remaining -= bytes;
+        }
+        if (!term.empty()) {
+            terms.push_back(term);
+        }
+        free(folded);
+
+        return terms;
+    }
+
+}
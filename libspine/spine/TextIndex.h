@@ -0,0 +1,101 @@
+/*****************************************************************************
+ *
+ *   This file is part of the libspine library.
+ *       Copyright (c) 2008-2017 Lost Island Labs
+ *           <info@utopiadocs.com>
+ *
+ *   The libspine library is free software: you can redistribute it and/or
+ *   modify it under the terms of the GNU AFFERO GENERAL PUBLIC LICENSE
+ *   VERSION 3 as published by the Free Software Foundation.
+ *
+ *   The libspine library is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Affero
+ *   General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Affero General Public License
+ *   along with the libspine library. If not, see
+ *   <http://www.gnu.org/licenses/>
+ *
+ *****************************************************************************/
+
+#ifndef LIBSPINE_TEXTINDEX_INCL_
+#define LIBSPINE_TEXTINDEX_INCL_
+
+#include <spine/BoundingBox.h>
+
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <string>
+#include <vector>
+
+/*****************************************************************************
+ *
+ * TextIndex.h
+ *
+ * An inverted index of a document's words. Words are case folded and
+ * compatibility normalised, and split on anything that isn't a letter, mark
+ * or number, so that "Protein-Protein" indexes as the two terms "protein"
+ * and "protein". Each term maps to its positions in the document, and each
+ * position to the page and bounding box of the word it came from, so term
+ * and phrase queries can be answered from a saved index without going back
+ * to the document itself.
+ *
+ ****************************************************************************/
+
+namespace Spine {
+
+    class Document;
+
+    class TextIndexPrivate;
+    class TextIndex
+    {
+    public:
+        struct Hit
+        {
+            Hit(size_t position_ = 0, size_t length_ = 0, int page_ = 0, const BoundingBox & boundingBox_ = BoundingBox())
+                : position(position_), length(length_), page(page_), boundingBox(boundingBox_)
+                {}
+
+            size_t position; // Index of the first matching term in the document
+            size_t length; // Number of terms matched
+            int page; // Page of the first matching term
+            BoundingBox boundingBox; // Bounds of the matched terms on that page
+        };
+
+        TextIndex();
+        TextIndex(Document & document);
+        ~TextIndex();
+
+        bool empty() const;
+        size_t size() const;
+        std::vector< std::string > terms() const;
+
+        // Find every occurrence of a term or (whitespace separated) phrase
+        std::vector< Hit > find(const std::string & phrase) const;
+        bool contains(const std::string & phrase) const;
+
+        // Pages on which a literal search for the text could match, either as
+        // whole words or anywhere within them (the pages of the first and last
+        // terms of each candidate are given); false if the text has no terms
+        // for the index to go on
+        bool pages(const std::string & text, bool wholeWords, std::vector< int > & pages) const;
+
+        bool load(const std::string & filename);
+        bool save(const std::string & filename) const;
+
+        // Split text into normalised terms, the way the index does
+        static std::vector< std::string > tokenize(const std::string & text);
+
+    private:
+        boost::scoped_ptr< TextIndexPrivate > d;
+
+        TextIndex(const TextIndex &);
+        TextIndex & operator = (const TextIndex &);
+    };
+
+    typedef boost::shared_ptr< TextIndex > TextIndexHandle;
+
+}
+
+#endif /* LIBSPINE_TEXTINDEX_INCL_ */
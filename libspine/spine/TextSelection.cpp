@@ -31,54 +31,192 @@
 #include <string>
 #include <utf8/unicode.h>
 #include <algorithm>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/tss.hpp>
 
 using namespace std;
 using namespace utf8;
 using namespace pcrecpp;
 
+namespace
+{
+
+    // Number of characters between cached text iterators
+    const size_t checkpointInterval = 16;
+
+#ifdef PCRE_STUDY_JIT_COMPILE
+    // JIT compiled patterns need more than PCRE's default 32K of stack to
+    // match across a whole document, so each thread gets a larger one
+    pcre_jit_stack * threadJitStack(void *)
+    {
+        static boost::thread_specific_ptr< pcre_jit_stack > stacks(&pcre_jit_stack_free);
+        if (!stacks.get()) {
+            stacks.reset(pcre_jit_stack_alloc(32 * 1024, 1024 * 1024));
+        }
+        return stacks.get(); // If null, PCRE falls back to its default stack
+    }
+#endif
+
+    // A compiled (and where possible JIT compiled) regular expression
+    class CompiledPattern
+    {
+    public:
+        CompiledPattern(pcre * re_)
+            : re(re_), extra(0), captureCount(0)
+        {
+            const char * errptr = 0;
+#ifdef PCRE_STUDY_JIT_COMPILE
+            extra = pcre_study(re, PCRE_STUDY_JIT_COMPILE, &errptr);
+            if (extra) {
+                pcre_assign_jit_stack(extra, &threadJitStack, 0);
+                interpreted = *extra;
+                interpreted.flags &= ~PCRE_EXTRA_EXECUTABLE_JIT;
+            }
+#else
+            extra = pcre_study(re, 0, &errptr);
+#endif
+            pcre_fullinfo(re, extra, PCRE_INFO_CAPTURECOUNT, &captureCount);
+        }
+
+        // As pcre_exec(), but should a match need more JIT stack than is
+        // available, it is tried again without JIT rather than given up on
+        int exec(const char * subject_, int length_, int offset_, int options_, int * ovector_, int ovecsize_) const
+        {
+            int rc = pcre_exec(re, extra, subject_, length_, offset_, options_, ovector_, ovecsize_);
+#ifdef PCRE_STUDY_JIT_COMPILE
+            if (rc == PCRE_ERROR_JIT_STACKLIMIT) {
+                rc = pcre_exec(re, &interpreted, subject_, length_, offset_, options_, ovector_, ovecsize_);
+            }
+#endif
+            return rc;
+        }
+
+        ~CompiledPattern()
+        {
+            if (extra) {
+#ifdef PCRE_STUDY_JIT_COMPILE
+                pcre_free_study(extra);
+#else
+                pcre_free(extra);
+#endif
+            }
+            pcre_free(re);
+        }
+
+        pcre * re;
+        pcre_extra * extra;
+        int captureCount;
+
+    private:
+#ifdef PCRE_STUDY_JIT_COMPILE
+        pcre_extra interpreted; // As extra, without its JIT code
+#endif
+
+        CompiledPattern(const CompiledPattern &);
+        CompiledPattern & operator = (const CompiledPattern &);
+    };
+
+    typedef boost::shared_ptr< CompiledPattern > CompiledPatternHandle;
+
+    // Process-wide cache of the most recently used patterns, as plugins tend
+    // to issue the same searches over and over again
+    class PatternCache
+    {
+        typedef pair< string, int > Key;
+        typedef list< Key > Recency;
+        typedef map< Key, pair< CompiledPatternHandle, Recency::iterator > > Patterns;
+
+    public:
+        static const size_t capacity = 512;
+
+        // Returns a null handle and sets errptr_ if the pattern is invalid
+        CompiledPatternHandle get(const string & regex_, int options_, const char ** errptr_)
+        {
+            Key key(regex_, options_);
+            {
+                boost::lock_guard< boost::mutex > guard(_mutex);
+                Patterns::iterator found(_patterns.find(key));
+                if (found != _patterns.end()) {
+                    _recency.splice(_recency.begin(), _recency, found->second.second);
+                    return found->second.first;
+                }
+            }
+
+            // Compile outside the lock
+            int erroffset = 0;
+            pcre * re = pcre_compile(regex_.c_str(), options_, errptr_, &erroffset, NULL);
+            if (!re) {
+                return CompiledPatternHandle();
+            }
+            CompiledPatternHandle pattern(new CompiledPattern(re));
+
+            boost::lock_guard< boost::mutex > guard(_mutex);
+            Patterns::iterator found(_patterns.find(key));
+            if (found != _patterns.end()) {
+                // Another thread got there first
+                return found->second.first;
+            }
+            _recency.push_front(key);
+            _patterns[key] = make_pair(pattern, _recency.begin());
+            while (_patterns.size() > capacity) {
+                _patterns.erase(_recency.back());
+                _recency.pop_back();
+            }
+            return pattern;
+        }
+
+        static PatternCache & instance()
+        {
+            static PatternCache cache;
+            return cache;
+        }
+
+    private:
+        boost::mutex _mutex;
+        Patterns _patterns;
+        Recency _recency;
+    };
+
+}
+
 namespace Spine
 {
 
     void TextExtent::_cacheText() const
     {
         // append utf8 representation of each character in turn onto
-        // cached text string. An entry is inserted into the skiplist
-        // every 100 characters or if the utf8 representation of the
-        // character > 1 byte
+        // cached text string, recording the character offset of each
+        // byte appended. An iterator is kept every checkpointInterval
+        // characters, from which any other offset is a short walk away
 
         _cached_text.clear();
-        _skiplist_utf8.clear();
-        _skiplist_utf32.clear();
+        _offsets_utf8.clear();
+        _checkpoints.clear();
 
         TextIterator chr(first);
         back_insert_iterator<string> ins(back_inserter(_cached_text));
 
-        size_t offset_utf8(0); // count of utf8 characters into this cache
         size_t offset_utf32(0); // count of utf32 characters into this cache
 
         while (chr < second) {
 
-            // insert skip list entry every 100 chars
-            if(offset_utf32 % 100 == 0) {
-                _skiplist_utf8.insert(make_pair(offset_utf8, chr));
-                _skiplist_utf32.insert(make_pair(offset_utf32, chr));
+            // keep an iterator every checkpointInterval chars
+            if(offset_utf32 % checkpointInterval == 0) {
+                _checkpoints.push_back(chr);
             }
 
             // append utf8 string representing current char and advance iterator
             append(*chr, ins);
+            _offsets_utf8.resize(_cached_text.length(), offset_utf32);
             ++chr;
-
-            // insert utf8 skip list entry for offset_utf8 following character if
-            // utf32 char decomposed to more than 1 utf8 char
-            if(_cached_text.length() > offset_utf8+1) {
-                _skiplist_utf8.insert(make_pair(_cached_text.length(), chr));
-            }
-            offset_utf8=_cached_text.length();
             ++offset_utf32;
         }
-        // ensure final skip list entry for end of sequence
-        _skiplist_utf8.insert(make_pair(offset_utf8, chr));
-        _skiplist_utf32.insert(make_pair(offset_utf32, chr));
+        // ensure final entries for end of sequence
+        if(offset_utf32 % checkpointInterval == 0) {
+            _checkpoints.push_back(chr);
+        }
+        _offsets_utf8.push_back(offset_utf32);
     }
 
     AreaList TextExtent::areas() const
@@ -206,7 +344,21 @@ namespace Spine
     Spine::TextExtentSet TextExtent::search(const string &regexp_, int options) const
     {
         Spine::TextExtentSet matches;
+        _search(regexp_, options, matches);
+        return matches;
+    }
 
+    vector< Spine::TextExtentSet > TextExtent::search(const vector< string > &regexps_, int options) const
+    {
+        vector< Spine::TextExtentSet > matches(regexps_.size());
+        for (size_t i = 0; i < regexps_.size(); ++i) {
+            _search(regexps_[i], options, matches[i]);
+        }
+        return matches;
+    }
+
+    void TextExtent::_search(const string &regexp_, int options, Spine::TextExtentSet &matches) const
+    {
         //std::cerr << "=== SEARCHING ===" << std::endl;
         if (!regexp_.empty()) {
             //std::cerr << "   orig regex: " << regexp_ << std::endl;
@@ -240,42 +392,42 @@ namespace Spine
             if (!regex.empty()) {
                 //std::cerr << "REGEX SEARCH " << regex << std::endl;
 
-                // Compile the regular expression
+                // Fetch the compiled regular expression
                 const char * errptr = 0;
-                int erroffset = 0;
-                pcre * re = pcre_compile(regex.c_str(), opt, &errptr, &erroffset, NULL);
+                CompiledPatternHandle pattern(PatternCache::instance().get(regex, opt, &errptr));
 
                 // check regex was created OK
-                if(!re) {
-                    throw TextExtent::regex_exception(regex, string(errptr));
+                if(!pattern) {
+                    throw TextExtent::regex_exception(regex, string(errptr ? errptr : ""));
                 }
 
                 // cache text if not already
-                if(_cached_text.empty()) {
+                if(_checkpoints.empty()) {
                     _cacheText();
                 }
 
                 // Find number of sub-string matches
-                int substring_count = 0;
-                pcre_fullinfo(re, NULL, PCRE_INFO_CAPTURECOUNT, &substring_count);
+                int substring_count = pattern->captureCount;
 
                 //std::cerr << "    regex info: " << substring_count << std::endl;
 
                 // Set up output variables and dynamic offset
                 int ovector_length = (substring_count + 1) * 3;
-                int ovector[ovector_length];
+                vector< int > ovector(ovector_length);
                 int offset = 0;
 
+                // The subject only needs its utf8 checked once
+                int exec_options = 0;
+
                 // Continue searching until complete
                 while (true) {
-                    int rc = pcre_exec(re,                      /* the compiled pattern */
-                                   NULL,                    /* no extra data - we didn't study the pattern */
-                                   _cached_text.c_str(),    /* the subject string */
-                                   _cached_text.length(),   /* the length of the subject in bytes */
-                                   offset,                  /* offset in the subject */
-                                   0,                       /* default options */
-                                   ovector,                 /* output vector for substring information */
-                                   ovector_length);          /* number of elements in the output vector */
+                    int rc = pattern->exec(_cached_text.c_str(),    /* the subject string */
+                                           _cached_text.length(),   /* the length of the subject in bytes */
+                                           offset,                  /* offset in the subject */
+                                           exec_options,            /* default options */
+                                           &ovector[0],             /* output vector for substring information */
+                                           ovector_length);         /* number of elements in the output vector */
+                    exec_options = PCRE_NO_UTF8_CHECK;
 
                     //std::cerr << " -> " << rc << std::endl;
                     if (rc < 0) { // Error
@@ -296,73 +448,55 @@ namespace Spine
                         }
                     }
                 }
-
-                // Delete regular expression
-                pcre_free(re);
             }
         }
-
-        return matches;
     }
 
     Spine::TextIterator TextExtent::iteratorFromOffset(size_t start_) const {
-        return this->_iteratorFromOffset(start_, this->_skiplist_utf32);
+        return this->_iteratorFromOffset(start_);
     }
 
     Spine::TextIterator TextExtent::iteratorFromOffsetUtf8(size_t start_) const {
-        return this->_iteratorFromOffset(start_, this->_skiplist_utf8);
+        return this->_iteratorFromOffset(this->_offsetFromUtf8(start_));
     }
 
-    Spine::TextIterator TextExtent::_iteratorFromOffset(size_t start_,
-                                                       const std::map<size_t,
-                                                       TextIterator> &skiplist_) const {
+    size_t TextExtent::_offsetFromUtf8(size_t start_) const {
 
-        if(_cached_text.empty()) {
+        if(_checkpoints.empty()) {
             _cacheText();
         }
 
-        // This returns an iterator pointing to the first element in
-        // the container whose key compares greater than x
-        std::map<size_t, TextIterator>::const_iterator i(skiplist_.upper_bound(start_));
-
-        // decrement to get key preceding offset
-        --i;
+        return _offsets_utf8[std::min(start_, _offsets_utf8.size() - 1)];
+    }
 
-        size_t ti_pos(i->first);
-        TextIterator ti(i->second);
+    Spine::TextIterator TextExtent::_iteratorFromOffset(size_t start_) const {
 
-        if(ti_pos > start_) {
-            // shouldn't happen!
-//            printf("Skiplist: ti_pos > start_\n");
-            ti=first;
-            ti_pos=0;
+        if(_checkpoints.empty()) {
+            _cacheText();
         }
-        while(ti_pos < start_ && ti != second) {
-            ++ti_pos;
+
+        // clamp to the end of the extent
+        start_ = std::min(start_, static_cast< size_t >(_offsets_utf8.back()));
+
+        // walk forward from the preceding checkpoint
+        TextIterator ti(_checkpoints[start_ / checkpointInterval]);
+        for (size_t ti_pos = start_ - start_ % checkpointInterval; ti_pos < start_ && ti != second; ++ti_pos) {
             ++ti;
         }
-        if(ti==second) {
-            // shouldn't happen!
-//            printf("Skiplist: ti==second\n");
-        }
 
         return ti;
     }
 
     Spine::TextExtentHandle TextExtent::subExtent(size_t start_, size_t length_) const {
-        return this->_cachedSubExtent(start_, length_, this->_skiplist_utf32);
-    }
+        TextIterator match_begin(this->_iteratorFromOffset(start_));
+        TextIterator match_end(this->_iteratorFromOffset(start_+length_));
 
-    Spine::TextExtentHandle TextExtent::subExtentUtf8(size_t start_, size_t length_) const {
-        return this->_cachedSubExtent(start_, length_, this->_skiplist_utf8);
+        return TextExtentHandle(new TextExtent(match_begin, match_end));
     }
 
-    Spine::TextExtentHandle TextExtent::_cachedSubExtent(size_t start_, size_t length_,
-                                                         const std::map<size_t,
-                                                         TextIterator> &skiplist_) const {
-
-        TextIterator match_begin(this->_iteratorFromOffset(start_, skiplist_));
-        TextIterator match_end(this->_iteratorFromOffset(start_+length_, skiplist_));
+    Spine::TextExtentHandle TextExtent::subExtentUtf8(size_t start_, size_t length_) const {
+        TextIterator match_begin(this->_iteratorFromOffset(this->_offsetFromUtf8(start_)));
+        TextIterator match_end(this->_iteratorFromOffset(this->_offsetFromUtf8(start_+length_)));
 
         return TextExtentHandle(new TextExtent(match_begin, match_end));
     }
@@ -142,7 +142,7 @@ namespace Spine
 
         std::string text() const
         {
-            if(_cached_text.empty()) {
+            if(_checkpoints.empty()) {
                 _cacheText();
             }
             return _cached_text;
@@ -157,21 +157,25 @@ namespace Spine
         AreaList areas() const;
         std::set< boost::shared_ptr< TextExtent >, ExtentCompare< TextExtent > >
             search(const std::string &regexp_, int options = DefaultSearchOptions) const;
+        // Search for several patterns at once, sharing the cached text
+        // between them; results are in the order of the given patterns
+        std::vector< std::set< boost::shared_ptr< TextExtent >, ExtentCompare< TextExtent > > >
+            search(const std::vector< std::string > &regexps_, int options = DefaultSearchOptions) const;
         boost::shared_ptr< TextExtent > clone();
 
     private:
 
         void _cacheText() const;
-        boost::shared_ptr< TextExtent > _cachedSubExtent(size_t start_, size_t length_,
-                                                         const std::map<size_t,
-                                                         TextIterator> &skiplist_) const;
-        Spine::TextIterator _iteratorFromOffset(size_t start_,
-                                                const std::map<size_t,
-                                                TextIterator> &skiplist_) const;
+        void _search(const std::string &regexp_, int options,
+                     std::set< boost::shared_ptr< TextExtent >, ExtentCompare< TextExtent > > &matches_) const;
+        size_t _offsetFromUtf8(size_t start_octets_) const;
+        Spine::TextIterator _iteratorFromOffset(size_t start_codepoints_) const;
 
         mutable std::string _cached_text;
-        mutable std::map<size_t, TextIterator> _skiplist_utf8;
-        mutable std::map<size_t, TextIterator> _skiplist_utf32;
+        // Character offset of each byte of the cached text (plus its end)
+        mutable std::vector< unsigned int > _offsets_utf8;
+        // Iterators at regular character offsets into the extent
+        mutable std::vector< TextIterator > _checkpoints;
     };
 
     typedef boost::shared_ptr< TextExtent > TextExtentHandle;
@@ -141,6 +141,29 @@ namespace {
         return new_SpineStringFromUTF8(str.data(), str.length(), error);
     }
 
+    inline SpineArea makeSpineArea(int page, int rotation, const BoundingBox &b)
+    {
+        SpineArea result;
+        result.page=page;
+        result.rotation=rotation*90;
+        result.x1=b.x1;
+        result.y1=b.y1;
+        result.x2=b.x2;
+        result.y2=b.y2;
+        return result;
+    }
+
+    // Copy a vector into a newly allocated array
+    template< typename T >
+    inline T *newArray(const vector< T > &values)
+    {
+        T *result=new T[values.empty() ? 1 : values.size()];
+        if(!values.empty()) {
+            ::memcpy(result, &values[0], values.size()*sizeof(T));
+        }
+        return result;
+    }
+
     inline string SpineString_asUTF8string(SpineString str, SpineError *error)
     {
         string result;
@@ -467,6 +490,33 @@ void delete_SpineAnnotationList(SpineAnnotationList *list, SpineError *error)
     *list = 0;
 }
 
+/*****************************************************************************
+ *
+ * SpineTextLayout
+ *
+ ****************************************************************************/
+
+void delete_SpineTextLayout(SpineTextLayout *layout, SpineError *error)
+{
+    if(layout && *layout) {
+        delete [] (*layout)->characters;
+        delete [] (*layout)->characterAreas;
+        delete [] (*layout)->wordCharacters;
+        delete [] (*layout)->wordText;
+        delete [] (*layout)->wordAreas;
+        delete [] (*layout)->wordSpaceAfter;
+        delete [] (*layout)->text;
+        delete [] (*layout)->lineWords;
+        delete [] (*layout)->lineAreas;
+        delete [] (*layout)->blockLines;
+        delete [] (*layout)->blockAreas;
+        delete *layout;
+        *layout = 0;
+    } else {
+        setError(error, SpineError_InvalidType);
+    }
+}
+
 /*****************************************************************************
  *
  * TextExtent
@@ -1305,6 +1355,95 @@ SpineString SpineDocument_text(SpineDocument doc, SpineError *error)
     return 0;
 }
 
+SpineTextLayout SpineDocument_textLayout(SpineDocument doc, int fromPage, int toPage, SpineError *error)
+{
+    if (!doc) {
+        setError(error, SpineError_InvalidType);
+        return 0;
+    }
+
+    int pages=(int) doc->_handle->numberOfPages();
+    if (toPage <= 0 || toPage > pages) {
+        toPage=pages;
+    }
+    if (fromPage < 1 || fromPage > toPage) {
+        setError(error, SpineError_InvalidArgument);
+        return 0;
+    }
+
+    vector< uint32_t > characters;
+    vector< SpineArea > characterAreas;
+    vector< uint32_t > wordCharacters;
+    vector< uint32_t > wordText;
+    vector< SpineArea > wordAreas;
+    vector< uint8_t > wordSpaceAfter;
+    string text;
+    vector< uint32_t > lineWords;
+    vector< SpineArea > lineAreas;
+    vector< uint32_t > blockLines;
+    vector< SpineArea > blockAreas;
+
+    // Walk the words of each page once, noting where lines and blocks change
+    CursorHandle cursor(doc->_handle->newCursor(fromPage));
+    for (; cursor->page() && cursor->page()->pageNumber() <= toPage; cursor->nextPage()) {
+        int page=cursor->page()->pageNumber();
+        const Line *lastLine=0;
+        const Block *lastBlock=0;
+        while (const Word *word=cursor->word()) {
+            if (cursor->block() != lastBlock) {
+                lastBlock=cursor->block();
+                blockLines.push_back((uint32_t) lineAreas.size());
+                blockAreas.push_back(makeSpineArea(page, lastBlock->rotation(), lastBlock->boundingBox()));
+            }
+            if (cursor->line() != lastLine) {
+                lastLine=cursor->line();
+                lineWords.push_back((uint32_t) wordAreas.size());
+                lineAreas.push_back(makeSpineArea(page, lastLine->rotation(), lastLine->boundingBox()));
+            }
+
+            wordCharacters.push_back((uint32_t) characters.size());
+            wordText.push_back((uint32_t) text.size());
+            wordAreas.push_back(makeSpineArea(page, word->rotation(), word->boundingBox()));
+            wordSpaceAfter.push_back(word->spaceAfter() ? 1 : 0);
+            text+=word->text();
+
+            while (const Character *character=cursor->character()) {
+                characters.push_back(character->charcode());
+                characterAreas.push_back(makeSpineArea(page, character->rotation(), character->boundingBox()));
+                cursor->nextCharacter(WithinWord);
+            }
+
+            cursor->nextWord(WithinPage);
+        }
+    }
+
+    // Close off each level's ranges
+    wordCharacters.push_back((uint32_t) characters.size());
+    wordText.push_back((uint32_t) text.size());
+    lineWords.push_back((uint32_t) wordAreas.size());
+    blockLines.push_back((uint32_t) lineAreas.size());
+
+    SpineTextLayout result=new SpineTextLayoutImpl;
+    result->characterCount=characters.size();
+    result->characters=newArray(characters);
+    result->characterAreas=newArray(characterAreas);
+    result->wordCount=wordAreas.size();
+    result->wordCharacters=newArray(wordCharacters);
+    result->wordText=newArray(wordText);
+    result->wordAreas=newArray(wordAreas);
+    result->wordSpaceAfter=newArray(wordSpaceAfter);
+    result->textLength=text.size();
+    result->text=new char[text.size()+1];
+    ::memcpy(result->text, text.c_str(), text.size()+1);
+    result->lineCount=lineAreas.size();
+    result->lineWords=newArray(lineWords);
+    result->lineAreas=newArray(lineAreas);
+    result->blockCount=blockAreas.size();
+    result->blockLines=newArray(blockLines);
+    result->blockAreas=newArray(blockAreas);
+    return result;
+}
+
 SpineTextExtent SpineDocument_substr(SpineDocument doc, int from, int len, SpineError *error)
 {
     if (doc) {
@@ -114,6 +114,36 @@ extern "C" {
         double b;
     } SpineColor;
 
+    /* The text of a run of pages, flattened into contiguous arrays. Each
+       word, line and block owns a range of the level below it: word i's
+       characters are those from wordCharacters[i] up to (but excluding)
+       wordCharacters[i+1], its UTF-8 text runs from wordText[i] to
+       wordText[i+1] in text, and so on for lines (lineWords) and blocks
+       (blockLines). Each of these offset arrays has one more entry than
+       there are items. */
+    typedef struct SpineTextLayoutImpl {
+        size_t characterCount;
+        uint32_t * characters; /* code points */
+        SpineArea * characterAreas;
+
+        size_t wordCount;
+        uint32_t * wordCharacters;
+        uint32_t * wordText;
+        SpineArea * wordAreas;
+        uint8_t * wordSpaceAfter;
+
+        char * text;
+        size_t textLength;
+
+        size_t lineCount;
+        uint32_t * lineWords;
+        SpineArea * lineAreas;
+
+        size_t blockCount;
+        uint32_t * blockLines;
+        SpineArea * blockAreas;
+    } *SpineTextLayout;
+
     /* SpineString */
     void delete_SpineString(SpineString *str, SpineError *error);
     char *SpineString_asUTF8(SpineString str, SpineError *error);
@@ -154,6 +184,9 @@ extern "C" {
     SpineAnnotationList new_SpineAnnotationList(size_t entries, SpineError *error);
     void delete_SpineAnnotationList(SpineAnnotationList *list, SpineError *error);
 
+    /* SpineTextLayout */
+    void delete_SpineTextLayout(SpineTextLayout *layout, SpineError *error);
+
     /* Document */
     typedef enum {
         SpineDocument_ViewDefault,
@@ -224,6 +257,7 @@ extern "C" {
     SpineTextExtentList SpineDocument_search(SpineDocument doc, SpineString regex, int options, SpineError *error);
     SpineTextExtentList SpineDocument_searchFrom(SpineDocument doc, SpineCursor start, SpineString regex, int options, SpineError *error);
     SpineString SpineDocument_text(SpineDocument doc, SpineError *error);
+    SpineTextLayout SpineDocument_textLayout(SpineDocument doc, int fromPage, int toPage, SpineError *error);
     SpineTextExtent SpineDocument_substr(SpineDocument doc, int start, int len, SpineError *error);
 
     SpineAnnotationList SpineDocument_annotations(SpineDocument doc, SpineError *error);
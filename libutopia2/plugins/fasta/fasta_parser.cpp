@@ -33,10 +33,11 @@
 
 #include <utopia2/node.h>
 #include <utopia2/aminoacid.h>
+#include <utopia2/linereader.h>
 #include <utopia2/nucleotide.h>
 
+#include <cctype>
 #include <vector>
-#include <QTextStream>
 
 namespace Utopia
 {
@@ -76,73 +77,54 @@ namespace Utopia
     }
     void FASTAParser::convertResidueSequenceToNodes(const std::string& sequence_str_, Node* sequence_)
     {
-        Node* p_code = UtopiaDomain.term("code");
         Node* p_size = UtopiaDomain.term("size");
         Node* c_Gap = UtopiaDomain.term("Gap");
 
-        // For each letter, presume Nucleotide
-        bool Nucleotide = true;
-        std::vector< Node* > residues;
-        std::vector< int > gaps;
-        int gap = 0;
+        // Resolve each distinct code only once
+        Node* nucleotides[256];
+        Node* aminoAcids[256];
+        bool resolved[256] = { false };
         for (size_t i = 0; i < sequence_str_.size(); ++i)
         {
-            // Make code string
-            std::string code = sequence_str_.substr(i, 1);
-
-            if (sequence_str_.at(i) == '-')
+            unsigned char code = sequence_str_.at(i);
+            if (code != '-' && !resolved[code])
             {
-                ++gap;
-                continue;
+                QString symbol(QChar::fromLatin1(code));
+                nucleotides[code] = Nucleotide::get(symbol);
+                aminoAcids[code] = AminoAcid::get(symbol);
+                resolved[code] = true;
             }
+        }
 
-            Node* residue = 0;
+        // Presume Nucleotides, unless a code isn't one
+        bool Nucleotide = true;
+        for (size_t i = 0; Nucleotide && i < sequence_str_.size(); ++i)
+        {
+            unsigned char code = sequence_str_.at(i);
+            Nucleotide = (code == '-' || nucleotides[code] != 0);
+        }
+        Node** residues = Nucleotide ? nucleotides : aminoAcids;
 
-            if (Nucleotide)
+        int gap = 0;
+        for (size_t i = 0; i < sequence_str_.size(); ++i)
+        {
+            unsigned char code = sequence_str_.at(i);
+            if (code == '-')
             {
-                residue = Nucleotide::get(QString::fromStdString(code));
-
-                // If residue is not a Nucleotide, then re-evaluate...
-                if (residue == 0)
-                {
-                    // Re-evaluate List as amino acids
-                    for (size_t j = 0; j < residues.size(); ++j)
-                    {
-                        residue = AminoAcid::get(residues[j]->attributes.get(p_code).toString());
-                        residues[j] = residue;
-                    }
-
-                    Nucleotide = false;
-                }
-                else
-                {
-                    residues.push_back(residue);
-                }
+                ++gap;
+                continue;
             }
 
-            if (!Nucleotide)
-            {
-                residue = AminoAcid::get(QString::fromStdString(code));
-                residues.push_back(residue);
-            }
+            Node* residue = sequence_->create(residues[code]);
+            sequence_->relations(UtopiaSystem.hasPart).append(residue);
 
             // Attach gaps?
-            gaps.push_back(gap);
             if (gap > 0)
-            {
-                gap = 0;
-            }
-        }
-
-        for (size_t i = 0; i < residues.size(); ++i)
-        {
-            Node* residue = sequence_->create(residues.at(i));
-            sequence_->relations(UtopiaSystem.hasPart).append(residue);
-            if (gaps.at(i) > 0)
             {
                 Node* gap_annotation = sequence_->create(c_Gap);
                 gap_annotation->relations(UtopiaSystem.annotates).append(residue);
-                gap_annotation->attributes.set(p_size, QVariant::fromValue(gaps.at(i)));
+                gap_annotation->attributes.set(p_size, QVariant::fromValue(gap));
+                gap = 0;
             }
         }
     }
@@ -164,7 +146,7 @@ namespace Utopia
             ctx.setMessage("Empty Stream");
         }
 
-        QTextStream stream(&stream_);
+        LineReader reader(stream_);
 
         // State machine state
         enum {
@@ -189,15 +171,36 @@ namespace Utopia
         Node* authority = 0;
 
         // Read file, line by line
-        while (state != Finished && !stream.atEnd()) {
-            QString qline = stream.readLine().trimmed();
+        const char* begin = 0;
+        const char* end = 0;
+        while (state != Finished && reader.readLine(&begin, &end)) {
             ++line_no;
+
+            // Report progress every so often
+            if (line_no % 4096 == 0 && !ctx.progress(reader.position(), reader.size()))
+            {
+                ctx.setErrorCode(Cancelled);
+                ctx.setErrorLine(line_no);
+                ctx.setMessage("Parsing cancelled.");
+                break;
+            }
+
+            // Trim whitespace
+            while (begin != end && ::isspace((unsigned char) *begin))
+            {
+                ++begin;
+            }
+            while (end != begin && ::isspace((unsigned char) *(end - 1)))
+            {
+                --end;
+            }
+
             // Ignore empty lines
-            if (qline.isEmpty())
+            if (begin == end)
             {
                 continue;
             }
-            std::string line = qline.toStdString();
+            std::string line(begin, end);
 
             // State machine
             switch (state)
@@ -341,9 +344,12 @@ namespace Utopia
             }
         }
         // Else clean up
-        else if (authority)
+        else
         {
-            delete authority;
+            for (size_t i = 0; i < authorities.size(); ++i)
+            {
+                delete authorities.at(i);
+            }
             authority = 0;
         }
 
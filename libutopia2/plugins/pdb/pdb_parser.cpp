@@ -31,9 +31,50 @@
 
 #include "pdb_parser.h"
 #include <gtl/matrix.h>
+#include <utopia2/linereader.h>
+
+#include <cstdlib>
+#include <cstring>
 
 namespace Utopia {
 
+    namespace
+    {
+
+        // Fixed column fields of a space padded 80 column record
+        inline bool isRecord(const char * record, const char * type)
+        {
+            return ::memcmp(record, type, 6) == 0;
+        }
+
+        inline QString field(const char * record, int column, int width)
+        {
+            return QString::fromLatin1(record + column, width);
+        }
+
+        inline QChar charField(const char * record, int column)
+        {
+            return QChar::fromLatin1(record[column]);
+        }
+
+        inline long intField(const char * record, int column, int width)
+        {
+            char buffer[16];
+            ::memcpy(buffer, record + column, width);
+            buffer[width] = 0;
+            return ::strtol(buffer, 0, 10);
+        }
+
+        inline double realField(const char * record, int column, int width)
+        {
+            char buffer[16];
+            ::memcpy(buffer, record + column, width);
+            buffer[width] = 0;
+            return ::strtod(buffer, 0);
+        }
+
+    } // anonymous namespace
+
     // Constructor
     PDBParser::PDBParser()
         : Parser()
@@ -629,7 +670,7 @@ Node * PDBParser::parse(Parser::Context& ctx, QIODevice& stream_) const
         ctx.setMessage("Empty Stream");
     }
 
-    QTextStream stream(&stream_);
+    LineReader reader(stream_);
 
     // Convenience...
     Node * c_ExtentAnnotation = UtopiaSystem.term("ExtentAnnotation");
@@ -645,6 +686,14 @@ Node * PDBParser::parse(Parser::Context& ctx, QIODevice& stream_) const
     secondaryStructure->attributes.set("name", "Secondary Structure");
     secondaryStructure->attributes.set("class", "group");
 
+    // Atoms are stored column-wise, their Nodes only being created on demand
+    AtomTable * atomTable = new AtomTable;
+    if (stream_.size() > 0)
+    {
+        // Most of a PDB file is 81 byte ATOM / HETATM records
+        atomTable->reserve((int) qMin(stream_.size() / 81, (qint64) 1 << 24));
+    }
+
     try {
         // Local variables required for importing the structure and data
         Node * molecule = 0;
@@ -654,8 +703,8 @@ Node * PDBParser::parse(Parser::Context& ctx, QIODevice& stream_) const
         Node * residue = 0;
         Node * backbone = 0;
         Node * sidechain = 0;
-        Node * atom = 0;
-        QMap< int, Node * > atoms;
+        QChar chainChainId;
+        QString residueSeqId;
         QMap< QString, Node * > residues;
         QSet< Node * > bonds;
         QSet< DummySSBOND* > _dummySSBONDs;
@@ -679,26 +728,33 @@ Node * PDBParser::parse(Parser::Context& ctx, QIODevice& stream_) const
         QVector< gtl::matrix_4d > matrices;
         size_t line_no = 0;
 
-        while (!stream.atEnd() && firstModel) {
-            QString line = stream.readLine();
+        const char * begin = 0;
+        const char * end = 0;
+        char record[81];
+        while (firstModel && reader.readLine(&begin, &end)) {
             ++line_no;
-            // Ignore empty lines
-            if (line.isEmpty())
+
+            // Report progress every so often
+            if (line_no % 4096 == 0 && !ctx.progress(reader.position(), reader.size()))
             {
-                continue;
+                // Bail out through the clean up below
+                throw Cancelled;
             }
 
-            if (line.length() < 80)
+            // Ignore empty lines
+            if (begin == end)
             {
-                line += QString(80 - line.length(), ' ');
+                continue;
             }
-//qDebug() << line;
 
+            // Records are read from fixed columns of a space padded copy
+            size_t length = qMin(end - begin, (ptrdiff_t) 80);
+            ::memcpy(record, begin, length);
+            ::memset(record + length, ' ', 80 - length);
+            record[80] = 0;
 
-            QString recordtype = line.mid(0, 6);
-
-            if (recordtype == "COMPND") {
-                QString compnd = line.mid(10, 60).trimmed();
+            if (isRecord(record, "COMPND")) {
+                QString compnd = field(record, 10, 60).trimmed();
                 QString key = "";
                 QString value = "";
 
@@ -718,45 +774,45 @@ Node * PDBParser::parse(Parser::Context& ctx, QIODevice& stream_) const
                 }
                 compndInfo.back()[key] += (compndInfo.back()[key] == "" ? "" : " ") + value;
                 lastKey = key;
-            } else if (recordtype == "HET   ") {
+            } else if (isRecord(record, "HET   ")) {
                 Heterogen * het = 0;
-                hetInfo.push_back(Heterogen(line.mid(7, 3).trimmed()));
+                hetInfo.push_back(Heterogen(field(record, 7, 3).trimmed()));
                 het = &hetInfo.back();
-                het->chainId = line[12];
-                het->seqId = line.mid(13, 4).trimmed();
-                het->iCode = line[17];
-                het->text = line.mid(30, 40).trimmed();
-            } else if (recordtype == "TER   ") {
+                het->chainId = charField(record, 12);
+                het->seqId = field(record, 13, 4).trimmed();
+                het->iCode = charField(record, 17);
+                het->text = field(record, 30, 40).trimmed();
+            } else if (isRecord(record, "TER   ")) {
 //                      chain = 0;
-            } else if (recordtype == "ENDMDL") {
+            } else if (isRecord(record, "ENDMDL")) {
                 firstModel = false;
-            } else if (recordtype == "HETNAM") {
-                QString hetID = line.mid(11, 3).trimmed();
-                QString name = line.mid(15, 55).trimmed();
+            } else if (isRecord(record, "HETNAM")) {
+                QString hetID = field(record, 11, 3).trimmed();
+                QString name = field(record, 15, 55).trimmed();
                 QList< Heterogen >::iterator het = hetInfo.begin();
                 QList< Heterogen >::iterator end = hetInfo.end();
                 for (; het != end; ++het)
                     if ((*het).hetID == hetID)
                         (*het).name = name;
-            } else if (recordtype == "TURN  ") {
-                QChar chainId = line[19];
-                QString initSeqId = line.mid(20, 4).trimmed();
-                QString endSeqId = line.mid(31, 4).trimmed();
+            } else if (isRecord(record, "TURN  ")) {
+                QChar chainId = charField(record, 19);
+                QString initSeqId = field(record, 20, 4).trimmed();
+                QString endSeqId = field(record, 31, 4).trimmed();
                 turnInfo.push_back(Turn(chainId, initSeqId, endSeqId));
-            } else if (recordtype == "HELIX ") {
-                QChar chainId = line[19];
-                QString initSeqId = line.mid(21, 4).trimmed();
-                QString endSeqId = line.mid(33, 4).trimmed();
+            } else if (isRecord(record, "HELIX ")) {
+                QChar chainId = charField(record, 19);
+                QString initSeqId = field(record, 21, 4).trimmed();
+                QString endSeqId = field(record, 33, 4).trimmed();
                 helixInfo.push_back(Helix(chainId, initSeqId, endSeqId));
-            } else if (recordtype == "SHEET ") {
-                QChar chainId = line[21];
-                QString initSeqId = line.mid(22, 4).trimmed();
-                QString endSeqId = line.mid(33, 4).trimmed();
+            } else if (isRecord(record, "SHEET ")) {
+                QChar chainId = charField(record, 21);
+                QString initSeqId = field(record, 22, 4).trimmed();
+                QString endSeqId = field(record, 33, 4).trimmed();
                 sheetInfo.push_back(Sheet(chainId, initSeqId, endSeqId));
-            } else if (recordtype == "HEADER") {
-                classification = line.mid(9, 41).trimmed();
-                date = line.mid(50, 9).trimmed();
-                pdbcode = line.mid(62, 4).trimmed();
+            } else if (isRecord(record, "HEADER")) {
+                classification = field(record, 9, 41).trimmed();
+                date = field(record, 50, 9).trimmed();
+                pdbcode = field(record, 62, 4).trimmed();
                 if (pdbcode.size() != 4)
                 {
                     pdbcode = "????";
@@ -770,29 +826,29 @@ Node * PDBParser::parse(Parser::Context& ctx, QIODevice& stream_) const
                 model->attributes.set("pdbcode", pdbcode);
                 utopia_name = pdbcode;
                 utopia_description = classification;
-            } else if (recordtype == "TITLE ") {
+            } else if (isRecord(record, "TITLE ")) {
                 if (title != "")
                     title += " ";
-                title += line.mid(10, 60).trimmed();
+                title += field(record, 10, 60).trimmed();
                 if (title.trimmed() == "")
                 {
                     title = "*Unnamed entry*";
                 }
                 model->attributes.set("title", title);
                 utopia_description = title;
-            } else if (recordtype == "REMARK") {
-                int number = atoi(line.mid(7, 3).toStdString().c_str());
+            } else if (isRecord(record, "REMARK")) {
+                int number = intField(record, 7, 3);
                 switch (number)
                 {
                 case 350:
-                    if (line.mid(13, 5) == "BIOMT")
+                    if (field(record, 13, 5) == "BIOMT")
                     {
-                        size_t row = atoi(line.mid(18, 1).toStdString().c_str());
-                        int id = atoi(line.mid(20, 3).toStdString().c_str());
-                        double r1 = atof(line.mid(24, 9).toStdString().c_str());
-                        double r2 = atof(line.mid(34, 9).toStdString().c_str());
-                        double r3 = atof(line.mid(44, 9).toStdString().c_str());
-                        double t = atof(line.mid(54, 14).toStdString().c_str());
+                        size_t row = intField(record, 18, 1);
+                        int id = intField(record, 20, 3);
+                        double r1 = realField(record, 24, 9);
+                        double r2 = realField(record, 34, 9);
+                        double r3 = realField(record, 44, 9);
+                        double t = realField(record, 54, 14);
                         if (id > matrices.size())
                         {
                             matrices.push_back(gtl::matrix_4d::identity());
@@ -801,29 +857,29 @@ Node * PDBParser::parse(Parser::Context& ctx, QIODevice& stream_) const
                     }
                     break;
                 }
-            } else if (recordtype == "ATOM  ") {
-                long int serial = atoi(line.mid(6, 5).toStdString().c_str());
-                QString name = line.mid(12, 4);
-                QChar remoteness = line[14];
-                QChar branch = line[15];
-                QChar altLoc = line[16];
-                QString resSymbol = line.mid(17, 3).trimmed();
-                QChar chainId = line[21];
-                QString seqId = line.mid(22, 4).trimmed();
-//                         QChar iCode = line[26];
-                float x = atof(line.mid(30, 8).toStdString().c_str());
-                float y = atof(line.mid(38, 8).toStdString().c_str());
-                float z = atof(line.mid(46, 8).toStdString().c_str());
-//                         float occupancy = atof(line.mid(54, 6).toStdString().c_str());
-                //float tempFactor = atof(line.mid(60, 6).toStdString().c_str());
-                QString segID = line.mid(72, 4).trimmed();
+            } else if (isRecord(record, "ATOM  ")) {
+                long int serial = intField(record, 6, 5);
+                QString name = field(record, 12, 4);
+                QChar remoteness = charField(record, 14);
+                QChar branch = charField(record, 15);
+                QChar altLoc = charField(record, 16);
+                QString resSymbol = field(record, 17, 3).trimmed();
+                QChar chainId = charField(record, 21);
+                QString seqId = field(record, 22, 4).trimmed();
+//                         QChar iCode = charField(record, 26);
+                float x = realField(record, 30, 8);
+                float y = realField(record, 38, 8);
+                float z = realField(record, 46, 8);
+//                         float occupancy = realField(record, 54, 6);
+                //float tempFactor = realField(record, 60, 6);
+                QString segID = field(record, 72, 4).trimmed();
                 QString element = "";
-                if (line[77] >= 'A' && line[77] <= 'Z')
-                    element = line.mid(76, 2).trimmed();
+                if (charField(record, 77) >= 'A' && charField(record, 77) <= 'Z')
+                    element = field(record, 76, 2).trimmed();
                 int charge = 0;
-                QChar chargeSign = line[79];
+                QChar chargeSign = charField(record, 79);
                 if (chargeSign == '+' || chargeSign == '-') {
-                    charge = line[78].toLatin1() - '0';
+                    charge = charField(record, 78).toLatin1() - '0';
                     if (chargeSign == '-') charge *= -1;
                 }
 
@@ -834,7 +890,7 @@ Node * PDBParser::parse(Parser::Context& ctx, QIODevice& stream_) const
                 else moleculeClass = "heterogen";
 
                 // Initialise new chains
-                if (chain == 0 || !chain->attributes.exists("chainId") || chainId != chain->attributes.get("chainId").toChar()) {
+                if (chain == 0 || chainId != chainChainId) {
                     size_t moleculeId = 1;
                     int compndIndex = 0;
                     if (compndInfo.size() > 1) {
@@ -868,10 +924,11 @@ Node * PDBParser::parse(Parser::Context& ctx, QIODevice& stream_) const
                     chain = molecule->create("chain");
                     molecule->relations(Utopia::UtopiaSystem.hasPart).append(chain);
                     chain->attributes.set("chainId", chainId);
+                    chainChainId = chainId;
                 }
 
                 // Initialise new residues
-                if (residue == 0 || seqId != residue->attributes.get("seqId").toString()) {
+                if (residue == 0 || seqId != residueSeqId) {
                     if (moleculeClass == "protein") {
                         residue = chain->create();
                         chain->relations(Utopia::UtopiaSystem.hasPart).append(residue);
@@ -884,6 +941,7 @@ Node * PDBParser::parse(Parser::Context& ctx, QIODevice& stream_) const
                         }
                         residue->setType(AminoAcid::get(resSymbol, true));
                         residue->attributes.set("seqId", seqId);
+                        residueSeqId = seqId;
                     } else if (moleculeClass == "nucleicacid") {
                         residue = chain->create();
                         chain->relations(Utopia::UtopiaSystem.hasPart).append(residue);
@@ -895,6 +953,7 @@ Node * PDBParser::parse(Parser::Context& ctx, QIODevice& stream_) const
                         }
                         residue->setType(Nucleotide::get(resSymbol, true));
                         residue->attributes.set("seqId", seqId);
+                        residueSeqId = seqId;
                     }
                     if (moleculeClass != "heterogen") {
                         backbone = residue->create("backbone");
@@ -910,68 +969,37 @@ Node * PDBParser::parse(Parser::Context& ctx, QIODevice& stream_) const
                     QString symbol = "";
                     if (name[0] == ' ' || (name[0] >= '1' && name[0] <='9')) symbol = name.mid(1,1);
                     else symbol = name.mid(0,2);
+                    Node * group = chain;
                     if (moleculeClass == "protein") {
-                        if (remoteness == ' ' || remoteness == 'A')
-                        {
-                            atom = backbone->create(Element::get(symbol, true));
-                            backbone->relations(Utopia::UtopiaSystem.hasPart).append(atom);
-                        }
-                        else
-                        {
-                            atom = sidechain->create(Element::get(symbol, true));
-                            sidechain->relations(Utopia::UtopiaSystem.hasPart).append(atom);
-                        }
+                        group = (remoteness == ' ' || remoteness == 'A') ? backbone : sidechain;
                     } else if (moleculeClass == "nucleicacid") {
-                        if (branch == '*' || branch == 'P' || remoteness == ' ')
-                        {
-                            atom = backbone->create(Element::get(symbol, true));
-                            backbone->relations(Utopia::UtopiaSystem.hasPart).append(atom);
-                        }
-                        else
-                        {
-                            atom = sidechain->create(Element::get(symbol, true));
-                            sidechain->relations(Utopia::UtopiaSystem.hasPart).append(atom);
-                        }
-                    } else {
-                        atom = chain->create(Element::get(symbol, true));
-                        chain->relations(Utopia::UtopiaSystem.hasPart).append(atom);
+                        group = (branch == '*' || branch == 'P' || remoteness == ' ') ? backbone : sidechain;
                     }
-                    atom->attributes.set("x", x);
-                    atom->attributes.set("y", y);
-                    atom->attributes.set("z", z);
-                    atom->attributes.set("remoteness", remoteness);
-/*
-  atom->setSerial(serial);
-  atom->setPosition(x, y, z);
-  atom->setTemperature(tempFactor);
-  atom->setCharge(charge);
-  atom->setBranch(branch);
-*/
-                    atoms[serial] = atom;
+                    atomTable->append(group, Element::get(symbol, true), x, y, z, remoteness, serial);
                 }
-            } else if (recordtype == "HETATM") {
-                long int serial = atoi(line.mid(6, 5).toStdString().c_str());
-                QString name = line.mid(12, 4);
-                QChar remoteness = line[14];
-                //QChar branch = line[15];
-                QChar altLoc = line[16];
-                QString resSymbol = line.mid(17, 3).trimmed();
-                QChar chainId = line[21];
-                QString seqId = line.mid(22, 4).trimmed();
-//                         QChar iCode = line[26];
-                float x = atof(line.mid(30, 8).toStdString().c_str());
-                float y = atof(line.mid(38, 8).toStdString().c_str());
-                float z = atof(line.mid(46, 8).toStdString().c_str());
-//                         float occupancy = atof(line.mid(54, 6).toStdString().c_str());
-                //float tempFactor = atof(line.mid(60, 6).toStdString().c_str());
-                QString segID = line.mid(72, 4).trimmed();
+            } else if (isRecord(record, "HETATM")) {
+                long int serial = intField(record, 6, 5);
+                QString name = field(record, 12, 4);
+                QChar remoteness = charField(record, 14);
+                //QChar branch = charField(record, 15);
+                QChar altLoc = charField(record, 16);
+                QString resSymbol = field(record, 17, 3).trimmed();
+                QChar chainId = charField(record, 21);
+                QString seqId = field(record, 22, 4).trimmed();
+//                         QChar iCode = charField(record, 26);
+                float x = realField(record, 30, 8);
+                float y = realField(record, 38, 8);
+                float z = realField(record, 46, 8);
+//                         float occupancy = realField(record, 54, 6);
+                //float tempFactor = realField(record, 60, 6);
+                QString segID = field(record, 72, 4).trimmed();
                 QString element = "";
-                if (line[77] >= 'A' && line[77] <= 'Z')
-                    element = line.mid(76, 2).trimmed();
+                if (charField(record, 77) >= 'A' && charField(record, 77) <= 'Z')
+                    element = field(record, 76, 2).trimmed();
                 int charge = 0;
-                QChar chargeSign = line[79];
+                QChar chargeSign = charField(record, 79);
                 if (chargeSign == '+' || chargeSign == '-') {
-                    charge = line[78].toLatin1() - '0';
+                    charge = charField(record, 78).toLatin1() - '0';
                     if (chargeSign == '-') charge *= -1;
                 }
 
@@ -991,23 +1019,26 @@ Node * PDBParser::parse(Parser::Context& ctx, QIODevice& stream_) const
                 chain_het = molecule;
 
                 // Initialise new residues
-                if (residue == 0 || seqId != residue->attributes.get("seqId").toString()) {
+                if (residue == 0 || seqId != residueSeqId) {
                     if (AminoAcid::get(resSymbol) != 0) {
                         residue = chain_het->create(AminoAcid::get(resSymbol));
                         chain_het->relations(Utopia::UtopiaSystem.hasPart).append(residue);
                         residue->attributes.set("seqId", seqId);
+                        residueSeqId = seqId;
                         backbone = residue->create("backbone");
                         sidechain = residue->create("sidechain");
                     } else if (Nucleotide::get(resSymbol) != 0) {
                         residue = chain_het->create(Nucleotide::get(resSymbol));
                         chain_het->relations(Utopia::UtopiaSystem.hasPart).append(residue);
                         residue->attributes.set("seqId", seqId);
+                        residueSeqId = seqId;
                         backbone = residue->create("backbone");
                         sidechain = residue->create("sidechain");
                     } else {
                         residue = chain_het->create("heterogen");
                         chain_het->relations(Utopia::UtopiaSystem.hasPart).append(residue);
                         residue->attributes.set("seqId", seqId);
+                        residueSeqId = seqId;
                         residue->attributes.set("hetID", resSymbol);
                         QList< Heterogen >::iterator het_iter = hetInfo.begin();
                         QList< Heterogen >::iterator het_end = hetInfo.end();
@@ -1027,21 +1058,7 @@ Node * PDBParser::parse(Parser::Context& ctx, QIODevice& stream_) const
                     QString symbol = "";
                     if (name[0] == ' ' || (name[0] >= '1' && name[0] <='9')) symbol = name.mid(1,1);
                     else symbol = name.mid(0,2);
-                    atom = residue->create(Element::get(symbol, true));
-                    residue->relations(Utopia::UtopiaSystem.hasPart).append(atom);
-//                    qDebug() << "+++++" << symbol << Element::get(symbol, true) << atom;
-                    atom->attributes.set("x", x);
-                    atom->attributes.set("y", y);
-                    atom->attributes.set("z", z);
-                    atom->attributes.set("remoteness", remoteness);
-/*
-  atom->setSerial(serial);
-  atom->setPosition(x, y, z);
-  atom->setTemperature(tempFactor);
-  atom->setCharge(charge);
-  atom->setBranch(branch);
-*/
-                    atoms[serial] = atom;
+                    atomTable->append(residue, Element::get(symbol, true), x, y, z, remoteness, serial);
 //                                              residue->add(atom);
                 }
             }
@@ -1195,6 +1212,9 @@ annotation->add(initResidue);
         // Set model's Biological transformation matrices
         model->attributes.set("BIOMT", qVariantFromValue((void *) new QVector< gtl::matrix_4d >(matrices)));
 
+        // Set model's atoms
+        model->attributes.set("atoms", qVariantFromValue((void *) atomTable));
+
         if (utopia_name.trimmed() == "")
         {
             utopia_name = "Unknown Model";
@@ -1228,8 +1248,17 @@ annotation->add(initResidue);
 
     if (authority == 0)
     {
-        ctx.setErrorCode(StreamError);
-        ctx.setMessage("Error parsing stream");
+        delete atomTable;
+        if (ctx.cancelled())
+        {
+            ctx.setErrorCode(Cancelled);
+            ctx.setMessage("Parsing cancelled");
+        }
+        else
+        {
+            ctx.setErrorCode(StreamError);
+            ctx.setMessage("Error parsing stream");
+        }
     }
 
     return authority;
@@ -33,6 +33,7 @@
 #include <utopia2/parser.h>
 #include <utopia2/nucleotide.h>
 #include <utopia2/aminoacid.h>
+#include <utopia2/atomtable.h>
 #include <utopia2/element.h>
 
 #include <QString>
@@ -76,6 +76,29 @@ struct Document loadPDFFromBuffer(const char *buffer_, size_t size_) {
     return d;
  }
 
+static void extractAllProgress(void *userdef_, size_t completed_, size_t total_) {
+    PyGILState_STATE gstate = PyGILState_Ensure();
+    PyObject *result=PyObject_CallFunction((PyObject *) userdef_, (char *) "nn",
+                                           (Py_ssize_t) completed_, (Py_ssize_t) total_);
+    if(result) {
+        Py_DECREF(result);
+    } else {
+        PyErr_Print();
+    }
+    PyGILState_Release(gstate);
+ }
+
+void extractAll(struct Document *document_, size_t threads_, PyObject *progress_) {
+    CrackleProgressCallback callback=0;
+    if(progress_ && progress_ != Py_None) {
+        callback=extractAllProgress;
+    }
+    document_->_err=SpineError_NoError;
+    Py_BEGIN_ALLOW_THREADS
+    CrackleDocument_extractAll(document_->_doc, threads_, callback, progress_, &document_->_err);
+    Py_END_ALLOW_THREADS
+ }
+
 %}
 
 
@@ -86,7 +109,17 @@ struct Document loadPDFFromBuffer(const char *buffer_, size_t size_) {
     }
  }
 
+%exception extractAll {
+  $action
+    if(check_exception(arg1->_err)) {
+        return NULL;
+    }
+ }
+
 struct Document loadPDF(const char *filename_);
 struct Document loadPDFFromBuffer(const char *buffer_, size_t size_);
 
+/* Extract every page in parallel; progress(completed, total) is called as pages finish */
+void extractAll(struct Document *document_, size_t threads_=0, PyObject *progress_=0);
+
 %include "crackleapi_python.py"
@@ -42,11 +42,16 @@
 
 #include "conversion.h"
 #include "spine/pyspineapi.h"
+#include "workerpool.h"
 
 #include <string>
 #include <iostream>
 
+#include <QAtomicInt>
 #include <QDebug>
+#include <QJsonValue>
+#include <QMap>
+#include <QStringList>
 #include <QVariant>
 
 namespace python = boost::python;
@@ -132,16 +137,36 @@ public:
                         if (PyObject * py_attr = PyObject_GetAttrString(extensionObject(), (char *) c_attr)) {
                             QRegExp parse("(before|on|after)_(\\w+)_event");
                             if (PyCallable_Check(py_attr) && parse.exactMatch(attr)) {
+                                QString event(QString("%1:%2").arg(parse.cap(1)).arg(parse.cap(2)));
                                 int weight = 0;
                                 if (PyObject * doc = PyObject_GetAttrString(py_attr, (char *) "__doc__")) {
+                                    QString docString(convert(doc).toString());
                                     QRegExp parseWeight(".*\\[(?:.+;)?\\s*weight=(-?\\d+)\\s*(?:;.+)?\\].*");
-                                    if (parseWeight.exactMatch(convert(doc).toString())) {
+                                    if (parseWeight.exactMatch(docString)) {
                                         weight = parseWeight.cap(1).toInt();
                                     }
+                                    // Annotation concepts, e.g. [produces=citation,hyperlink; consumes=]
+                                    QRegExp parseProduces(".*\\[(?:.+;)?\\s*produces=([^;\\]]*)(?:;.+)?\\].*");
+                                    if (parseProduces.exactMatch(docString)) {
+                                        _producedConcepts[event] = parseConcepts(parseProduces.cap(1));
+                                    }
+                                    QRegExp parseConsumes(".*\\[(?:.+;)?\\s*consumes=([^;\\]]*)(?:;.+)?\\].*");
+                                    if (parseConsumes.exactMatch(docString)) {
+                                        _consumedConcepts[event] = parseConcepts(parseConsumes.cap(1));
+                                    }
+                                    // Handlers may run in a worker process, e.g. [isolated=true; consumes=],
+                                    // but as a worker's document has no annotations, only if they consume none
+                                    QRegExp parseIsolated(".*\\[(?:.+;)?\\s*isolated=(true|1)\\s*(?:;.+)?\\].*");
+                                    if (parseIsolated.exactMatch(docString)) {
+                                        if (_consumedConcepts.contains(event) && _consumedConcepts[event].isEmpty()) {
+                                            _isolatedEvents << event;
+                                        } else {
+                                            qDebug() << "Not isolating" << attr << "as it may consume annotations";
+                                        }
+                                    }
                                     Py_DECREF(doc);
                                 }
 
-                                QString event(QString("%1:%2").arg(parse.cap(1)).arg(parse.cap(2)));
                                 _handleableEventNames << event;
                                 event += QString("/%1").arg(weight);
                                 _handleableEvents << event;
@@ -155,6 +180,26 @@ public:
                 PyErr_PrintEx(0);
             }
 
+            // Find where this extension's class was loaded from, so that worker
+            // processes can load it for themselves
+            if (PyObject * cls = PyObject_GetAttrString(extensionObject(), "__class__")) {
+                PyObject * className = PyObject_GetAttrString(cls, "__name__");
+                PyObject * moduleName = PyObject_GetAttrString(cls, "__module__");
+                if (className && moduleName) {
+                    if (PyObject * module = PyImport_AddModule(PyString_AsString(moduleName))) { // Borrowed
+                        if (PyObject * file = PyObject_GetAttrString(module, "__file__")) {
+                            _pluginPath = convert(file).toString();
+                            _className = convert(className).toString();
+                            Py_DECREF(file);
+                        }
+                    }
+                }
+                PyErr_Clear();
+                Py_XDECREF(moduleName);
+                Py_XDECREF(className);
+                Py_DECREF(cls);
+            }
+
             // Register legacy method names to event names
             QMapIterator< QString, QString > liter(event_name_to_legacy_method_name);
             while (liter.hasNext()) {
@@ -248,12 +293,104 @@ public:
         return success;
     }
 
+    // Run an isolated event handler in this thread's worker process, adding
+    // to the document whatever annotations it creates there. If the handler
+    // cannot be run that way, *handled is left false and nothing is done.
+    bool _annotateInWorker(const QString & name, Spine::DocumentHandle document, const QVariantMap & kwargs, bool * handled)
+    {
+        *handled = false;
+
+        PythonWorkerPool & pool = PythonWorkerPool::instance();
+        if (!document || _pluginPath.isEmpty() || !pool.isAvailable()) {
+            return false;
+        }
+
+        // Only plain data can be passed to a worker
+        QMapIterator< QString, QVariant > arg(kwargs);
+        while (arg.hasNext()) {
+            arg.next();
+            if (!arg.value().isNull() && QJsonValue::fromVariant(arg.value()).isNull()) {
+                return false;
+            }
+        }
+
+        QString snapshot(pool.snapshot(document));
+        if (snapshot.isEmpty()) {
+            return false;
+        }
+
+        QVariantMap request;
+        request["plugin"] = _pluginPath;
+        request["extension"] = _className;
+        request["method"] = name;
+        request["snapshot"] = snapshot;
+        request["kwargs"] = kwargs;
+        QVariantMap reply;
+        bool called = pool.call(request, &reply, &_cancelled);
+        if (_cancelled.fetchAndStoreOrdered(0)) {
+            // Don't fall back to running a cancelled handler in-process
+            *handled = true;
+            setErrorString("Cancelled");
+            return false;
+        }
+        if (!called) {
+            return false;
+        }
+        *handled = true;
+
+        if (!reply.value("success").toBool()) {
+            setErrorString(Papyro::unicodeFromQString(reply.value("error").toString()));
+            return false;
+        }
+
+        // Rebuild the worker's annotations against this document
+        std::map< std::string, std::set< Spine::AnnotationHandle > > created;
+        foreach (const QVariant & serialized, reply.value("annotations").toList()) {
+            QVariantMap fields(serialized.toMap());
+            Spine::AnnotationHandle annotation(new Spine::Annotation);
+            QMapIterator< QString, QVariant > property(fields.value("properties").toMap());
+            while (property.hasNext()) {
+                property.next();
+                foreach (const QVariant & value, property.value().toList()) {
+                    annotation->setProperty(Papyro::unicodeFromQString(property.key()), Papyro::unicodeFromQString(value.toString()));
+                }
+            }
+            foreach (const QVariant & area, fields.value("areas").toList()) {
+                QVariantList a(area.toList());
+                if (a.size() == 6) {
+                    annotation->addArea(Spine::Area(a[0].toInt(), a[1].toInt(), Spine::BoundingBox(a[2].toDouble(), a[3].toDouble(), a[4].toDouble(), a[5].toDouble())));
+                }
+            }
+            foreach (const QVariant & extent, fields.value("extents").toList()) {
+                QVariantList e(extent.toList());
+                if (e.size() == 6) {
+                    if (Spine::TextExtentHandle resolved = document->resolveExtent(e[0].toInt(), e[1].toDouble(), e[2].toDouble(), e[3].toInt(), e[4].toDouble(), e[5].toDouble())) {
+                        annotation->addExtent(resolved);
+                    }
+                }
+            }
+            created[Papyro::unicodeFromQString(fields.value("scratch").toString())].insert(annotation);
+        }
+        std::map< std::string, std::set< Spine::AnnotationHandle > >::const_iterator list(created.begin());
+        for (; list != created.end(); ++list) {
+            document->addAnnotations(list->second, list->first);
+        }
+
+        return true;
+    }
+
     // Ensure the extension is cancelled
     void cancel()
     {
+        _cancelled.store(1);
         PyExtension::cancel();
     }
 
+    QStringList consumedConcepts(const QString & event)
+    {
+        return _consumedConcepts.value(event, QStringList("*"));
+    }
+
     bool canHandleEvent(const QString & event)
     {
         foreach (const QString & candidate, handleableEvents()) {
@@ -265,20 +402,45 @@ public:
         return false;
     }
 
+    QStringList producedConcepts(const QString & event)
+    {
+        return _producedConcepts.value(event, QStringList("*"));
+    }
+
     QStringList handleableEvents()
     {
         QStringList unique(_handleableEvents + _handleableLegacyEvents);
+        // Isolated handlers' snapshots are released when the document closes
+        if (!_isolatedEvents.isEmpty() && !_handleableEventNames.contains("after:close")) {
+            unique << "after:close/0";
+        }
         unique.removeDuplicates();
         return unique;
     }
 
     bool handleEvent(const QString & event, Spine::DocumentHandle document, const QVariantMap & kwargs)
     {
+        if (event == "after:close" && !_isolatedEvents.isEmpty()) {
+            PythonWorkerPool::instance().release(document);
+            if (!_handleableEventNames.contains(event)) {
+                return true;
+            }
+        }
+
+        // A cancellation that arrived while idle belongs to no call
+        _cancelled.store(0);
         makeCancellable();
 
         // Only attempt events we've registered
         if (_handleableEventNames.contains(event)) {
             QString name(event_name_to_method_name(event));
+            if (_isolatedEvents.contains(event)) {
+                bool handled = false;
+                bool success = _annotateInWorker(name, document, kwargs, &handled);
+                if (handled) {
+                    return success;
+                }
+            }
             return _annotate(Papyro::unicodeFromQString(name), document, kwargs);
         }
         if (_handleableLegacyEvents.contains(event)) {
@@ -436,6 +598,24 @@ protected:
     QStringList _handleableEvents;
     QStringList _handleableLegacyEvents;
     QStringList _handleableEventNames;
+    QStringList _isolatedEvents;
+    QString _pluginPath;
+    QString _className;
+    // Set by cancel() to abandon a handler running in a worker
+    QAtomicInt _cancelled;
+    QMap< QString, QStringList > _consumedConcepts;
+    QMap< QString, QStringList > _producedConcepts;
+
+    static QStringList parseConcepts(const QString & list)
+    {
+        QStringList concepts;
+        foreach (const QString & concept, list.split(',', QString::SkipEmptyParts)) {
+            if (!concept.trimmed().isEmpty()) {
+                concepts << concept.trimmed();
+            }
+        }
+        return concepts;
+    }
 };
 
 
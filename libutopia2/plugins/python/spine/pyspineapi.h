@@ -57,4 +57,9 @@ struct Cursor {
     SpineError _err;
 };
 
+struct TextLayout {
+    PyObject *_capsule; /* owns the SpineTextLayout */
+    SpineError _err;
+};
+
 #endif /* PYSPINEAPI_INCL_ */
@@ -92,6 +92,37 @@
         return result;
     }
 
+    static void delete_layout_capsule(PyObject *capsule) {
+        SpineTextLayout layout=(SpineTextLayout) PyCapsule_GetPointer(capsule, "spineapi.TextLayout");
+        delete_SpineTextLayout(&layout, 0);
+    }
+
+    static SpineTextLayout layout_of(struct TextLayout *layout) {
+        if (!layout->_capsule) {
+            layout->_err=SpineError_InvalidType;
+            return 0;
+        }
+        return (SpineTextLayout) PyCapsule_GetPointer(layout->_capsule, "spineapi.TextLayout");
+    }
+
+    /* A read-only memoryview onto one of a layout's arrays. The view holds
+       a reference to the layout's capsule, so the array stays valid for as
+       long as the view is in use, even after the TextLayout object is gone. */
+    static PyObject *layout_view(struct TextLayout *layout, void *data, size_t count, Py_ssize_t itemsize, const char *format) {
+        Py_buffer view;
+        Py_ssize_t shape=(Py_ssize_t) count;
+        Py_ssize_t strides=itemsize;
+        if (PyBuffer_FillInfo(&view, layout->_capsule, data, shape*itemsize, 1, PyBUF_FULL_RO) < 0) {
+            return 0;
+        }
+        view.format=(char *) format;
+        view.itemsize=itemsize;
+        view.ndim=1;
+        view.shape=&shape;
+        view.strides=&strides;
+        return PyMemoryView_FromBuffer(&view);
+    }
+
 %}
 
 
@@ -601,6 +632,24 @@
 
 }
 
+%extend TextLayout {
+    TextLayout() {
+        struct TextLayout *l=(struct TextLayout *) malloc(sizeof(struct TextLayout));
+        l->_err=SpineError_InvalidType;
+        l->_capsule=0;
+        check_exception(l->_err);
+        return l;
+    }
+
+    ~TextLayout() {
+        PyGILState_STATE state=PyGILState_Ensure();
+        Py_XDECREF($self->_capsule);
+        $self->_capsule=0;
+        PyGILState_Release(state);
+    }
+
+}
+
 %extend TextExtent {
 
     TextExtent(const struct Cursor start, const struct Cursor to) {
@@ -830,6 +879,21 @@
         return result;
     }
 
+    /* All the text of pages fromPage to toPage (0 for the last page) in
+       flat arrays; see TextLayout */
+    struct TextLayout textLayout(int fromPage=1, int toPage=0) {
+        struct TextLayout l;
+        SpineTextLayout layout;
+        SpineError err=SpineError_NoError;
+        Py_BEGIN_ALLOW_THREADS
+        layout=SpineDocument_textLayout($self->_doc, fromPage, toPage, &err);
+        Py_END_ALLOW_THREADS
+        $self->_err=err;
+        l._err=SpineError_NoError;
+        l._capsule=layout ? PyCapsule_New(layout, "spineapi.TextLayout", delete_layout_capsule) : 0;
+        return l;
+    }
+
     struct TextExtent substr(int start, int len) {
         struct TextExtent e;
         e._err=SpineError_NoError;
@@ -1360,6 +1424,85 @@
 
 }
 
+/****************************************************************************
+ *
+ * TextLayout arrays are returned as memoryviews onto the layout itself,
+ * without copying. Offsets are uint32 ("I"), areas are SpineArea structs
+ * ("iidddd": page, rotation, x1, y1, x2, y2), and text is UTF-8 bytes.
+ *
+ ****************************************************************************/
+
+%extend TextLayout
+{
+
+    PyObject * characters()
+    {
+        SpineTextLayout l=layout_of($self);
+        return l ? layout_view($self, l->characters, l->characterCount, sizeof(uint32_t), "I") : 0;
+    }
+
+    PyObject * characterAreas()
+    {
+        SpineTextLayout l=layout_of($self);
+        return l ? layout_view($self, l->characterAreas, l->characterCount, sizeof(SpineArea), "iidddd") : 0;
+    }
+
+    PyObject * wordCharacters()
+    {
+        SpineTextLayout l=layout_of($self);
+        return l ? layout_view($self, l->wordCharacters, l->wordCount+1, sizeof(uint32_t), "I") : 0;
+    }
+
+    PyObject * wordText()
+    {
+        SpineTextLayout l=layout_of($self);
+        return l ? layout_view($self, l->wordText, l->wordCount+1, sizeof(uint32_t), "I") : 0;
+    }
+
+    PyObject * wordAreas()
+    {
+        SpineTextLayout l=layout_of($self);
+        return l ? layout_view($self, l->wordAreas, l->wordCount, sizeof(SpineArea), "iidddd") : 0;
+    }
+
+    PyObject * wordSpaceAfter()
+    {
+        SpineTextLayout l=layout_of($self);
+        return l ? layout_view($self, l->wordSpaceAfter, l->wordCount, sizeof(uint8_t), "B") : 0;
+    }
+
+    PyObject * text()
+    {
+        SpineTextLayout l=layout_of($self);
+        return l ? layout_view($self, l->text, l->textLength, 1, "B") : 0;
+    }
+
+    PyObject * lineWords()
+    {
+        SpineTextLayout l=layout_of($self);
+        return l ? layout_view($self, l->lineWords, l->lineCount+1, sizeof(uint32_t), "I") : 0;
+    }
+
+    PyObject * lineAreas()
+    {
+        SpineTextLayout l=layout_of($self);
+        return l ? layout_view($self, l->lineAreas, l->lineCount, sizeof(SpineArea), "iidddd") : 0;
+    }
+
+    PyObject * blockLines()
+    {
+        SpineTextLayout l=layout_of($self);
+        return l ? layout_view($self, l->blockLines, l->blockCount+1, sizeof(uint32_t), "I") : 0;
+    }
+
+    PyObject * blockAreas()
+    {
+        SpineTextLayout l=layout_of($self);
+        return l ? layout_view($self, l->blockAreas, l->blockCount, sizeof(SpineArea), "iidddd") : 0;
+    }
+
+}
+
 %extend Image
 {
 
@@ -74,6 +74,20 @@
 }
 
 
+%extend TextLayout {
+  %pythoncode %{
+
+    def words(self):
+        """The text of each word, decoded. The other arrays are best read
+        without copying, e.g. numpy.frombuffer(layout.wordAreas(), ...)"""
+        import array
+        text = self.text().tobytes()
+        offsets = array.array('I', self.wordText().tobytes())
+        return [text[offsets[i]:offsets[i + 1]].decode('utf8') for i in xrange(len(offsets) - 1)]
+  %}
+}
+
+
 %extend Document {
   %pythoncode %{
 
@@ -0,0 +1,253 @@
+/*****************************************************************************
+ *  
+ *   This file is part of the Utopia Documents application.
+ *       Copyright (c) 2008-2017 Lost Island Labs
+ *           <info@utopiadocs.com>
+ *   
+ *   Utopia Documents is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU GENERAL PUBLIC LICENSE VERSION 3 as
+ *   published by the Free Software Foundation.
+ *   
+ *   Utopia Documents is distributed in the hope that it will be useful, but
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ *   Public License for more details.
+ *   
+ *   In addition, as a special exception, the copyright holders give
+ *   permission to link the code of portions of this program with the OpenSSL
+ *   library under certain conditions as described in each individual source
+ *   file, and distribute linked combinations including the two.
+ *   
+ *   You must obey the GNU General Public License in all respects for all of
+ *   the code used other than OpenSSL. If you modify file(s) with this
+ *   exception, you may extend this exception to your version of the file(s),
+ *   but you are not obligated to do so. If you do not wish to do so, delete
+ *   this exception statement from your version.
+ *   
+ *   You should have received a copy of the GNU General Public License
+ *   along with Utopia Documents. If not, see <http://www.gnu.org/licenses/>
+ *  
+ *****************************************************************************/
+
+#include <Python.h>
+
+#include "conversion.h"
+#include "workerpool.h"
+
+#include <spine/spineapi.h>
+
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QMutexLocker>
+#include <QProcess>
+#include <QProcessEnvironment>
+#include <QTemporaryFile>
+
+// How long to wait for a worker's reply before checking for cancellation
+static const int pollInterval = 100;
+
+// Snapshot files start with this, then a version, the page count and the
+// layout's counts, followed by its arrays in native byte order (as read by
+// utopia.worker.SharedLayout)
+static const char layoutMagic[8] = { 'U', 'T', 'L', 'A', 'Y', 'O', 'U', 'T' };
+static const quint32 layoutVersion = 1;
+
+static bool writeLayout(QIODevice & file, quint32 pages, SpineTextLayout layout)
+{
+    quint64 counts[5] = { layout->characterCount, layout->wordCount, layout->textLength, layout->lineCount, layout->blockCount };
+    struct { const void * data; qint64 size; } arrays[] = {
+        { layout->characters, (qint64) (layout->characterCount * sizeof(uint32_t)) },
+        { layout->characterAreas, (qint64) (layout->characterCount * sizeof(SpineArea)) },
+        { layout->wordCharacters, (qint64) ((layout->wordCount + 1) * sizeof(uint32_t)) },
+        { layout->wordText, (qint64) ((layout->wordCount + 1) * sizeof(uint32_t)) },
+        { layout->wordAreas, (qint64) (layout->wordCount * sizeof(SpineArea)) },
+        { layout->wordSpaceAfter, (qint64) (layout->wordCount * sizeof(uint8_t)) },
+        { layout->text, (qint64) layout->textLength },
+        { layout->lineWords, (qint64) ((layout->lineCount + 1) * sizeof(uint32_t)) },
+        { layout->lineAreas, (qint64) (layout->lineCount * sizeof(SpineArea)) },
+        { layout->blockLines, (qint64) ((layout->blockCount + 1) * sizeof(uint32_t)) },
+        { layout->blockAreas, (qint64) (layout->blockCount * sizeof(SpineArea)) },
+    };
+
+    bool written = file.write(layoutMagic, sizeof(layoutMagic)) == (qint64) sizeof(layoutMagic) &&
+                   file.write((const char *) &layoutVersion, sizeof(layoutVersion)) == (qint64) sizeof(layoutVersion) &&
+                   file.write((const char *) &pages, sizeof(pages)) == (qint64) sizeof(pages) &&
+                   file.write((const char *) counts, sizeof(counts)) == (qint64) sizeof(counts);
+    for (size_t i = 0; written && i < sizeof(arrays) / sizeof(arrays[0]); ++i) {
+        written = file.write((const char *) arrays[i].data, arrays[i].size) == arrays[i].size;
+    }
+    return written;
+}
+
+
+PythonWorkerPool::PythonWorkerPool()
+{
+    // Workers run the same Python, with the same search path, as the
+    // embedded interpreter
+    PyGILState_STATE gstate;
+    gstate = PyGILState_Ensure();
+
+    if (PyObject * executable = PySys_GetObject((char *) "executable")) { // Borrowed
+        QString program(convert(executable).toString());
+        // An embedding application reports itself here on some platforms
+        if (QFileInfo(program).fileName().startsWith("python", Qt::CaseInsensitive)) {
+            _program = program;
+        }
+    }
+    if (PyObject * path = PySys_GetObject((char *) "path")) { // Borrowed
+        _pythonPath = convert(path).toStringList();
+    }
+
+    PyGILState_Release(gstate);
+}
+
+PythonWorkerPool::~PythonWorkerPool()
+{
+    // Any remaining snapshots go with the temporary directory
+}
+
+QProcess * PythonWorkerPool::_worker()
+{
+    QProcess * worker = _workers.hasLocalData() ? _workers.localData() : 0;
+
+    // (Re)start this thread's worker if it isn't running
+    if (worker == 0 || worker->state() != QProcess::Running) {
+        worker = new QProcess;
+        QProcessEnvironment environment(QProcessEnvironment::systemEnvironment());
+#ifdef _WIN32
+        environment.insert("PYTHONPATH", _pythonPath.join(";"));
+#else
+        environment.insert("PYTHONPATH", _pythonPath.join(":"));
+#endif
+        worker->setProcessEnvironment(environment);
+        worker->setProcessChannelMode(QProcess::ForwardedErrorChannel);
+        worker->start(_program, QStringList() << "-u" << "-m" << "utopia.worker");
+        _workers.setLocalData(worker); // Deletes any previous worker
+        if (!worker->waitForStarted()) {
+            qDebug() << "Could not start Python worker:" << worker->errorString();
+            return 0;
+        }
+    }
+
+    return worker;
+}
+
+bool PythonWorkerPool::call(const QVariantMap & request, QVariantMap * reply, const QAtomicInt * cancelled)
+{
+    QProcess * worker = isAvailable() ? _worker() : 0;
+    if (worker == 0) {
+        return false;
+    }
+
+    worker->write(QJsonDocument::fromVariant(request).toJson(QJsonDocument::Compact) + "\n");
+    while (!worker->canReadLine()) {
+        // Handlers may legitimately take a long time (network lookups and
+        // the like), so only give up if cancelled or if the worker goes away
+        if (cancelled && cancelled->load()) {
+            worker->kill();
+            worker->waitForFinished();
+            return false;
+        }
+        if (!worker->waitForReadyRead(pollInterval) && worker->state() != QProcess::Running) {
+            qDebug() << "Python worker failed:" << worker->errorString();
+            worker->kill();
+            return false;
+        }
+    }
+
+    *reply = QJsonDocument::fromJson(worker->readLine()).toVariant().toMap();
+    return !reply->isEmpty();
+}
+
+PythonWorkerPool & PythonWorkerPool::instance()
+{
+    static PythonWorkerPool pool;
+    return pool;
+}
+
+bool PythonWorkerPool::isAvailable() const
+{
+    return !_program.isEmpty();
+}
+
+void PythonWorkerPool::_purge(Spine::DocumentHandle released)
+{
+    // Forget closed (and released) documents, deleting the snapshots that
+    // no open document needs any more (must hold _mutex)
+    QMutableMapIterator< std::string, Snapshot > iter(_snapshots);
+    while (iter.hasNext()) {
+        iter.next();
+        QMutableListIterator< Spine::WeakDocumentHandle > document(iter.value().documents);
+        while (document.hasNext()) {
+            Spine::DocumentHandle handle(document.next().lock());
+            if (!handle || handle == released) {
+                document.remove();
+            }
+        }
+        if (iter.value().documents.isEmpty()) {
+            QFile::remove(iter.value().path);
+            iter.remove();
+        }
+    }
+}
+
+void PythonWorkerPool::release(Spine::DocumentHandle document)
+{
+    QMutexLocker guard(&_mutex);
+    _purge(document);
+}
+
+QString PythonWorkerPool::snapshot(Spine::DocumentHandle document)
+{
+    // Snapshots are named by the digest at the end of the file hash IRI
+    std::string hash(document->filehashDigest());
+    if (hash.empty()) {
+        return QString();
+    }
+
+    QMutexLocker guard(&_mutex);
+    _purge();
+    QMap< std::string, Snapshot >::iterator found(_snapshots.find(hash));
+    if (found != _snapshots.end()) {
+        bool known = false;
+        foreach (const Spine::WeakDocumentHandle & other, found.value().documents) {
+            known = known || other.lock() == document;
+        }
+        if (!known) {
+            found.value().documents.append(document);
+        }
+        return found.value().path;
+    }
+
+    // Snapshots live in a directory only this user can read, under names
+    // that can't be guessed in advance
+    if (!_directory.isValid()) {
+        return QString();
+    }
+    QTemporaryFile file(QDir(_directory.path()).absoluteFilePath("XXXXXX.layout"));
+    file.setAutoRemove(false);
+    if (file.open()) {
+        // The text is extracted here once for every worker that needs it
+        SpineError error = SpineError_NoError;
+        SpineDocument doc = Spine::share_SpineDocument(document, &error);
+        SpineTextLayout layout = SpineDocument_textLayout(doc, 1, 0, &error);
+        bool written = layout && writeLayout(file, (quint32) document->numberOfPages(), layout);
+        if (layout) {
+            delete_SpineTextLayout(&layout, 0);
+        }
+        delete_SpineDocument(&doc, 0);
+        file.close();
+        if (written) {
+            Snapshot & snapshot = _snapshots[hash];
+            snapshot.path = file.fileName();
+            snapshot.documents.append(document);
+            return snapshot.path;
+        }
+        file.remove();
+    }
+
+    return QString();
+}
@@ -0,0 +1,108 @@
+/*****************************************************************************
+ *  
+ *   This file is part of the Utopia Documents application.
+ *       Copyright (c) 2008-2017 Lost Island Labs
+ *           <info@utopiadocs.com>
+ *   
+ *   Utopia Documents is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU GENERAL PUBLIC LICENSE VERSION 3 as
+ *   published by the Free Software Foundation.
+ *   
+ *   Utopia Documents is distributed in the hope that it will be useful, but
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ *   Public License for more details.
+ *   
+ *   In addition, as a special exception, the copyright holders give
+ *   permission to link the code of portions of this program with the OpenSSL
+ *   library under certain conditions as described in each individual source
+ *   file, and distribute linked combinations including the two.
+ *   
+ *   You must obey the GNU General Public License in all respects for all of
+ *   the code used other than OpenSSL. If you modify file(s) with this
+ *   exception, you may extend this exception to your version of the file(s),
+ *   but you are not obligated to do so. If you do not wish to do so, delete
+ *   this exception statement from your version.
+ *   
+ *   You should have received a copy of the GNU General Public License
+ *   along with Utopia Documents. If not, see <http://www.gnu.org/licenses/>
+ *  
+ *****************************************************************************/
+
+#ifndef UTOPIA_PYTHON_WORKERPOOL_H
+#define UTOPIA_PYTHON_WORKERPOOL_H
+
+#include <spine/Document.h>
+
+#include <QAtomicInt>
+#include <QList>
+#include <QMap>
+#include <QMutex>
+#include <QString>
+#include <QStringList>
+#include <QTemporaryDir>
+#include <QThreadStorage>
+#include <QVariant>
+
+class QProcess;
+
+
+/*****************************************************************************
+ *
+ * A pool of child Python processes (running utopia.worker) in which isolated
+ * annotator event handlers can run in parallel, rather than one at a time on
+ * the embedded interpreter. Each calling thread is given its own worker, so
+ * the pool grows with the annotator thread pool. Rather than each worker
+ * parsing the PDF again, a document's text layout (see
+ * SpineDocument_textLayout) is exported once to a read-only snapshot file in
+ * a private temporary directory, which every worker then maps. Snapshots are
+ * kept until every document with that content has been released.
+ *
+ ****************************************************************************/
+
+class PythonWorkerPool
+{
+public:
+    // Constructor
+    PythonWorkerPool();
+    // Destructor
+    ~PythonWorkerPool();
+
+    // Instance
+    static PythonWorkerPool & instance();
+
+    // Can workers be started at all?
+    bool isAvailable() const;
+
+    // Send a request to this thread's worker and wait for its reply; returns
+    // false if the worker could not be reached, or if cancelled becomes
+    // non-zero while waiting (in which case the worker is killed)
+    bool call(const QVariantMap & request, QVariantMap * reply, const QAtomicInt * cancelled = 0);
+
+    // Release a document's hold on its snapshot, deleting the snapshot once
+    // no open document shares it
+    void release(Spine::DocumentHandle document);
+
+    // Path of a read-only snapshot of the document's text layout
+    QString snapshot(Spine::DocumentHandle document);
+
+private:
+    struct Snapshot
+    {
+        QString path;
+        QList< Spine::WeakDocumentHandle > documents;
+    };
+
+    QString _program;
+    QStringList _pythonPath;
+    QThreadStorage< QProcess * > _workers;
+    QMutex _mutex;
+    QTemporaryDir _directory;
+    QMap< std::string, Snapshot > _snapshots;
+
+    QProcess * _worker();
+    void _purge(Spine::DocumentHandle released = Spine::DocumentHandle());
+
+}; // class PythonWorkerPool
+
+#endif // UTOPIA_PYTHON_WORKERPOOL_H
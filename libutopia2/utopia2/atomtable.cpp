@@ -0,0 +1,236 @@
+/*****************************************************************************
+ *  
+ *   This file is part of the Utopia Documents application.
+ *       Copyright (c) 2008-2017 Lost Island Labs
+ *           <info@utopiadocs.com>
+ *   
+ *   Utopia Documents is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU GENERAL PUBLIC LICENSE VERSION 3 as
+ *   published by the Free Software Foundation.
+ *   
+ *   Utopia Documents is distributed in the hope that it will be useful, but
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ *   Public License for more details.
+ *   
+ *   In addition, as a special exception, the copyright holders give
+ *   permission to link the code of portions of this program with the OpenSSL
+ *   library under certain conditions as described in each individual source
+ *   file, and distribute linked combinations including the two.
+ *   
+ *   You must obey the GNU General Public License in all respects for all of
+ *   the code used other than OpenSSL. If you modify file(s) with this
+ *   exception, you may extend this exception to your version of the file(s),
+ *   but you are not obligated to do so. If you do not wish to do so, delete
+ *   this exception statement from your version.
+ *   
+ *   You should have received a copy of the GNU General Public License
+ *   along with Utopia Documents. If not, see <http://www.gnu.org/licenses/>
+ *  
+ *****************************************************************************/
+
+
+#include <utopia2/atomtable.h>
+#include <utopia2/node.h>
+#include <utopia2/ontology.h>
+
+#include <algorithm>
+
+namespace Utopia
+{
+
+    /** Construct an empty table. */
+    AtomTable::AtomTable()
+        : _sorted(true)
+    {}
+
+    /** Add an atom to the end of the table. */
+    int AtomTable::append(Node* group_, Node* element_, float x_, float y_, float z_, QChar remoteness_, long serial_)
+    {
+        int index = _elements.size();
+
+        // Find / add its group
+        QHash< Node*, int >::const_iterator found = _groupIndex.find(group_);
+        int group;
+        if (found == _groupIndex.end())
+        {
+            Group g = { group_, index, index, false };
+            group = _groupList.size();
+            _groupList.append(g);
+            _groupIndex.insert(group_, group);
+        }
+        else
+        {
+            group = found.value();
+            _next[_groupList[group].last] = index;
+            _groupList[group].last = index;
+        }
+
+        if (!_serials.isEmpty() && serial_ <= _serials.last())
+        {
+            _sorted = false;
+        }
+
+        _coordinates << x_ << y_ << z_;
+        _elements.append(element_);
+        _remoteness.append(remoteness_);
+        _serials.append(serial_);
+        _groups.append(group);
+        _next.append(-1);
+        _atoms.append(0);
+
+        // Keep already expanded groups complete
+        if (_groupList[group].expanded)
+        {
+            _groupList[group].expanded = false;
+            _expand(group);
+        }
+
+        return index;
+    }
+
+    /** Reserve room for a number of atoms. */
+    void AtomTable::reserve(int size_)
+    {
+        _coordinates.reserve(size_ * 3);
+        _elements.reserve(size_);
+        _remoteness.reserve(size_);
+        _serials.reserve(size_);
+        _groups.reserve(size_);
+        _next.reserve(size_);
+        _atoms.reserve(size_);
+    }
+
+    /** Count atoms. */
+    int AtomTable::size() const
+    {
+        return _elements.size();
+    }
+
+    /** Is this table empty? */
+    bool AtomTable::empty() const
+    {
+        return _elements.isEmpty();
+    }
+
+    float AtomTable::x(int index_) const
+    {
+        return _coordinates.at(index_ * 3);
+    }
+
+    float AtomTable::y(int index_) const
+    {
+        return _coordinates.at(index_ * 3 + 1);
+    }
+
+    float AtomTable::z(int index_) const
+    {
+        return _coordinates.at(index_ * 3 + 2);
+    }
+
+    /** Interleaved coordinates of all atoms. */
+    const float* AtomTable::coordinates() const
+    {
+        return _coordinates.constData();
+    }
+
+    Node* AtomTable::element(int index_) const
+    {
+        return _elements.at(index_);
+    }
+
+    QChar AtomTable::remoteness(int index_) const
+    {
+        return _remoteness.at(index_);
+    }
+
+    long AtomTable::serial(int index_) const
+    {
+        return _serials.at(index_);
+    }
+
+    Node* AtomTable::group(int index_) const
+    {
+        return _groupList.at(_groups.at(index_)).node;
+    }
+
+    /** Find an atom by its serial number. */
+    int AtomTable::find(long serial_) const
+    {
+        if (_sorted)
+        {
+            QVector< long >::const_iterator found = std::lower_bound(_serials.begin(), _serials.end(), serial_);
+            if (found != _serials.end() && *found == serial_)
+            {
+                return found - _serials.begin();
+            }
+        }
+        else
+        {
+            int index = _serials.indexOf(serial_);
+            if (index >= 0)
+            {
+                return index;
+            }
+        }
+        return -1;
+    }
+
+    /** Get an atom's Node, creating its group's atoms if needed. */
+    Node* AtomTable::atom(int index_)
+    {
+        if (_atoms.at(index_) == 0)
+        {
+            _expand(_groups.at(index_));
+        }
+        return _atoms.at(index_);
+    }
+
+    /** Create the Nodes of all atoms in a group. */
+    void AtomTable::expand(Node* group_)
+    {
+        QHash< Node*, int >::const_iterator found = _groupIndex.find(group_);
+        if (found != _groupIndex.end())
+        {
+            _expand(found.value());
+        }
+    }
+
+    /** Create the Nodes of all atoms. */
+    void AtomTable::expand()
+    {
+        for (int group = 0; group < _groupList.size(); ++group)
+        {
+            _expand(group);
+        }
+    }
+
+    /** Has this atom's Node been created? */
+    bool AtomTable::expanded(int index_) const
+    {
+        return _atoms.at(index_) != 0;
+    }
+
+    void AtomTable::_expand(int group_)
+    {
+        Group & group = _groupList[group_];
+        if (!group.expanded)
+        {
+            for (int index = group.first; index >= 0; index = _next.at(index))
+            {
+                if (_atoms.at(index) == 0)
+                {
+                    Node* atom = group.node->create(_elements.at(index));
+                    group.node->relations(UtopiaSystem.hasPart).append(atom);
+                    atom->attributes.set("x", x(index));
+                    atom->attributes.set("y", y(index));
+                    atom->attributes.set("z", z(index));
+                    atom->attributes.set("remoteness", _remoteness.at(index));
+                    _atoms[index] = atom;
+                }
+            }
+            group.expanded = true;
+        }
+    }
+
+} // namespace Utopia
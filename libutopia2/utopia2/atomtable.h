@@ -0,0 +1,125 @@
+/*****************************************************************************
+ *  
+ *   This file is part of the Utopia Documents application.
+ *       Copyright (c) 2008-2017 Lost Island Labs
+ *           <info@utopiadocs.com>
+ *   
+ *   Utopia Documents is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU GENERAL PUBLIC LICENSE VERSION 3 as
+ *   published by the Free Software Foundation.
+ *   
+ *   Utopia Documents is distributed in the hope that it will be useful, but
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ *   Public License for more details.
+ *   
+ *   In addition, as a special exception, the copyright holders give
+ *   permission to link the code of portions of this program with the OpenSSL
+ *   library under certain conditions as described in each individual source
+ *   file, and distribute linked combinations including the two.
+ *   
+ *   You must obey the GNU General Public License in all respects for all of
+ *   the code used other than OpenSSL. If you modify file(s) with this
+ *   exception, you may extend this exception to your version of the file(s),
+ *   but you are not obligated to do so. If you do not wish to do so, delete
+ *   this exception statement from your version.
+ *   
+ *   You should have received a copy of the GNU General Public License
+ *   along with Utopia Documents. If not, see <http://www.gnu.org/licenses/>
+ *  
+ *****************************************************************************/
+
+
+#ifndef Utopia_ATOMTABLE_H
+#define Utopia_ATOMTABLE_H
+
+#include <utopia2/config.h>
+
+#include <QChar>
+#include <QHash>
+#include <QVector>
+
+namespace Utopia
+{
+
+    // Forwards
+    class Node;
+
+    //
+    // class AtomTable
+    //
+    // Column-wise storage for the atoms of a structure. Parsers append one
+    // row per atom with the group (residue, backbone, sidechain or chain)
+    // Node it belongs to; the atom's own Node, with its x / y / z and
+    // remoteness attributes, is only created when something asks for it,
+    // and then every atom of that group is created at once (in the order
+    // they were added) so the group's hasPart relation stays in file order.
+    //
+
+    class LIBUTOPIA_API AtomTable
+    {
+    public:
+        // Constructor
+        AtomTable();
+
+        // Add an atom, returning its index
+        int append(Node* group_, Node* element_, float x_, float y_, float z_, QChar remoteness_ = QChar(' '), long serial_ = 0);
+        // Reserve room for a number of atoms
+        void reserve(int size_);
+
+        // Count atoms
+        int size() const;
+        bool empty() const;
+
+        // Columns
+        float x(int index_) const;
+        float y(int index_) const;
+        float z(int index_) const;
+        const float* coordinates() const; // x0 y0 z0 x1 y1 z1 ...
+        Node* element(int index_) const;
+        QChar remoteness(int index_) const;
+        long serial(int index_) const;
+        Node* group(int index_) const;
+
+        // Find an atom by serial number, or -1
+        int find(long serial_) const;
+
+        // Get (creating if needed) an atom's Node
+        Node* atom(int index_);
+        // Create the Nodes of all atoms in a group, or in the whole table
+        void expand(Node* group_);
+        void expand();
+        // Has this atom's Node been created?
+        bool expanded(int index_) const;
+
+    private:
+        // Per atom
+        QVector< float > _coordinates;
+        QVector< Node* > _elements;
+        QVector< QChar > _remoteness;
+        QVector< long > _serials;
+        QVector< int > _groups;
+        QVector< int > _next; // next atom in the same group, or -1
+        QVector< Node* > _atoms; // lazily created Nodes
+
+        // Per group
+        struct Group
+        {
+            Node* node;
+            int first;
+            int last;
+            bool expanded;
+        };
+        QVector< Group > _groupList;
+        QHash< Node*, int > _groupIndex;
+        // Are serial numbers in ascending order?
+        bool _sorted;
+
+        // Create the Nodes of a group's atoms
+        void _expand(int group_);
+
+    }; // class AtomTable
+
+} // namespace Utopia
+
+#endif // Utopia_ATOMTABLE_H
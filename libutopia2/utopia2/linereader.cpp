@@ -0,0 +1,159 @@
+/*****************************************************************************
+ *  
+ *   This file is part of the Utopia Documents application.
+ *       Copyright (c) 2008-2017 Lost Island Labs
+ *           <info@utopiadocs.com>
+ *   
+ *   Utopia Documents is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU GENERAL PUBLIC LICENSE VERSION 3 as
+ *   published by the Free Software Foundation.
+ *   
+ *   Utopia Documents is distributed in the hope that it will be useful, but
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ *   Public License for more details.
+ *   
+ *   In addition, as a special exception, the copyright holders give
+ *   permission to link the code of portions of this program with the OpenSSL
+ *   library under certain conditions as described in each individual source
+ *   file, and distribute linked combinations including the two.
+ *   
+ *   You must obey the GNU General Public License in all respects for all of
+ *   the code used other than OpenSSL. If you modify file(s) with this
+ *   exception, you may extend this exception to your version of the file(s),
+ *   but you are not obligated to do so. If you do not wish to do so, delete
+ *   this exception statement from your version.
+ *   
+ *   You should have received a copy of the GNU General Public License
+ *   along with Utopia Documents. If not, see <http://www.gnu.org/licenses/>
+ *  
+ *****************************************************************************/
+
+
+#include <utopia2/linereader.h>
+
+#include <QFile>
+
+#include <cstring>
+
+namespace Utopia
+{
+
+    /** Construct a reader over an open device. */
+    LineReader::LineReader(QIODevice& device_, qint64 chunkSize_)
+        : _device(device_), _chunkSize(chunkSize_), _file(qobject_cast< QFile* >(&device_)), _map(0),
+          _offset(0), _eof(false), _position(0), _size(-1), _lineNumber(0)
+    {
+        if (!_device.isSequential())
+        {
+            _size = _device.size() - _device.pos();
+        }
+
+        // Map whatever remains of a file
+        if (_file && _size > 0)
+        {
+            _map = _file->map(_file->pos(), _size);
+        }
+    }
+
+    /** Destructor. */
+    LineReader::~LineReader()
+    {
+        if (_map)
+        {
+            _file->unmap(_map);
+        }
+    }
+
+    /** Read the next line. */
+    bool LineReader::readLine(const char** begin_, const char** end_)
+    {
+        const char* begin = 0;
+        const char* end = 0;
+        qint64 consumed = 0;
+
+        if (_map)
+        {
+            if (_position >= _size)
+            {
+                return false;
+            }
+            begin = reinterpret_cast< const char* >(_map) + _position;
+            const char* last = reinterpret_cast< const char* >(_map) + _size;
+            end = static_cast< const char* >(::memchr(begin, '\n', last - begin));
+            if (end == 0)
+            {
+                end = last;
+                consumed = end - begin;
+            }
+            else
+            {
+                consumed = end - begin + 1;
+            }
+        }
+        else
+        {
+            const char* newline = 0;
+            for (;;)
+            {
+                begin = _buffer.constData() + _offset;
+                newline = static_cast< const char* >(::memchr(begin, '\n', _buffer.size() - _offset));
+                if (newline || _eof)
+                {
+                    break;
+                }
+
+                // Drop consumed bytes and top up the buffer
+                _buffer.remove(0, _offset);
+                _offset = 0;
+                QByteArray chunk = _device.read(_chunkSize);
+                if (chunk.isEmpty())
+                {
+                    _eof = true;
+                }
+                _buffer.append(chunk);
+            }
+            if (newline == 0 && _offset == _buffer.size())
+            {
+                return false;
+            }
+            end = newline ? newline : _buffer.constData() + _buffer.size();
+            consumed = end - begin + (newline ? 1 : 0);
+            _offset += consumed;
+        }
+
+        _position += consumed;
+        ++_lineNumber;
+
+        // Strip carriage returns
+        if (end > begin && *(end - 1) == '\r')
+        {
+            --end;
+        }
+
+        *begin_ = begin;
+        *end_ = end;
+        return true;
+    }
+
+    qint64 LineReader::position() const
+    {
+        return _position;
+    }
+
+    qint64 LineReader::size() const
+    {
+        return _size;
+    }
+
+    size_t LineReader::lineNumber() const
+    {
+        return _lineNumber;
+    }
+
+    bool LineReader::isMapped() const
+    {
+        return _map != 0;
+    }
+
+} // namespace Utopia
@@ -0,0 +1,99 @@
+/*****************************************************************************
+ *  
+ *   This file is part of the Utopia Documents application.
+ *       Copyright (c) 2008-2017 Lost Island Labs
+ *           <info@utopiadocs.com>
+ *   
+ *   Utopia Documents is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU GENERAL PUBLIC LICENSE VERSION 3 as
+ *   published by the Free Software Foundation.
+ *   
+ *   Utopia Documents is distributed in the hope that it will be useful, but
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ *   Public License for more details.
+ *   
+ *   In addition, as a special exception, the copyright holders give
+ *   permission to link the code of portions of this program with the OpenSSL
+ *   library under certain conditions as described in each individual source
+ *   file, and distribute linked combinations including the two.
+ *   
+ *   You must obey the GNU General Public License in all respects for all of
+ *   the code used other than OpenSSL. If you modify file(s) with this
+ *   exception, you may extend this exception to your version of the file(s),
+ *   but you are not obligated to do so. If you do not wish to do so, delete
+ *   this exception statement from your version.
+ *   
+ *   You should have received a copy of the GNU General Public License
+ *   along with Utopia Documents. If not, see <http://www.gnu.org/licenses/>
+ *  
+ *****************************************************************************/
+
+
+#ifndef Utopia_LINEREADER_H
+#define Utopia_LINEREADER_H
+
+#include <utopia2/config.h>
+
+#include <QByteArray>
+
+class QFile;
+class QIODevice;
+
+namespace Utopia
+{
+
+    //
+    // class LineReader
+    //
+    // Reads a stream a line at a time without decoding it. Files are memory
+    // mapped where possible, and anything else is read in large chunks;
+    // either way each line is handed back as a range of bytes (without its
+    // line ending) that stays valid until the next call to readLine().
+    //
+
+    class LIBUTOPIA_API LineReader
+    {
+    public:
+        // Constructor
+        LineReader(QIODevice& device_, qint64 chunkSize_ = 1 << 20);
+        // Destructor
+        ~LineReader();
+
+        // Read the next line, returning false at the end of the stream
+        bool readLine(const char** begin_, const char** end_);
+
+        // Bytes consumed so far
+        qint64 position() const;
+        // Total bytes, or -1 if unknown
+        qint64 size() const;
+        // Number of the last line read
+        size_t lineNumber() const;
+        // Is the stream memory mapped?
+        bool isMapped() const;
+
+    private:
+        // Stream
+        QIODevice& _device;
+        qint64 _chunkSize;
+        // Mapped file
+        QFile* _file;
+        uchar* _map;
+        // Chunk buffer
+        QByteArray _buffer;
+        int _offset;
+        bool _eof;
+        // Progress
+        qint64 _position;
+        qint64 _size;
+        size_t _lineNumber;
+
+        // Not copyable
+        LineReader(const LineReader&);
+        LineReader& operator = (const LineReader&);
+
+    }; // class LineReader
+
+} // namespace Utopia
+
+#endif // Utopia_LINEREADER_H
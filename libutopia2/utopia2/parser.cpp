@@ -135,8 +135,33 @@ namespace Utopia
 
 
 
-    Parser::Context::Context(const Parser* parser_)
-        : _parser(parser_), _model(0), _errorCode(None), _errorLine(0), _errorCharacter(0)
+    Parser::Monitor::Monitor()
+        : _cancelled(0)
+    {}
+
+    Parser::Monitor::~Monitor()
+    {}
+
+    /** Default progress reporting does nothing. */
+    void Parser::Monitor::progress(qint64 done_, qint64 total_)
+    {}
+
+    /** Request cancellation. */
+    void Parser::Monitor::cancel()
+    {
+        this->_cancelled.fetchAndStoreOrdered(1);
+    }
+
+    /** Has cancellation been requested? */
+    bool Parser::Monitor::cancelled() const
+    {
+        return this->_cancelled.load() != 0;
+    }
+
+
+
+    Parser::Context::Context(const Parser* parser_, Monitor* monitor_)
+        : _parser(parser_), _monitor(monitor_), _model(0), _errorCode(None), _errorLine(0), _errorCharacter(0)
     {}
 
     const Parser* Parser::Context::parser() const
@@ -217,12 +242,28 @@ namespace Utopia
         this->_warnings.push_back(Warning(message_, line_, character_));
     }
 
+    /** Report progress. */
+    bool Parser::Context::progress(qint64 done_, qint64 total_)
+    {
+        if (this->_monitor)
+        {
+            this->_monitor->progress(done_, total_);
+        }
+        return !this->cancelled();
+    }
+
+    /** Has the parse been cancelled? */
+    bool Parser::Context::cancelled() const
+    {
+        return this->_monitor && this->_monitor->cancelled();
+    }
+
 
 
     /** Parse! */
-    Parser::Context Parser::parse(QIODevice& stream_) const
+    Parser::Context Parser::parse(QIODevice& stream_, Monitor* monitor_) const
     {
-        Parser::Context ctx(this);
+        Parser::Context ctx(this, monitor_);
         ctx.setModel(this->parse(ctx, stream_));
         return ctx;
     }
@@ -286,14 +327,14 @@ namespace Utopia
     }
 
     /** Parse stream using given file format. */
-    Parser::Context parse(QIODevice& stream_, FileFormat* fileFormat_)
+    Parser::Context parse(QIODevice& stream_, FileFormat* fileFormat_, Parser::Monitor* monitor_)
     {
         Parser* parser = Parser::get(fileFormat_);
-        return parser ? parser->parse(stream_) : Parser::Context(0);
+        return parser ? parser->parse(stream_, monitor_) : Parser::Context(0);
     }
 
     /** Load file using given file format. */
-    Parser::Context load(const QString& fileName_, FileFormat* fileFormat_)
+    Parser::Context load(const QString& fileName_, FileFormat* fileFormat_, Parser::Monitor* monitor_)
     {
         QFile file(fileName_);
         file.open(QIODevice::ReadOnly | QIODevice::Text);
@@ -310,7 +351,7 @@ namespace Utopia
                 fileFormat_ = *formats.begin();
             }
         }
-        return parse(file, fileFormat_);
+        return parse(file, fileFormat_, monitor_);
     }
 
 } // namespace Utopia
@@ -40,6 +40,7 @@
 
 #include <utopia2/fileformat.h>
 
+#include <QAtomicInt>
 #include <QSet>
 #include <QString>
 #include <QIODevice>
@@ -67,7 +68,8 @@ namespace Utopia
             UnexpectedEof,
             UnexpectedEol,
             Incapable,
-            Unknown
+            Unknown,
+            Cancelled
         } ErrorCode;
 
         typedef enum
@@ -89,11 +91,30 @@ namespace Utopia
             size_t character;
         };
 
+        class LIBUTOPIA_API Monitor
+        {
+        public:
+            // Constructor
+            Monitor();
+            // Virtual Destructor
+            virtual ~Monitor();
+
+            // Progress through the stream (total_ is -1 if unknown)
+            virtual void progress(qint64 done_, qint64 total_);
+
+            // Ask the parser to stop (from any thread)
+            void cancel();
+            bool cancelled() const;
+
+        private:
+            QAtomicInt _cancelled;
+        };
+
         class LIBUTOPIA_API Context
         {
         public:
             // Constructor
-            Context(const Parser* parser_);
+            Context(const Parser* parser_, Monitor* monitor_ = 0);
 
             // Context
             const Parser* parser() const;
@@ -119,9 +140,16 @@ namespace Utopia
             // Add warning
             void addWarning(const QString& message_, size_t line_ = 0, size_t character_ = 0);
 
+            // Report progress, returning false if the parse should stop
+            bool progress(qint64 done_, qint64 total_);
+            // Has the parse been cancelled?
+            bool cancelled() const;
+
         private:
             // Parser used
             const Parser* _parser;
+            // Progress monitor
+            Monitor* _monitor;
             // Model node
             Node* _model;
 
@@ -147,7 +175,7 @@ namespace Utopia
         virtual ~Parser() {};
 
         // Parse method
-        Context parse(QIODevice& stream_) const;
+        Context parse(QIODevice& stream_, Monitor* monitor_ = 0) const;
         virtual Node* parse(Context& ctx, QIODevice& stream_) const = 0;
         virtual Acceptance accepts(QIODevice& stream_) const;
         virtual QString description() const = 0;
@@ -161,8 +189,8 @@ namespace Utopia
 
     }; /* class Parser */
 
-    LIBUTOPIA_API Parser::Context parse(QIODevice& stream_, FileFormat* fileFormat_);
-    LIBUTOPIA_API Parser::Context load(const QString& fileName_, FileFormat* fileFormat_ = 0);
+    LIBUTOPIA_API Parser::Context parse(QIODevice& stream_, FileFormat* fileFormat_, Parser::Monitor* monitor_ = 0);
+    LIBUTOPIA_API Parser::Context load(const QString& fileName_, FileFormat* fileFormat_ = 0, Parser::Monitor* monitor_ = 0);
 
 } /* namespace Utopia */
 
@@ -32,6 +32,7 @@
 #include <utopia2/config.h>
 
 #include <utopia2/aminoacid.h>
+#include <utopia2/atomtable.h>
 #include <utopia2/element.h>
 #include <utopia2/enums.h>
 #include <utopia2/fileformat.h>
@@ -41,6 +42,7 @@
 #include <utopia2/invocation.h>
 #include <utopia2/invocationset.h>
 #include <utopia2/library.h>
+#include <utopia2/linereader.h>
 #include <utopia2/list.h>
 #include <utopia2/node.h>
 #include <utopia2/nucleotide.h>
@@ -34,13 +34,20 @@
 
 #include <utopia2/qt/cacheditem.h>
 
+#include <boost/shared_ptr.hpp>
+#include <boost/weak_ptr.hpp>
+
+#include <QByteArray>
 #include <QDataStream>
 #include <QDateTime>
 #include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QList>
 #include <QMap>
 #include <QMutex>
 #include <QMutexLocker>
-#include <QPair>
 #include <QString>
 
 #include <QtDebug>
@@ -48,6 +55,34 @@
 namespace Utopia
 {
 
+    // Default cost of an item in a cache, in bytes; overload this in the
+    // Utopia namespace for item types whose size is known
+    template< class Item >
+    inline qint64 cacheCost(const Item &)
+    {
+        return sizeof(Item);
+    }
+
+    inline qint64 cacheCost(const QByteArray & item)
+    {
+        return item.size();
+    }
+
+    inline qint64 cacheCost(const QString & item)
+    {
+        return item.size() * sizeof(QChar);
+    }
+
+    template< class Item >
+    inline qint64 cacheCost(const QList< Item > & items)
+    {
+        qint64 cost = sizeof(QList< Item >);
+        foreach (const Item & item, items) {
+            cost += cacheCost(item);
+        }
+        return cost;
+    }
+
     template< class Item >
     class CachePrivate
     {
@@ -55,47 +90,173 @@ namespace Utopia
         typedef CachePrivate< Item > CachePrivateClass;
         typedef CachedItem< Item > CachedItemClass;
 
+        // Items are spread over a number of independently locked shards, each
+        // with its own share of the cache's limits and its own recency list
+        static const int shardCount = 16;
+
+        struct Node
+        {
+            Node(const CachedItemClass & item, qint64 cost)
+                : item(item), cost(cost), dirty(false), previous(0), next(0)
+            {}
+
+            CachedItemClass item;
+            qint64 cost;
+            bool dirty;
+            // Recency list, least recently used first
+            Node * previous;
+            Node * next;
+        };
+
+        struct Shard
+        {
+            Shard()
+                : oldest(0), newest(0), totalCost(0), hits(0), misses(0), evictions(0)
+            {}
+
+            QMutex mutex;
+            QHash< QString, Node * > nodes;
+            Node * oldest;
+            Node * newest;
+            qint64 totalCost;
+            qint64 hits;
+            qint64 misses;
+            qint64 evictions;
+        };
+
         // Create a new cache backend with the specified path name
         CachePrivate(const QString & path = QString())
-            : path(path), maximumSize(0), mutex(QMutex::Recursive)
+            : path(path), maximumSize(0), maximumCost(0)
         {}
         ~CachePrivate()
-        {}
+        {
+            for (int i = 0; i < shardCount; ++i) {
+                qDeleteAll(shards[i].nodes);
+            }
+        }
 
         // Path name of cache
         QString path;
-        // Items stored in cache
-        QMap< QString, QPair< CachedItemClass, bool > > items;
-        // Maximum size
+        // Maximum number of items (zero for unrestricted)
         int maximumSize;
-        // Recently used items
-        QList< QString > recentlyUsed;
-
-        // Mutex for concurrent access to this cache backend
-        QMutex mutex;
-
-        // Check the size of this cache, removing elements if they cause it
-        // to exceed its maximum size
-        void resize()
-        {
-            // A zero maximum size means this cache is unrestricted
-            if (maximumSize > 0 && recentlyUsed.size() > maximumSize) {
-                // Remove excess items from the front of the list, removing
-                // them from the cache
-                while (recentlyUsed.size() > maximumSize) {
-                    QString doomed = recentlyUsed.takeFirst();
-                    items.remove(doomed);
+        // Maximum total cost of items (zero for unrestricted)
+        qint64 maximumCost;
+        // Items stored in cache
+        Shard shards[shardCount];
+
+        bool isPersistent() const
+        {
+            return !path.isEmpty() && !path.startsWith(":");
+        }
+
+        Shard & shardOf(const QString & id)
+        {
+            return shards[qHash(id) % shardCount];
+        }
+
+        QString filePathOf(const QString & id) const
+        {
+            QString escaped(id);
+            return path + "/" + escaped.replace("/", "\\/") + ".cache";
+        }
+
+        // Recency list management (shard must be locked)
+        static void unlink(Shard & shard, Node * node)
+        {
+            (node->previous ? node->previous->next : shard.oldest) = node->next;
+            (node->next ? node->next->previous : shard.newest) = node->previous;
+            node->previous = node->next = 0;
+        }
+
+        static void append(Shard & shard, Node * node)
+        {
+            node->previous = shard.newest;
+            node->next = 0;
+            (shard.newest ? shard.newest->next : shard.oldest) = node;
+            shard.newest = node;
+        }
+
+        void insert(Shard & shard, const QString & id, Node * node)
+        {
+            shard.nodes.insert(id, node);
+            shard.totalCost += node->cost;
+            append(shard, node);
+            resize(shard);
+        }
+
+        // Remove an item from memory, first writing it to disk if it has
+        // changed and this is a persistent cache (shard must be locked)
+        void erase(Shard & shard, typename QHash< QString, Node * >::iterator found, bool discard = false)
+        {
+            Node * node = found.value();
+            if (!discard) {
+                write(node);
+            }
+            unlink(shard, node);
+            shard.totalCost -= node->cost;
+            shard.nodes.erase(found);
+            delete node;
+        }
+
+        // Write a changed item to disk (shard must be locked)
+        void write(Node * node)
+        {
+            if (node->dirty && isPersistent()) {
+                QFile file(filePathOf(node->item.id()));
+                if (file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+                    QDataStream str(&file);
+                    str << node->item;
+                    node->dirty = false;
                 }
             }
         }
 
+        // Find an item, loading it from disk if this is a persistent cache
+        // that hasn't yet seen it (shard must be locked)
+        Node * find(Shard & shard, const QString & id)
+        {
+            typename QHash< QString, Node * >::iterator found(shard.nodes.find(id));
+            if (found != shard.nodes.end()) {
+                return found.value();
+            }
+            if (isPersistent()) {
+                QFile file(filePathOf(id));
+                if (file.open(QIODevice::ReadOnly)) {
+                    QDataStream str(&file);
+                    CachedItemClass item;
+                    str >> item;
+                    if (str.status() == QDataStream::Ok && item.isValid()) {
+                        Node * node = new Node(item, cacheCost(item.item()));
+                        insert(shard, id, node);
+                        // The item may have been too costly to keep
+                        return shard.nodes.value(id, 0);
+                    }
+                }
+            }
+            return 0;
+        }
+
+        // Remove least recently used items from a shard while it exceeds its
+        // share of this cache's limits (shard must be locked)
+        void resize(Shard & shard)
+        {
+            int shardSize = maximumSize > 0 ? qMax(1, (maximumSize + shardCount - 1) / shardCount) : 0;
+            qint64 shardCost = maximumCost > 0 ? qMax(Q_INT64_C(1), (maximumCost + shardCount - 1) / shardCount) : 0;
+            while (shard.oldest &&
+                   ((shardSize > 0 && shard.nodes.size() > shardSize) ||
+                    (shardCost > 0 && shard.totalCost > shardCost))) {
+                erase(shard, shard.nodes.find(shard.oldest->item.id()));
+                ++shard.evictions;
+            }
+        }
+
         // Get an existing cache by path name or create a new one
         static boost::shared_ptr< CachePrivateClass > getCache(const QString & path)
         {
             // Global map of caches of this type of Item
             static QMap< QString, boost::weak_ptr< CachePrivateClass > > caches;
             // Global mutex for concurrent access to static cache map
-            static QMutex globalMutex(QMutex::Recursive);
+            static QMutex globalMutex;
 
             // Protect access to global cache map
             QMutexLocker l(&globalMutex);
@@ -111,19 +272,15 @@ namespace Utopia
             // Otherwise a new named cache is created
             else
             {
-                // Path names beginning with a colon are volatile
-                if (path.startsWith(":")) {
-                    boost::shared_ptr< CachePrivateClass > cache(new CachePrivateClass(path));
-                    caches[path] = cache;
-                    return cache;
-                }
-                // Otherwise the path name represents the path of the persistent cache directory
-                else {
+                // Path names not beginning with a colon represent the path
+                // of the persistent cache directory, whose items are loaded
+                // as and when they are asked for
+                if (!path.startsWith(":")) {
                     QFileInfo info(QDir::cleanPath(path));
 
                     // Ensure existence of cache path
                     if (!info.exists()) {
-                        if (!QDir().mkpath(info.path())) {
+                        if (!QDir().mkpath(info.absoluteFilePath())) {
                             // Couldn't create path
                             return boost::shared_ptr< CachePrivateClass >();
                         }
@@ -131,50 +288,40 @@ namespace Utopia
                         // Not a directory, nor readable/writable
                         return boost::shared_ptr< CachePrivateClass >();
                     }
-
-                    boost::shared_ptr< CachePrivateClass > cache(new CachePrivateClass(path));
-                    caches[path] = cache;
-
-                    // Load all persisted items
-                    QDir dir(info.dir());
-                    dir.setFilter(QDir::Files |
-                                  QDir::NoSymLinks |
-                                  QDir::NoDotAndDotDot |
-                                  QDir::Readable |
-                                  QDir::Writable |
-                                  QDir::CaseSensitive);
-                    QStringList filters;
-                    filters << "*.cache";
-                    dir.setNameFilters(filters);
-
-                    QFileInfoList list(dir.entryInfoList());
-                    for (int i = 0; i < list.size(); ++i) {
-                        QFileInfo info(list.at(i));
-                        QFile file(info.path());
-                        file.open(QIODevice::ReadOnly);
-                        QDataStream str(&file);
-                        CachedItemClass item;
-                        str >> item;
-                        file.close();
-                        cache->items[item.id()] = qMakePair(item, false);
-                    }
-
-                    return cache;
                 }
+
+                boost::shared_ptr< CachePrivateClass > cache(new CachePrivateClass(path));
+                caches[path] = cache;
+                return cache;
             }
         }
     };
 
+    /*************************************************************************
+     *
+     * A least recently used cache of items, limited by number of items and/or
+     * by their total cost in bytes. Lookups and insertions take constant time
+     * and lock only the shard of the cache that the item's id hashes to, so
+     * concurrent users rarely contend. Caches with the same path share their
+     * items; a path beginning with a colon names a volatile cache, any other
+     * names a directory from which persisted items are loaded on demand.
+     *
+     * A Cache object's path should not be changed while other threads are
+     * using that object.
+     *
+     ************************************************************************/
+
     template< class Item >
     class Cache
     {
     public:
         typedef CachePrivate< Item > CachePrivateClass;
         typedef CachedItem< Item > CachedItemClass;
+        typedef typename CachePrivateClass::Node Node;
+        typedef typename CachePrivateClass::Shard Shard;
 
         // Constructors
         Cache(const QString & path = QString())
-            : m(QMutex::Recursive)
         {
             setPath(path);
         }
@@ -185,180 +332,219 @@ namespace Utopia
 
         void clear()
         {
-            // Lock access
-            QMutexLocker lock(&m);
-            QMutexLocker lockShared(&d->mutex);
-
             if (isValid()) {
-                d->items.clear();
-                d->recentlyUsed.clear();
+                for (int i = 0; i < CachePrivateClass::shardCount; ++i) {
+                    Shard & shard = d->shards[i];
+                    QMutexLocker lock(&shard.mutex);
+                    foreach (Node * node, shard.nodes) {
+                        d->write(node);
+                    }
+                    qDeleteAll(shard.nodes);
+                    shard.nodes.clear();
+                    shard.oldest = shard.newest = 0;
+                    shard.totalCost = 0;
+                }
             }
         }
 
         bool exists(const QString & id) const
         {
-            // Lock access
-            QMutexLocker lock(&m);
-            QMutexLocker lockShared(&d->mutex);
+            if (isValid()) {
+                Shard & shard = d->shardOf(id);
+                QMutexLocker lock(&shard.mutex);
+                return d->find(shard, id) != 0;
+            }
+            return false;
+        }
 
-            return isValid() && d->items.contains(id);
+        // Number of items evicted to keep within this cache's limits
+        qint64 evictions() const
+        {
+            return sum(&Shard::evictions);
         }
 
+        // Write items that have changed since being loaded to disk
         void flush()
         {
-            // Lock access
-            QMutexLocker lock(&m);
-            QMutexLocker lockShared(&d->mutex);
-
             // Flush only works on persistent caches
             if (isValid() && isPersistent()) {
-                // FIXME
+                for (int i = 0; i < CachePrivateClass::shardCount; ++i) {
+                    Shard & shard = d->shards[i];
+                    QMutexLocker lock(&shard.mutex);
+                    foreach (Node * node, shard.nodes) {
+                        d->write(node);
+                    }
+                }
             }
         }
 
         Item get(const QString & id) const
         {
-            // Lock access
-            QMutexLocker lock(&m);
-            QMutexLocker lockShared(&d->mutex);
-
-            Q_ASSERT_X(isValid(), "d->items", "Cannot get item from Null cache");
-
-            // Touch and return
-            QPair< CachedItemClass, bool > & item = d->items[id];
-            d->recentlyUsed.removeAll(id);
-            d->recentlyUsed.append(id);
-            item.first.touch();
-            item.second = true;
-            return item.first.isValid() ? item.first : Item();
+            CachedItemClass item(getMeta(id));
+            return item.isValid() ? item.item() : Item();
         }
 
         CachedItemClass getMeta(const QString & id) const
         {
-            // Lock access
-            QMutexLocker lock(&m);
-            QMutexLocker lockShared(&d->mutex);
+            Q_ASSERT_X(isValid(), "d->shards", "Cannot get item from Null cache");
 
-            Q_ASSERT_X(isValid(), "d->items", "Cannot get item from Null cache");
+            Shard & shard = d->shardOf(id);
+            QMutexLocker lock(&shard.mutex);
 
             // Touch and return
-            QPair< CachedItemClass, bool > & item = d->items[id];
-            item.first.touch();
-            item.second = true;
-            return item.first;
+            if (Node * node = d->find(shard, id)) {
+                ++shard.hits;
+                CachePrivateClass::unlink(shard, node);
+                CachePrivateClass::append(shard, node);
+                node->item.touch();
+                return node->item;
+            }
+            ++shard.misses;
+            return CachedItemClass();
         }
 
-        bool isPersistent() const
+        qint64 hits() const
         {
-            // Lock access
-            QMutexLocker lock(&m);
-            QMutexLocker lockShared(&d->mutex);
+            return sum(&Shard::hits);
+        }
 
-            return isValid() && !d->path.isEmpty() && !d->path.startsWith(":");
+        bool isPersistent() const
+        {
+            return isValid() && d->isPersistent();
         }
 
         bool isValid() const
         {
-            // Lock access
-            QMutexLocker lock(&m);
-            QMutexLocker lockShared(&d->mutex);
-
             return (bool) d;
         }
 
-        int maximumSize() const
+        qint64 maximumCost() const
         {
-            // Lock access
-            QMutexLocker lock(&m);
-            QMutexLocker lockShared(&d->mutex);
+            return isValid() ? d->maximumCost : 0;
+        }
 
+        int maximumSize() const
+        {
             return isValid() ? d->maximumSize : 0;
         }
 
-        QString path() const
+        qint64 misses() const
         {
-            // Lock access
-            QMutexLocker lock(&m);
-            QMutexLocker lockShared(&d->mutex);
+            return sum(&Shard::misses);
+        }
 
+        QString path() const
+        {
             return isValid() ? d->path : QString();
         }
 
         void put(const Item & item, const QString & id)
         {
-            // Lock access
-            QMutexLocker lock(&m);
-            QMutexLocker lockShared(&d->mutex);
+            put(item, id, cacheCost(item));
+        }
 
-            Q_ASSERT_X(isValid(), "d->items", "Cannot put item into Null cache");
+        void put(const Item & item, const QString & id, qint64 cost)
+        {
+            Q_ASSERT_X(isValid(), "d->shards", "Cannot put item into Null cache");
 
-            // Remove if present
-            remove(id);
+            Shard & shard = d->shardOf(id);
+            QMutexLocker lock(&shard.mutex);
 
-            // Check whether this now means we should remove an old item from
-            // the cache
-            d->resize();
+            // Replace if present (no need to write out what is replaced)
+            typename QHash< QString, Node * >::iterator found(shard.nodes.find(id));
+            if (found != shard.nodes.end()) {
+                d->erase(shard, found, true);
+            }
 
-            // Create new item
-            d->items[id] = qMakePair(CachedItemClass(item, id, QDateTime::currentDateTime(), QDateTime::currentDateTime()), true);
-            d->recentlyUsed.push_back(id);
+            // Create new item, removing old items if this now means the
+            // shard is too big
+            QDateTime now(QDateTime::currentDateTime());
+            Node * node = new Node(CachedItemClass(item, id, now, now), qMax(Q_INT64_C(0), cost));
+            node->dirty = true;
+            d->insert(shard, id, node);
         }
 
         void remove(const QString & id)
         {
-            // Lock access
-            QMutexLocker lock(&m);
-            QMutexLocker lockShared(&d->mutex);
+            if (isValid()) {
+                Shard & shard = d->shardOf(id);
+                QMutexLocker lock(&shard.mutex);
+                typename QHash< QString, Node * >::iterator found(shard.nodes.find(id));
+                if (found != shard.nodes.end()) {
+                    d->erase(shard, found, true);
+                }
+                if (isPersistent()) {
+                    QFile::remove(d->filePathOf(id));
+                }
+            }
+        }
 
-            if (isValid() && exists(id)) {
-                d->items.remove(id);
-                d->recentlyUsed.removeAll(id);
+        void setMaximumCost(qint64 maximumCost)
+        {
+            if (isValid()) {
+                d->maximumCost = maximumCost;
+                resizeAll();
             }
         }
 
         void setMaximumSize(int maximumSize)
         {
-            // Lock access
-            QMutexLocker lock(&m);
-            QMutexLocker lockShared(&d->mutex);
-
-            d->maximumSize = maximumSize;
-            d->resize();
+            if (isValid()) {
+                d->maximumSize = maximumSize;
+                resizeAll();
+            }
         }
 
         bool setPath(const QString & path, bool create = false)
         {
-            // Lock access
-            QMutexLocker lock(&m);
-            bool first = !d;
-            if (!first) d->mutex.lock(); // Lock old shared mutex
-            boost::shared_ptr< CachePrivateClass > oldCache(d);
-            boost::shared_ptr< CachePrivateClass > newCache(CachePrivateClass::getCache(path));
-            bool success = newCache;
-            if (success) newCache->mutex.lock(); // Lock new shared mutex
-            d = newCache;
-            if (!first) oldCache->mutex.unlock(); // Unlock old shared mutex
-            if (success) newCache->mutex.unlock(); // Unlock new shared mutex
+            d = CachePrivateClass::getCache(path);
             return true;
         }
 
+        // Number of items currently held in memory
+        int size() const
+        {
+            return isValid() ? (int) sum(0) : 0;
+        }
+
+        // Total cost of items currently held in memory
+        qint64 totalCost() const
+        {
+            return sum(&Shard::totalCost);
+        }
+
     protected:
         QString filePathOf(const QString & id) const
         {
-            QString result;
-            QString filePath = path();
-            if (true) {
-                QString tmp(id);
-                result=filePath + "/" + tmp.replace("/", "\\/") + ".cache";
-            }
-	    return result;
+            return isValid() ? d->filePathOf(id) : QString();
         }
 
     private:
         // Item
         boost::shared_ptr< CachePrivateClass > d;
-        // Concurrent access to this cache object
-        mutable QMutex m;
+
+        void resizeAll()
+        {
+            for (int i = 0; i < CachePrivateClass::shardCount; ++i) {
+                Shard & shard = d->shards[i];
+                QMutexLocker lock(&shard.mutex);
+                d->resize(shard);
+            }
+        }
+
+        // Total of a counter over all shards (or of their sizes if null)
+        qint64 sum(qint64 Shard::* counter) const
+        {
+            qint64 total = 0;
+            if (isValid()) {
+                for (int i = 0; i < CachePrivateClass::shardCount; ++i) {
+                    Shard & shard = d->shards[i];
+                    QMutexLocker lock(&shard.mutex);
+                    total += counter ? shard.*counter : shard.nodes.size();
+                }
+            }
+            return total;
+        }
     };
 
 } // namespace Utopia
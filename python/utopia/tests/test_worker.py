@@ -0,0 +1,172 @@
+###############################################################################
+#   
+#    This file is part of the Utopia Documents application.
+#        Copyright (c) 2008-2017 Lost Island Labs
+#            <info@utopiadocs.com>
+#    
+#    Utopia Documents is free software: you can redistribute it and/or modify
+#    it under the terms of the GNU GENERAL PUBLIC LICENSE VERSION 3 as
+#    published by the Free Software Foundation.
+#    
+#    Utopia Documents is distributed in the hope that it will be useful, but
+#    WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+#    Public License for more details.
+#    
+#    In addition, as a special exception, the copyright holders give
+#    permission to link the code of portions of this program with the OpenSSL
+#    library under certain conditions as described in each individual source
+#    file, and distribute linked combinations including the two.
+#    
+#    You must obey the GNU General Public License in all respects for all of
+#    the code used other than OpenSSL. If you modify file(s) with this
+#    exception, you may extend this exception to your version of the file(s),
+#    but you are not obligated to do so. If you do not wish to do so, delete
+#    this exception statement from your version.
+#    
+#    You should have received a copy of the GNU General Public License
+#    along with Utopia Documents. If not, see <http://www.gnu.org/licenses/>
+#   
+###############################################################################
+
+import atexit
+import json
+import os
+import struct
+import sys
+import tempfile
+import types
+from StringIO import StringIO
+
+# spineapi doesn't exist outside Utopia; a stand-in is enough to exercise the
+# request/reply protocol itself
+sys.modules.setdefault('spineapi', types.ModuleType('spineapi'))
+
+import utopia.worker
+
+def writeLayout(words):
+    # A one page, one line, one block layout of the given words, as written
+    # by PythonWorkerPool
+    characters = u''.join(words)
+    text = ''.join([word.encode('utf8') for word in words])
+    area = struct.pack('iidddd', 1, 0, 0.0, 0.0, 1.0, 1.0)
+    data = struct.pack('=8sII5Q', 'UTLAYOUT', 1, 1, len(characters), len(words), len(text), 1, 1)
+    data += struct.pack('{}I'.format(len(characters)), *[ord(c) for c in characters])
+    data += area * len(characters)
+    offsets = [0]
+    for word in words:
+        offsets.append(offsets[-1] + len(word))
+    data += struct.pack('{}I'.format(len(offsets)), *offsets)
+    offsets = [0]
+    for word in words:
+        offsets.append(offsets[-1] + len(word.encode('utf8')))
+    data += struct.pack('{}I'.format(len(offsets)), *offsets)
+    data += area * len(words)
+    data += '\1' * (len(words) - 1) + '\0'
+    data += text
+    data += struct.pack('2I', 0, len(words)) + area
+    data += struct.pack('2I', 0, 1) + area
+    handle, path = tempfile.mkstemp('.layout')
+    os.write(handle, data)
+    os.close(handle)
+    return path
+
+SNAPSHOT = writeLayout([u'Hello', u'w\xf6rld'])
+atexit.register(os.remove, SNAPSHOT)
+
+class FakeAnnotation(object):
+    def __init__(self, properties, areas = ()):
+        self._properties = properties
+        self._areas = list(areas)
+    def properties(self):
+        return self._properties
+    def areas(self):
+        return self._areas
+    def extents(self):
+        return []
+
+class FakeAnnotator(object):
+    def __init__(self):
+        self.calls = []
+    def on_ready_event(self, document, **kwargs):
+        self.calls.append((document, kwargs))
+        annotation = FakeAnnotation({'concept': ['Highlight']}, [(0, 90, (1.0, 2.0), (3.0, 4.0))])
+        document.addAnnotation(annotation, kwargs.get('scratch'))
+    def on_fail_event(self, document, **kwargs):
+        raise ValueError('no good')
+
+class FakeWorker(utopia.worker.Worker):
+    def __init__(self):
+        super(FakeWorker, self).__init__()
+        self.annotator = FakeAnnotator()
+    def extension(self, plugin, name):
+        if (plugin, name) != ('plugin.py', 'FakeAnnotator'):
+            raise RuntimeError('Cannot find annotator {} in {}'.format(name, plugin))
+        return self.annotator
+
+def request(method, **kwargs):
+    return json.dumps({
+        'plugin': 'plugin.py',
+        'extension': 'FakeAnnotator',
+        'method': method,
+        'snapshot': SNAPSHOT,
+        'kwargs': kwargs,
+    })
+
+def converse(worker, *lines):
+    output = StringIO()
+    worker.run(StringIO(''.join([line + '\n' for line in lines])), output)
+    return [json.loads(line) for line in output.getvalue().splitlines()]
+
+## Each request line gets exactly one reply line, in order
+
+def test_replies():
+    replies = converse(FakeWorker(), request('on_ready_event'), request('on_fail_event'), request('on_ready_event'))
+    assert([reply['success'] for reply in replies] == [True, False, True])
+
+## Annotations added by the handler are serialised into the reply
+
+def test_annotations():
+    reply = converse(FakeWorker(), request('on_ready_event', scratch = 'overlay'))[0]
+    assert(reply == {
+        'success': True,
+        'annotations': [{
+            'scratch': 'overlay',
+            'properties': {'concept': ['Highlight']},
+            'areas': [[0, 90, 1.0, 2.0, 3.0, 4.0]],
+            'extents': [],
+        }],
+    })
+
+## Keyword arguments and the snapshot's document reach the handler
+
+def test_arguments():
+    worker = FakeWorker()
+    converse(worker, request('on_ready_event', phrase = 'abc'), request('on_ready_event'))
+    (first, kwargs), (second, _) = worker.annotator.calls
+    assert(kwargs == {'phrase': 'abc'})
+    # The same snapshot is only opened once
+    assert(first._document is second._document)
+    assert(len(first._document.annotations()) == 2)
+
+## The handler sees the text layout shared through the snapshot
+
+def test_layout():
+    document = utopia.worker.Worker().document(SNAPSHOT)
+    assert(document.numberOfPages() == 1)
+    assert(document.words() == [u'Hello', u'w\xf6rld'])
+    assert(document.text() == u'Hello w\xf6rld')
+    layout = document.textLayout()
+    assert(struct.unpack('iidddd', str(layout.wordAreas())[:struct.calcsize('iidddd')]) == (1, 0, 0.0, 0.0, 1.0, 1.0))
+    assert(struct.unpack('2I', str(layout.lineWords())) == (0, 2))
+
+## Failures are reported rather than ending the conversation
+
+def test_failures():
+    replies = converse(FakeWorker(), request('on_fail_event'), 'not json', request('on_ready_event'))
+    assert(replies[0] == {'success': False, 'error': 'no good'})
+    assert(replies[1]['success'] == False)
+    assert(replies[2]['success'] == True)
+    replies = converse(FakeWorker(), json.dumps({'plugin': 'other.py', 'extension': 'Missing', 'method': 'x', 'snapshot': u'/s.pdf'}))
+    assert(replies[0]['success'] == False)
+    assert('Missing' in replies[0]['error'])
@@ -0,0 +1,258 @@
+###############################################################################
+#   
+#    This file is part of the Utopia Documents application.
+#        Copyright (c) 2008-2017 Lost Island Labs
+#            <info@utopiadocs.com>
+#    
+#    Utopia Documents is free software: you can redistribute it and/or modify
+#    it under the terms of the GNU GENERAL PUBLIC LICENSE VERSION 3 as
+#    published by the Free Software Foundation.
+#    
+#    Utopia Documents is distributed in the hope that it will be useful, but
+#    WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+#    Public License for more details.
+#    
+#    In addition, as a special exception, the copyright holders give
+#    permission to link the code of portions of this program with the OpenSSL
+#    library under certain conditions as described in each individual source
+#    file, and distribute linked combinations including the two.
+#    
+#    You must obey the GNU General Public License in all respects for all of
+#    the code used other than OpenSSL. If you modify file(s) with this
+#    exception, you may extend this exception to your version of the file(s),
+#    but you are not obligated to do so. If you do not wish to do so, delete
+#    this exception statement from your version.
+#    
+#    You should have received a copy of the GNU General Public License
+#    along with Utopia Documents. If not, see <http://www.gnu.org/licenses/>
+#   
+###############################################################################
+##  Child worker process for Python annotators.
+##
+##  Utopia can run the event handlers of annotators that declare themselves
+##  isolated (e.g. a docstring containing [isolated=true]) in a pool of these
+##  processes rather than on its single embedded interpreter. Requests arrive
+##  one per line on stdin as JSON objects naming the plugin, extension class,
+##  method and keyword arguments, along with a read-only snapshot of the
+##  document's text layout, exported once by Utopia and mapped here rather
+##  than the PDF being parsed again by every worker. Handlers are given a
+##  document offering that layout (textLayout(), words(), text() and
+##  numberOfPages()) to which they add annotations as usual. Each reply is one
+##  line of JSON on stdout listing the annotations the handler added.
+##
+##  Run as:  python -m utopia.worker
+###############################################################################
+
+import array
+import json
+import mmap
+import os
+import struct
+import sys
+import traceback
+
+import spineapi
+
+import utopia.document
+import utopia.extension
+from utopia.log import logger
+
+
+
+# Keep only a couple of documents open; the snapshots themselves stay cached
+# by the OS so reopening one is cheap
+_MAX_DOCUMENTS = 2
+
+# Snapshot layout, as written by PythonWorkerPool: magic, version, page count
+# and the counts of characters, words, text bytes, lines and blocks, then the
+# arrays of a spineapi.TextLayout in native byte order
+_LAYOUT_MAGIC = 'UTLAYOUT'
+_LAYOUT_VERSION = 1
+_LAYOUT_HEADER = '=8sII5Q'
+_AREA = 'iidddd'
+
+
+
+class SharedLayout(object):
+    '''A snapshot's text layout, with the accessors of spineapi.TextLayout.
+
+    Each accessor returns a read-only buffer over the array's raw bytes in
+    the mapped snapshot, e.g. for numpy.frombuffer(); areas are packed as
+    struct format 'iidddd' (page, rotation, x1, y1, x2, y2).'''
+
+    def __init__(self, path):
+        with open(path, 'rb') as file:
+            self._map = mmap.mmap(file.fileno(), 0, access = mmap.ACCESS_READ)
+        magic, version, self.pages, characters, words, text, lines, blocks = struct.unpack_from(_LAYOUT_HEADER, self._map)
+        if magic != _LAYOUT_MAGIC or version != _LAYOUT_VERSION:
+            raise RuntimeError('Not a text layout snapshot: {}'.format(path))
+        offset = struct.calcsize(_LAYOUT_HEADER)
+        area = struct.calcsize(_AREA)
+        self._arrays = {}
+        for name, size in (('characters', 4 * characters),
+                           ('characterAreas', area * characters),
+                           ('wordCharacters', 4 * (words + 1)),
+                           ('wordText', 4 * (words + 1)),
+                           ('wordAreas', area * words),
+                           ('wordSpaceAfter', words),
+                           ('text', text),
+                           ('lineWords', 4 * (lines + 1)),
+                           ('lineAreas', area * lines),
+                           ('blockLines', 4 * (blocks + 1)),
+                           ('blockAreas', area * blocks)):
+            self._arrays[name] = (offset, offset + size)
+            offset += size
+        if offset > len(self._map):
+            raise RuntimeError('Truncated text layout snapshot: {}'.format(path))
+
+    def _view(self, name):
+        start, end = self._arrays[name]
+        return buffer(self._map, start, end - start)
+
+    def characters(self): return self._view('characters')
+    def characterAreas(self): return self._view('characterAreas')
+    def wordCharacters(self): return self._view('wordCharacters')
+    def wordText(self): return self._view('wordText')
+    def wordAreas(self): return self._view('wordAreas')
+    def wordSpaceAfter(self): return self._view('wordSpaceAfter')
+    def text(self): return self._view('text')
+    def lineWords(self): return self._view('lineWords')
+    def lineAreas(self): return self._view('lineAreas')
+    def blockLines(self): return self._view('blockLines')
+    def blockAreas(self): return self._view('blockAreas')
+
+    def words(self):
+        '''The text of each word, decoded.'''
+        text = str(self.text())
+        offsets = array.array('I', str(self.wordText()))
+        return [text[offsets[i]:offsets[i + 1]].decode('utf8') for i in xrange(len(offsets) - 1)]
+
+
+
+class _LayoutDocument(object):
+    '''The document a handler sees in a worker: its text layout, and the
+    annotations added to it.'''
+
+    def __init__(self, snapshot):
+        self._layout = SharedLayout(snapshot)
+        self._annotations = []
+    def addAnnotation(self, annotation, scratch = None):
+        self._annotations.append((scratch, annotation))
+    def addAnnotations(self, annotations, scratch = None):
+        self._annotations.extend([(scratch, annotation) for annotation in annotations])
+    def annotations(self, scratch = None):
+        return [annotation for (s, annotation) in self._annotations if s == scratch]
+    def numberOfPages(self):
+        return self._layout.pages
+    def text(self):
+        spaces = str(self._layout.wordSpaceAfter())
+        return u''.join([word + (u' ' if spaces[i] != '\0' else u'') for i, word in enumerate(self.words())])
+    def textLayout(self, fromPage = 1, toPage = 0):
+        if fromPage != 1 or toPage not in (0, self._layout.pages):
+            raise ValueError('Only the whole document\'s layout is shared with workers')
+        return self._layout
+    def words(self):
+        return self._layout.words()
+
+
+
+class _RecordingDocumentWrapper(object):
+    '''Pass through to a document, remembering every annotation added to it.'''
+
+    def __init__(self, document):
+        self.__dict__['_document'] = document
+        self.__dict__['_added'] = []
+    def addAnnotation(self, annotation, scratch = None):
+        self._added.append((scratch, annotation))
+        return self._document.addAnnotation(annotation, scratch)
+    def addAnnotations(self, annotations, scratch = None):
+        annotations = list(annotations)
+        self._added.extend([(scratch, annotation) for annotation in annotations])
+        return self._document.addAnnotations(annotations, scratch)
+    def __getattr__(self, key):
+        return getattr(self._document, key)
+    def __setattr__(self, key, value):
+        setattr(self._document, key, value)
+
+
+
+def _characterPoint(cursor):
+    page, _, (x1, y1), (x2, y2) = cursor.characterArea()
+    return [page, (x1 + x2) / 2.0, (y1 + y2) / 2.0]
+
+def _serializeExtent(extent):
+    # An extent is shipped as the centres of its first and last characters,
+    # from which the parent can resolve it against its own copy of the text
+    last = extent.end().copy()
+    last.retreatCharacter(spineapi.UntilEndOfDocument)
+    return _characterPoint(extent.begin()) + _characterPoint(last)
+
+def _serializeAnnotation(scratch, annotation):
+    return {
+        'scratch': scratch,
+        'properties': annotation.properties(),
+        'areas': [[page, rotation, x1, y1, x2, y2] for (page, rotation, (x1, y1), (x2, y2)) in annotation.areas()],
+        'extents': [_serializeExtent(extent) for extent in annotation.extents()],
+    }
+
+
+
+class Worker(object):
+
+    def __init__(self):
+        self._documents = []
+        self._extensions = {}
+
+    def document(self, snapshot):
+        for entry in self._documents:
+            if entry[0] == snapshot:
+                return entry[1]
+        document = _LayoutDocument(snapshot)
+        self._documents.insert(0, (snapshot, document))
+        del self._documents[_MAX_DOCUMENTS:]
+        return document
+
+    def extension(self, plugin, name):
+        key = (plugin, name)
+        if key not in self._extensions:
+            cls = self._findClass(plugin, name)
+            if cls is None:
+                utopia.extension.loadPlugin(plugin)
+                cls = self._findClass(plugin, name)
+            if cls is None:
+                raise RuntimeError('Cannot find annotator {} in {}'.format(name, plugin))
+            self._extensions[key] = cls()
+        return self._extensions[key]
+
+    def _findClass(self, plugin, name):
+        for cls in utopia.document.Annotator.types():
+            module = sys.modules.get(cls.__module__)
+            if cls.__name__ == name and getattr(module, '__file__', None) == plugin:
+                return cls
+
+    def handle(self, request):
+        extension = self.extension(request['plugin'], request['extension'])
+        document = _RecordingDocumentWrapper(self.document(request['snapshot']))
+        kwargs = dict([(str(key), value) for (key, value) in request.get('kwargs', {}).iteritems()])
+        kwargs['document'] = document
+        getattr(extension, request['method'])(**kwargs)
+        return [_serializeAnnotation(scratch, annotation) for (scratch, annotation) in document._added]
+
+    def run(self, input = sys.stdin, output = sys.stdout):
+        for line in iter(input.readline, ''):
+            try:
+                reply = {'success': True, 'annotations': self.handle(json.loads(line))}
+            except Exception as e:
+                logger.error('Annotator failed in worker process', exc_info=True)
+                reply = {'success': False, 'error': unicode(e) or type(e).__name__}
+            output.write(json.dumps(reply) + '\n')
+            output.flush()
+
+
+
+if __name__ == '__main__':
+    # Anything the plugins print must not corrupt the reply stream
+    output = os.fdopen(os.dup(sys.stdout.fileno()), 'w')
+    sys.stdout = sys.stderr
+    Worker().run(output = output)